@@ -0,0 +1,173 @@
+#include "AmbientOcclusion.hpp"
+
+#include "Bake.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace gps {
+
+	static const char CACHE_MAGIC[8] = { 'G', 'P', 'S', 'A', 'O', '0', '0', '1' };
+	// Rays start this far along the normal, as a share of maxDistance, so they don't hit their own surface
+	static const float RAY_OFFSET = 0.001f;
+	static const size_t BAKE_GRAIN_VERTICES = 256;
+
+	// Angle in [0, 2 pi) from a position, so the copies of a vertex along texture seams get the same
+	// rotation of the sample set and the same occlusion
+	static float sampleRotation(const glm::vec3& position) {
+
+		uint64_t hash = hashBytes(HASH_SEED, &position, sizeof(position));
+		return (float)(hash >> 40) / (float)(1 << 24) * 6.28318531f;
+	}
+
+	// Cosine-weighted directions around +z from a Hammersley set: evenly spread, and the same every bake
+	static void hemisphereSamples(int samples, std::vector<glm::vec3>& directions) {
+
+		directions.resize(samples);
+		for (int i = 0; i < samples; i++) {
+
+			uint32_t bits = (uint32_t)i;
+			bits = (bits << 16) | (bits >> 16);
+			bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+			bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+			bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+			bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+
+			float u = ((float)i + 0.5f) / (float)samples;
+			float v = (float)bits * 2.3283064e-10f;
+			float radius = std::sqrt(u);
+			float angle = 6.28318531f * v;
+			directions[i] = glm::vec3(radius * std::cos(angle), radius * std::sin(angle), std::sqrt(std::max(0.0f, 1.0f - u)));
+		}
+	}
+
+	void bakeVertexOcclusion(const gps::Bvh& bvh, const std::vector<gps::Mesh>& meshes, int samples, float maxDistance,
+		std::vector<std::vector<float> >& occlusion) {
+
+		PROFILE_FUNCTION();
+
+		occlusion.resize(meshes.size());
+		std::vector<size_t> firstVertex(meshes.size() + 1, 0);
+		for (size_t m = 0; m < meshes.size(); m++) {
+			occlusion[m].assign(meshes[m].vertices.size(), 1.0f);
+			firstVertex[m + 1] = firstVertex[m] + meshes[m].vertices.size();
+		}
+		if (samples <= 0 || bvh.empty()) {
+			return;
+		}
+
+		std::vector<glm::vec3> directions;
+		hemisphereSamples(samples, directions);
+
+		// one flat range over the vertices of every mesh, so small meshes don't leave cores idle
+		parallelFor(firstVertex.back(), BAKE_GRAIN_VERTICES, [&](size_t begin, size_t end) {
+
+			size_t m = 0;
+			for (size_t i = begin; i < end; i++) {
+
+				while (i >= firstVertex[m + 1]) {
+					m++;
+				}
+				const Vertex& vertex = meshes[m].vertices[i - firstVertex[m]];
+
+				float normalLength = glm::length(vertex.Normal);
+				if (normalLength == 0.0f) {
+					continue;
+				}
+				glm::vec3 normal = vertex.Normal / normalLength;
+
+				// tangent frame around the normal, turned by the vertex's rotation
+				glm::vec3 tangent, bitangent;
+				tangentFrame(normal, tangent, bitangent);
+				float angle = sampleRotation(vertex.Position);
+				glm::vec3 rotatedTangent = tangent * std::cos(angle) + bitangent * std::sin(angle);
+				glm::vec3 rotatedBitangent = glm::cross(normal, rotatedTangent);
+
+				// the samples share an origin and a hemisphere, so they go out four at a time as one packet
+				glm::vec3 origin = vertex.Position + normal * (RAY_OFFSET * maxDistance);
+				int open = 0;
+				for (int s = 0; s < samples; s += 4) {
+					BvhRay rays[4];
+					for (int r = 0; r < 4; r++) {
+						const glm::vec3& d = directions[std::min(s + r, samples - 1)];
+						rays[r].origin = origin;
+						rays[r].direction = rotatedTangent * d.x + rotatedBitangent * d.y + normal * d.z;
+						// past the last sample: left out of the packet
+						rays[r].tMax = s + r < samples ? maxDistance : -1.0f;
+					}
+					int occludedMask = bvh.occluded4(rays);
+					for (int r = 0; r < 4 && s + r < samples; r++) {
+						open += (occludedMask & (1 << r)) ? 0 : 1;
+					}
+				}
+				occlusion[m][i - firstVertex[m]] = (float)open / (float)samples;
+			}
+		});
+	}
+
+	static bool loadOcclusion(const std::string& fileName, uint64_t sourceHash, const std::vector<gps::Mesh>& meshes,
+		std::vector<std::vector<float> >& occlusion) {
+
+		FILE* file = openBakeCache(fileName, CACHE_MAGIC, sourceHash);
+		if (file == NULL) {
+			return false;
+		}
+
+		uint64_t meshCount = 0;
+		bool valid = fread(&meshCount, sizeof(meshCount), 1, file) == 1 && meshCount == meshes.size();
+
+		occlusion.resize(meshes.size());
+		for (size_t m = 0; m < meshes.size() && valid; m++) {
+			uint64_t vertexCount = 0;
+			valid = fread(&vertexCount, sizeof(vertexCount), 1, file) == 1 && vertexCount == meshes[m].vertices.size();
+			if (valid) {
+				occlusion[m].resize((size_t)vertexCount);
+				valid = fread(occlusion[m].data(), sizeof(float), occlusion[m].size(), file) == occlusion[m].size();
+			}
+		}
+		fclose(file);
+
+		if (!valid) {
+			occlusion.clear();
+		}
+		return valid;
+	}
+
+	static bool saveOcclusion(const std::string& fileName, uint64_t sourceHash, const std::vector<std::vector<float> >& occlusion) {
+
+		FILE* file = createBakeCache(fileName, CACHE_MAGIC, sourceHash);
+		if (file == NULL) {
+			return false;
+		}
+
+		uint64_t meshCount = occlusion.size();
+		bool written = fwrite(&meshCount, sizeof(meshCount), 1, file) == 1;
+		for (size_t m = 0; m < occlusion.size() && written; m++) {
+			uint64_t vertexCount = occlusion[m].size();
+			written = fwrite(&vertexCount, sizeof(vertexCount), 1, file) == 1
+				&& fwrite(occlusion[m].data(), sizeof(float), occlusion[m].size(), file) == occlusion[m].size();
+		}
+
+		return fclose(file) == 0 && written;
+	}
+
+	bool bakeVertexOcclusionCached(const gps::Bvh& bvh, const std::vector<gps::Mesh>& meshes, int samples, float maxDistance,
+		const std::string& cachePath, std::vector<std::vector<float> >& occlusion) {
+
+		uint64_t sourceHash = hashBytes(HASH_SEED, &samples, sizeof(samples));
+		sourceHash = hashBytes(sourceHash, &maxDistance, sizeof(maxDistance));
+		sourceHash = hashMeshGeometry(sourceHash, meshes, true);
+		if (loadOcclusion(cachePath, sourceHash, meshes, occlusion)) {
+			return true;
+		}
+
+		bakeVertexOcclusion(bvh, meshes, samples, maxDistance, occlusion);
+		if (!saveOcclusion(cachePath, sourceHash, occlusion)) {
+			fprintf(stderr, "WARNING: could not write the ambient occlusion cache %s\n", cachePath.c_str());
+		}
+		return false;
+	}
+}
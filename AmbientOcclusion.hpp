@@ -0,0 +1,28 @@
+#ifndef AmbientOcclusion_hpp
+#define AmbientOcclusion_hpp
+
+#include "Bvh.hpp"
+#include "Mesh.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Ambient occlusion baked per vertex at load time. Every vertex casts cosine-weighted rays over the
+    // hemisphere around its normal into the scene BVH, and keeps the fraction that escape within
+    // maxDistance: 1 in the open, towards 0 in crevices. The shaders scale the ambient term by it, so
+    // the occlusion costs nothing per frame. Vertices are spread over the worker pool and share
+    // nothing but the read-only tree, so the bake scales with the cores.
+
+    // Fills occlusion with one value per vertex of every mesh. bvh holds the same meshes, in the same space
+    void bakeVertexOcclusion(const gps::Bvh& bvh, const std::vector<gps::Mesh>& meshes, int samples, float maxDistance,
+        std::vector<std::vector<float> >& occlusion);
+
+    // Reads the occlusion from cachePath if it was baked from the same geometry and settings, else bakes
+    // it and writes it there. Returns true when the cache was used
+    bool bakeVertexOcclusionCached(const gps::Bvh& bvh, const std::vector<gps::Mesh>& meshes, int samples, float maxDistance,
+        const std::string& cachePath, std::vector<std::vector<float> >& occlusion);
+}
+
+#endif /* AmbientOcclusion_hpp */
@@ -0,0 +1,86 @@
+#include "Bake.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+	static const size_t MAGIC_SIZE = 8;
+
+	uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint64_t hashMeshGeometry(uint64_t hash, const std::vector<gps::Mesh>& meshes, bool withNormals) {
+
+		for (size_t m = 0; m < meshes.size(); m++) {
+			const gps::MeshLod& lod = meshes[m].lods[0];
+			hash = hashBytes(hash, &lod.indexCount, sizeof(lod.indexCount));
+			hash = hashBytes(hash, meshes[m].indices.data() + lod.firstIndex, lod.indexCount * sizeof(GLuint));
+			for (size_t v = 0; v < meshes[m].vertices.size(); v++) {
+				hash = hashBytes(hash, &meshes[m].vertices[v].Position, sizeof(glm::vec3));
+				if (withNormals) {
+					hash = hashBytes(hash, &meshes[m].vertices[v].Normal, sizeof(glm::vec3));
+				}
+			}
+		}
+		return hash;
+	}
+
+	FILE* openBakeCache(const std::string& fileName, const char magic[8], uint64_t sourceHash) {
+
+		FILE* file = fopen(fileName.c_str(), "rb");
+		if (file == NULL) {
+			return NULL;
+		}
+
+		char fileMagic[MAGIC_SIZE];
+		uint64_t hash = 0;
+		bool valid = fread(fileMagic, sizeof(fileMagic), 1, file) == 1 && memcmp(fileMagic, magic, MAGIC_SIZE) == 0
+			&& fread(&hash, sizeof(hash), 1, file) == 1 && hash == sourceHash;
+		if (!valid) {
+			fclose(file);
+			return NULL;
+		}
+		return file;
+	}
+
+	FILE* createBakeCache(const std::string& fileName, const char magic[8], uint64_t sourceHash) {
+
+		FILE* file = fopen(fileName.c_str(), "wb");
+		if (file == NULL) {
+			return NULL;
+		}
+
+		if (fwrite(magic, MAGIC_SIZE, 1, file) != 1 || fwrite(&sourceHash, sizeof(sourceHash), 1, file) != 1) {
+			fclose(file);
+			return NULL;
+		}
+		return file;
+	}
+
+	uint32_t hashInteger(uint32_t value) {
+
+		uint32_t state = value * 747796405u + 2891336453u;
+		uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	float nextRandom(uint32_t& state) {
+
+		state = hashInteger(state);
+		return (float)(state >> 8) * (1.0f / 16777216.0f);
+	}
+
+	void tangentFrame(const glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent) {
+
+		glm::vec3 helper = std::fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		tangent = glm::normalize(glm::cross(helper, normal));
+		bitangent = glm::cross(normal, tangent);
+	}
+}
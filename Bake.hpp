@@ -0,0 +1,47 @@
+#ifndef Bake_hpp
+#define Bake_hpp
+
+#include "Mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Helpers shared by the load-time bakes (BVH, ambient occlusion, lightmap, PVS). Each bake keeps its
+    // result in a cache file next to the scene: an 8 byte magic naming the format and its version, a
+    // 64-bit hash of everything the bake read, then the bake's own payload.
+
+    const uint64_t HASH_SEED = 14695981039346656037ull;
+
+    // FNV-1a: hashBytes(HASH_SEED, ...) starts a hash, feeding the result back in extends it
+    uint64_t hashBytes(uint64_t hash, const void* data, size_t size);
+
+    // Extends hash with the geometry of LOD 0 of every mesh: its triangles and vertex positions, and the
+    // vertex normals too if withNormals
+    uint64_t hashMeshGeometry(uint64_t hash, const std::vector<gps::Mesh>& meshes, bool withNormals);
+
+    // Opens the cache and checks its header; NULL if it is missing, of another format, or baked from
+    // other inputs. The caller reads the payload and closes the file
+    FILE* openBakeCache(const std::string& fileName, const char magic[8], uint64_t sourceHash);
+
+    // Creates the cache and writes its header; NULL on failure. The caller writes the payload and closes
+    // the file, which is where a write error shows up
+    FILE* createBakeCache(const std::string& fileName, const char magic[8], uint64_t sourceHash);
+
+    // PCG hash. Seeded from the index of what is baked (a texel, a cell), the random numbers of a bake
+    // depend only on that, never on the threads, and a rebake gives the same result
+    uint32_t hashInteger(uint32_t value);
+
+    // Next number in [0, 1) of the sequence state steps through
+    float nextRandom(uint32_t& state);
+
+    // Unit tangent and bitangent that make an orthonormal frame with the (unit) normal
+    void tangentFrame(const glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent);
+}
+
+#endif /* Bake_hpp */
@@ -0,0 +1,204 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+	// Nearest-rank percentile of sorted samples
+	static double percentile(const std::vector<double>& sorted, double p) {
+
+		size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+		return sorted[rank > 0 ? rank - 1 : 0];
+	}
+
+	static void writeStats(FILE* file, const char* name, const std::vector<double>& samples) {
+
+		if (samples.empty()) {
+			fprintf(file, "\"%s\": null", name);
+			return;
+		}
+
+		std::vector<double> sorted(samples);
+		std::sort(sorted.begin(), sorted.end());
+
+		double total = 0.0;
+		for (size_t i = 0; i < sorted.size(); i++) {
+			total += sorted[i];
+		}
+
+		fprintf(file, "\"%s\": {\"min\": %.4f, \"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+			name, sorted.front(), total / sorted.size(),
+			percentile(sorted, 50.0), percentile(sorted, 95.0), percentile(sorted, 99.0), sorted.back());
+	}
+
+	static std::string escapeJson(const std::string& text) {
+
+		std::string escaped;
+		for (size_t i = 0; i < text.size(); i++) {
+
+			char c = text[i];
+			if (c == '"' || c == '\\') {
+				escaped += '\\';
+				escaped += c;
+			}
+			else if ((unsigned char)c < 0x20) {
+				char code[8];
+				snprintf(code, sizeof(code), "\\u%04x", c);
+				escaped += code;
+			}
+			else {
+				escaped += c;
+			}
+		}
+
+		return escaped;
+	}
+
+	void Benchmark::start(int frameCount, int warmupFrames, uint64_t firstGpuFrame) {
+
+		this->running = true;
+		this->frameCount = frameCount;
+		this->warmupFrames = warmupFrames;
+		this->frame = 0;
+		this->firstGpuFrame = firstGpuFrame;
+		this->openPasses.clear();
+
+		this->passes.clear();
+		Pass framePass;
+		framePass.name = "frame";
+		this->passes.push_back(framePass);
+	}
+
+	bool Benchmark::isRunning() const {
+		return this->running;
+	}
+
+	bool Benchmark::isWarmingUp() const {
+		return this->running && this->frame < this->warmupFrames;
+	}
+
+	bool Benchmark::isFinished() const {
+		return this->running && this->frame >= this->warmupFrames + this->frameCount;
+	}
+
+	void Benchmark::beginFrame() {
+
+		if (!this->running) {
+			return;
+		}
+
+		beginPass(this->passes[0].name);
+	}
+
+	void Benchmark::endFrame() {
+
+		if (!this->running) {
+			return;
+		}
+
+		endPass();
+		this->frame++;
+	}
+
+	void Benchmark::beginPass(const char* name) {
+
+		if (!this->running) {
+			return;
+		}
+
+		OpenPass open;
+		open.pass = findPass(name);
+		open.cpuStart = Clock::now();
+		this->openPasses.push_back(open);
+	}
+
+	void Benchmark::endPass() {
+
+		if (!this->running || this->openPasses.empty()) {
+			return;
+		}
+
+		OpenPass open = this->openPasses.back();
+		this->openPasses.pop_back();
+
+		if (isRecording(this->frame)) {
+			this->passes[open.pass].cpuTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - open.cpuStart).count());
+		}
+	}
+
+	void Benchmark::addGpuTimings(const std::vector<GpuPassTiming>& timings) {
+
+		if (!this->running) {
+			return;
+		}
+
+		for (size_t i = 0; i < timings.size(); i++) {
+			if (isRecording((int64_t)(timings[i].frame - this->firstGpuFrame))) {
+				this->passes[findPass(timings[i].name)].gpuTimes.push_back(timings[i].milliseconds);
+			}
+		}
+	}
+
+	void Benchmark::setInfo(const std::string& key, const std::string& value) {
+
+		this->info.push_back(std::make_pair(key, "\"" + escapeJson(value) + "\""));
+	}
+
+	void Benchmark::setInfo(const std::string& key, double value) {
+
+		char number[32];
+		snprintf(number, sizeof(number), "%.10g", value);
+		this->info.push_back(std::make_pair(key, std::string(number)));
+	}
+
+	bool Benchmark::writeReport(FILE* file) {
+
+		fprintf(file, "{\n");
+		for (size_t i = 0; i < this->info.size(); i++) {
+			fprintf(file, "  \"%s\": %s,\n", escapeJson(this->info[i].first).c_str(), this->info[i].second.c_str());
+		}
+		fprintf(file, "  \"frames\": %d,\n", this->frameCount);
+		fprintf(file, "  \"warmup_frames\": %d,\n", this->warmupFrames);
+
+		fprintf(file, "  \"frame\": {");
+		writeStats(file, "cpu_ms", this->passes[0].cpuTimes);
+		fprintf(file, ", ");
+		writeStats(file, "gpu_ms", this->passes[0].gpuTimes);
+		fprintf(file, "},\n");
+
+		fprintf(file, "  \"passes\": {");
+		for (size_t i = 1; i < this->passes.size(); i++) {
+
+			fprintf(file, "%s\n    \"%s\": {", i > 1 ? "," : "", escapeJson(this->passes[i].name).c_str());
+			writeStats(file, "cpu_ms", this->passes[i].cpuTimes);
+			fprintf(file, ", ");
+			writeStats(file, "gpu_ms", this->passes[i].gpuTimes);
+			fprintf(file, "}");
+		}
+		fprintf(file, "%s}\n}\n", this->passes.size() > 1 ? "\n  " : "");
+		fflush(file);
+
+		return !ferror(file);
+	}
+
+	bool Benchmark::isRecording(int64_t frame) const {
+		return frame >= this->warmupFrames && frame < this->warmupFrames + this->frameCount;
+	}
+
+	size_t Benchmark::findPass(const char* name) {
+
+		for (size_t i = 0; i < this->passes.size(); i++) {
+			if (this->passes[i].name == name || strcmp(this->passes[i].name, name) == 0) {
+				return i;
+			}
+		}
+
+		Pass pass;
+		pass.name = name;
+		this->passes.push_back(pass);
+
+		return this->passes.size() - 1;
+	}
+}
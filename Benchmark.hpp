@@ -0,0 +1,82 @@
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include "GpuProfiler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gps {
+
+    // Frame and per-pass timings of a benchmark run, reported as min/avg/p50/p95/p99/max in JSON.
+    // CPU times come from a steady clock around the pass markers; GPU times are the GpuProfiler's,
+    // handed over with addGpuTimings() as they are read back.
+    // Every call is a no-op unless a run was started, so the pass markers can stay in the render code.
+    class Benchmark {
+
+    public:
+        // Starts a run of frameCount measured frames, after warmupFrames that are rendered but not recorded;
+        // firstGpuFrame is the GpuProfiler frame number of the run's first frame
+        void start(int frameCount, int warmupFrames, uint64_t firstGpuFrame);
+
+        bool isRunning() const;
+
+        // True while the warm-up frames render; a scripted flight should hold still meanwhile
+        bool isWarmingUp() const;
+
+        // True once every measured frame has been rendered
+        bool isFinished() const;
+
+        void beginFrame();
+        void endFrame();
+
+        // Passes may nest; name must be a string literal (it is compared by address first)
+        void beginPass(const char* name);
+        void endPass();
+
+        // Keeps the GPU timings that belong to measured frames
+        void addGpuTimings(const std::vector<GpuPassTiming>& timings);
+
+        // Extra top-level fields of the report, e.g. the renderer or the resolution
+        void setInfo(const std::string& key, const std::string& value);
+        void setInfo(const std::string& key, double value);
+
+        // Call after the last GPU timings were added
+        bool writeReport(FILE* file);
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Pass {
+
+            const char* name;
+            std::vector<double> cpuTimes;
+            std::vector<double> gpuTimes;
+        };
+
+        struct OpenPass {
+
+            size_t pass;
+            Clock::time_point cpuStart;
+        };
+
+        bool running = false;
+        int frameCount = 0;
+        int warmupFrames = 0;
+        int frame = 0;
+        uint64_t firstGpuFrame = 0;
+
+        // index 0 is the whole frame
+        std::vector<Pass> passes;
+        std::vector<OpenPass> openPasses;
+        std::vector<std::pair<std::string, std::string>> info;
+
+        bool isRecording(int64_t frame) const;
+        size_t findPass(const char* name);
+    };
+}
+
+#endif /* Benchmark_hpp */
@@ -0,0 +1,826 @@
+#include "Bvh.hpp"
+
+#include "Bake.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define GPS_BVH_SSE
+    #include <emmintrin.h>
+#endif
+
+namespace gps {
+
+	static const int SAH_BINS = 16;
+	// Nodes with this few triangles always become leaves; larger ones only when no split is cheaper
+	static const uint32_t MIN_LEAF_TRIANGLES = 2;
+	static const uint32_t MAX_LEAF_TRIANGLES = 8;
+	// SAH cost of visiting a node, relative to testing one triangle
+	static const float TRAVERSAL_COST = 1.0f;
+	// Nodes above this many triangles are binned by the whole worker pool
+	static const uint32_t PARALLEL_BINNING_TRIANGLES = 65536;
+	// Subtrees below this many triangles are built by a single task
+	static const uint32_t MIN_TASK_TRIANGLES = 4096;
+	// From this depth on nodes are split at the median, which bounds the depth of the tree and so the
+	// traversal stacks
+	static const uint32_t MEDIAN_SPLIT_DEPTH = 96;
+	static const int MAX_TRAVERSAL_DEPTH = 128;
+
+	// Bump when the file layout changes, so stale caches are rebuilt
+	static const char CACHE_MAGIC[8] = { 'G', 'P', 'S', 'B', 'V', 'H', '0', '1' };
+
+	namespace {
+
+		struct Bounds {
+
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+
+			Bounds() : boundsMin(FLT_MAX), boundsMax(-FLT_MAX) {
+			}
+
+			void grow(const glm::vec3& p) {
+				boundsMin = glm::min(boundsMin, p);
+				boundsMax = glm::max(boundsMax, p);
+			}
+
+			void grow(const Bounds& other) {
+				boundsMin = glm::min(boundsMin, other.boundsMin);
+				boundsMax = glm::max(boundsMax, other.boundsMax);
+			}
+
+			float area() const {
+				glm::vec3 extent = boundsMax - boundsMin;
+				if (extent.x < 0.0f) {
+					return 0.0f;
+				}
+				return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+			}
+		};
+
+		struct Bin {
+
+			Bounds bounds;
+			uint32_t count = 0;
+		};
+
+		// Node before flattening; children are ids into the tree they were built in
+		struct BuildNode {
+
+			Bounds bounds;
+			uint32_t first;
+			uint32_t count;
+			uint32_t left;
+			uint32_t right;
+			uint32_t depth;
+			// >= 0: leaf of the top levels whose subtree is built by that task
+			int task;
+		};
+
+		class Builder {
+
+		public:
+			std::vector<Bounds> triangleBounds;
+			std::vector<glm::vec3> centroids;
+			// triangle ids, partitioned in place as the tree is split
+			std::vector<uint32_t> references;
+
+			// Bounds of the triangles and of their centroids over [first, first + count)
+			void measure(uint32_t first, uint32_t count, Bounds& bounds, Bounds& centroidBounds, bool parallel) {
+
+				if (!parallel) {
+					for (uint32_t i = first; i < first + count; i++) {
+						bounds.grow(triangleBounds[references[i]]);
+						centroidBounds.grow(centroids[references[i]]);
+					}
+					return;
+				}
+
+				std::mutex merge;
+				parallelFor(count, PARALLEL_BINNING_TRIANGLES / 8, [&](size_t begin, size_t end) {
+					Bounds localBounds;
+					Bounds localCentroids;
+					for (size_t i = first + begin; i < first + end; i++) {
+						localBounds.grow(triangleBounds[references[i]]);
+						localCentroids.grow(centroids[references[i]]);
+					}
+					std::lock_guard<std::mutex> lock(merge);
+					bounds.grow(localBounds);
+					centroidBounds.grow(localCentroids);
+				});
+			}
+
+			// Partitions the node at the cheapest of the binned SAH splits; returns the size of the left
+			// half, or 0 when the node should stay a leaf
+			uint32_t split(uint32_t first, uint32_t count, uint32_t depth, const Bounds& bounds, const Bounds& centroidBounds, bool parallel) {
+
+				if (count <= MIN_LEAF_TRIANGLES) {
+					return 0;
+				}
+
+				glm::vec3 extent = centroidBounds.boundsMax - centroidBounds.boundsMin;
+				int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+				if (extent[axis] <= 0.0f) {
+					// every centroid coincides; nothing to split on
+					return count > MAX_LEAF_TRIANGLES ? count / 2 : 0;
+				}
+
+				if (depth >= MEDIAN_SPLIT_DEPTH) {
+					uint32_t* begin = references.data() + first;
+					std::nth_element(begin, begin + count / 2, begin + count, [&](uint32_t a, uint32_t b) {
+						return centroids[a][axis] < centroids[b][axis];
+					});
+					return count / 2;
+				}
+
+				float binScale = SAH_BINS / extent[axis];
+				float binOrigin = centroidBounds.boundsMin[axis];
+				Bin bins[SAH_BINS];
+
+				auto binOf = [&](uint32_t triangle) {
+					int bin = (int)((centroids[triangle][axis] - binOrigin) * binScale);
+					return std::min(std::max(bin, 0), SAH_BINS - 1);
+				};
+
+				if (parallel) {
+					std::mutex merge;
+					parallelFor(count, PARALLEL_BINNING_TRIANGLES / 8, [&](size_t begin, size_t end) {
+						Bin localBins[SAH_BINS];
+						for (size_t i = first + begin; i < first + end; i++) {
+							Bin& bin = localBins[binOf(references[i])];
+							bin.bounds.grow(triangleBounds[references[i]]);
+							bin.count++;
+						}
+						std::lock_guard<std::mutex> lock(merge);
+						for (int b = 0; b < SAH_BINS; b++) {
+							bins[b].bounds.grow(localBins[b].bounds);
+							bins[b].count += localBins[b].count;
+						}
+					});
+				}
+				else {
+					for (uint32_t i = first; i < first + count; i++) {
+						Bin& bin = bins[binOf(references[i])];
+						bin.bounds.grow(triangleBounds[references[i]]);
+						bin.count++;
+					}
+				}
+
+				// sweep from the right, then evaluate every plane between bins from the left
+				float rightCosts[SAH_BINS];
+				Bounds rightBounds;
+				uint32_t rightCount = 0;
+				for (int b = SAH_BINS - 1; b > 0; b--) {
+					rightBounds.grow(bins[b].bounds);
+					rightCount += bins[b].count;
+					rightCosts[b] = rightBounds.area() * rightCount;
+				}
+
+				float bestCost = FLT_MAX;
+				int bestPlane = -1;
+				Bounds leftBounds;
+				uint32_t leftCount = 0;
+				for (int b = 0; b < SAH_BINS - 1; b++) {
+					leftBounds.grow(bins[b].bounds);
+					leftCount += bins[b].count;
+					if (leftCount == 0 || leftCount == count) {
+						continue;
+					}
+					float cost = leftBounds.area() * leftCount + rightCosts[b + 1];
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestPlane = b;
+					}
+				}
+
+				float parentArea = std::max(bounds.area(), FLT_MIN);
+				float splitCost = TRAVERSAL_COST + bestCost / parentArea;
+				if (splitCost >= (float)count && count <= MAX_LEAF_TRIANGLES) {
+					return 0;
+				}
+
+				uint32_t* begin = references.data() + first;
+				uint32_t* middle = std::partition(begin, begin + count, [&](uint32_t triangle) {
+					return binOf(triangle) <= bestPlane;
+				});
+				return (uint32_t)(middle - begin);
+			}
+
+			// Builds the subtree over [first, first + count) into nodes; returns its root
+			uint32_t buildSubtree(uint32_t first, uint32_t count, uint32_t depth, std::vector<BuildNode>& nodes) {
+
+				uint32_t root = (uint32_t)nodes.size();
+				nodes.push_back({ Bounds(), first, count, 0, 0, depth, -1 });
+				std::vector<uint32_t> stack(1, root);
+
+				while (!stack.empty()) {
+
+					uint32_t id = stack.back();
+					stack.pop_back();
+
+					Bounds bounds;
+					Bounds centroidBounds;
+					measure(nodes[id].first, nodes[id].count, bounds, centroidBounds, false);
+					nodes[id].bounds = bounds;
+
+					uint32_t leftCount = split(nodes[id].first, nodes[id].count, nodes[id].depth, bounds, centroidBounds, false);
+					if (leftCount == 0) {
+						continue;
+					}
+
+					uint32_t nodeFirst = nodes[id].first;
+					uint32_t nodeCount = nodes[id].count;
+					uint32_t childDepth = nodes[id].depth + 1;
+					uint32_t left = (uint32_t)nodes.size();
+					nodes.push_back({ Bounds(), nodeFirst, leftCount, 0, 0, childDepth, -1 });
+					nodes.push_back({ Bounds(), nodeFirst + leftCount, nodeCount - leftCount, 0, 0, childDepth, -1 });
+					nodes[id].left = left;
+					nodes[id].right = left + 1;
+					nodes[id].count = 0;
+					stack.push_back(left + 1);
+					stack.push_back(left);
+				}
+
+				return root;
+			}
+		};
+
+		// Writes the subtree under node depth first; task leaves of the top levels continue in their task's tree
+		void flatten(const std::vector<std::vector<BuildNode> >& subtrees, const std::vector<uint32_t>& subtreeRoots,
+			const std::vector<BuildNode>& tree, uint32_t node, std::vector<BvhNode>& out) {
+
+			const BuildNode& source = tree[node];
+			if (source.task >= 0) {
+				flatten(subtrees, subtreeRoots, subtrees[source.task], subtreeRoots[source.task], out);
+				return;
+			}
+
+			uint32_t index = (uint32_t)out.size();
+			out.push_back(BvhNode());
+			out[index].boundsMin = source.bounds.boundsMin;
+			out[index].boundsMax = source.bounds.boundsMax;
+
+			if (source.count > 0) {
+				out[index].offset = source.first;
+				out[index].count = source.count;
+				return;
+			}
+
+			flatten(subtrees, subtreeRoots, tree, source.left, out);
+			out[index].offset = (uint32_t)out.size();
+			out[index].count = 0;
+			flatten(subtrees, subtreeRoots, tree, source.right, out);
+		}
+
+		bool intersectTriangle(const BvhTriangle& triangle, const glm::vec3& origin, const glm::vec3& direction,
+			float tMax, float& t, float& u, float& v) {
+
+			// Moller-Trumbore, without a facing test
+			glm::vec3 edge1 = triangle.v1 - triangle.v0;
+			glm::vec3 edge2 = triangle.v2 - triangle.v0;
+			glm::vec3 p = glm::cross(direction, edge2);
+			float determinant = glm::dot(edge1, p);
+			if (std::fabs(determinant) < 1e-12f) {
+				return false;
+			}
+
+			float inverse = 1.0f / determinant;
+			glm::vec3 s = origin - triangle.v0;
+			u = glm::dot(s, p) * inverse;
+			if (u < 0.0f || u > 1.0f) {
+				return false;
+			}
+
+			glm::vec3 q = glm::cross(s, edge1);
+			v = glm::dot(direction, q) * inverse;
+			if (v < 0.0f || u + v > 1.0f) {
+				return false;
+			}
+
+			t = glm::dot(edge2, q) * inverse;
+			return t > 0.0f && t < tMax;
+		}
+
+		// Entry distance of the ray into the box, or FLT_MAX when it misses it before tMax
+		float intersectBounds(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax) {
+
+			glm::vec3 t1 = (node.boundsMin - origin) * inverseDirection;
+			glm::vec3 t2 = (node.boundsMax - origin) * inverseDirection;
+			glm::vec3 tNear = glm::min(t1, t2);
+			glm::vec3 tFar = glm::max(t1, t2);
+			float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+			float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+			return entry <= exit ? entry : FLT_MAX;
+		}
+
+		glm::vec3 inverseOf(const glm::vec3& direction) {
+
+			// a zero component gives a huge but finite inverse, so 0 * inverse stays a number
+			glm::vec3 inverse;
+			for (int axis = 0; axis < 3; axis++) {
+				float d = direction[axis];
+				inverse[axis] = 1.0f / (std::fabs(d) > 1e-20f ? d : (d < 0.0f ? -1e-20f : 1e-20f));
+			}
+			return inverse;
+		}
+
+#ifdef GPS_BVH_SSE
+		// Four rays as structure of arrays: one register per axis holds that component of all of them
+		struct RayPacket {
+
+			__m128 origin[3];
+			__m128 inverseDirection[3];
+		};
+
+		RayPacket makePacket(const BvhRay rays[4]) {
+
+			RayPacket packet;
+			glm::vec3 inverse[4] = { inverseOf(rays[0].direction), inverseOf(rays[1].direction), inverseOf(rays[2].direction), inverseOf(rays[3].direction) };
+			for (int axis = 0; axis < 3; axis++) {
+				packet.origin[axis] = _mm_setr_ps(rays[0].origin[axis], rays[1].origin[axis], rays[2].origin[axis], rays[3].origin[axis]);
+				packet.inverseDirection[axis] = _mm_setr_ps(inverse[0][axis], inverse[1][axis], inverse[2][axis], inverse[3][axis]);
+			}
+			return packet;
+		}
+
+		// Slab test of all four rays against the node at once: bit r is set when ray r reaches it before tMax[r]
+		int packetEntersNode(const BvhNode& node, const RayPacket& packet, const float tMax[4]) {
+
+			__m128 entry = _mm_setzero_ps();
+			__m128 exit = _mm_loadu_ps(tMax);
+			for (int axis = 0; axis < 3; axis++) {
+				__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[axis]), packet.origin[axis]), packet.inverseDirection[axis]);
+				__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[axis]), packet.origin[axis]), packet.inverseDirection[axis]);
+				entry = _mm_max_ps(entry, _mm_min_ps(t1, t2));
+				exit = _mm_min_ps(exit, _mm_max_ps(t1, t2));
+			}
+			return _mm_movemask_ps(_mm_cmple_ps(entry, exit));
+		}
+#endif
+	}
+
+	void Bvh::build(const std::vector<gps::Mesh>& meshes) {
+
+		PROFILE_FUNCTION();
+
+		this->nodes.clear();
+		this->triangles.clear();
+
+		for (size_t m = 0; m < meshes.size(); m++) {
+
+			const gps::Mesh& mesh = meshes[m];
+			const gps::MeshLod& lod = mesh.lods[0];
+			for (GLuint i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; i += 3) {
+				BvhTriangle triangle;
+				triangle.v0 = mesh.vertices[mesh.indices[i]].Position;
+				triangle.v1 = mesh.vertices[mesh.indices[i + 1]].Position;
+				triangle.v2 = mesh.vertices[mesh.indices[i + 2]].Position;
+				triangle.mesh = (uint32_t)m;
+				triangle.triangle = i / 3;
+				this->triangles.push_back(triangle);
+			}
+		}
+
+		uint32_t triangleCount = (uint32_t)this->triangles.size();
+		if (triangleCount == 0) {
+			return;
+		}
+
+		Builder builder;
+		builder.triangleBounds.resize(triangleCount);
+		builder.centroids.resize(triangleCount);
+		builder.references.resize(triangleCount);
+		parallelFor(triangleCount, 4096, [&](size_t begin, size_t end) {
+			for (size_t t = begin; t < end; t++) {
+				Bounds bounds;
+				bounds.grow(this->triangles[t].v0);
+				bounds.grow(this->triangles[t].v1);
+				bounds.grow(this->triangles[t].v2);
+				builder.triangleBounds[t] = bounds;
+				builder.centroids[t] = (bounds.boundsMin + bounds.boundsMax) * 0.5f;
+				builder.references[t] = (uint32_t)t;
+			}
+		});
+
+		// top levels: split on the calling thread until there is enough independent work for every core
+		uint32_t taskSize = std::max(MIN_TASK_TRIANGLES, triangleCount / (parallelThreadCount() * 8));
+		std::vector<BuildNode> top;
+		std::vector<uint32_t> pending(1, 0);
+		top.push_back({ Bounds(), 0, triangleCount, 0, 0, 0, -1 });
+		std::vector<uint32_t> taskNodes;
+
+		while (!pending.empty()) {
+
+			uint32_t id = pending.back();
+			pending.pop_back();
+
+			if (top[id].count <= taskSize) {
+				top[id].task = (int)taskNodes.size();
+				taskNodes.push_back(id);
+				continue;
+			}
+
+			bool parallel = top[id].count >= PARALLEL_BINNING_TRIANGLES;
+			Bounds bounds;
+			Bounds centroidBounds;
+			builder.measure(top[id].first, top[id].count, bounds, centroidBounds, parallel);
+			top[id].bounds = bounds;
+
+			uint32_t leftCount = builder.split(top[id].first, top[id].count, top[id].depth, bounds, centroidBounds, parallel);
+			if (leftCount == 0) {
+				continue;
+			}
+
+			uint32_t nodeFirst = top[id].first;
+			uint32_t nodeCount = top[id].count;
+			uint32_t childDepth = top[id].depth + 1;
+			uint32_t left = (uint32_t)top.size();
+			top.push_back({ Bounds(), nodeFirst, leftCount, 0, 0, childDepth, -1 });
+			top.push_back({ Bounds(), nodeFirst + leftCount, nodeCount - leftCount, 0, 0, childDepth, -1 });
+			top[id].left = left;
+			top[id].right = left + 1;
+			top[id].count = 0;
+			pending.push_back(left + 1);
+			pending.push_back(left);
+		}
+
+		// the subtrees cover disjoint ranges of the references, so they are built side by side
+		std::vector<std::vector<BuildNode> > subtrees(taskNodes.size());
+		std::vector<uint32_t> subtreeRoots(taskNodes.size());
+		parallelFor(taskNodes.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t t = begin; t < end; t++) {
+				const BuildNode& node = top[taskNodes[t]];
+				subtreeRoots[t] = builder.buildSubtree(node.first, node.count, node.depth, subtrees[t]);
+			}
+		});
+
+		this->nodes.reserve(top.size() + triangleCount);
+		flatten(subtrees, subtreeRoots, top, 0, this->nodes);
+
+		// triangles in leaf order, so a leaf reads one contiguous block
+		std::vector<BvhTriangle> ordered(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; i++) {
+			ordered[i] = this->triangles[builder.references[i]];
+		}
+		this->triangles.swap(ordered);
+		this->nodes.shrink_to_fit();
+	}
+
+	bool Bvh::buildCached(const std::vector<gps::Mesh>& meshes, const std::string& cachePath) {
+
+		uint64_t sourceHash = hashMeshGeometry(HASH_SEED, meshes, false);
+		if (load(cachePath, sourceHash)) {
+			return true;
+		}
+
+		build(meshes);
+		if (!save(cachePath, sourceHash)) {
+			fprintf(stderr, "WARNING: could not write the BVH cache %s\n", cachePath.c_str());
+		}
+		return false;
+	}
+
+	bool Bvh::load(const std::string& fileName, uint64_t sourceHash) {
+
+		PROFILE_FUNCTION();
+
+		FILE* file = openBakeCache(fileName, CACHE_MAGIC, sourceHash);
+		if (file == NULL) {
+			return false;
+		}
+
+		uint64_t nodeCount = 0;
+		uint64_t triangleCount = 0;
+		bool valid = fread(&nodeCount, sizeof(nodeCount), 1, file) == 1
+			&& fread(&triangleCount, sizeof(triangleCount), 1, file) == 1;
+
+		if (valid) {
+			this->nodes.resize((size_t)nodeCount);
+			this->triangles.resize((size_t)triangleCount);
+			valid = fread(this->nodes.data(), sizeof(BvhNode), this->nodes.size(), file) == this->nodes.size()
+				&& fread(this->triangles.data(), sizeof(BvhTriangle), this->triangles.size(), file) == this->triangles.size();
+		}
+		fclose(file);
+
+		if (!valid) {
+			this->nodes.clear();
+			this->triangles.clear();
+		}
+		return valid;
+	}
+
+	bool Bvh::save(const std::string& fileName, uint64_t sourceHash) const {
+
+		FILE* file = createBakeCache(fileName, CACHE_MAGIC, sourceHash);
+		if (file == NULL) {
+			return false;
+		}
+
+		uint64_t nodeCount = this->nodes.size();
+		uint64_t triangleCount = this->triangles.size();
+		bool written = fwrite(&nodeCount, sizeof(nodeCount), 1, file) == 1
+			&& fwrite(&triangleCount, sizeof(triangleCount), 1, file) == 1
+			&& fwrite(this->nodes.data(), sizeof(BvhNode), this->nodes.size(), file) == this->nodes.size()
+			&& fwrite(this->triangles.data(), sizeof(BvhTriangle), this->triangles.size(), file) == this->triangles.size();
+
+		return fclose(file) == 0 && written;
+	}
+
+	bool Bvh::intersect(const BvhRay& ray, BvhHit& hit) const {
+
+		if (this->nodes.empty()) {
+			return false;
+		}
+
+		glm::vec3 inverseDirection = inverseOf(ray.direction);
+		float closest = ray.tMax;
+		bool found = false;
+
+		uint32_t stack[MAX_TRAVERSAL_DEPTH];
+		int depth = 0;
+		uint32_t node = 0;
+		if (intersectBounds(this->nodes[0], ray.origin, inverseDirection, closest) == FLT_MAX) {
+			return false;
+		}
+
+		for (;;) {
+
+			const BvhNode& current = this->nodes[node];
+			if (current.count > 0) {
+
+				for (uint32_t i = current.offset; i < current.offset + current.count; i++) {
+					float t, u, v;
+					if (intersectTriangle(this->triangles[i], ray.origin, ray.direction, closest, t, u, v)) {
+						closest = t;
+						hit.t = t;
+						hit.u = u;
+						hit.v = v;
+						hit.mesh = this->triangles[i].mesh;
+						hit.triangle = this->triangles[i].triangle;
+						found = true;
+					}
+				}
+			}
+			else {
+
+				// nearer child first; the other waits on the stack
+				uint32_t left = node + 1;
+				uint32_t right = current.offset;
+				float leftEntry = intersectBounds(this->nodes[left], ray.origin, inverseDirection, closest);
+				float rightEntry = intersectBounds(this->nodes[right], ray.origin, inverseDirection, closest);
+				if (leftEntry > rightEntry) {
+					std::swap(leftEntry, rightEntry);
+					std::swap(left, right);
+				}
+
+				if (leftEntry != FLT_MAX) {
+					if (rightEntry != FLT_MAX && depth < MAX_TRAVERSAL_DEPTH) {
+						stack[depth++] = right;
+					}
+					node = left;
+					continue;
+				}
+			}
+
+			if (depth == 0) {
+				break;
+			}
+			node = stack[--depth];
+		}
+
+		return found;
+	}
+
+	bool Bvh::occluded(const BvhRay& ray) const {
+
+		if (this->nodes.empty()) {
+			return false;
+		}
+
+		glm::vec3 inverseDirection = inverseOf(ray.direction);
+		uint32_t stack[MAX_TRAVERSAL_DEPTH];
+		int depth = 0;
+		stack[depth++] = 0;
+
+		while (depth > 0) {
+
+			const BvhNode& current = this->nodes[stack[--depth]];
+			if (intersectBounds(current, ray.origin, inverseDirection, ray.tMax) == FLT_MAX) {
+				continue;
+			}
+
+			if (current.count > 0) {
+				for (uint32_t i = current.offset; i < current.offset + current.count; i++) {
+					float t, u, v;
+					if (intersectTriangle(this->triangles[i], ray.origin, ray.direction, ray.tMax, t, u, v)) {
+						return true;
+					}
+				}
+			}
+			else if (depth + 2 <= MAX_TRAVERSAL_DEPTH) {
+				stack[depth++] = current.offset;
+				stack[depth++] = (uint32_t)(&current - this->nodes.data()) + 1;
+			}
+		}
+
+		return false;
+	}
+
+	int Bvh::intersect4(const BvhRay rays[4], BvhHit hits[4]) const {
+
+#ifdef GPS_BVH_SSE
+		if (this->nodes.empty()) {
+			return 0;
+		}
+
+		RayPacket packet = makePacket(rays);
+		float closest[4];
+		for (int r = 0; r < 4; r++) {
+			closest[r] = rays[r].tMax;
+		}
+		int hitMask = 0;
+
+		uint32_t stack[MAX_TRAVERSAL_DEPTH];
+		int depth = 0;
+		stack[depth++] = 0;
+
+		while (depth > 0) {
+
+			uint32_t node = stack[--depth];
+			const BvhNode& current = this->nodes[node];
+
+			// the node is entered if any ray reaches it
+			int active = packetEntersNode(current, packet, closest);
+			if (active == 0) {
+				continue;
+			}
+
+			if (current.count > 0) {
+				for (uint32_t i = current.offset; i < current.offset + current.count; i++) {
+					for (int r = 0; r < 4; r++) {
+						float t, u, v;
+						if ((active & (1 << r)) && intersectTriangle(this->triangles[i], rays[r].origin, rays[r].direction, closest[r], t, u, v)) {
+							closest[r] = t;
+							hits[r].t = t;
+							hits[r].u = u;
+							hits[r].v = v;
+							hits[r].mesh = this->triangles[i].mesh;
+							hits[r].triangle = this->triangles[i].triangle;
+							hitMask |= 1 << r;
+						}
+					}
+				}
+			}
+			else if (depth + 2 <= MAX_TRAVERSAL_DEPTH) {
+				// the packet mostly agrees on direction, so the first active ray picks the child to visit first
+				int lead = 0;
+				while (!(active & (1 << lead))) {
+					lead++;
+				}
+				glm::vec3 leadInverse = inverseOf(rays[lead].direction);
+				float leftEntry = intersectBounds(this->nodes[node + 1], rays[lead].origin, leadInverse, closest[lead]);
+				float rightEntry = intersectBounds(this->nodes[current.offset], rays[lead].origin, leadInverse, closest[lead]);
+				if (leftEntry <= rightEntry) {
+					stack[depth++] = current.offset;
+					stack[depth++] = node + 1;
+				}
+				else {
+					stack[depth++] = node + 1;
+					stack[depth++] = current.offset;
+				}
+			}
+		}
+
+		return hitMask;
+#else
+		int hitMask = 0;
+		for (int r = 0; r < 4; r++) {
+			if (intersect(rays[r], hits[r])) {
+				hitMask |= 1 << r;
+			}
+		}
+		return hitMask;
+#endif
+	}
+
+	int Bvh::occluded4(const BvhRay rays[4]) const {
+
+#ifdef GPS_BVH_SSE
+		if (this->nodes.empty()) {
+			return 0;
+		}
+
+		RayPacket packet = makePacket(rays);
+		float tMax[4];
+		// rays that are blocked (or never were asked) drop out of the packet
+		int done = 0;
+		for (int r = 0; r < 4; r++) {
+			tMax[r] = rays[r].tMax;
+			if (tMax[r] < 0.0f) {
+				done |= 1 << r;
+			}
+		}
+		int occludedMask = 0;
+
+		uint32_t stack[MAX_TRAVERSAL_DEPTH];
+		int depth = 0;
+		stack[depth++] = 0;
+
+		while (depth > 0 && done != 0xF) {
+
+			uint32_t node = stack[--depth];
+			const BvhNode& current = this->nodes[node];
+
+			int active = packetEntersNode(current, packet, tMax) & ~done;
+			if (active == 0) {
+				continue;
+			}
+
+			if (current.count > 0) {
+				for (uint32_t i = current.offset; i < current.offset + current.count && active != 0; i++) {
+					for (int r = 0; r < 4; r++) {
+						float t, u, v;
+						if ((active & (1 << r)) && intersectTriangle(this->triangles[i], rays[r].origin, rays[r].direction, tMax[r], t, u, v)) {
+							occludedMask |= 1 << r;
+							done |= 1 << r;
+							active &= ~(1 << r);
+							// the node test now leaves it out
+							tMax[r] = -1.0f;
+						}
+					}
+				}
+			}
+			else if (depth + 2 <= MAX_TRAVERSAL_DEPTH) {
+				stack[depth++] = current.offset;
+				stack[depth++] = node + 1;
+			}
+		}
+
+		return occludedMask;
+#else
+		int occludedMask = 0;
+		for (int r = 0; r < 4; r++) {
+			if (occluded(rays[r])) {
+				occludedMask |= 1 << r;
+			}
+		}
+		return occludedMask;
+#endif
+	}
+
+	void Bvh::queryAabb(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& result) const {
+
+		if (this->nodes.empty()) {
+			return;
+		}
+
+		uint32_t stack[MAX_TRAVERSAL_DEPTH];
+		int depth = 0;
+		stack[depth++] = 0;
+
+		while (depth > 0) {
+
+			uint32_t node = stack[--depth];
+			const BvhNode& current = this->nodes[node];
+			if (glm::any(glm::greaterThan(current.boundsMin, boundsMax)) || glm::any(glm::lessThan(current.boundsMax, boundsMin))) {
+				continue;
+			}
+
+			if (current.count > 0) {
+				for (uint32_t i = current.offset; i < current.offset + current.count; i++) {
+					const BvhTriangle& triangle = this->triangles[i];
+					glm::vec3 triangleMin = glm::min(triangle.v0, glm::min(triangle.v1, triangle.v2));
+					glm::vec3 triangleMax = glm::max(triangle.v0, glm::max(triangle.v1, triangle.v2));
+					if (!glm::any(glm::greaterThan(triangleMin, boundsMax)) && !glm::any(glm::lessThan(triangleMax, boundsMin))) {
+						result.push_back(i);
+					}
+				}
+			}
+			else if (depth + 2 <= MAX_TRAVERSAL_DEPTH) {
+				stack[depth++] = current.offset;
+				stack[depth++] = node + 1;
+			}
+		}
+	}
+
+	const BvhTriangle& Bvh::getTriangle(uint32_t index) const {
+		return this->triangles[index];
+	}
+
+	size_t Bvh::getTriangleCount() const {
+		return this->triangles.size();
+	}
+
+	size_t Bvh::getNodeCount() const {
+		return this->nodes.size();
+	}
+
+	bool Bvh::empty() const {
+		return this->nodes.empty();
+	}
+}
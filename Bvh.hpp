@@ -0,0 +1,102 @@
+#ifndef Bvh_hpp
+#define Bvh_hpp
+
+#include "Mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Node of the flattened tree, 32 bytes so two share a cache line. Nodes are stored depth first:
+    // an interior node's left child is the next node
+    struct BvhNode {
+
+        glm::vec3 boundsMin;
+        // interior: index of the right child; leaf: first triangle
+        uint32_t offset;
+        glm::vec3 boundsMax;
+        // triangles in the leaf, 0 for interior nodes
+        uint32_t count;
+    };
+
+    struct BvhTriangle {
+
+        glm::vec3 v0, v1, v2;
+        // index of the mesh in the model, and of the triangle in that mesh's index buffer (LOD 0)
+        uint32_t mesh;
+        uint32_t triangle;
+    };
+
+    struct BvhRay {
+
+        glm::vec3 origin;
+        glm::vec3 direction;
+        // hits further along than this (in units of direction) are ignored
+        float tMax;
+    };
+
+    struct BvhHit {
+
+        float t;
+        // barycentric coordinates of the hit: weight of v1 and v2
+        float u, v;
+        uint32_t mesh;
+        uint32_t triangle;
+    };
+
+    // Bounding volume hierarchy over the triangles of a model, in model space, shared by every CPU query
+    // on the scene (picking, collision, baking). Built with binned SAH, in parallel: the top levels are
+    // split with the binning spread over the worker pool, then the subtrees below them are built one
+    // per task. Triangles are two-sided, like the renderer draws them.
+    class Bvh {
+
+    public:
+        // Builds over LOD 0 of every mesh
+        void build(const std::vector<gps::Mesh>& meshes);
+
+        // Reads the tree from cachePath if it was built from the same geometry, else builds it and
+        // writes it there. Returns true when the cache was used
+        bool buildCached(const std::vector<gps::Mesh>& meshes, const std::string& cachePath);
+
+        // Closest hit along the ray, if any
+        bool intersect(const BvhRay& ray, BvhHit& hit) const;
+
+        // Whether anything lies along the ray; stops at the first hit, so cheaper than intersect
+        bool occluded(const BvhRay& ray) const;
+
+        // Closest hits of four rays traversed together, with SSE testing the packet against each node;
+        // coherent rays (neighbouring pixels, a hemisphere of samples) share most of the nodes they visit.
+        // Returns a mask with bit i set when ray i hit. A ray with a negative tMax is left out of the packet
+        int intersect4(const BvhRay rays[4], BvhHit hits[4]) const;
+
+        // occluded for four rays traversed together; a ray drops out of the packet at its first hit, and
+        // those with a negative tMax are left out. Returns a mask with bit i set when ray i is blocked
+        int occluded4(const BvhRay rays[4]) const;
+
+        // Appends the triangles whose bounds overlap the box
+        void queryAabb(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& result) const;
+
+        const BvhTriangle& getTriangle(uint32_t index) const;
+
+        size_t getTriangleCount() const;
+
+        size_t getNodeCount() const;
+
+        bool empty() const;
+
+    private:
+        std::vector<BvhNode> nodes;
+        // in leaf order
+        std::vector<BvhTriangle> triangles;
+
+        bool load(const std::string& fileName, uint64_t sourceHash);
+
+        bool save(const std::string& fileName, uint64_t sourceHash) const;
+    };
+}
+
+#endif /* Bvh_hpp */
@@ -2,7 +2,6 @@
 
 namespace gps {
 
-    float yaw, pitch;
     // Camera constructor
     Camera::Camera(glm::vec3 cameraPosition, glm::vec3 cameraTarget, glm::vec3 cameraUp) {
         this->cameraPosition = cameraPosition;
@@ -13,8 +12,9 @@ namespace gps {
         // Calculăm direcțiile frontale și dreapta ale camerei
         cameraFrontDirection = glm::normalize(cameraTarget - cameraPosition);
         cameraRightDirection = glm::normalize(glm::cross(cameraFrontDirection, cameraUpDirection));
-        yaw = -90.0f;  // Camera privește înainte pe axa Z negativă
-        pitch = 0.0f;  // Camera este orizontală inițial
+        // the angles of the front direction, for rotate()
+        pitch = glm::degrees(asin(glm::clamp(cameraFrontDirection.y, -1.0f, 1.0f)));
+        yaw = glm::degrees(atan2(cameraFrontDirection.z, cameraFrontDirection.x));
     }
 
     // Returnează matricea de vizualizare folosind glm::lookAt()
@@ -61,4 +61,14 @@ namespace gps {
         cameraUpDirection = glm::normalize(glm::cross(cameraRightDirection, cameraFrontDirection));
     }
 
+    void Camera::setView(glm::vec3 cameraPosition, glm::vec3 cameraTarget) {
+        this->cameraPosition = cameraPosition;
+        this->cameraTarget = cameraTarget;
+
+        glm::vec3 front = glm::normalize(cameraTarget - cameraPosition);
+        pitch = glm::degrees(asin(glm::clamp(front.y, -1.0f, 1.0f)));
+        yaw = glm::degrees(atan2(front.z, front.x));
+        rotate(0.0f, 0.0f);
+    }
+
 }
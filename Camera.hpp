@@ -21,12 +21,19 @@ namespace gps {
         //yaw - camera rotation around the y axis
         //pitch - camera rotation around the x axis
         void rotate(float pitch, float yaw);        
+        //place the camera at cameraPosition looking at cameraTarget, keeping yaw/pitch in sync for rotate()
+        void setView(glm::vec3 cameraPosition, glm::vec3 cameraTarget);
 
         glm::vec3 cameraPosition;
         glm::vec3 cameraTarget;
         glm::vec3 cameraFrontDirection;
         glm::vec3 cameraRightDirection;
         glm::vec3 cameraUpDirection;
+
+    private:
+        // degrees, kept per camera; rotate() rebuilds the directions from them
+        float yaw;
+        float pitch;
     };    
 }
 
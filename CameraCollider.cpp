@@ -0,0 +1,278 @@
+#include "CameraCollider.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+	// Moves a sphere can slide through in one call before the rest of the motion is dropped
+	static const int MAX_SLIDES = 4;
+	// Gap kept between the sphere and what it touches, so the next sweep doesn't start in contact
+	static const float CONTACT_SKIN = 0.001f;
+
+	// Smallest root of a t^2 + b t + c = 0 in [0, maxT]
+	static bool lowestRoot(float a, float b, float c, float maxT, float& root) {
+
+		if (std::fabs(a) < 1e-12f) {
+			return false;
+		}
+		float discriminant = b * b - 4.0f * a * c;
+		if (discriminant < 0.0f) {
+			return false;
+		}
+
+		float sqrtD = std::sqrt(discriminant);
+		float r1 = (-b - sqrtD) / (2.0f * a);
+		float r2 = (-b + sqrtD) / (2.0f * a);
+		if (r1 > r2) {
+			std::swap(r1, r2);
+		}
+		if (r1 >= 0.0f && r1 < maxT) {
+			root = r1;
+			return true;
+		}
+		if (r2 >= 0.0f && r2 < maxT) {
+			root = r2;
+			return true;
+		}
+		return false;
+	}
+
+	// Point of the triangle closest to p (Ericson, Real-Time Collision Detection 5.1.5)
+	static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+
+		glm::vec3 ab = b - a;
+		glm::vec3 ac = c - a;
+		glm::vec3 ap = p - a;
+		float d1 = glm::dot(ab, ap);
+		float d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f) {
+			return a;
+		}
+
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp);
+		float d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3) {
+			return b;
+		}
+
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+			return a + ab * (d1 / (d1 - d3));
+		}
+
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp);
+		float d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6) {
+			return c;
+		}
+
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+			return a + ac * (d2 / (d2 - d6));
+		}
+
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		}
+
+		float denominator = 1.0f / (va + vb + vc);
+		return a + ab * (vb * denominator) + ac * (vc * denominator);
+	}
+
+	// Earliest time the sphere moving from center by motion touches the triangle, before tMax.
+	// Sets contact to the touched point of the triangle
+	static bool sweepTriangle(const BvhTriangle& triangle, const glm::vec3& center, const glm::vec3& motion, float radius,
+		float& tMax, glm::vec3& contact) {
+
+		const glm::vec3 vertices[3] = {triangle.v0, triangle.v1, triangle.v2};
+		bool found = false;
+
+		// already touching: only a move towards the triangle is a contact
+		glm::vec3 closest = closestPointOnTriangle(center, triangle.v0, triangle.v1, triangle.v2);
+		glm::vec3 away = center - closest;
+		if (glm::dot(away, away) < radius * radius) {
+			if (glm::dot(motion, away) < 0.0f) {
+				tMax = 0.0f;
+				contact = closest;
+				return true;
+			}
+			return false;
+		}
+
+		// face: the sphere touches the plane with the point nearest to it; triangles are two-sided, so
+		// the plane faces the side the sphere starts on
+		glm::vec3 normal = glm::cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0);
+		float normalLength = glm::length(normal);
+		if (normalLength > 0.0f) {
+
+			normal /= normalLength;
+			// the winding test below needs the normal the vertices wind around
+			glm::vec3 windingNormal = normal;
+			float distance = glm::dot(center - triangle.v0, normal);
+			if (distance < 0.0f) {
+				normal = -normal;
+				distance = -distance;
+			}
+
+			float approach = glm::dot(motion, normal);
+			if (approach < 0.0f) {
+
+				float t = (radius - distance) / approach;
+				if (t >= 0.0f && t < tMax) {
+
+					glm::vec3 point = center + motion * t - normal * radius;
+					bool inside = true;
+					for (int e = 0; e < 3 && inside; e++) {
+						glm::vec3 edge = vertices[(e + 1) % 3] - vertices[e];
+						inside = glm::dot(glm::cross(edge, point - vertices[e]), windingNormal) >= 0.0f;
+					}
+					// a contact inside the face comes before any with its edges or vertices
+					if (inside) {
+						tMax = t;
+						contact = point;
+						return true;
+					}
+				}
+			}
+		}
+
+		float motionLength2 = glm::dot(motion, motion);
+
+		// vertices: |center + motion t - vertex| = radius
+		for (int v = 0; v < 3; v++) {
+			glm::vec3 toCenter = center - vertices[v];
+			float t;
+			if (lowestRoot(motionLength2, 2.0f * glm::dot(motion, toCenter), glm::dot(toCenter, toCenter) - radius * radius, tMax, t)) {
+				tMax = t;
+				contact = vertices[v];
+				found = true;
+			}
+		}
+
+		// edges: distance radius from the infinite line through the edge, at a point within the edge
+		for (int e = 0; e < 3; e++) {
+
+			glm::vec3 edge = vertices[(e + 1) % 3] - vertices[e];
+			glm::vec3 toVertex = vertices[e] - center;
+			float edgeLength2 = glm::dot(edge, edge);
+			float edgeDotMotion = glm::dot(edge, motion);
+			float edgeDotToVertex = glm::dot(edge, toVertex);
+
+			float a = edgeLength2 * -motionLength2 + edgeDotMotion * edgeDotMotion;
+			float b = edgeLength2 * 2.0f * glm::dot(motion, toVertex) - 2.0f * edgeDotMotion * edgeDotToVertex;
+			float c = edgeLength2 * (radius * radius - glm::dot(toVertex, toVertex)) + edgeDotToVertex * edgeDotToVertex;
+			float t;
+			if (lowestRoot(a, b, c, tMax, t)) {
+				float f = (edgeDotMotion * t - edgeDotToVertex) / edgeLength2;
+				if (f >= 0.0f && f <= 1.0f) {
+					tMax = t;
+					contact = vertices[e] + edge * f;
+					found = true;
+				}
+			}
+		}
+
+		return found;
+	}
+
+	void CameraCollider::init(const gps::Bvh* bvh, float radius, const glm::mat4& modelMatrix) {
+		this->bvh = bvh;
+		this->radius = radius;
+		this->modelMatrix = modelMatrix;
+		this->inverseModel = glm::inverse(modelMatrix);
+
+		// a scaled model stretches the sphere into an ellipsoid; the longest axis keeps it from cutting into walls
+		float scale = std::max(glm::length(glm::vec3(this->inverseModel[0])),
+			std::max(glm::length(glm::vec3(this->inverseModel[1])), glm::length(glm::vec3(this->inverseModel[2]))));
+		this->modelRadius = radius * scale;
+	}
+
+	bool CameraCollider::sweep(const glm::vec3& position, const glm::vec3& motion, float& t, glm::vec3& normal) const {
+
+		t = 1.0f;
+		bool found = false;
+		glm::vec3 contact;
+		for (size_t i = 0; i < this->candidates.size(); i++) {
+			if (sweepTriangle(this->bvh->getTriangle(this->candidates[i]), position, motion, this->modelRadius, t, contact)) {
+				found = true;
+			}
+		}
+
+		if (found) {
+			normal = position + motion * t - contact;
+			float length = glm::length(normal);
+			normal = length > 0.0f ? normal / length : -glm::normalize(motion);
+		}
+		return found;
+	}
+
+	glm::vec3 CameraCollider::move(const glm::vec3& position, const glm::vec3& motion) {
+
+		if (this->bvh == nullptr || this->bvh->empty() || motion == glm::vec3(0.0f)) {
+			return position + motion;
+		}
+
+		glm::vec3 modelPosition = glm::vec3(this->inverseModel * glm::vec4(position, 1.0f));
+		glm::vec3 modelMotion = glm::vec3(this->inverseModel * glm::vec4(motion, 0.0f));
+		return glm::vec3(this->modelMatrix * glm::vec4(moveInModel(modelPosition, modelMotion), 1.0f));
+	}
+
+	glm::vec3 CameraCollider::moveInModel(const glm::vec3& position, const glm::vec3& motion) {
+
+		float distance = glm::length(motion);
+
+		// sliding never takes the sphere further than the motion's length, so one query covers every slide
+		glm::vec3 extent(distance + this->modelRadius + CONTACT_SKIN);
+		this->candidates.clear();
+		this->bvh->queryAabb(position - extent, position + extent, this->candidates);
+
+		glm::vec3 current = position;
+		glm::vec3 remaining = motion;
+		for (int slide = 0; slide < MAX_SLIDES; slide++) {
+
+			float length = glm::length(remaining);
+			if (length < CONTACT_SKIN) {
+				break;
+			}
+
+			float t;
+			glm::vec3 normal;
+			if (!sweep(current, remaining, t, normal)) {
+				return current + remaining;
+			}
+
+			// stop just short of the contact, then slide the rest of the motion along the contact plane
+			current += remaining * std::max(0.0f, t - CONTACT_SKIN / length);
+			remaining *= 1.0f - t;
+			remaining -= normal * glm::dot(remaining, normal);
+		}
+		return current;
+	}
+
+	bool CameraCollider::findGround(const glm::vec3& position, float maxDistance, float& distance) const {
+
+		if (this->bvh == nullptr || this->bvh->empty()) {
+			return false;
+		}
+
+		// straight down in the world; the direction stays unnormalized, so t is a world distance
+		BvhRay ray;
+		ray.origin = glm::vec3(this->inverseModel * glm::vec4(position, 1.0f));
+		ray.direction = glm::vec3(this->inverseModel * glm::vec4(0.0f, -1.0f, 0.0f, 0.0f));
+		ray.tMax = maxDistance;
+		BvhHit hit;
+		if (!this->bvh->intersect(ray, hit)) {
+			return false;
+		}
+		distance = hit.t;
+		return true;
+	}
+
+	float CameraCollider::getRadius() const {
+		return this->radius;
+	}
+}
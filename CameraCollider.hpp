@@ -0,0 +1,51 @@
+#ifndef CameraCollider_hpp
+#define CameraCollider_hpp
+
+#include "Bvh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Keeps the camera out of the scene geometry. The camera is a sphere swept along each move against
+    // the triangles the BVH finds around the move, and slides along whatever it touches (Fauerby's
+    // collide and slide), so a move costs one box query and a handful of triangle tests.
+    // Positions, moves and distances are in world space; the BVH's triangles are in the space of the
+    // model they were built from, placed in the world by the model matrix given to init(). Not thread
+    // safe: the candidate list is reused between calls.
+    class CameraCollider {
+
+    public:
+        // radius is in world units
+        void init(const gps::Bvh* bvh, float radius, const glm::mat4& modelMatrix = glm::mat4(1.0f));
+
+        // Where a sphere at position ends up when moved by motion, sliding along what it hits
+        glm::vec3 move(const glm::vec3& position, const glm::vec3& motion);
+
+        // Distance straight down from position to the closest triangle, if one is within maxDistance
+        bool findGround(const glm::vec3& position, float maxDistance, float& distance) const;
+
+        float getRadius() const;
+
+    private:
+        const gps::Bvh* bvh = nullptr;
+        float radius = 0.25f;
+        glm::mat4 modelMatrix = glm::mat4(1.0f);
+        glm::mat4 inverseModel = glm::mat4(1.0f);
+        // radius in the BVH's space, enough to cover the world sphere along every axis
+        float modelRadius = 0.25f;
+        std::vector<uint32_t> candidates;
+
+        // move() in the BVH's space
+        glm::vec3 moveInModel(const glm::vec3& position, const glm::vec3& motion);
+
+        // First contact of the sphere moving from position by motion (t in 0..1 of the motion), with the
+        // contact normal pointing back towards the sphere; in the BVH's space
+        bool sweep(const glm::vec3& position, const glm::vec3& motion, float& t, glm::vec3& normal) const;
+    };
+}
+
+#endif /* CameraCollider_hpp */
@@ -0,0 +1,147 @@
+#include "CameraPath.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace gps {
+
+	template <typename T>
+	static T catmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float t) {
+
+		float t2 = t * t;
+		float t3 = t2 * t;
+
+		return 0.5f * (2.0f * p1
+			+ (p2 - p0) * t
+			+ (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2
+			+ (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+	}
+
+	bool CameraPath::load(const std::string& fileName) {
+
+		std::ifstream file(fileName.c_str());
+		if (!file) {
+			fprintf(stderr, "ERROR: could not open camera path %s\n", fileName.c_str());
+			return false;
+		}
+
+		std::vector<CameraKeyframe> keyframes;
+		std::string line;
+		int lineNumber = 0;
+
+		while (std::getline(file, line)) {
+
+			lineNumber++;
+
+			std::istringstream fields(line);
+			std::string first;
+			if (!(fields >> first) || first[0] == '#') {
+				continue;
+			}
+
+			CameraKeyframe keyframe;
+			fields.clear();
+			fields.str(line);
+			if (!(fields >> keyframe.time
+				>> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+				>> keyframe.target.x >> keyframe.target.y >> keyframe.target.z)) {
+
+				fprintf(stderr, "ERROR: %s:%d: expected time px py pz tx ty tz [lightAngle]\n", fileName.c_str(), lineNumber);
+				return false;
+			}
+			if (!(fields >> keyframe.lightAngle)) {
+				keyframe.lightAngle = keyframes.empty() ? 0.0f : keyframes.back().lightAngle;
+			}
+
+			if (!keyframes.empty() && keyframe.time <= keyframes.back().time) {
+				fprintf(stderr, "ERROR: %s:%d: keyframe times must increase\n", fileName.c_str(), lineNumber);
+				return false;
+			}
+
+			keyframes.push_back(keyframe);
+		}
+
+		if (keyframes.empty()) {
+			fprintf(stderr, "ERROR: camera path %s has no keyframes\n", fileName.c_str());
+			return false;
+		}
+
+		this->keyframes.swap(keyframes);
+		return true;
+	}
+
+	bool CameraPath::save(const std::string& fileName) const {
+
+		FILE* file = fopen(fileName.c_str(), "w");
+		if (file == NULL) {
+			fprintf(stderr, "ERROR: could not open %s for writing\n", fileName.c_str());
+			return false;
+		}
+
+		fprintf(file, "# time  px py pz  tx ty tz  lightAngle\n");
+		for (size_t i = 0; i < this->keyframes.size(); i++) {
+
+			const CameraKeyframe& keyframe = this->keyframes[i];
+			fprintf(file, "%.4f  %.4f %.4f %.4f  %.4f %.4f %.4f  %.4f\n", keyframe.time,
+				keyframe.position.x, keyframe.position.y, keyframe.position.z,
+				keyframe.target.x, keyframe.target.y, keyframe.target.z,
+				keyframe.lightAngle);
+		}
+
+		bool written = !ferror(file);
+		fclose(file);
+
+		return written;
+	}
+
+	void CameraPath::addKeyframe(const CameraKeyframe& keyframe) {
+		this->keyframes.push_back(keyframe);
+	}
+
+	void CameraPath::clear() {
+		this->keyframes.clear();
+	}
+
+	bool CameraPath::empty() const {
+		return this->keyframes.empty();
+	}
+
+	float CameraPath::getDuration() const {
+		return this->keyframes.empty() ? 0.0f : this->keyframes.back().time;
+	}
+
+	CameraKeyframe CameraPath::evaluate(float time) const {
+
+		size_t count = this->keyframes.size();
+
+		if (time <= this->keyframes[0].time || count == 1) {
+			return this->keyframes[0];
+		}
+		if (time >= this->keyframes[count - 1].time) {
+			return this->keyframes[count - 1];
+		}
+
+		// segment k runs from keyframe k to k + 1
+		size_t k = 0;
+		while (time >= this->keyframes[k + 1].time) {
+			k++;
+		}
+
+		// the end keyframes are repeated, so the curve starts and stops exactly on them
+		const CameraKeyframe& k0 = this->keyframes[k > 0 ? k - 1 : 0];
+		const CameraKeyframe& k1 = this->keyframes[k];
+		const CameraKeyframe& k2 = this->keyframes[k + 1];
+		const CameraKeyframe& k3 = this->keyframes[k + 2 < count ? k + 2 : count - 1];
+
+		float t = (time - k1.time) / (k2.time - k1.time);
+
+		CameraKeyframe keyframe;
+		keyframe.time = time;
+		keyframe.position = catmullRom(k0.position, k1.position, k2.position, k3.position, t);
+		keyframe.target = catmullRom(k0.target, k1.target, k2.target, k3.target, t);
+		keyframe.lightAngle = catmullRom(k0.lightAngle, k1.lightAngle, k2.lightAngle, k3.lightAngle, t);
+
+		return keyframe;
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef CameraPath_hpp
+#define CameraPath_hpp
+
+#include "glm/glm.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    struct CameraKeyframe {
+
+        // seconds from the start of the path
+        float time;
+        glm::vec3 position;
+        glm::vec3 target;
+        // rotation of the directional light around the y axis, in degrees
+        float lightAngle;
+    };
+
+    // Camera and light flight through a list of keyframes, stored as a text file with one keyframe per line:
+    //   time  px py pz  tx ty tz  [lightAngle]
+    // Blank lines and lines starting with '#' are skipped; keyframes must be in increasing time order.
+    // A missing light angle repeats the previous keyframe's (0 for the first).
+    class CameraPath {
+
+    public:
+        // Replaces the keyframes with the ones in the file; false (and prints why) if it can't be read
+        bool load(const std::string& fileName);
+
+        // Writes the keyframes in the format load() reads; false if the file can't be written
+        bool save(const std::string& fileName) const;
+
+        // Appends a keyframe; its time must be later than the last one's
+        void addKeyframe(const CameraKeyframe& keyframe);
+
+        void clear();
+
+        bool empty() const;
+
+        // Time of the last keyframe
+        float getDuration() const;
+
+        // Catmull-Rom spline through the keyframes; times outside the path clamp to its ends
+        CameraKeyframe evaluate(float time) const;
+
+    private:
+        std::vector<CameraKeyframe> keyframes;
+    };
+}
+
+#endif /* CameraPath_hpp */
@@ -0,0 +1,164 @@
+#include "DynamicResolution.hpp"
+
+#include "GpuMemory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace gps {
+
+	// Scales are multiples of this, so the render size only takes a few values
+	static const float SCALE_STEP = 0.05f;
+	// Over the target the scale drops; it only rises again below this share of it
+	static const float RAISE_THRESHOLD = 0.8f;
+	// A single change never rises more than this, so a spike of headroom can't overshoot the budget
+	static const float MAX_RAISE = 0.1f;
+
+	void DynamicResolution::init(int outputWidth, int outputHeight, float minScale, float maxScale, float targetMilliseconds) {
+
+		release();
+
+		this->outputWidth = outputWidth;
+		this->outputHeight = outputHeight;
+		this->minScale = minScale;
+		this->maxScale = maxScale;
+		this->scale = maxScale;
+		this->targetMilliseconds = targetMilliseconds;
+		this->sampleSum = 0.0;
+		this->sampleCount = 0;
+		this->cooldown = COOLDOWN_FRAMES;
+
+		this->width = std::max(1, (int)std::ceil(outputWidth * maxScale));
+		this->height = std::max(1, (int)std::ceil(outputHeight * maxScale));
+
+		// sampled by the upscale pass, so a texture rather than a renderbuffer
+		glGenTextures(1, &this->colorTexture);
+		glBindTexture(GL_TEXTURE_2D, this->colorTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, this->width, this->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenRenderbuffers(1, &this->depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, this->width, this->height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		trackGpuTexture(GL_TEXTURE_2D, this->colorTexture, "DynamicResolution", "scene color");
+		trackGpuRenderbuffer(this->depthBuffer, "DynamicResolution", "scene depth");
+
+		glGenFramebuffers(1, &this->framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->colorTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "ERROR: dynamic resolution framebuffer is incomplete\n");
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	bool DynamicResolution::update(double gpuMilliseconds) {
+
+		// timings of frames drawn before the last change don't describe the current size
+		if (this->cooldown > 0) {
+			this->cooldown--;
+			return false;
+		}
+
+		this->sampleSum += gpuMilliseconds;
+		this->sampleCount++;
+		if (this->sampleCount < SAMPLE_FRAMES) {
+			return false;
+		}
+
+		double average = this->sampleSum / this->sampleCount;
+		this->sampleSum = 0.0;
+		this->sampleCount = 0;
+
+		bool over = average > this->targetMilliseconds;
+		bool under = average < this->targetMilliseconds * RAISE_THRESHOLD;
+		if (!over && !under) {
+			return false;
+		}
+
+		// GPU time is roughly proportional to the pixel count, i.e. to the square of the scale;
+		// aim between the two thresholds so the next decision is most likely to keep it
+		double wanted = this->targetMilliseconds * (1.0 + RAISE_THRESHOLD) / 2.0;
+		float next = this->scale * (float)std::sqrt(wanted / std::max(average, 0.001));
+		next = std::min(next, this->scale + MAX_RAISE);
+
+		// round away from the current scale, so a decision always changes something
+		float steps = next / SCALE_STEP;
+		steps = over ? std::floor(steps + 0.01f) : std::ceil(steps - 0.01f);
+		next = std::min(std::max(steps * SCALE_STEP, this->minScale), this->maxScale);
+
+		if (std::fabs(next - this->scale) < SCALE_STEP / 2.0f) {
+			return false;
+		}
+
+		this->scale = next;
+		this->cooldown = COOLDOWN_FRAMES;
+		return true;
+	}
+
+	void DynamicResolution::bind() {
+
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glViewport(0, 0, getRenderWidth(), getRenderHeight());
+	}
+
+	void DynamicResolution::upscale(gps::Shader shader, gps::ScreenTriangle& screenTriangle, float sharpness) {
+
+		shader.useShaderProgram();
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, this->colorTexture);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "sceneColor"), 0);
+		glUniform2f(glGetUniformLocation(shader.shaderProgram, "renderScale"),
+			(float)getRenderWidth() / this->width, (float)getRenderHeight() / this->height);
+		glUniform1f(glGetUniformLocation(shader.shaderProgram, "sharpness"), sharpness);
+
+		glDisable(GL_DEPTH_TEST);
+		screenTriangle.Draw(shader);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	GLuint DynamicResolution::getFramebuffer() const {
+		return this->framebuffer;
+	}
+
+	int DynamicResolution::getRenderWidth() const {
+		return std::min(this->width, std::max(1, (int)std::round(this->outputWidth * this->scale)));
+	}
+
+	int DynamicResolution::getRenderHeight() const {
+		return std::min(this->height, std::max(1, (int)std::round(this->outputHeight * this->scale)));
+	}
+
+	float DynamicResolution::getScale() const {
+		return this->scale;
+	}
+
+	float DynamicResolution::getTargetMilliseconds() const {
+		return this->targetMilliseconds;
+	}
+
+	void DynamicResolution::release() {
+
+		if (this->framebuffer == 0) {
+			return;
+		}
+
+		glDeleteFramebuffers(1, &this->framebuffer);
+		glDeleteTextures(1, &this->colorTexture);
+		glDeleteRenderbuffers(1, &this->depthBuffer);
+		releaseGpuResource(GPU_TEXTURE, this->colorTexture);
+		releaseGpuResource(GPU_RENDERBUFFER, this->depthBuffer);
+		this->framebuffer = 0;
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef DynamicResolution_hpp
+#define DynamicResolution_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Shader.hpp"
+#include "ScreenTriangle.hpp"
+
+namespace gps {
+
+    // Scene target whose resolution follows the GPU frame time. The targets are allocated once for the
+    // largest scale and the scene is drawn into the lower left width x height corner, so a scale change
+    // only moves the viewport. upscale() stretches that corner over the output with a sharpening filter.
+    //
+    // The scale reacts to the average GPU frame time of the last few frames, with hysteresis: it drops
+    // as soon as the average is over the target, rises only once it is well under, and every change is
+    // followed by a cooldown, so the resolution doesn't flicker between two steps.
+    class DynamicResolution {
+
+    public:
+        // Frames averaged for a decision, and frames after a change whose timings are ignored
+        static const int SAMPLE_FRAMES = 20;
+        static const int COOLDOWN_FRAMES = 30;
+
+        // Creates the targets for outputWidth x outputHeight at maxScale and starts at maxScale;
+        // scales are per axis. Needs a current context
+        void init(int outputWidth, int outputHeight, float minScale, float maxScale, float targetMilliseconds);
+
+        // Feeds the GPU time of one frame; returns true when the render size changed
+        bool update(double gpuMilliseconds);
+
+        // Binds the framebuffer for drawing and covers the render size with the viewport
+        void bind();
+
+        // Draws the scene over the bound framebuffer, which should cover the output size;
+        // sharpness goes from 0 (plain bilinear) to 1
+        void upscale(gps::Shader shader, gps::ScreenTriangle& screenTriangle, float sharpness);
+
+        GLuint getFramebuffer() const;
+
+        int getRenderWidth() const;
+
+        int getRenderHeight() const;
+
+        float getScale() const;
+
+        float getTargetMilliseconds() const;
+
+        // Deletes the targets - before the context goes; init() creates them again
+        void release();
+
+    private:
+        GLuint framebuffer = 0;
+        GLuint colorTexture = 0;
+        GLuint depthBuffer = 0;
+        int outputWidth = 0;
+        int outputHeight = 0;
+        // allocated size, for maxScale
+        int width = 0;
+        int height = 0;
+
+        float scale = 1.0f;
+        float minScale = 1.0f;
+        float maxScale = 1.0f;
+        float targetMilliseconds = 0.0f;
+
+        double sampleSum = 0.0;
+        int sampleCount = 0;
+        int cooldown = 0;
+    };
+}
+
+#endif /* DynamicResolution_hpp */
@@ -0,0 +1,138 @@
+#include "Framebuffer.hpp"
+
+#include "GpuMemory.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+	void Framebuffer::init(int width, int height, int samples) {
+
+		release();
+
+		this->width = width;
+		this->height = height;
+		this->samples = samples;
+
+		glGenRenderbuffers(1, &this->colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->colorBuffer);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_SRGB8_ALPHA8, width, height);
+
+		glGenRenderbuffers(1, &this->depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		trackGpuRenderbuffer(this->colorBuffer, "Framebuffer", "color");
+		trackGpuRenderbuffer(this->depthBuffer, "Framebuffer", "depth");
+
+		glGenFramebuffers(1, &this->framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "ERROR: offscreen framebuffer is incomplete\n");
+		}
+
+		if (samples > 0) {
+
+			glGenRenderbuffers(1, &this->resolveBuffer);
+			glBindRenderbuffer(GL_RENDERBUFFER, this->resolveBuffer);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, width, height);
+			glBindRenderbuffer(GL_RENDERBUFFER, 0);
+			trackGpuRenderbuffer(this->resolveBuffer, "Framebuffer", "resolved color");
+
+			glGenFramebuffers(1, &this->resolveFramebuffer);
+			glBindFramebuffer(GL_FRAMEBUFFER, this->resolveFramebuffer);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->resolveBuffer);
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void Framebuffer::bind() {
+
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glViewport(0, 0, this->width, this->height);
+	}
+
+	void Framebuffer::readPixels(std::vector<unsigned char>& pixels) {
+
+		size_t rowSize = (size_t)this->width * 3;
+		pixels.resize(rowSize * this->height);
+
+		GLuint source = this->framebuffer;
+		if (this->samples > 0) {
+
+			// multisampled buffers can't be read directly
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffer);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->resolveFramebuffer);
+			glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			source = this->resolveFramebuffer;
+		}
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, this->width, this->height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+		// GL returns the bottom row first
+		std::vector<unsigned char> row(rowSize);
+		for (int y = 0; y < this->height / 2; y++) {
+
+			unsigned char* top = pixels.data() + y * rowSize;
+			unsigned char* bottom = pixels.data() + (this->height - 1 - y) * rowSize;
+			memcpy(row.data(), top, rowSize);
+			memcpy(top, bottom, rowSize);
+			memcpy(bottom, row.data(), rowSize);
+		}
+	}
+
+	bool Framebuffer::writePPM(FILE* file) {
+
+		std::vector<unsigned char> pixels;
+		readPixels(pixels);
+
+		fprintf(file, "P6\n%d %d\n255\n", this->width, this->height);
+		size_t written = fwrite(pixels.data(), 1, pixels.size(), file);
+		fflush(file);
+
+		return written == pixels.size() && !ferror(file);
+	}
+
+	GLuint Framebuffer::getFramebuffer() const {
+		return this->framebuffer;
+	}
+
+	int Framebuffer::getWidth() const {
+		return this->width;
+	}
+
+	int Framebuffer::getHeight() const {
+		return this->height;
+	}
+
+	void Framebuffer::release() {
+
+		if (this->framebuffer == 0) {
+			return;
+		}
+
+		glDeleteFramebuffers(1, &this->framebuffer);
+		glDeleteRenderbuffers(1, &this->colorBuffer);
+		glDeleteRenderbuffers(1, &this->depthBuffer);
+		releaseGpuResource(GPU_RENDERBUFFER, this->colorBuffer);
+		releaseGpuResource(GPU_RENDERBUFFER, this->depthBuffer);
+		if (this->resolveFramebuffer != 0) {
+			glDeleteFramebuffers(1, &this->resolveFramebuffer);
+			glDeleteRenderbuffers(1, &this->resolveBuffer);
+			releaseGpuResource(GPU_RENDERBUFFER, this->resolveBuffer);
+			this->resolveFramebuffer = 0;
+		}
+		this->framebuffer = 0;
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef Framebuffer_hpp
+#define Framebuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstdio>
+#include <vector>
+
+namespace gps {
+
+    // Offscreen color + depth target the scene can be rendered into instead of the window.
+    // Color is SRGB8_ALPHA8, so with GL_FRAMEBUFFER_SRGB on it holds display-ready values.
+    // A multisampled target is resolved into a single-sampled copy before it is read back.
+    class Framebuffer {
+
+    public:
+        // Creates (or recreates, on resize) the target - needs a current context; samples > 0 multisamples it
+        void init(int width, int height, int samples = 0);
+
+        // Binds the framebuffer for drawing and covers it with the viewport
+        void bind();
+
+        // Tightly packed RGB rows, top row first
+        void readPixels(std::vector<unsigned char>& pixels);
+
+        // Writes the color target as a binary PPM (P6); false on I/O errors
+        bool writePPM(FILE* file);
+
+        GLuint getFramebuffer() const;
+
+        int getWidth() const;
+
+        int getHeight() const;
+
+        // Deletes the target - before the context goes; init() creates it again
+        void release();
+
+    private:
+        GLuint framebuffer = 0;
+        GLuint colorBuffer = 0;
+        GLuint depthBuffer = 0;
+        // single-sampled copy of a multisampled color buffer, for readPixels
+        GLuint resolveFramebuffer = 0;
+        GLuint resolveBuffer = 0;
+        int width = 0;
+        int height = 0;
+        int samples = 0;
+    };
+}
+
+#endif /* Framebuffer_hpp */
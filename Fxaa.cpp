@@ -0,0 +1,73 @@
+#include "Fxaa.hpp"
+
+#include "GpuMemory.hpp"
+
+#include <cstdio>
+
+namespace gps {
+
+	void Fxaa::init(int width, int height) {
+
+		release();
+
+		// the pass samples between texels to blend across edges
+		glGenTextures(1, &this->colorTexture);
+		glBindTexture(GL_TEXTURE_2D, this->colorTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenRenderbuffers(1, &this->depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		trackGpuTexture(GL_TEXTURE_2D, this->colorTexture, "Fxaa", "input color");
+		trackGpuRenderbuffer(this->depthBuffer, "Fxaa", "input depth");
+
+		glGenFramebuffers(1, &this->framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->colorTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "ERROR: FXAA framebuffer is incomplete\n");
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void Fxaa::apply(gps::Shader shader, gps::ScreenTriangle& screenTriangle) {
+
+		shader.useShaderProgram();
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, this->colorTexture);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "sceneColor"), 0);
+
+		glDisable(GL_DEPTH_TEST);
+		screenTriangle.Draw(shader);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	GLuint Fxaa::getFramebuffer() const {
+		return this->framebuffer;
+	}
+
+	void Fxaa::release() {
+
+		if (this->framebuffer == 0) {
+			return;
+		}
+
+		glDeleteFramebuffers(1, &this->framebuffer);
+		glDeleteTextures(1, &this->colorTexture);
+		glDeleteRenderbuffers(1, &this->depthBuffer);
+		releaseGpuResource(GPU_TEXTURE, this->colorTexture);
+		releaseGpuResource(GPU_RENDERBUFFER, this->depthBuffer);
+		this->framebuffer = 0;
+	}
+}
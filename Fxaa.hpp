@@ -0,0 +1,42 @@
+#ifndef Fxaa_hpp
+#define Fxaa_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Shader.hpp"
+#include "ScreenTriangle.hpp"
+
+namespace gps {
+
+    // Post-process anti-aliasing (FXAA): the frame is drawn single-sampled into this target, then
+    // apply() finds the edges from the luma contrast of each pixel's neighbours and blends across
+    // them (shaders/fxaa.frag). One extra read of the finished image replaces the multiplied color
+    // and depth traffic MSAA pays over the whole frame.
+    class Fxaa {
+
+    public:
+        // Creates (or recreates, on resize) the target - needs a current context
+        void init(int width, int height);
+
+        // Draws the smoothed image over the bound framebuffer, which should be the same size
+        void apply(gps::Shader shader, gps::ScreenTriangle& screenTriangle);
+
+        GLuint getFramebuffer() const;
+
+        // Deletes the target - before the context goes; init() creates it again
+        void release();
+
+    private:
+        GLuint framebuffer = 0;
+        GLuint colorTexture = 0;
+        GLuint depthBuffer = 0;
+    };
+}
+
+#endif /* Fxaa_hpp */
@@ -0,0 +1,111 @@
+#include "GBuffer.hpp"
+
+#include "GpuMemory.hpp"
+
+#include <cstdio>
+
+namespace gps {
+
+	static GLuint createTarget(int width, int height, GLint internalFormat, GLenum format, GLenum type) {
+
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+		// the lighting pass reads one texel per pixel
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		return texture;
+	}
+
+	void GBuffer::init(int width, int height) {
+
+		release();
+
+		this->width = width;
+		this->height = height;
+
+		this->albedoTexture = createTarget(width, height, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE);
+		this->normalTexture = createTarget(width, height, GL_RG16F, GL_RG, GL_FLOAT);
+		this->specularTexture = createTarget(width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+		this->depthTexture = createTarget(width, height, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		trackGpuTexture(GL_TEXTURE_2D, this->albedoTexture, "GBuffer", "albedo");
+		trackGpuTexture(GL_TEXTURE_2D, this->normalTexture, "GBuffer", "normal");
+		trackGpuTexture(GL_TEXTURE_2D, this->specularTexture, "GBuffer", "specular");
+		trackGpuTexture(GL_TEXTURE_2D, this->depthTexture, "GBuffer", "depth");
+
+		glGenFramebuffers(1, &this->framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->albedoTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, this->normalTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, this->specularTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depthTexture, 0);
+
+		GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+		glDrawBuffers(3, drawBuffers);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "ERROR: G-buffer framebuffer is incomplete\n");
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void GBuffer::bindForGeometry() {
+
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glViewport(0, 0, this->width, this->height);
+	}
+
+	void GBuffer::bindTextures(gps::Shader shader, GLuint firstUnit) {
+
+		shader.useShaderProgram();
+
+		const char* names[] = { "gAlbedo", "gNormal", "gSpecular", "gDepth" };
+		GLuint textures[] = { this->albedoTexture, this->normalTexture, this->specularTexture, this->depthTexture };
+
+		for (GLuint i = 0; i < 4; i++) {
+
+			glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			glUniform1i(glGetUniformLocation(shader.shaderProgram, names[i]), firstUnit + i);
+		}
+
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	GLuint GBuffer::getFramebuffer() const {
+		return this->framebuffer;
+	}
+
+	int GBuffer::getWidth() const {
+		return this->width;
+	}
+
+	int GBuffer::getHeight() const {
+		return this->height;
+	}
+
+	void GBuffer::release() {
+
+		if (this->framebuffer == 0) {
+			return;
+		}
+
+		glDeleteFramebuffers(1, &this->framebuffer);
+		glDeleteTextures(1, &this->albedoTexture);
+		glDeleteTextures(1, &this->normalTexture);
+		glDeleteTextures(1, &this->specularTexture);
+		glDeleteTextures(1, &this->depthTexture);
+		releaseGpuResource(GPU_TEXTURE, this->albedoTexture);
+		releaseGpuResource(GPU_TEXTURE, this->normalTexture);
+		releaseGpuResource(GPU_TEXTURE, this->specularTexture);
+		releaseGpuResource(GPU_TEXTURE, this->depthTexture);
+		this->framebuffer = 0;
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef GBuffer_hpp
+#define GBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Shader.hpp"
+
+namespace gps {
+
+    // Render targets of the deferred path, written by shaders/gBuffer.frag:
+    //   albedo   - SRGB8_ALPHA8, diffuse texture color, baked ambient occlusion in alpha
+    //   normal   - RG16F, eye space normal in octahedral encoding
+    //   specular - RGBA8, specular texture color
+    //   depth    - DEPTH_COMPONENT24, eye space position is rebuilt from it
+    class GBuffer {
+
+    public:
+        // Creates (or recreates, on resize) the targets - needs a current context
+        void init(int width, int height);
+
+        // Binds the framebuffer for the geometry pass
+        void bindForGeometry();
+
+        // Binds the targets to firstUnit..firstUnit+3 for the lighting pass
+        void bindTextures(gps::Shader shader, GLuint firstUnit);
+
+        GLuint getFramebuffer() const;
+
+        int getWidth() const;
+
+        int getHeight() const;
+
+        // Deletes the targets - before the context goes; init() creates them again
+        void release();
+
+    private:
+        GLuint framebuffer = 0;
+        GLuint albedoTexture = 0;
+        GLuint normalTexture = 0;
+        GLuint specularTexture = 0;
+        GLuint depthTexture = 0;
+        int width = 0;
+        int height = 0;
+    };
+}
+
+#endif /* GBuffer_hpp */
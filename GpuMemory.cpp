@@ -0,0 +1,307 @@
+#include "GpuMemory.hpp"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+	namespace {
+
+		struct GpuAllocation {
+
+			GPU_RESOURCE type = GPU_BUFFER;
+			GLuint name = 0;
+			int64_t bytes = 0;
+			// internal format; 0 for buffers
+			GLenum format = 0;
+			std::string owner;
+			std::string label;
+		};
+
+		struct GpuMemoryState {
+
+			// keyed by type and object name, see allocationKey
+			std::unordered_map<uint64_t, GpuAllocation> allocations;
+			int64_t totals[GPU_RESOURCE_COUNT] = {};
+			int64_t budget = 0;
+			bool overBudget = false;
+		};
+
+		// Never destroyed: modules release their objects from destructors that may run after any other static
+		GpuMemoryState& state() {
+
+			static GpuMemoryState* instance = new GpuMemoryState();
+			return *instance;
+		}
+
+		const char* TYPE_NAMES[GPU_RESOURCE_COUNT] = { "buffer", "texture", "renderbuffer" };
+
+		const double MEGABYTE = 1024.0 * 1024.0;
+
+		uint64_t allocationKey(GPU_RESOURCE type, GLuint name) {
+			return ((uint64_t)type << 32) | name;
+		}
+
+		const char* formatName(GLenum format, char* fallback, size_t fallbackSize) {
+
+			switch (format) {
+			case 0:                         return "-";
+			case GL_RGB:                    return "RGB";
+			case GL_RGBA:                   return "RGBA";
+			case GL_R8:                     return "R8";
+			case GL_RGB8:                   return "RGB8";
+			case GL_RGBA8:                  return "RGBA8";
+			case GL_SRGB8:                  return "SRGB8";
+			case GL_SRGB8_ALPHA8:           return "SRGB8_ALPHA8";
+			case GL_R16F:                   return "R16F";
+			case GL_RG16F:                  return "RG16F";
+			case GL_RGB16F:                 return "RGB16F";
+			case GL_RGBA16F:                return "RGBA16F";
+			case GL_R11F_G11F_B10F:         return "R11F_G11F_B10F";
+			case GL_RGBA32F:                return "RGBA32F";
+			case GL_R32UI:                  return "R32UI";
+			case GL_RG32UI:                 return "RG32UI";
+			case GL_DEPTH_COMPONENT:        return "DEPTH_COMPONENT";
+			case GL_DEPTH_COMPONENT16:      return "DEPTH_COMPONENT16";
+			case GL_DEPTH_COMPONENT24:      return "DEPTH_COMPONENT24";
+			case GL_DEPTH_COMPONENT32F:     return "DEPTH_COMPONENT32F";
+			case GL_DEPTH24_STENCIL8:       return "DEPTH24_STENCIL8";
+			}
+
+			snprintf(fallback, fallbackSize, "0x%04x", format);
+			return fallback;
+		}
+
+		// Drivers pad 3 byte texels (RGB8, DEPTH24) to 4
+		int64_t paddedTexelBytes(int64_t bits) {
+
+			int64_t bytes = (bits + 7) / 8;
+			int64_t padded = 1;
+			while (padded < bytes) {
+				padded *= 2;
+			}
+			return padded;
+		}
+
+		void labelObject(GPU_RESOURCE type, GLuint name, const std::string& owner, const std::string& label) {
+
+#if !defined (__APPLE__)
+			if (!GLEW_KHR_debug && !GLEW_VERSION_4_3) {
+				return;
+			}
+
+			const GLenum identifiers[GPU_RESOURCE_COUNT] = { GL_BUFFER, GL_TEXTURE, GL_RENDERBUFFER };
+			std::string objectLabel = owner + " " + label;
+			glObjectLabel(identifiers[type], name, -1, objectLabel.c_str());
+#endif
+		}
+
+		void track(GPU_RESOURCE type, GLuint name, int64_t bytes, GLenum format, const std::string& owner, const std::string& label) {
+
+			GpuMemoryState& memory = state();
+
+			GpuAllocation& allocation = memory.allocations[allocationKey(type, name)];
+			bool relabel = allocation.owner != owner || allocation.label != label;
+			memory.totals[type] += bytes - allocation.bytes;
+
+			allocation.type = type;
+			allocation.name = name;
+			allocation.bytes = bytes;
+			allocation.format = format;
+			if (relabel) {
+				allocation.owner = owner;
+				allocation.label = label;
+				labelObject(type, name, owner, label);
+			}
+
+			int64_t total = getGpuMemoryTotal();
+			if (memory.budget > 0 && total > memory.budget && !memory.overBudget) {
+				fprintf(stderr, "WARNING: GPU memory at %.1f MB is over the %.1f MB budget, after %s %s (%.1f MB)\n",
+					total / MEGABYTE, memory.budget / MEGABYTE, owner.c_str(), label.c_str(), bytes / MEGABYTE);
+			}
+			memory.overBudget = memory.budget > 0 && total > memory.budget;
+		}
+	}
+
+	void trackGpuBuffer(GLuint buffer, int64_t bytes, const std::string& owner, const std::string& label) {
+
+		track(GPU_BUFFER, buffer, bytes, 0, owner, label);
+	}
+
+	void trackGpuTexture(GLenum target, GLuint texture, const std::string& owner, const std::string& label) {
+
+		GLenum binding = GL_TEXTURE_BINDING_2D;
+		switch (target) {
+		case GL_TEXTURE_CUBE_MAP:           binding = GL_TEXTURE_BINDING_CUBE_MAP; break;
+		case GL_TEXTURE_2D_ARRAY:           binding = GL_TEXTURE_BINDING_2D_ARRAY; break;
+		case GL_TEXTURE_3D:                 binding = GL_TEXTURE_BINDING_3D; break;
+		case GL_TEXTURE_2D_MULTISAMPLE:     binding = GL_TEXTURE_BINDING_2D_MULTISAMPLE; break;
+		}
+
+		GLint previous = 0;
+		glGetIntegerv(binding, &previous);
+		glBindTexture(target, texture);
+
+		// a cube map is six faces of the same size
+		GLenum levelTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+		int64_t faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+
+		GLint format = 0;
+		glGetTexLevelParameteriv(levelTarget, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+
+		int64_t bytes = 0;
+		for (GLint level = 0; level < 32; level++) {
+
+			GLint width = 0, height = 0, depth = 0;
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_WIDTH, &width);
+			if (width == 0) {
+				break;
+			}
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_HEIGHT, &height);
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_DEPTH, &depth);
+
+			GLint compressed = GL_FALSE;
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED, &compressed);
+			if (compressed) {
+
+				GLint compressedSize = 0;
+				glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressedSize);
+				bytes += compressedSize * faces;
+				continue;
+			}
+
+			const GLenum componentSizes[] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE,
+				GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE, GL_TEXTURE_SHARED_SIZE };
+			int64_t bits = 0;
+			for (GLenum component : componentSizes) {
+				GLint size = 0;
+				glGetTexLevelParameteriv(levelTarget, level, component, &size);
+				bits += size;
+			}
+
+			GLint samples = 0;
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_SAMPLES, &samples);
+
+			bytes += (int64_t)width * std::max(height, 1) * std::max(depth, 1) * std::max(samples, 1) * paddedTexelBytes(bits) * faces;
+		}
+
+		glBindTexture(target, previous);
+
+		track(GPU_TEXTURE, texture, bytes, format, owner, label);
+	}
+
+	void trackGpuRenderbuffer(GLuint renderbuffer, const std::string& owner, const std::string& label) {
+
+		GLint previous = 0;
+		glGetIntegerv(GL_RENDERBUFFER_BINDING, &previous);
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+
+		GLint width = 0, height = 0, samples = 0, format = 0;
+		glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &width);
+		glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_HEIGHT, &height);
+		glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_SAMPLES, &samples);
+		glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_INTERNAL_FORMAT, &format);
+
+		const GLenum componentSizes[] = { GL_RENDERBUFFER_RED_SIZE, GL_RENDERBUFFER_GREEN_SIZE, GL_RENDERBUFFER_BLUE_SIZE,
+			GL_RENDERBUFFER_ALPHA_SIZE, GL_RENDERBUFFER_DEPTH_SIZE, GL_RENDERBUFFER_STENCIL_SIZE };
+		int64_t bits = 0;
+		for (GLenum component : componentSizes) {
+			GLint size = 0;
+			glGetRenderbufferParameteriv(GL_RENDERBUFFER, component, &size);
+			bits += size;
+		}
+
+		glBindRenderbuffer(GL_RENDERBUFFER, previous);
+
+		int64_t bytes = (int64_t)width * height * std::max(samples, 1) * paddedTexelBytes(bits);
+		track(GPU_RENDERBUFFER, renderbuffer, bytes, format, owner, label);
+	}
+
+	void releaseGpuResource(GPU_RESOURCE type, GLuint name) {
+
+		GpuMemoryState& memory = state();
+
+		auto allocation = memory.allocations.find(allocationKey(type, name));
+		if (allocation == memory.allocations.end()) {
+			return;
+		}
+
+		memory.totals[type] -= allocation->second.bytes;
+		memory.allocations.erase(allocation);
+		memory.overBudget = memory.budget > 0 && getGpuMemoryTotal() > memory.budget;
+	}
+
+	void setGpuMemoryBudget(int64_t bytes) {
+
+		state().budget = bytes;
+	}
+
+	int64_t getGpuMemoryBudget() {
+		return state().budget;
+	}
+
+	int64_t getGpuMemoryTotal() {
+
+		int64_t total = 0;
+		for (int type = 0; type < GPU_RESOURCE_COUNT; type++) {
+			total += state().totals[type];
+		}
+		return total;
+	}
+
+	int64_t getGpuMemoryTotal(GPU_RESOURCE type) {
+		return state().totals[type];
+	}
+
+	void writeGpuMemoryReport(FILE* file) {
+
+		GpuMemoryState& memory = state();
+
+		std::vector<const GpuAllocation*> allocations;
+		std::map<std::string, int64_t> owners;
+		int counts[GPU_RESOURCE_COUNT] = {};
+		for (const auto& entry : memory.allocations) {
+			allocations.push_back(&entry.second);
+			owners[entry.second.owner] += entry.second.bytes;
+			counts[entry.second.type]++;
+		}
+
+		std::sort(allocations.begin(), allocations.end(), [](const GpuAllocation* a, const GpuAllocation* b) {
+			return a->bytes > b->bytes;
+		});
+
+		fprintf(file, "GPU memory: %.2f MB", getGpuMemoryTotal() / MEGABYTE);
+		if (memory.budget > 0) {
+			fprintf(file, " of a %.2f MB budget%s", memory.budget / MEGABYTE, memory.overBudget ? " - OVER BUDGET" : "");
+		}
+		fprintf(file, "\n");
+
+		for (int type = 0; type < GPU_RESOURCE_COUNT; type++) {
+			fprintf(file, "  %-14s %10.2f MB  %d objects\n", TYPE_NAMES[type], memory.totals[type] / MEGABYTE, counts[type]);
+		}
+
+		// owners from the largest down
+		std::vector<std::pair<int64_t, std::string>> ownerTotals;
+		for (const auto& owner : owners) {
+			ownerTotals.push_back(std::make_pair(owner.second, owner.first));
+		}
+		std::sort(ownerTotals.rbegin(), ownerTotals.rend());
+
+		fprintf(file, "by owner:\n");
+		for (const auto& owner : ownerTotals) {
+			fprintf(file, "  %10.2f MB  %s\n", owner.first / MEGABYTE, owner.second.c_str());
+		}
+
+		fprintf(file, "allocations:\n");
+		for (const GpuAllocation* allocation : allocations) {
+
+			char fallback[16];
+			fprintf(file, "  %10.2f MB  %-12s %-18s %s: %s\n", allocation->bytes / MEGABYTE, TYPE_NAMES[allocation->type],
+				formatName(allocation->format, fallback, sizeof(fallback)), allocation->owner.c_str(), allocation->label.c_str());
+		}
+
+		fflush(file);
+	}
+}
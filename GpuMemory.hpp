@@ -0,0 +1,48 @@
+#ifndef GpuMemory_hpp
+#define GpuMemory_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Accounting of the video memory held by buffers, textures and renderbuffers. Every allocation is
+// recorded with its size, format, owner (the module or asset that holds it) and a label; with KHR_debug
+// the label is also attached to the GL object, so captures show the same names.
+namespace gps {
+
+    enum GPU_RESOURCE {GPU_BUFFER, GPU_TEXTURE, GPU_RENDERBUFFER, GPU_RESOURCE_COUNT};
+
+    // Records the storage of a buffer; tracking an object again (after glBufferData) replaces its record
+    void trackGpuBuffer(GLuint buffer, int64_t bytes, const std::string& owner, const std::string& label);
+
+    // Records a texture with its storage defined; size and format are read back from the driver, over
+    // every mip level (and cube face). target is the bind target, e.g. GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+    void trackGpuTexture(GLenum target, GLuint texture, const std::string& owner, const std::string& label);
+
+    void trackGpuRenderbuffer(GLuint renderbuffer, const std::string& owner, const std::string& label);
+
+    // Drops the record of an object, before or after it is deleted
+    void releaseGpuResource(GPU_RESOURCE type, GLuint name);
+
+    // A warning is printed whenever the total grows past the budget; 0 disables it
+    void setGpuMemoryBudget(int64_t bytes);
+
+    int64_t getGpuMemoryBudget();
+
+    int64_t getGpuMemoryTotal();
+
+    int64_t getGpuMemoryTotal(GPU_RESOURCE type);
+
+    // Totals per category and owner, then every allocation from the largest down
+    void writeGpuMemoryReport(FILE* file);
+}
+
+#endif /* GpuMemory_hpp */
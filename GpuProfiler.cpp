@@ -0,0 +1,234 @@
+#include "GpuProfiler.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+	static const char* FRAME_PASS_NAME = "frame";
+
+	void GpuProfiler::init() {
+
+		release();
+
+		this->initialized = true;
+#if defined (__APPLE__)
+		// macOS stops at OpenGL 4.1, which has no debug groups
+		this->debugGroups = false;
+#else
+		this->debugGroups = GLEW_KHR_debug || GLEW_VERSION_4_3;
+#endif
+
+		this->passes.clear();
+		findPass(FRAME_PASS_NAME);
+	}
+
+	void GpuProfiler::beginFrame() {
+
+		if (!this->initialized) {
+			return;
+		}
+
+		this->resolvedTimings.clear();
+
+		// FRAME_LATENCY frames have passed since this slot was filled, so its results should be in
+		PendingFrame& pending = this->pendingFrames[this->frame % FRAME_LATENCY];
+		resolveFrame(pending, false);
+		pending.frame = this->frame;
+
+		beginPass(FRAME_PASS_NAME);
+	}
+
+	void GpuProfiler::endFrame() {
+
+		if (!this->initialized) {
+			return;
+		}
+
+		endPass();
+		this->frame++;
+	}
+
+	void GpuProfiler::beginPass(const char* name) {
+
+		if (!this->initialized) {
+			return;
+		}
+
+#if !defined (__APPLE__)
+		if (this->debugGroups) {
+			glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+		}
+#endif
+
+		OpenPass open;
+		open.pass = findPass(name);
+		open.beginQuery = timestamp();
+		this->openPasses.push_back(open);
+	}
+
+	void GpuProfiler::endPass() {
+
+		if (!this->initialized || this->openPasses.empty()) {
+			return;
+		}
+
+		OpenPass open = this->openPasses.back();
+		this->openPasses.pop_back();
+
+		PendingPass pending;
+		pending.pass = open.pass;
+		pending.beginQuery = open.beginQuery;
+		pending.endQuery = timestamp();
+		this->pendingFrames[this->frame % FRAME_LATENCY].passes.push_back(pending);
+
+#if !defined (__APPLE__)
+		if (this->debugGroups) {
+			glPopDebugGroup();
+		}
+#endif
+	}
+
+	const std::vector<GpuPassTiming>& GpuProfiler::getResolvedTimings() const {
+		return this->resolvedTimings;
+	}
+
+	std::vector<GpuPassStats> GpuProfiler::getStats() const {
+
+		std::vector<GpuPassStats> stats;
+
+		for (size_t i = 0; i < this->passes.size(); i++) {
+
+			const PassHistory& history = this->passes[i];
+			if (history.samples.empty()) {
+				continue;
+			}
+
+			GpuPassStats pass;
+			pass.name = history.name;
+			pass.last = history.last;
+			pass.minimum = history.samples[0];
+			pass.maximum = history.samples[0];
+
+			double total = 0.0;
+			for (size_t j = 0; j < history.samples.size(); j++) {
+				total += history.samples[j];
+				pass.minimum = std::min(pass.minimum, history.samples[j]);
+				pass.maximum = std::max(pass.maximum, history.samples[j]);
+			}
+			pass.average = total / history.samples.size();
+
+			stats.push_back(pass);
+		}
+
+		return stats;
+	}
+
+	void GpuProfiler::flush() {
+
+		this->resolvedTimings.clear();
+
+		// oldest frame first
+		for (int i = 0; i < FRAME_LATENCY; i++) {
+			resolveFrame(this->pendingFrames[(this->frame + i) % FRAME_LATENCY], true);
+		}
+	}
+
+	uint64_t GpuProfiler::getFrame() const {
+		return this->frame;
+	}
+
+	size_t GpuProfiler::findPass(const char* name) {
+
+		for (size_t i = 0; i < this->passes.size(); i++) {
+			if (this->passes[i].name == name) {
+				return i;
+			}
+		}
+
+		PassHistory history;
+		history.name = name;
+		this->passes.push_back(history);
+
+		return this->passes.size() - 1;
+	}
+
+	GLuint GpuProfiler::timestamp() {
+
+		GLuint query;
+		if (this->freeQueries.empty()) {
+			glGenQueries(1, &query);
+		}
+		else {
+			query = this->freeQueries.back();
+			this->freeQueries.pop_back();
+		}
+
+		glQueryCounter(query, GL_TIMESTAMP);
+		return query;
+	}
+
+	void GpuProfiler::resolveFrame(PendingFrame& pending, bool wait) {
+
+		for (size_t i = 0; i < pending.passes.size(); i++) {
+
+			PendingPass& pass = pending.passes[i];
+
+			// a result that is still not there is dropped rather than waited for
+			GLint available = GL_TRUE;
+			if (!wait) {
+				glGetQueryObjectiv(pass.endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+			}
+
+			if (available) {
+
+				GLuint64 begin = 0, end = 0;
+				glGetQueryObjectui64v(pass.beginQuery, GL_QUERY_RESULT, &begin);
+				glGetQueryObjectui64v(pass.endQuery, GL_QUERY_RESULT, &end);
+				double milliseconds = (end - begin) * 1e-6;
+
+				PassHistory& history = this->passes[pass.pass];
+				if (history.samples.size() < (size_t)ROLLING_FRAMES) {
+					history.samples.push_back(milliseconds);
+				}
+				else {
+					history.samples[history.next] = milliseconds;
+				}
+				history.next = (history.next + 1) % ROLLING_FRAMES;
+				history.last = milliseconds;
+
+				GpuPassTiming timing;
+				timing.name = history.name;
+				timing.frame = pending.frame;
+				timing.milliseconds = milliseconds;
+				this->resolvedTimings.push_back(timing);
+			}
+
+			this->freeQueries.push_back(pass.beginQuery);
+			this->freeQueries.push_back(pass.endQuery);
+		}
+
+		pending.passes.clear();
+	}
+
+	void GpuProfiler::release() {
+
+		for (int i = 0; i < FRAME_LATENCY; i++) {
+			for (size_t j = 0; j < this->pendingFrames[i].passes.size(); j++) {
+				this->freeQueries.push_back(this->pendingFrames[i].passes[j].beginQuery);
+				this->freeQueries.push_back(this->pendingFrames[i].passes[j].endQuery);
+			}
+			this->pendingFrames[i].passes.clear();
+		}
+		for (size_t i = 0; i < this->openPasses.size(); i++) {
+			this->freeQueries.push_back(this->openPasses[i].beginQuery);
+		}
+		this->openPasses.clear();
+
+		if (!this->freeQueries.empty()) {
+			glDeleteQueries((GLsizei)this->freeQueries.size(), this->freeQueries.data());
+			this->freeQueries.clear();
+		}
+
+		this->initialized = false;
+	}
+}
@@ -0,0 +1,119 @@
+#ifndef GpuProfiler_hpp
+#define GpuProfiler_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // One pass of one frame, as measured on the GPU
+    struct GpuPassTiming {
+
+        const char* name;
+        // number of the frame, counted by beginFrame() from 0
+        uint64_t frame;
+        double milliseconds;
+    };
+
+    // Rolling statistics of a pass over the last ROLLING_FRAMES measured frames
+    struct GpuPassStats {
+
+        const char* name;
+        double last;
+        double average;
+        double minimum;
+        double maximum;
+    };
+
+    // GPU time of each render pass. Every pass is bracketed by a pair of GL_TIMESTAMP queries taken
+    // from a ring FRAME_LATENCY frames deep, so a frame's results are only read back FRAME_LATENCY
+    // frames later, when they are ready - the CPU never waits on the GPU. Passes may nest.
+    // With KHR_debug available, each pass is also a debug group of the same name, so captures in
+    // external tools (RenderDoc, Nsight, apitrace) show the same structure.
+    class GpuProfiler {
+
+    public:
+        static const int FRAME_LATENCY = 4;
+        static const int ROLLING_FRAMES = 120;
+
+        // Needs a current context; queries the timer and debug group support
+        void init();
+
+        // The whole frame is measured as a pass named "frame"
+        void beginFrame();
+        void endFrame();
+
+        // name must outlive the profiler (a string literal); passes are matched by address
+        void beginPass(const char* name);
+        void endPass();
+
+        // Timings read back by the last beginFrame() (or flush()), oldest frame first
+        const std::vector<GpuPassTiming>& getResolvedTimings() const;
+
+        // Per pass that has samples yet, in the order the passes were first seen; look passes up by name,
+        // "frame" included
+        std::vector<GpuPassStats> getStats() const;
+
+        // Waits for every outstanding query; only for the end of a run, it stalls
+        void flush();
+
+        // Number of the next frame beginFrame() starts
+        uint64_t getFrame() const;
+
+        // Deletes every query, pending or free - before the context goes
+        void release();
+
+    private:
+        struct PendingPass {
+
+            size_t pass;
+            GLuint beginQuery;
+            GLuint endQuery;
+        };
+
+        struct PendingFrame {
+
+            uint64_t frame = 0;
+            std::vector<PendingPass> passes;
+        };
+
+        struct OpenPass {
+
+            size_t pass;
+            GLuint beginQuery;
+        };
+
+        struct PassHistory {
+
+            const char* name;
+            // ring of the last ROLLING_FRAMES samples
+            std::vector<double> samples;
+            size_t next = 0;
+            double last = 0.0;
+        };
+
+        bool initialized = false;
+        bool debugGroups = false;
+        uint64_t frame = 0;
+
+        std::vector<PassHistory> passes;
+        std::vector<OpenPass> openPasses;
+        PendingFrame pendingFrames[FRAME_LATENCY];
+        std::vector<GLuint> freeQueries;
+        std::vector<GpuPassTiming> resolvedTimings;
+
+        size_t findPass(const char* name);
+        GLuint timestamp();
+        void resolveFrame(PendingFrame& pending, bool wait);
+    };
+}
+
+#endif /* GpuProfiler_hpp */
@@ -0,0 +1,147 @@
+#include "HeadlessContext.hpp"
+
+#include <cstdio>
+
+#if defined (GPS_HEADLESS_EGL)
+    #include <EGL/eglext.h>
+
+    #ifndef EGL_PLATFORM_SURFACELESS_MESA
+        #define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+    #endif
+#endif
+
+namespace gps {
+
+#if defined (GPS_HEADLESS_EGL)
+
+	bool HeadlessContext::create() {
+
+		// the surfaceless platform needs neither a display server nor a GPU
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay != NULL) {
+			this->display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		}
+		if (this->display == EGL_NO_DISPLAY) {
+			this->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		}
+
+		EGLint major, minor;
+		if (this->display == EGL_NO_DISPLAY || !eglInitialize(this->display, &major, &minor)) {
+			fprintf(stderr, "ERROR: could not initialize an EGL display\n");
+			return false;
+		}
+
+		if (!eglBindAPI(EGL_OPENGL_API)) {
+			fprintf(stderr, "ERROR: EGL display does not support desktop OpenGL\n");
+			destroy();
+			return false;
+		}
+
+		const EGLint configAttributes[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint configCount = 0;
+		if (!eglChooseConfig(this->display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+			fprintf(stderr, "ERROR: no EGL config supports desktop OpenGL\n");
+			destroy();
+			return false;
+		}
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 4,
+			EGL_CONTEXT_MINOR_VERSION, 1,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		this->context = eglCreateContext(this->display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (this->context == EGL_NO_CONTEXT) {
+			fprintf(stderr, "ERROR: could not create an OpenGL 4.1 core context with EGL\n");
+			destroy();
+			return false;
+		}
+
+		// no surface at all (EGL_KHR_surfaceless_context)
+		if (!eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, this->context)) {
+			fprintf(stderr, "ERROR: could not make the EGL context current\n");
+			destroy();
+			return false;
+		}
+
+		return true;
+	}
+
+	void HeadlessContext::destroy() {
+
+		if (this->display == EGL_NO_DISPLAY) {
+			return;
+		}
+
+		eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (this->context != EGL_NO_CONTEXT) {
+			eglDestroyContext(this->display, this->context);
+			this->context = EGL_NO_CONTEXT;
+		}
+		eglTerminate(this->display);
+		this->display = EGL_NO_DISPLAY;
+	}
+
+#elif defined (GPS_HEADLESS_OSMESA)
+
+	bool HeadlessContext::create() {
+
+		const int contextAttributes[] = {
+			OSMESA_FORMAT, OSMESA_RGBA,
+			OSMESA_DEPTH_BITS, 24,
+			OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+			OSMESA_CONTEXT_MAJOR_VERSION, 4,
+			OSMESA_CONTEXT_MINOR_VERSION, 1,
+			0
+		};
+		this->context = OSMesaCreateContextAttribs(contextAttributes, NULL);
+		if (this->context == NULL) {
+			fprintf(stderr, "ERROR: could not create an OpenGL 4.1 core context with OSMesa\n");
+			return false;
+		}
+
+		// the scene goes to an offscreen framebuffer, so the context's own buffer can be a single pixel
+		if (!OSMesaMakeCurrent(this->context, this->colorBuffer, GL_UNSIGNED_BYTE, 1, 1)) {
+			fprintf(stderr, "ERROR: could not make the OSMesa context current\n");
+			destroy();
+			return false;
+		}
+
+		return true;
+	}
+
+	void HeadlessContext::destroy() {
+
+		if (this->context == NULL) {
+			return;
+		}
+
+		OSMesaDestroyContext(this->context);
+		this->context = NULL;
+	}
+
+#else
+
+	bool HeadlessContext::create() {
+
+		fprintf(stderr, "ERROR: headless rendering needs a build with GPS_HEADLESS_EGL or GPS_HEADLESS_OSMESA\n");
+		return false;
+	}
+
+	void HeadlessContext::destroy() {
+	}
+
+#endif
+
+	HeadlessContext::~HeadlessContext() {
+
+		destroy();
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef HeadlessContext_hpp
+#define HeadlessContext_hpp
+
+#if defined (GPS_HEADLESS_EGL)
+    #include <EGL/egl.h>
+#elif defined (GPS_HEADLESS_OSMESA)
+    #include <GL/osmesa.h>
+#endif
+
+namespace gps {
+
+    // OpenGL 4.1 core context with no window and no display, for render nodes without either.
+    // Built with GPS_HEADLESS_EGL it uses EGL on Mesa's surfaceless platform (llvmpipe when there is
+    // no GPU); with GPS_HEADLESS_OSMESA it uses OSMesa. Without either, create() fails.
+    // There is no default framebuffer to speak of - render into a gps::Framebuffer.
+    class HeadlessContext {
+
+    public:
+        ~HeadlessContext();
+
+        // Creates the context and makes it current on the calling thread
+        bool create();
+
+        void destroy();
+
+    private:
+#if defined (GPS_HEADLESS_EGL)
+        EGLDisplay display = EGL_NO_DISPLAY;
+        EGLContext context = EGL_NO_CONTEXT;
+#elif defined (GPS_HEADLESS_OSMESA)
+        OSMesaContext context = NULL;
+        // OSMesa always wants a color buffer to make the context current
+        unsigned char colorBuffer[4];
+#endif
+    };
+}
+
+#endif /* HeadlessContext_hpp */
@@ -0,0 +1,277 @@
+#include "Hud.hpp"
+
+#include "GpuMemory.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+namespace gps {
+
+	// 5x7 glyphs of the printable ASCII characters ' ' to '_', one byte per row, top row first,
+	// leftmost pixel in bit 4
+	static const int FONT_FIRST_CHAR = 32;
+	static const int FONT_CHAR_COUNT = 64;
+	static const unsigned char FONT_GLYPHS[FONT_CHAR_COUNT][Hud::GLYPH_HEIGHT] = {
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+		{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+		{ 0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00 }, // "
+		{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a }, // #
+		{ 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 }, // $
+		{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+		{ 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d }, // &
+		{ 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 }, // '
+		{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+		{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+		{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 }, // *
+		{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 }, // +
+		{ 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08 }, // ,
+		{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 }, // -
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c }, // .
+		{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+		{ 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e }, // 0
+		{ 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e }, // 1
+		{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f }, // 2
+		{ 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e }, // 3
+		{ 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 }, // 4
+		{ 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e }, // 5
+		{ 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e }, // 6
+		{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+		{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e }, // 8
+		{ 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c }, // 9
+		{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 }, // :
+		{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 }, // ;
+		{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+		{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 }, // =
+		{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+		{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+		{ 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e }, // @
+		{ 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // A
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e }, // B
+		{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e }, // C
+		{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c }, // D
+		{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f }, // E
+		{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 }, // F
+		{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f }, // G
+		{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // H
+		{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e }, // I
+		{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c }, // J
+		{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f }, // L
+		{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+		{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+		{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // O
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 }, // P
+		{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d }, // Q
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 }, // R
+		{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e }, // S
+		{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // U
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 }, // V
+		{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a }, // W
+		{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 }, // X
+		{ 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 }, // Y
+		{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f }, // Z
+		{ 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e }, // [
+		{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // backslash
+		{ 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e }, // ]
+		{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 }, // ^
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f }, // _
+	};
+
+	// The font texture holds the glyphs in a 16 x 4 grid of 6x8 cells, with a solid cell after them for rectangles
+	static const int ATLAS_COLUMNS = 16;
+	static const int CELL_WIDTH = 6;
+	static const int CELL_HEIGHT = 8;
+	static const int SOLID_CELL = FONT_CHAR_COUNT;
+	static const int ATLAS_WIDTH = ATLAS_COLUMNS * CELL_WIDTH;
+	static const int ATLAS_HEIGHT = (FONT_CHAR_COUNT / ATLAS_COLUMNS + 1) * CELL_HEIGHT;
+
+	// A full HUD is a few thousand vertices; the ring only grows if a batch is larger
+	static const GLsizeiptr VERTEX_STREAM_CAPACITY = 512 * 1024;
+
+	void Hud::init() {
+
+		std::vector<unsigned char> atlas(ATLAS_WIDTH * ATLAS_HEIGHT, 0);
+
+		for (int glyph = 0; glyph < FONT_CHAR_COUNT; glyph++) {
+
+			int cellX = glyph % ATLAS_COLUMNS * CELL_WIDTH;
+			int cellY = glyph / ATLAS_COLUMNS * CELL_HEIGHT;
+
+			for (int row = 0; row < GLYPH_HEIGHT; row++) {
+				for (int column = 0; column < GLYPH_WIDTH; column++) {
+					if (FONT_GLYPHS[glyph][row] & (0x10 >> column)) {
+						atlas[(cellY + row) * ATLAS_WIDTH + cellX + column] = 255;
+					}
+				}
+			}
+		}
+
+		int solidX = SOLID_CELL % ATLAS_COLUMNS * CELL_WIDTH;
+		int solidY = SOLID_CELL / ATLAS_COLUMNS * CELL_HEIGHT;
+		for (int row = 0; row < CELL_HEIGHT; row++) {
+			memset(&atlas[(solidY + row) * ATLAS_WIDTH + solidX], 255, CELL_WIDTH);
+		}
+
+		glGenTextures(1, &this->fontTexture);
+		glBindTexture(GL_TEXTURE_2D, this->fontTexture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, ATLAS_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		// glyphs are only ever drawn at whole multiples of their size
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		trackGpuTexture(GL_TEXTURE_2D, this->fontTexture, "Hud", "font");
+
+		this->vertexStream.init(GL_ARRAY_BUFFER, VERTEX_STREAM_CAPACITY, "hud vertices");
+
+		glGenVertexArrays(1, &this->VAO);
+		glBindVertexArray(this->VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->vertexStream.getBuffer());
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(HudVertex), (GLvoid*)offsetof(HudVertex, position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(HudVertex), (GLvoid*)offsetof(HudVertex, texCoords));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(HudVertex), (GLvoid*)offsetof(HudVertex, color));
+		glBindVertexArray(0);
+
+		this->shader.loadShader("shaders/hud.vert", "shaders/hud.frag");
+	}
+
+	void Hud::begin(int width, int height) {
+
+		this->width = width;
+		this->height = height;
+		this->vertices.clear();
+	}
+
+	void Hud::addText(float x, float y, const char* text, const glm::vec4& color, float scale) {
+
+		float left = x;
+
+		for (const char* c = text; *c != '\0'; c++) {
+
+			if (*c == '\n') {
+				x = left;
+				y += LINE_ADVANCE * scale;
+				continue;
+			}
+
+			int glyph = (unsigned char)*c;
+			if (glyph >= 'a' && glyph <= 'z') {
+				glyph -= 'a' - 'A';
+			}
+			glyph -= FONT_FIRST_CHAR;
+			if (glyph < 0 || glyph >= FONT_CHAR_COUNT) {
+				glyph = '?' - FONT_FIRST_CHAR;
+			}
+
+			// blanks cost nothing to skip
+			if (glyph != 0) {
+
+				glm::vec2 cell(glyph % ATLAS_COLUMNS * CELL_WIDTH, glyph / ATLAS_COLUMNS * CELL_HEIGHT);
+				glm::vec2 atlasSize(ATLAS_WIDTH, ATLAS_HEIGHT);
+				glm::vec2 glyphSize(GLYPH_WIDTH, GLYPH_HEIGHT);
+
+				addQuad(glm::vec2(x, y), glm::vec2(x, y) + glyphSize * scale,
+					cell / atlasSize, (cell + glyphSize) / atlasSize, color);
+			}
+
+			x += CHAR_ADVANCE * scale;
+		}
+	}
+
+	void Hud::addRect(float x, float y, float width, float height, const glm::vec4& color) {
+
+		// every corner samples the middle of the solid cell
+		glm::vec2 solid = glm::vec2(SOLID_CELL % ATLAS_COLUMNS * CELL_WIDTH + CELL_WIDTH / 2,
+			SOLID_CELL / ATLAS_COLUMNS * CELL_HEIGHT + CELL_HEIGHT / 2) / glm::vec2(ATLAS_WIDTH, ATLAS_HEIGHT);
+
+		addQuad(glm::vec2(x, y), glm::vec2(x + width, y + height), solid, solid, color);
+	}
+
+	void Hud::addGraph(float x, float y, float width, float height, const float* samples, int count, int first,
+		float maxValue, const glm::vec4& color) {
+
+		if (count <= 0 || maxValue <= 0.0f) {
+			return;
+		}
+
+		float barWidth = width / count;
+		for (int i = 0; i < count; i++) {
+
+			float value = samples[(first + i) % count];
+			float barHeight = glm::min(value / maxValue, 1.0f) * height;
+			if (barHeight > 0.0f) {
+				addRect(x + i * barWidth, y + height - barHeight, barWidth, barHeight, color);
+			}
+		}
+	}
+
+	void Hud::draw() {
+
+		if (this->vertices.empty() || this->VAO == 0) {
+			return;
+		}
+
+		// vertex-sized alignment, so the offset is a whole number of vertices to start the draw at
+		GLintptr offset = this->vertexStream.upload(this->vertices.data(),
+			this->vertices.size() * sizeof(HudVertex), sizeof(HudVertex));
+
+		GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+		GLboolean blend = glIsEnabled(GL_BLEND);
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		this->shader.useShaderProgram();
+		glUniform2f(glGetUniformLocation(this->shader.shaderProgram, "screenSize"), (float)this->width, (float)this->height);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, this->fontTexture);
+		glUniform1i(glGetUniformLocation(this->shader.shaderProgram, "font"), 0);
+
+		glBindVertexArray(this->VAO);
+		glDrawArrays(GL_TRIANGLES, (GLint)(offset / sizeof(HudVertex)), (GLsizei)this->vertices.size());
+		glBindVertexArray(0);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		if (depthTest) {
+			glEnable(GL_DEPTH_TEST);
+		}
+		if (!blend) {
+			glDisable(GL_BLEND);
+		}
+	}
+
+	void Hud::addQuad(glm::vec2 topLeft, glm::vec2 bottomRight, glm::vec2 texTopLeft, glm::vec2 texBottomRight, const glm::vec4& color) {
+
+		HudVertex corners[4] = {
+			{ topLeft, texTopLeft, color },
+			{ glm::vec2(bottomRight.x, topLeft.y), glm::vec2(texBottomRight.x, texTopLeft.y), color },
+			{ bottomRight, texBottomRight, color },
+			{ glm::vec2(topLeft.x, bottomRight.y), glm::vec2(texTopLeft.x, texBottomRight.y), color }
+		};
+
+		// two triangles, no index buffer
+		const int order[6] = { 0, 1, 2, 0, 2, 3 };
+		for (int i = 0; i < 6; i++) {
+			this->vertices.push_back(corners[order[i]]);
+		}
+	}
+
+	void Hud::release() {
+
+		if (this->VAO != 0) {
+			glDeleteVertexArrays(1, &this->VAO);
+			glDeleteTextures(1, &this->fontTexture);
+			releaseGpuResource(GPU_TEXTURE, this->fontTexture);
+			this->VAO = 0;
+			this->fontTexture = 0;
+		}
+		this->vertexStream.release();
+	}
+}
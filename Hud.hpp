@@ -0,0 +1,76 @@
+#ifndef Hud_hpp
+#define Hud_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "glm/glm.hpp"
+
+#include "Shader.hpp"
+#include "StreamBuffer.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Screen overlay for text, rectangles and graphs, placed in pixels from the top left corner.
+    // Everything added between begin() and draw() is batched on the CPU and drawn with a single
+    // draw call from one small font texture, so the overlay barely shows up in the timings it displays.
+    class Hud {
+
+    public:
+        // Size of a glyph of the built-in font, and the advance of a character and of a line, at scale 1
+        static const int GLYPH_WIDTH = 5;
+        static const int GLYPH_HEIGHT = 7;
+        static const int CHAR_ADVANCE = 6;
+        static const int LINE_ADVANCE = 9;
+
+        // Builds the font texture and loads shaders/hud.vert/.frag - needs a current context
+        void init();
+
+        // Starts a new batch for a viewport of width x height pixels
+        void begin(int width, int height);
+
+        // ASCII only; lower case is drawn as upper case and characters the font lacks as '?'
+        void addText(float x, float y, const char* text, const glm::vec4& color, float scale = 1.0f);
+
+        void addRect(float x, float y, float width, float height, const glm::vec4& color);
+
+        // One bar per sample, read from a ring of count samples whose oldest is samples[first];
+        // bars are scaled so maxValue fills the height
+        void addGraph(float x, float y, float width, float height, const float* samples, int count, int first,
+            float maxValue, const glm::vec4& color);
+
+        // Draws the batch over the bound framebuffer; depth testing and blending are restored afterwards
+        void draw();
+
+        // Deletes the font texture, the VAO and the vertex stream - before the context goes
+        void release();
+
+    private:
+        struct HudVertex {
+
+            glm::vec2 position;
+            glm::vec2 texCoords;
+            glm::vec4 color;
+        };
+
+        gps::Shader shader;
+        GLuint VAO = 0;
+        GLuint fontTexture = 0;
+        gps::StreamBuffer vertexStream;
+
+        std::vector<HudVertex> vertices;
+        int width = 0;
+        int height = 0;
+
+        void addQuad(glm::vec2 topLeft, glm::vec2 bottomRight, glm::vec2 texTopLeft, glm::vec2 texBottomRight, const glm::vec4& color);
+    };
+}
+
+#endif /* Hud_hpp */
@@ -0,0 +1,288 @@
+#include "LightClusters.hpp"
+
+#include "GpuMemory.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+	// Depth slices are spaced exponentially from here to the far plane; everything closer falls in slice 0
+	static const float CLUSTER_SLICE_NEAR = 1.0f;
+
+	static void createBufferTexture(GLuint* buffer, GLuint* texture, GLenum format) {
+
+		glGenBuffers(1, buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, *buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+
+		glGenTextures(1, texture);
+		glBindTexture(GL_TEXTURE_BUFFER, *texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, *buffer);
+
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// Orphans the old storage so the upload never waits for the previous frame
+	static void uploadBuffer(GLuint buffer, const void* data, size_t size, const char* label) {
+
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(size, 16), NULL, GL_STREAM_DRAW);
+		trackGpuBuffer(buffer, std::max<size_t>(size, 16), "LightClusters", label);
+		if (size > 0) {
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void LightClusters::init() {
+
+		createBufferTexture(&this->lightBuffer, &this->lightTexture, GL_RGBA32F);
+		createBufferTexture(&this->clusterBuffer, &this->clusterTexture, GL_RG32UI);
+		createBufferTexture(&this->indexBuffer, &this->indexTexture, GL_R32UI);
+
+		this->sliceIndices.resize(CLUSTERS_Z);
+		this->sliceCounts.resize(CLUSTERS_Z);
+		this->clusterData.resize(2 * CLUSTER_COUNT);
+	}
+
+	void LightClusters::update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+		float nearPlane, float farPlane, int viewportWidth, int viewportHeight) {
+
+		PROFILE_FUNCTION();
+
+		if (projection != this->boundsProjection || nearPlane != this->boundsNear || farPlane != this->boundsFar) {
+
+			computeClusterBounds(projection, nearPlane, farPlane);
+		}
+
+		this->screenScale = glm::vec2((float)CLUSTERS_X / viewportWidth, (float)CLUSTERS_Y / viewportHeight);
+
+		// move the lights to view space once; the binning pass only reads these arrays
+		size_t lightCount = lights.size();
+		this->lightX.resize(lightCount);
+		this->lightY.resize(lightCount);
+		this->lightZ.resize(lightCount);
+		this->lightRadius.resize(lightCount);
+		this->lightData.resize(8 * lightCount);
+
+		for (size_t i = 0; i < lightCount; i++) {
+
+			glm::vec4 positionEye = view * glm::vec4(lights[i].position, 1.0f);
+			this->lightX[i] = positionEye.x;
+			this->lightY[i] = positionEye.y;
+			this->lightZ[i] = positionEye.z;
+			this->lightRadius[i] = lights[i].radius;
+
+			GLfloat* texels = &this->lightData[8 * i];
+			texels[0] = positionEye.x;
+			texels[1] = positionEye.y;
+			texels[2] = positionEye.z;
+			texels[3] = lights[i].radius;
+			texels[4] = lights[i].color.x;
+			texels[5] = lights[i].color.y;
+			texels[6] = lights[i].color.z;
+			texels[7] = 0.0f;
+		}
+
+		// every slice writes only its own lists, so the slices can be binned on different threads
+		parallelFor(CLUSTERS_Z, 1, [this](size_t begin, size_t end) {
+			for (size_t slice = begin; slice < end; slice++) {
+				binSlice((int)slice);
+			}
+		});
+
+		// concatenate the slice lists and turn the counts into offsets
+		this->indexData.clear();
+		for (int slice = 0; slice < CLUSTERS_Z; slice++) {
+
+			GLuint offset = (GLuint)this->indexData.size();
+			for (int tile = 0; tile < CLUSTERS_X * CLUSTERS_Y; tile++) {
+
+				int cluster = slice * CLUSTERS_X * CLUSTERS_Y + tile;
+				this->clusterData[2 * cluster + 0] = offset;
+				this->clusterData[2 * cluster + 1] = this->sliceCounts[slice][tile];
+				offset += this->sliceCounts[slice][tile];
+			}
+			this->indexData.insert(this->indexData.end(), this->sliceIndices[slice].begin(), this->sliceIndices[slice].end());
+		}
+
+		uploadBuffer(this->lightBuffer, this->lightData.data(), this->lightData.size() * sizeof(GLfloat), "lights");
+		uploadBuffer(this->clusterBuffer, this->clusterData.data(), this->clusterData.size() * sizeof(GLuint), "clusters");
+		uploadBuffer(this->indexBuffer, this->indexData.data(), this->indexData.size() * sizeof(GLuint), "light indices");
+	}
+
+	void LightClusters::bind(gps::Shader shader, GLuint firstUnit) {
+
+		shader.useShaderProgram();
+
+		glActiveTexture(GL_TEXTURE0 + firstUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, this->lightTexture);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "clusterLights"), firstUnit);
+
+		glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+		glBindTexture(GL_TEXTURE_BUFFER, this->clusterTexture);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "clusterGrid"), firstUnit + 1);
+
+		glActiveTexture(GL_TEXTURE0 + firstUnit + 2);
+		glBindTexture(GL_TEXTURE_BUFFER, this->indexTexture);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "clusterIndices"), firstUnit + 2);
+
+		glActiveTexture(GL_TEXTURE0);
+
+		glUniform2f(glGetUniformLocation(shader.shaderProgram, "clusterScreenScale"), this->screenScale.x, this->screenScale.y);
+		glUniform1f(glGetUniformLocation(shader.shaderProgram, "clusterSliceNear"), this->sliceNear);
+		glUniform1f(glGetUniformLocation(shader.shaderProgram, "clusterSliceScale"), this->sliceScale);
+	}
+
+	int LightClusters::getLightCount() const {
+		return (int)this->lightX.size();
+	}
+
+	int LightClusters::getIndexCount() const {
+		return (int)this->indexData.size();
+	}
+
+	// View space AABB of every cluster; only changes with the projection
+	void LightClusters::computeClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane) {
+
+		this->boundsProjection = projection;
+		this->boundsNear = nearPlane;
+		this->boundsFar = farPlane;
+
+		this->sliceNear = std::max(CLUSTER_SLICE_NEAR, nearPlane);
+		this->sliceScale = CLUSTERS_Z / std::log(farPlane / this->sliceNear);
+
+		this->boundsMinX.resize(CLUSTER_COUNT);
+		this->boundsMaxX.resize(CLUSTER_COUNT);
+		this->boundsMinY.resize(CLUSTER_COUNT);
+		this->boundsMaxY.resize(CLUSTER_COUNT);
+		this->sliceMinZ.resize(CLUSTERS_Z);
+		this->sliceMaxZ.resize(CLUSTERS_Z);
+
+		// for a symmetric perspective projection: x_view = x_ndc * depth / P[0][0]
+		float inverseScaleX = 1.0f / projection[0][0];
+		float inverseScaleY = 1.0f / projection[1][1];
+
+		for (int slice = 0; slice < CLUSTERS_Z; slice++) {
+
+			float depthNear = slice == 0 ? nearPlane : this->sliceNear * std::pow(farPlane / this->sliceNear, (float)slice / CLUSTERS_Z);
+			float depthFar = this->sliceNear * std::pow(farPlane / this->sliceNear, (float)(slice + 1) / CLUSTERS_Z);
+
+			// view space looks down -z
+			this->sliceMinZ[slice] = -depthFar;
+			this->sliceMaxZ[slice] = -depthNear;
+
+			for (int y = 0; y < CLUSTERS_Y; y++) {
+				for (int x = 0; x < CLUSTERS_X; x++) {
+
+					float ndcMinX = -1.0f + 2.0f * x / CLUSTERS_X;
+					float ndcMaxX = -1.0f + 2.0f * (x + 1) / CLUSTERS_X;
+					float ndcMinY = -1.0f + 2.0f * y / CLUSTERS_Y;
+					float ndcMaxY = -1.0f + 2.0f * (y + 1) / CLUSTERS_Y;
+
+					// the tile widens with depth, so the extremes are on the near or the far face
+					float xs[4] = { ndcMinX * depthNear, ndcMaxX * depthNear, ndcMinX * depthFar, ndcMaxX * depthFar };
+					float ys[4] = { ndcMinY * depthNear, ndcMaxY * depthNear, ndcMinY * depthFar, ndcMaxY * depthFar };
+
+					int cluster = slice * CLUSTERS_X * CLUSTERS_Y + y * CLUSTERS_X + x;
+					this->boundsMinX[cluster] = *std::min_element(xs, xs + 4) * inverseScaleX;
+					this->boundsMaxX[cluster] = *std::max_element(xs, xs + 4) * inverseScaleX;
+					this->boundsMinY[cluster] = *std::min_element(ys, ys + 4) * inverseScaleY;
+					this->boundsMaxY[cluster] = *std::max_element(ys, ys + 4) * inverseScaleY;
+				}
+			}
+		}
+	}
+
+	// Sphere / AABB tests of every light against the tiles of one depth slice
+	void LightClusters::binSlice(int slice) {
+
+		std::vector<GLuint>& indices = this->sliceIndices[slice];
+		std::vector<GLuint>& counts = this->sliceCounts[slice];
+		indices.clear();
+		counts.assign(CLUSTERS_X * CLUSTERS_Y, 0);
+
+		float minZ = this->sliceMinZ[slice];
+		float maxZ = this->sliceMaxZ[slice];
+		size_t lightCount = this->lightX.size();
+
+		// lights overlapping the slice in depth, with their squared distance to it along z
+		std::vector<GLuint> candidates;
+		std::vector<float> candidateDistanceZ;
+		candidates.reserve(lightCount);
+		candidateDistanceZ.reserve(lightCount);
+
+		for (size_t i = 0; i < lightCount; i++) {
+
+			float z = this->lightZ[i];
+			float dz = std::max(minZ - z, 0.0f) + std::max(z - maxZ, 0.0f);
+			if (dz * dz <= this->lightRadius[i] * this->lightRadius[i]) {
+
+				candidates.push_back((GLuint)i);
+				candidateDistanceZ.push_back(dz * dz);
+			}
+		}
+
+		if (candidates.empty()) {
+			return;
+		}
+
+		// gather the candidates into dense arrays so the inner loop is branch free and vectorizes
+		size_t candidateCount = candidates.size();
+		std::vector<float> cx(candidateCount), cy(candidateCount), cr2(candidateCount);
+		for (size_t c = 0; c < candidateCount; c++) {
+
+			GLuint light = candidates[c];
+			cx[c] = this->lightX[light];
+			cy[c] = this->lightY[light];
+			cr2[c] = this->lightRadius[light] * this->lightRadius[light] - candidateDistanceZ[c];
+		}
+
+		std::vector<unsigned char> hit(candidateCount);
+		int firstCluster = slice * CLUSTERS_X * CLUSTERS_Y;
+
+		for (int tile = 0; tile < CLUSTERS_X * CLUSTERS_Y; tile++) {
+
+			float minX = this->boundsMinX[firstCluster + tile];
+			float maxX = this->boundsMaxX[firstCluster + tile];
+			float minY = this->boundsMinY[firstCluster + tile];
+			float maxY = this->boundsMaxY[firstCluster + tile];
+
+			for (size_t c = 0; c < candidateCount; c++) {
+
+				float dx = std::max(minX - cx[c], 0.0f) + std::max(cx[c] - maxX, 0.0f);
+				float dy = std::max(minY - cy[c], 0.0f) + std::max(cy[c] - maxY, 0.0f);
+				hit[c] = dx * dx + dy * dy <= cr2[c];
+			}
+
+			GLuint count = 0;
+			for (size_t c = 0; c < candidateCount; c++) {
+
+				if (hit[c]) {
+					indices.push_back(candidates[c]);
+					count++;
+				}
+			}
+			counts[tile] = count;
+		}
+	}
+
+	void LightClusters::release() {
+
+		glDeleteTextures(1, &this->lightTexture);
+		glDeleteTextures(1, &this->clusterTexture);
+		glDeleteTextures(1, &this->indexTexture);
+		glDeleteBuffers(1, &this->lightBuffer);
+		glDeleteBuffers(1, &this->clusterBuffer);
+		glDeleteBuffers(1, &this->indexBuffer);
+		releaseGpuResource(GPU_BUFFER, this->lightBuffer);
+		releaseGpuResource(GPU_BUFFER, this->clusterBuffer);
+		releaseGpuResource(GPU_BUFFER, this->indexBuffer);
+		this->lightTexture = this->clusterTexture = this->indexTexture = 0;
+		this->lightBuffer = this->clusterBuffer = this->indexBuffer = 0;
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef LightClusters_hpp
+#define LightClusters_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "glm/glm.hpp"
+
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    struct PointLight {
+
+        glm::vec3 position;
+        glm::vec3 color;
+        // distance at which the light's contribution is faded out completely
+        float radius;
+    };
+
+    // Clustered forward lighting: the view frustum is split into a CLUSTERS_X x CLUSTERS_Y x CLUSTERS_Z grid
+    // (screen tiles x exponential depth slices) and every cluster gets the list of point lights touching it.
+    // The lists are built on the CPU each frame and read by shaderStart.frag through buffer textures.
+    class LightClusters {
+
+    public:
+        static const int CLUSTERS_X = 16;
+        static const int CLUSTERS_Y = 9;
+        static const int CLUSTERS_Z = 24;
+        static const int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+
+        // Creates the buffers and buffer textures - needs a current context
+        void init();
+
+        // Bins the lights into the clusters of the given camera and uploads the result
+        void update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+            float nearPlane, float farPlane, int viewportWidth, int viewportHeight);
+
+        // Binds the three buffer textures to firstUnit..firstUnit+2 and sets the cluster uniforms
+        void bind(gps::Shader shader, GLuint firstUnit);
+
+        int getLightCount() const;
+
+        // Total number of light references over all clusters
+        int getIndexCount() const;
+
+        // Deletes the buffers and buffer textures - before the context goes
+        void release();
+
+    private:
+        // lights: 2 RGBA32F texels per light - view space position and radius, color
+        // clusters: 1 RG32UI texel per cluster - offset and count in the index list
+        // indices: 1 R32UI texel per light reference
+        GLuint lightBuffer = 0, lightTexture = 0;
+        GLuint clusterBuffer = 0, clusterTexture = 0;
+        GLuint indexBuffer = 0, indexTexture = 0;
+
+        // Projection the cluster bounds were computed for
+        glm::mat4 boundsProjection = glm::mat4(0.0f);
+        float boundsNear = 0.0f, boundsFar = 0.0f;
+
+        float sliceNear = 0.0f;
+        float sliceScale = 0.0f;
+        glm::vec2 screenScale;
+
+        // View space bounding boxes of the clusters, one slice after the other (structure of arrays)
+        std::vector<float> boundsMinX, boundsMaxX, boundsMinY, boundsMaxY;
+        std::vector<float> sliceMinZ, sliceMaxZ;
+
+        // View space lights of the current frame (structure of arrays)
+        std::vector<float> lightX, lightY, lightZ, lightRadius;
+
+        // Per-slice binning output, merged after the parallel pass
+        std::vector<std::vector<GLuint>> sliceIndices;
+        std::vector<std::vector<GLuint>> sliceCounts;
+
+        std::vector<GLfloat> lightData;
+        std::vector<GLuint> clusterData;
+        std::vector<GLuint> indexData;
+
+        void computeClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane);
+
+        void binSlice(int slice);
+    };
+}
+
+#endif /* LightClusters_hpp */
@@ -0,0 +1,824 @@
+#include "Lightmap.hpp"
+
+#include "Bake.hpp"
+#include "GpuMemory.hpp"
+#include "MeshSimplifier.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+
+namespace gps {
+
+	// Triangles join a chart while they face within 45 degrees of the chart's axis
+	static const float CHART_MIN_COSINE = 0.7071f;
+	// Texels left around every chart, so bilinear filtering never reads a neighbouring chart
+	static const int CHART_GUTTER = 2;
+	// Each retry of the packing lowers the density by this factor
+	static const float PACK_SHRINK = 0.85f;
+	// Charts narrower than this many texels along an axis are stretched to it, so thin cables and trims
+	// still get texels of their own
+	static const float MIN_CHART_TEXELS = 2.0f;
+
+	static const char CACHE_MAGIC[8] = { 'G', 'P', 'S', 'L', 'M', '0', '0', '2' };
+	// one BVH ray packet
+	static const int INDIRECT_PATHS_PER_PASS = 4;
+	static const int MAX_BOUNCES = 3;
+	// Rays leave surfaces this far along the normal, in model units, so they don't hit their own triangle
+	static const float RAY_OFFSET = 0.002f;
+	// Surfaces without a diffuse texture reflect this much of the light
+	static const float DEFAULT_ALBEDO = 0.5f;
+	// Bounced light is capped below full reflection, which keeps a few bright paths from lingering as noise
+	static const float MAX_ALBEDO = 0.9f;
+	// A pass is split into batches so a frame's parallelFor holding the pool only serializes one of them
+	static const size_t BAKE_BATCH_TEXELS = 16384;
+
+	// Closest point of the triangle abc to p, all in texels
+	static glm::vec2 closestPointInTriangle(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+
+		glm::vec2 ab = b - a;
+		glm::vec2 ac = c - a;
+		glm::vec2 ap = p - a;
+		float d1 = glm::dot(ab, ap);
+		float d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f) {
+			return a;
+		}
+
+		glm::vec2 bp = p - b;
+		float d3 = glm::dot(ab, bp);
+		float d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3) {
+			return b;
+		}
+
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+			return a + ab * (d1 / (d1 - d3));
+		}
+
+		glm::vec2 cp = p - c;
+		float d5 = glm::dot(ab, cp);
+		float d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6) {
+			return c;
+		}
+
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+			return a + ac * (d2 / (d2 - d6));
+		}
+
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		}
+
+		float denominator = 1.0f / (va + vb + vc);
+		return a + ab * (vb * denominator) + ac * (vc * denominator);
+	}
+
+	void buildLightmapCharts(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices, gps::LightmapCharts& charts) {
+
+		size_t triangleCount = indices.size() / 3;
+
+		// charts grow across seams: neighbours are found through positions
+		std::vector<glm::vec3> positions(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++) {
+			positions[v] = vertices[v].Position;
+		}
+		std::vector<GLuint> welded;
+		weldPositions(positions, welded);
+
+		std::vector<glm::vec3> normals(triangleCount);
+		std::vector<std::pair<uint64_t, GLuint> > edges;
+		edges.reserve(triangleCount * 3);
+		for (size_t t = 0; t < triangleCount; t++) {
+
+			glm::vec3 a = positions[indices[t * 3]];
+			glm::vec3 normal = glm::cross(positions[indices[t * 3 + 1]] - a, positions[indices[t * 3 + 2]] - a);
+			float length = glm::length(normal);
+			normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+
+			for (int e = 0; e < 3; e++) {
+				GLuint first = welded[indices[t * 3 + e]];
+				GLuint second = welded[indices[t * 3 + (e + 1) % 3]];
+				if (first != second) {
+					edges.push_back(std::make_pair((uint64_t)std::min(first, second) << 32 | std::max(first, second), (GLuint)t));
+				}
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+
+		// flood fill from the first triangle left, in file order
+		std::vector<GLuint> triangleCharts(triangleCount, UINT32_MAX);
+		std::vector<glm::vec3> axes;
+		std::vector<GLuint> open;
+		for (size_t seed = 0; seed < triangleCount; seed++) {
+
+			if (triangleCharts[seed] != UINT32_MAX) {
+				continue;
+			}
+
+			GLuint chart = (GLuint)axes.size();
+			glm::vec3 axis = normals[seed] != glm::vec3(0.0f) ? normals[seed] : glm::vec3(0.0f, 0.0f, 1.0f);
+			axes.push_back(axis);
+			triangleCharts[seed] = chart;
+			open.assign(1, (GLuint)seed);
+
+			while (!open.empty()) {
+
+				GLuint t = open.back();
+				open.pop_back();
+				for (int e = 0; e < 3; e++) {
+
+					GLuint first = welded[indices[t * 3 + e]];
+					GLuint second = welded[indices[t * 3 + (e + 1) % 3]];
+					uint64_t key = (uint64_t)std::min(first, second) << 32 | std::max(first, second);
+					std::vector<std::pair<uint64_t, GLuint> >::iterator it =
+						std::lower_bound(edges.begin(), edges.end(), std::make_pair(key, (GLuint)0));
+					for (; it != edges.end() && it->first == key; ++it) {
+						GLuint neighbour = it->second;
+						if (triangleCharts[neighbour] == UINT32_MAX && glm::dot(normals[neighbour], axis) >= CHART_MIN_COSINE) {
+							triangleCharts[neighbour] = chart;
+							open.push_back(neighbour);
+						}
+					}
+				}
+			}
+		}
+
+		// a vertex used by several charts gets a copy in each
+		charts.vertexCharts.assign(vertices.size(), UINT32_MAX);
+		std::unordered_map<uint64_t, GLuint> copies;
+		for (size_t i = 0; i < indices.size(); i++) {
+
+			GLuint chart = triangleCharts[i / 3];
+			GLuint vertex = indices[i];
+			if (charts.vertexCharts[vertex] == UINT32_MAX) {
+				charts.vertexCharts[vertex] = chart;
+				continue;
+			}
+			if (charts.vertexCharts[vertex] == chart) {
+				continue;
+			}
+
+			uint64_t key = (uint64_t)vertex << 32 | chart;
+			std::unordered_map<uint64_t, GLuint>::iterator found = copies.find(key);
+			if (found != copies.end()) {
+				indices[i] = found->second;
+				continue;
+			}
+			gps::Vertex copy = vertices[vertex];
+			GLuint copyIndex = (GLuint)vertices.size();
+			vertices.push_back(copy);
+			charts.vertexCharts.push_back(chart);
+			copies[key] = copyIndex;
+			indices[i] = copyIndex;
+		}
+
+		// flatten each chart along its axis, from the corner of its bounds
+		size_t chartCount = axes.size();
+		std::vector<glm::vec3> tangents(chartCount);
+		std::vector<glm::vec3> bitangents(chartCount);
+		for (size_t c = 0; c < chartCount; c++) {
+			tangentFrame(axes[c], tangents[c], bitangents[c]);
+		}
+
+		std::vector<glm::vec2> minimum(chartCount, glm::vec2(FLT_MAX));
+		std::vector<glm::vec2> maximum(chartCount, glm::vec2(-FLT_MAX));
+		charts.chartCoords.assign(vertices.size(), glm::vec2(0.0f));
+		for (size_t v = 0; v < vertices.size(); v++) {
+
+			GLuint chart = charts.vertexCharts[v];
+			if (chart == UINT32_MAX) {
+				continue;
+			}
+			glm::vec2 coords(glm::dot(vertices[v].Position, tangents[chart]), glm::dot(vertices[v].Position, bitangents[chart]));
+			charts.chartCoords[v] = coords;
+			minimum[chart] = glm::min(minimum[chart], coords);
+			maximum[chart] = glm::max(maximum[chart], coords);
+		}
+
+		charts.chartSizes.resize(chartCount);
+		for (size_t c = 0; c < chartCount; c++) {
+			charts.chartSizes[c] = maximum[c] - minimum[c];
+		}
+		for (size_t v = 0; v < vertices.size(); v++) {
+			if (charts.vertexCharts[v] != UINT32_MAX) {
+				charts.chartCoords[v] -= minimum[charts.vertexCharts[v]];
+			}
+		}
+	}
+
+	float packLightmapAtlas(const std::vector<gps::LightmapCharts>& charts, float texelsPerUnit, int maxSize,
+		std::vector<std::vector<glm::vec2> >& lightmapCoords, int& width, int& height) {
+
+		struct Rect {
+			int width;
+			int height;
+			size_t mesh;
+			size_t chart;
+		};
+
+		std::vector<Rect> rects;
+		for (size_t m = 0; m < charts.size(); m++) {
+			for (size_t c = 0; c < charts[m].chartSizes.size(); c++) {
+				rects.push_back({ 0, 0, m, c });
+			}
+		}
+		if (rects.empty()) {
+			return 0.0f;
+		}
+
+		std::vector<std::vector<glm::ivec2> > offsets(charts.size());
+		std::vector<std::vector<glm::vec2> > scales(charts.size());
+		for (size_t m = 0; m < charts.size(); m++) {
+			offsets[m].resize(charts[m].chartSizes.size());
+			scales[m].resize(charts[m].chartSizes.size());
+		}
+
+		// shelves of charts sorted by height, retried at a lower density until the atlas fits
+		for (float density = texelsPerUnit; density > 0.01f; density *= PACK_SHRINK) {
+
+			double area = 0.0;
+			int widest = 0;
+			for (size_t r = 0; r < rects.size(); r++) {
+				// texels per unit along each axis, more on the axes where the chart would be too thin
+				glm::vec2 chartSize = charts[rects[r].mesh].chartSizes[rects[r].chart];
+				glm::vec2 scale(density);
+				for (int axis = 0; axis < 2; axis++) {
+					if (chartSize[axis] > 0.0f && chartSize[axis] * density < MIN_CHART_TEXELS) {
+						scale[axis] = MIN_CHART_TEXELS / chartSize[axis];
+					}
+				}
+				scales[rects[r].mesh][rects[r].chart] = scale;
+				glm::vec2 size = chartSize * scale;
+				rects[r].width = (int)std::ceil(size.x) + 2 * CHART_GUTTER + 1;
+				rects[r].height = (int)std::ceil(size.y) + 2 * CHART_GUTTER + 1;
+				area += (double)rects[r].width * rects[r].height;
+				widest = std::max(widest, rects[r].width);
+			}
+
+			int atlasWidth = std::max(widest, (int)std::ceil(std::sqrt(area * 1.1)));
+			atlasWidth = (atlasWidth + 3) & ~3;
+			if (atlasWidth > maxSize) {
+				continue;
+			}
+
+			std::sort(rects.begin(), rects.end(), [](const Rect& a, const Rect& b) {
+				return a.height > b.height;
+			});
+
+			int x = 0;
+			int y = 0;
+			int shelfHeight = 0;
+			for (size_t r = 0; r < rects.size(); r++) {
+				if (x + rects[r].width > atlasWidth) {
+					y += shelfHeight;
+					x = 0;
+					shelfHeight = 0;
+				}
+				offsets[rects[r].mesh][rects[r].chart] = glm::ivec2(x + CHART_GUTTER, y + CHART_GUTTER);
+				x += rects[r].width;
+				shelfHeight = std::max(shelfHeight, rects[r].height);
+			}
+
+			int atlasHeight = (y + shelfHeight + 3) & ~3;
+			if (atlasHeight > maxSize) {
+				continue;
+			}
+
+			width = atlasWidth;
+			height = atlasHeight;
+			glm::vec2 scale(1.0f / width, 1.0f / height);
+			lightmapCoords.resize(charts.size());
+			for (size_t m = 0; m < charts.size(); m++) {
+
+				const LightmapCharts& meshCharts = charts[m];
+				lightmapCoords[m].resize(meshCharts.vertexCharts.size());
+				for (size_t v = 0; v < meshCharts.vertexCharts.size(); v++) {
+					GLuint chart = meshCharts.vertexCharts[v];
+					lightmapCoords[m][v] = chart == UINT32_MAX ? glm::vec2(0.0f)
+						: (glm::vec2(offsets[m][chart]) + meshCharts.chartCoords[v] * scales[m][chart]) * scale;
+				}
+			}
+			return density;
+		}
+
+		return 0.0f;
+	}
+
+	namespace {
+
+		glm::vec3 cosineSample(const glm::vec3& normal, uint32_t& random) {
+
+			glm::vec3 tangent, bitangent;
+			tangentFrame(normal, tangent, bitangent);
+			float u = nextRandom(random);
+			float angle = 6.28318531f * nextRandom(random);
+			float radius = std::sqrt(u);
+			return tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle)) + normal * std::sqrt(std::max(0.0f, 1.0f - u));
+		}
+
+		// Linear average of the mesh's diffuse texture, which is all the bounce sees of it
+		glm::vec3 meshAlbedo(const gps::Mesh& mesh) {
+
+			for (size_t t = 0; t < mesh.textures.size(); t++) {
+
+				if (mesh.textures[t].type != "diffuseTexture") {
+					continue;
+				}
+
+				int x, y, n;
+				unsigned char* pixels = stbi_load(mesh.textures[t].path.c_str(), &x, &y, &n, 3);
+				if (pixels == NULL) {
+					break;
+				}
+
+				float toLinear[256];
+				for (int i = 0; i < 256; i++) {
+					toLinear[i] = std::pow(i / 255.0f, 2.2f);
+				}
+				glm::dvec3 sum(0.0);
+				size_t count = (size_t)x * y;
+				for (size_t p = 0; p < count; p++) {
+					sum += glm::dvec3(toLinear[pixels[p * 3]], toLinear[pixels[p * 3 + 1]], toLinear[pixels[p * 3 + 2]]);
+				}
+				stbi_image_free(pixels);
+				return glm::min(glm::vec3(sum / (double)std::max<size_t>(count, 1)), glm::vec3(MAX_ALBEDO));
+			}
+			return glm::vec3(DEFAULT_ALBEDO);
+		}
+
+		// Interpolated normal of a BVH hit, facing back along the ray
+		glm::vec3 hitNormal(const gps::Mesh& mesh, const BvhHit& hit, const glm::vec3& direction) {
+
+			const GLuint* corners = &mesh.indices[mesh.lods[0].firstIndex + hit.triangle * 3];
+			glm::vec3 normal = mesh.vertices[corners[0]].Normal * (1.0f - hit.u - hit.v)
+				+ mesh.vertices[corners[1]].Normal * hit.u + mesh.vertices[corners[2]].Normal * hit.v;
+			float length = glm::length(normal);
+			if (length == 0.0f) {
+				glm::vec3 a = mesh.vertices[corners[0]].Position;
+				normal = glm::cross(mesh.vertices[corners[1]].Position - a, mesh.vertices[corners[2]].Position - a);
+				length = glm::length(normal);
+			}
+			normal = length > 0.0f ? normal / length : -direction;
+			return glm::dot(normal, direction) > 0.0f ? -normal : normal;
+		}
+	}
+
+	Lightmap::~Lightmap() {
+		stop();
+	}
+
+	void Lightmap::bake(const gps::Bvh& bvh, const std::vector<gps::Mesh>& meshes, int width, int height,
+		const glm::vec3& sunDirection, int passes, const std::string& cachePath) {
+
+		stop();
+		this->bvh = &bvh;
+		this->meshes = &meshes;
+		this->width = width;
+		this->height = height;
+		this->sunDirection = glm::normalize(sunDirection);
+		this->passCount = passes;
+		this->cachePath = cachePath;
+		this->uploadedPasses = 0;
+		this->passesDone = 0;
+		this->stopping = false;
+
+		uint64_t hash = hashBytes(HASH_SEED, &width, sizeof(width));
+		hash = hashBytes(hash, &height, sizeof(height));
+		hash = hashBytes(hash, &passes, sizeof(passes));
+		hash = hashBytes(hash, &this->sunDirection, sizeof(this->sunDirection));
+		hash = hashMeshGeometry(hash, meshes, true);
+		for (size_t m = 0; m < meshes.size(); m++) {
+			const gps::Mesh& mesh = meshes[m];
+			for (size_t v = 0; v < mesh.vertices.size(); v++) {
+				hash = hashBytes(hash, &mesh.vertices[v].TexCoords, sizeof(glm::vec2));
+			}
+			hash = hashBytes(hash, mesh.lightmapCoords.data(), mesh.lightmapCoords.size() * sizeof(glm::vec2));
+			for (size_t t = 0; t < mesh.textures.size(); t++) {
+				hash = hashBytes(hash, mesh.textures[t].path.data(), mesh.textures[t].path.size());
+			}
+		}
+		this->sourceHash = hash;
+
+		std::vector<glm::vec4> image;
+		if (load(image)) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->pending.swap(image);
+			this->pendingPasses = passes;
+			this->passesDone = passes;
+			return;
+		}
+
+		this->pendingPasses = 0;
+		this->thread = std::thread(&Lightmap::run, this);
+	}
+
+	void Lightmap::run() {
+
+		setProfilerThreadName("lightmap");
+		PROFILE_FUNCTION();
+
+		const std::vector<gps::Mesh>& meshes = *this->meshes;
+		std::vector<glm::vec3> albedo(meshes.size());
+		for (size_t m = 0; m < meshes.size(); m++) {
+			albedo[m] = meshAlbedo(meshes[m]);
+		}
+
+		// the texels the charts touch, and the triangle baked into each: the one covering the centre, else
+		// the closest one overlapping the texel, so charts too thin to cover any centre still get texels
+		std::vector<BakeTexel> texels;
+		{
+			size_t texelCount = (size_t)this->width * this->height;
+			std::vector<unsigned char> covered(texelCount, 0);
+			std::vector<float> edgeDistances(texelCount, FLT_MAX);
+			std::vector<uint32_t> edgeTexels(texelCount, UINT32_MAX);
+			std::vector<BakeTexel> edges;
+			glm::vec2 atlasSize((float)this->width, (float)this->height);
+			for (size_t m = 0; m < meshes.size(); m++) {
+
+				const gps::Mesh& mesh = meshes[m];
+				if (mesh.lightmapCoords.size() != mesh.vertices.size()) {
+					continue;
+				}
+				const gps::MeshLod& lod = mesh.lods[0];
+				for (GLuint t = 0; t < lod.indexCount / 3; t++) {
+
+					const GLuint* corners = &mesh.indices[lod.firstIndex + t * 3];
+					glm::vec2 a = mesh.lightmapCoords[corners[0]] * atlasSize;
+					glm::vec2 b = mesh.lightmapCoords[corners[1]] * atlasSize;
+					glm::vec2 c = mesh.lightmapCoords[corners[2]] * atlasSize;
+					float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+					if (area == 0.0f) {
+						continue;
+					}
+
+					// every texel the triangle's bounds overlap
+					glm::vec2 low = glm::min(a, glm::min(b, c));
+					glm::vec2 high = glm::max(a, glm::max(b, c));
+					int x0 = std::max(0, (int)std::floor(low.x));
+					int y0 = std::max(0, (int)std::floor(low.y));
+					int x1 = std::min(this->width - 1, (int)std::floor(high.x));
+					int y1 = std::min(this->height - 1, (int)std::floor(high.y));
+					for (int y = y0; y <= y1; y++) {
+						for (int x = x0; x <= x1; x++) {
+
+							size_t texel = (size_t)y * this->width + x;
+							if (covered[texel]) {
+								continue;
+							}
+
+							glm::vec2 p((float)x + 0.5f, (float)y + 0.5f);
+							float w0 = ((b.x - p.x) * (c.y - p.y) - (c.x - p.x) * (b.y - p.y)) / area;
+							float w1 = ((c.x - p.x) * (a.y - p.y) - (a.x - p.x) * (c.y - p.y)) / area;
+							float w2 = 1.0f - w0 - w1;
+							if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) {
+								covered[texel] = 1;
+								texels.push_back({ (uint32_t)texel, (uint32_t)m, t });
+								continue;
+							}
+
+							// the triangle overlaps the texel when its closest point lies inside the texel's square
+							glm::vec2 offset = closestPointInTriangle(p, a, b, c) - p;
+							if (std::fabs(offset.x) > 0.5f || std::fabs(offset.y) > 0.5f) {
+								continue;
+							}
+							float distance = glm::dot(offset, offset);
+							if (distance < edgeDistances[texel]) {
+								edgeDistances[texel] = distance;
+								if (edgeTexels[texel] == UINT32_MAX) {
+									edgeTexels[texel] = (uint32_t)edges.size();
+									edges.push_back({ (uint32_t)texel, (uint32_t)m, t });
+								}
+								else {
+									edges[edgeTexels[texel]] = { (uint32_t)texel, (uint32_t)m, t };
+								}
+							}
+						}
+					}
+				}
+			}
+
+			// a centre covered by some triangle wins over the edges of the others
+			for (size_t e = 0; e < edges.size(); e++) {
+				if (!covered[edges[e].texel]) {
+					texels.push_back(edges[e]);
+				}
+			}
+		}
+
+		const gps::Bvh& bvh = *this->bvh;
+		glm::vec3 sun = this->sunDirection;
+		glm::vec2 atlasSize((float)this->width, (float)this->height);
+
+		// diffuse light from the sun, in units of its colour, reaching a point with the given normal
+		auto directLight = [&](const glm::vec3& position, const glm::vec3& normal) {
+			float cosine = glm::dot(normal, sun);
+			if (cosine <= 0.0f) {
+				return 0.0f;
+			}
+			BvhRay ray;
+			ray.origin = position + normal * RAY_OFFSET;
+			ray.direction = sun;
+			ray.tMax = FLT_MAX;
+			return bvh.occluded(ray) ? 0.0f : cosine;
+		};
+
+		std::vector<glm::vec4> sums(texels.size(), glm::vec4(0.0f));
+		std::vector<glm::vec4> image;
+		for (int pass = 0; pass < this->passCount && !this->stopping; pass++) {
+
+			PROFILE_ZONE("lightmapPass");
+
+			for (size_t batch = 0; batch < texels.size() && !this->stopping; batch += BAKE_BATCH_TEXELS) {
+
+				size_t batchEnd = std::min(texels.size(), batch + BAKE_BATCH_TEXELS);
+				parallelFor(batchEnd - batch, 256, [&](size_t begin, size_t end) {
+					for (size_t i = batch + begin; i < batch + end; i++) {
+
+						const BakeTexel& bakeTexel = texels[i];
+						const gps::Mesh& mesh = meshes[bakeTexel.mesh];
+						const GLuint* corners = &mesh.indices[mesh.lods[0].firstIndex + bakeTexel.triangle * 3];
+						// depends only on the texel and the pass
+						uint32_t random = hashInteger(bakeTexel.texel ^ hashInteger((uint32_t)pass));
+
+						// a jittered point of the texel, moved to the closest point of the triangle, so shadow edges
+						// get antialiased and texels the triangle only grazes sample the triangle where it passes
+						glm::vec2 a = mesh.lightmapCoords[corners[0]] * atlasSize;
+						glm::vec2 b = mesh.lightmapCoords[corners[1]] * atlasSize;
+						glm::vec2 c = mesh.lightmapCoords[corners[2]] * atlasSize;
+						glm::vec2 p((float)(bakeTexel.texel % this->width) + nextRandom(random), (float)(bakeTexel.texel / this->width) + nextRandom(random));
+						p = closestPointInTriangle(p, a, b, c);
+						float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+						glm::vec3 weights;
+						weights.x = ((b.x - p.x) * (c.y - p.y) - (c.x - p.x) * (b.y - p.y)) / area;
+						weights.y = ((c.x - p.x) * (a.y - p.y) - (a.x - p.x) * (c.y - p.y)) / area;
+						weights.z = 1.0f - weights.x - weights.y;
+						weights = glm::max(weights, glm::vec3(0.0f));
+						weights /= weights.x + weights.y + weights.z;
+
+						glm::vec3 position = mesh.vertices[corners[0]].Position * weights.x
+							+ mesh.vertices[corners[1]].Position * weights.y + mesh.vertices[corners[2]].Position * weights.z;
+						glm::vec3 normal = mesh.vertices[corners[0]].Normal * weights.x
+							+ mesh.vertices[corners[1]].Normal * weights.y + mesh.vertices[corners[2]].Normal * weights.z;
+						float normalLength = glm::length(normal);
+						if (normalLength == 0.0f) {
+							continue;
+						}
+						normal /= normalLength;
+
+						float direct = directLight(position, normal);
+
+						// cosine-weighted paths: each bounce multiplies by the albedo and adds the sun light there. The
+						// paths advance together, one ray packet per bounce and one for the sun rays from its hits;
+						// a path that escaped stays in the packet with a negative tMax
+						glm::vec3 indirect(0.0f);
+						glm::vec3 throughput[INDIRECT_PATHS_PER_PASS];
+						glm::vec3 origins[INDIRECT_PATHS_PER_PASS];
+						glm::vec3 surfaceNormals[INDIRECT_PATHS_PER_PASS];
+						int alive = (1 << INDIRECT_PATHS_PER_PASS) - 1;
+						for (int path = 0; path < INDIRECT_PATHS_PER_PASS; path++) {
+							throughput[path] = glm::vec3(1.0f);
+							origins[path] = position;
+							surfaceNormals[path] = normal;
+						}
+						for (int bounce = 0; bounce < MAX_BOUNCES && alive != 0; bounce++) {
+
+							BvhRay rays[INDIRECT_PATHS_PER_PASS];
+							BvhHit hits[INDIRECT_PATHS_PER_PASS];
+							for (int path = 0; path < INDIRECT_PATHS_PER_PASS; path++) {
+								rays[path].direction = (alive & (1 << path)) ? cosineSample(surfaceNormals[path], random) : surfaceNormals[path];
+								rays[path].origin = origins[path] + surfaceNormals[path] * RAY_OFFSET;
+								rays[path].tMax = (alive & (1 << path)) ? FLT_MAX : -1.0f;
+							}
+							alive = bvh.intersect4(rays, hits);
+
+							BvhRay sunRays[INDIRECT_PATHS_PER_PASS];
+							float cosines[INDIRECT_PATHS_PER_PASS];
+							for (int path = 0; path < INDIRECT_PATHS_PER_PASS; path++) {
+
+								cosines[path] = 0.0f;
+								sunRays[path].origin = origins[path];
+								sunRays[path].direction = sun;
+								sunRays[path].tMax = -1.0f;
+								if (!(alive & (1 << path))) {
+									continue;
+								}
+
+								origins[path] = rays[path].origin + rays[path].direction * hits[path].t;
+								surfaceNormals[path] = hitNormal(meshes[hits[path].mesh], hits[path], rays[path].direction);
+								throughput[path] *= albedo[hits[path].mesh];
+								cosines[path] = glm::dot(surfaceNormals[path], sun);
+								sunRays[path].origin = origins[path] + surfaceNormals[path] * RAY_OFFSET;
+								if (cosines[path] > 0.0f) {
+									sunRays[path].tMax = FLT_MAX;
+								}
+							}
+
+							int shadowed = bvh.occluded4(sunRays);
+							for (int path = 0; path < INDIRECT_PATHS_PER_PASS; path++) {
+								if (sunRays[path].tMax > 0.0f && !(shadowed & (1 << path))) {
+									indirect += throughput[path] * cosines[path];
+								}
+							}
+						}
+
+						sums[i] += glm::vec4(glm::vec3(direct) + indirect / (float)INDIRECT_PATHS_PER_PASS, direct > 0.0f ? 1.0f : 0.0f);
+					}
+				});
+			}
+
+			if (this->stopping) {
+				break;
+			}
+
+			resolve(texels, sums, pass + 1, image);
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->pending = image;
+				this->pendingPasses = pass + 1;
+			}
+			this->passesDone = pass + 1;
+		}
+
+		if (!this->stopping && !save(image)) {
+			fprintf(stderr, "WARNING: could not write the lightmap cache %s\n", this->cachePath.c_str());
+		}
+	}
+
+	void Lightmap::resolve(const std::vector<BakeTexel>& texels, const std::vector<glm::vec4>& sums, int passes,
+		std::vector<glm::vec4>& image) const {
+
+		size_t texelCount = (size_t)this->width * this->height;
+		image.assign(texelCount, glm::vec4(0.0f));
+		std::vector<unsigned char> filled(texelCount, 0);
+		for (size_t i = 0; i < texels.size(); i++) {
+			image[texels[i].texel] = sums[i] / (float)passes;
+			filled[texels[i].texel] = 1;
+		}
+
+		// grow every chart into its gutter, so filtering at its edges reads the chart and not black
+		std::vector<unsigned char> next;
+		for (int ring = 0; ring <= CHART_GUTTER; ring++) {
+
+			next = filled;
+			for (int y = 0; y < this->height; y++) {
+				for (int x = 0; x < this->width; x++) {
+
+					size_t texel = (size_t)y * this->width + x;
+					if (filled[texel]) {
+						continue;
+					}
+
+					glm::vec4 sum(0.0f);
+					int count = 0;
+					for (int dy = -1; dy <= 1; dy++) {
+						for (int dx = -1; dx <= 1; dx++) {
+							int nx = x + dx;
+							int ny = y + dy;
+							if (nx < 0 || ny < 0 || nx >= this->width || ny >= this->height) {
+								continue;
+							}
+							size_t neighbour = (size_t)ny * this->width + nx;
+							if (filled[neighbour]) {
+								sum += image[neighbour];
+								count++;
+							}
+						}
+					}
+					if (count > 0) {
+						image[texel] = sum / (float)count;
+						next[texel] = 1;
+					}
+				}
+			}
+			filled.swap(next);
+		}
+	}
+
+	bool Lightmap::update() {
+
+		if (this->width <= 0 || this->height <= 0) {
+			return false;
+		}
+
+		std::vector<glm::vec4> image;
+		int passes = 0;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			if (this->pendingPasses <= this->uploadedPasses) {
+				return false;
+			}
+			image.swap(this->pending);
+			passes = this->pendingPasses;
+		}
+
+		if (this->texture == 0) {
+			glGenTextures(1, &this->texture);
+			glBindTexture(GL_TEXTURE_2D, this->texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, this->width, this->height, 0, GL_RGBA, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			trackGpuTexture(GL_TEXTURE_2D, this->texture, "Lightmap", "baked sun light");
+		}
+
+		glBindTexture(GL_TEXTURE_2D, this->texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, this->width, this->height, GL_RGBA, GL_FLOAT, image.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+		this->uploadedPasses = passes;
+		return true;
+	}
+
+	void Lightmap::finish() {
+
+		if (this->thread.joinable()) {
+			this->thread.join();
+		}
+	}
+
+	void Lightmap::stop() {
+
+		this->stopping = true;
+		if (this->thread.joinable()) {
+			this->thread.join();
+		}
+	}
+
+	void Lightmap::release() {
+
+		stop();
+		if (this->texture != 0) {
+			glDeleteTextures(1, &this->texture);
+			releaseGpuResource(GPU_TEXTURE, this->texture);
+			this->texture = 0;
+		}
+	}
+
+	bool Lightmap::ready() const {
+		return this->texture != 0 && this->uploadedPasses > 0;
+	}
+
+	bool Lightmap::baking() const {
+		return this->passesDone < this->passCount && !this->stopping;
+	}
+
+	GLuint Lightmap::getTexture() const {
+		return this->texture;
+	}
+
+	int Lightmap::getWidth() const {
+		return this->width;
+	}
+
+	int Lightmap::getHeight() const {
+		return this->height;
+	}
+
+	int Lightmap::getPassesDone() const {
+		return this->passesDone;
+	}
+
+	int Lightmap::getPassCount() const {
+		return this->passCount;
+	}
+
+	bool Lightmap::load(std::vector<glm::vec4>& image) const {
+
+		FILE* file = openBakeCache(this->cachePath, CACHE_MAGIC, this->sourceHash);
+		if (file == NULL) {
+			return false;
+		}
+
+		image.resize((size_t)this->width * this->height);
+		bool valid = fread(image.data(), sizeof(glm::vec4), image.size(), file) == image.size();
+		fclose(file);
+
+		if (!valid) {
+			image.clear();
+		}
+		return valid;
+	}
+
+	bool Lightmap::save(const std::vector<glm::vec4>& image) const {
+
+		FILE* file = createBakeCache(this->cachePath, CACHE_MAGIC, this->sourceHash);
+		if (file == NULL) {
+			return false;
+		}
+
+		bool written = fwrite(image.data(), sizeof(glm::vec4), image.size(), file) == image.size();
+
+		return fclose(file) == 0 && written;
+	}
+}
@@ -0,0 +1,124 @@
+#ifndef Lightmap_hpp
+#define Lightmap_hpp
+
+#include "Bvh.hpp"
+#include "Mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Lightmap charts of one mesh: groups of connected triangles facing within 45 degrees of a common
+    // axis, flattened by projecting them along it, so no triangle in a chart turns over
+    struct LightmapCharts {
+
+        // per vertex: the chart it belongs to, and where it lies in it, in model units from its corner
+        std::vector<GLuint> vertexCharts;
+        std::vector<glm::vec2> chartCoords;
+        // per chart: width and height in model units
+        std::vector<glm::vec2> chartSizes;
+    };
+
+    // Splits the full mesh (indices holds only LOD 0) into charts, duplicating the vertices that sit on
+    // the border of two charts so each chart has its own. Run before the meshlets and LODs are built:
+    // the simplifier keeps the duplicates in place, so every level stays inside the charts
+    void buildLightmapCharts(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices, gps::LightmapCharts& charts);
+
+    // Packs the charts of every mesh into one atlas of at most maxSize texels a side, at texelsPerUnit or
+    // lower if they don't fit, with a gutter around each chart. Charts thinner than two texels along an axis
+    // are stretched to two, so every one gets texels of its own. Fills lightmapCoords with every vertex's
+    // atlas coordinates (0 to 1). Returns the density used, 0 if the charts can't be packed
+    float packLightmapAtlas(const std::vector<gps::LightmapCharts>& charts, float texelsPerUnit, int maxSize,
+        std::vector<std::vector<glm::vec2> >& lightmapCoords, int& width, int& height);
+
+    // Static lighting of a model from a directional sun, path traced on the CPU against the scene BVH.
+    // Every pass adds one jittered sun ray and a few cosine-weighted paths of up to three bounces to each
+    // texel, so the estimate refines progressively: the shadows are antialiased and the bounced light
+    // loses its noise. The bake runs on a thread of its own, spreading each pass over the worker pool,
+    // and the main thread uploads the latest pass into an RGBA16F texture: rgb is the diffuse light in
+    // units of the sun's colour (direct and indirect), alpha is the fraction of the texel the sun reaches.
+    // The finished lightmap is cached and reused while the geometry, sun and settings match
+    class Lightmap {
+
+    public:
+        ~Lightmap();
+
+        // Loads the lightmap of meshes (all with lightmapCoords) from cachePath, or starts baking it there.
+        // sunDirection points towards the sun, in the space of the BVH. meshes and bvh must outlive the bake
+        void bake(const gps::Bvh& bvh, const std::vector<gps::Mesh>& meshes, int width, int height,
+            const glm::vec3& sunDirection, int passes, const std::string& cachePath);
+
+        // Main thread: uploads the latest pass if one finished since the last call. Returns true when the
+        // texture changed
+        bool update();
+
+        // Waits for every pass to finish
+        void finish();
+
+        // Waits for the pass in flight and abandons the rest
+        void stop();
+
+        // Frees the texture; stops the bake first
+        void release();
+
+        // true once a pass is in the texture
+        bool ready() const;
+
+        // true while passes are still to come
+        bool baking() const;
+
+        GLuint getTexture() const;
+        int getWidth() const;
+        int getHeight() const;
+        int getPassesDone() const;
+        int getPassCount() const;
+
+    private:
+        // covered texel of the atlas and the LOD 0 triangle it is baked from: the one covering its centre,
+        // else the nearest one overlapping the texel
+        struct BakeTexel {
+            uint32_t texel;
+            uint32_t mesh;
+            uint32_t triangle;
+        };
+
+        const gps::Bvh* bvh = nullptr;
+        const std::vector<gps::Mesh>* meshes = nullptr;
+        int width = 0;
+        int height = 0;
+        glm::vec3 sunDirection;
+        int passCount = 0;
+        std::string cachePath;
+        uint64_t sourceHash = 0;
+
+        GLuint texture = 0;
+        int uploadedPasses = 0;
+
+        std::thread thread;
+        std::atomic<bool> stopping{false};
+        std::atomic<int> passesDone{0};
+        // guards the fields below, handed from the bake thread to the main thread
+        std::mutex mutex;
+        std::vector<glm::vec4> pending;
+        int pendingPasses = 0;
+
+        // runs on the bake thread
+        void run();
+
+        // rgb and alpha of every texel from the accumulated sums, with the gutters filled from the charts
+        void resolve(const std::vector<BakeTexel>& texels, const std::vector<glm::vec4>& sums, int passes,
+            std::vector<glm::vec4>& image) const;
+
+        bool load(std::vector<glm::vec4>& image) const;
+
+        bool save(const std::vector<glm::vec4>& image) const;
+    };
+}
+
+#endif /* Lightmap_hpp */
@@ -1,25 +1,292 @@
 #include "Mesh.hpp"
+
+#include "RenderStats.hpp"
+
 namespace gps {
 
+	// Attribute locations of the per-instance data (see shaderStart.vert)
+	static const GLuint INSTANCE_MATRIX_LOCATION = 3;
+	static const GLuint INSTANCE_TINT_LOCATION = 7;
+	// Baked per-vertex ambient occlusion
+	static const GLuint OCCLUSION_LOCATION = 8;
+	// Atlas coordinates of the baked lightmap
+	static const GLuint LIGHTMAP_LOCATION = 9;
+
+	// With their arrays disabled, the instance attributes read these current values:
+	// an identity matrix and a white tint, so non-instanced draws are unaffected.
+	// Meshes without baked occlusion read 1 from attribute 8 the same way
+	static void resetInstanceAttributes() {
+
+		glVertexAttrib4f(INSTANCE_MATRIX_LOCATION + 0, 1.0f, 0.0f, 0.0f, 0.0f);
+		glVertexAttrib4f(INSTANCE_MATRIX_LOCATION + 1, 0.0f, 1.0f, 0.0f, 0.0f);
+		glVertexAttrib4f(INSTANCE_MATRIX_LOCATION + 2, 0.0f, 0.0f, 1.0f, 0.0f);
+		glVertexAttrib4f(INSTANCE_MATRIX_LOCATION + 3, 0.0f, 0.0f, 0.0f, 1.0f);
+		glVertexAttrib4f(INSTANCE_TINT_LOCATION, 1.0f, 1.0f, 1.0f, 1.0f);
+		glVertexAttrib1f(OCCLUSION_LOCATION, 1.0f);
+	}
+
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) {
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, std::vector<MeshLod> lods) {
 
 		this->vertices = vertices;
 		this->indices = indices;
 		this->textures = textures;
+		this->lods = lods;
+		if (this->lods.empty()) {
+			this->lods.push_back({ 0, (GLuint)this->indices.size(), 0.0f });
+		}
+
+		// centre of the bounding box, which is close enough to the smallest sphere for LOD selection
+		glm::vec3 minimum(0.0f);
+		glm::vec3 maximum(0.0f);
+		for (size_t i = 0; i < this->vertices.size(); i++) {
+			minimum = i == 0 ? this->vertices[i].Position : glm::min(minimum, this->vertices[i].Position);
+			maximum = i == 0 ? this->vertices[i].Position : glm::max(maximum, this->vertices[i].Position);
+		}
+		this->boundsCenter = (minimum + maximum) * 0.5f;
+		this->boundsRadius = 0.0f;
+		for (size_t i = 0; i < this->vertices.size(); i++) {
+			this->boundsRadius = glm::max(this->boundsRadius, glm::length(this->vertices[i].Position - this->boundsCenter));
+		}
+
+		this->shadowBuffers = { 0, 0, 0 };
+		this->shadowIndexCount = 0;
+		this->occlusionBuffer = 0;
+		this->lightmapBuffer = 0;
+		this->rangesCulled = false;
+		this->culledTriangles = 0;
 
 		this->setupMesh();
 	}
 
+	const MeshLod& Mesh::getCurrentLod() const {
+		return this->lods[this->currentLod];
+	}
+
+	void Mesh::setVisibleRanges(const std::vector<GLsizei>& counts, const std::vector<const GLvoid*>& offsets, size_t culledTriangles) {
+
+		this->rangesCulled = true;
+		this->visibleCounts = counts;
+		this->visibleOffsets = offsets;
+		this->culledTriangles = culledTriangles;
+	}
+
+	void Mesh::clearVisibleRanges() {
+
+		this->rangesCulled = false;
+		this->culledTriangles = 0;
+	}
+
+	bool Mesh::hasVisibleRanges() const {
+		return this->rangesCulled && this->currentLod == 0;
+	}
+
+	const std::vector<GLsizei>& Mesh::getVisibleCounts() const {
+		return this->visibleCounts;
+	}
+
+	const std::vector<const GLvoid*>& Mesh::getVisibleOffsets() const {
+		return this->visibleOffsets;
+	}
+
+	size_t Mesh::getCulledTriangles() const {
+		return this->culledTriangles;
+	}
+
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
+	void Mesh::setShadowProxy(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices) {
+
+		if (positions.empty() || indices.empty()) {
+			return;
+		}
+
+		if (this->shadowBuffers.VAO == 0) {
+			glGenVertexArrays(1, &this->shadowBuffers.VAO);
+			glGenBuffers(1, &this->shadowBuffers.VBO);
+			glGenBuffers(1, &this->shadowBuffers.EBO);
+		}
+
+		glBindVertexArray(this->shadowBuffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->shadowBuffers.VBO);
+		glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->shadowBuffers.EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+		// only the position attribute; depthMap.vert reads nothing else per vertex
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+		glBindVertexArray(0);
+
+		this->shadowIndexCount = (GLsizei)indices.size();
+	}
+
+	bool Mesh::hasShadowProxy() const {
+		return this->shadowBuffers.VAO != 0;
+	}
+
+	Buffers Mesh::getShadowBuffers() {
+		return this->shadowBuffers;
+	}
+
+	void Mesh::setOcclusion(const std::vector<float>& occlusion) {
+
+		if (occlusion.size() != this->vertices.size()) {
+			return;
+		}
+
+		if (this->occlusionBuffer == 0) {
+			glGenBuffers(1, &this->occlusionBuffer);
+		}
+
+		glBindVertexArray(this->buffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->occlusionBuffer);
+		glBufferData(GL_ARRAY_BUFFER, occlusion.size() * sizeof(float), occlusion.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(OCCLUSION_LOCATION);
+		glVertexAttribPointer(OCCLUSION_LOCATION, 1, GL_FLOAT, GL_FALSE, sizeof(float), (GLvoid*)0);
+		glBindVertexArray(0);
+	}
+
+	GLuint Mesh::getOcclusionBuffer() const {
+		return this->occlusionBuffer;
+	}
+
+	void Mesh::setLightmapCoords(const std::vector<glm::vec2>& coords) {
+
+		if (coords.size() != this->vertices.size()) {
+			return;
+		}
+		this->lightmapCoords = coords;
+
+		if (this->lightmapBuffer == 0) {
+			glGenBuffers(1, &this->lightmapBuffer);
+		}
+
+		glBindVertexArray(this->buffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->lightmapBuffer);
+		glBufferData(GL_ARRAY_BUFFER, coords.size() * sizeof(glm::vec2), coords.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(LIGHTMAP_LOCATION);
+		glVertexAttribPointer(LIGHTMAP_LOCATION, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (GLvoid*)0);
+		glBindVertexArray(0);
+	}
+
+	GLuint Mesh::getLightmapBuffer() const {
+		return this->lightmapBuffer;
+	}
+
 	/* Mesh drawing function - also applies associated textures */
 	void Mesh::Draw(gps::Shader shader)	{
 
 		shader.useShaderProgram();
 
+		bindTextures(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		if (hasVisibleRanges()) {
+
+			const std::vector<GLsizei>& counts = this->visibleCounts;
+			if (counts.size() == 1) {
+				glDrawElements(GL_TRIANGLES, counts[0], GL_UNSIGNED_INT, this->visibleOffsets[0]);
+			}
+			else if (!counts.empty()) {
+				glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, this->visibleOffsets.data(), (GLsizei)counts.size());
+			}
+
+			GLsizei drawnIndices = 0;
+			for (size_t i = 0; i < counts.size(); i++) {
+				drawnIndices += counts[i];
+			}
+			if (!counts.empty()) {
+				renderStats.countDraw(drawnIndices / 3);
+			}
+			renderStats.countCulled(this->culledTriangles);
+		}
+		else {
+			const MeshLod& lod = getCurrentLod();
+			glDrawElements(GL_TRIANGLES, (GLsizei)lod.indexCount, GL_UNSIGNED_INT, (GLvoid*)(lod.firstIndex * sizeof(GLuint)));
+			renderStats.countDraw(lod.indexCount / 3);
+		}
+		glBindVertexArray(0);
+
+		// program, VAO and one bind per texture
+		renderStats.countStateChanges(2 + this->textures.size());
+
+		unbindTextures();
+    }
+
+	void Mesh::DrawShadow(gps::Shader shader) {
+
+		shader.useShaderProgram();
+
+		if (hasShadowProxy()) {
+			glBindVertexArray(this->shadowBuffers.VAO);
+			glDrawElements(GL_TRIANGLES, this->shadowIndexCount, GL_UNSIGNED_INT, 0);
+			renderStats.countDraw(this->shadowIndexCount / 3);
+		}
+		else {
+			const MeshLod& lod = getCurrentLod();
+			glBindVertexArray(this->buffers.VAO);
+			glDrawElements(GL_TRIANGLES, (GLsizei)lod.indexCount, GL_UNSIGNED_INT, (GLvoid*)(lod.firstIndex * sizeof(GLuint)));
+			renderStats.countDraw(lod.indexCount / 3);
+		}
+		glBindVertexArray(0);
+
+		// program and VAO
+		renderStats.countStateChanges(2);
+	}
+
+	/* Instanced drawing function - one draw call for all copies of the mesh */
+	void Mesh::DrawInstanced(gps::Shader shader, GLuint instanceBuffer, GLintptr matrixOffset, GLintptr tintOffset, GLsizei instanceCount) {
+
+		if (instanceCount <= 0) {
+			return;
+		}
+
+		shader.useShaderProgram();
+
+		bindTextures(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+		// a mat4 attribute takes four consecutive locations, one per column
+		for (GLuint column = 0; column < 4; column++) {
+
+			glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+			glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+				(GLvoid*)(matrixOffset + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + column, 1);
+		}
+
+		if (tintOffset >= 0) {
+
+			glEnableVertexAttribArray(INSTANCE_TINT_LOCATION);
+			glVertexAttribPointer(INSTANCE_TINT_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)tintOffset);
+			glVertexAttribDivisor(INSTANCE_TINT_LOCATION, 1);
+		}
+
+		const MeshLod& lod = getCurrentLod();
+		glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)lod.indexCount, GL_UNSIGNED_INT, (GLvoid*)(lod.firstIndex * sizeof(GLuint)), instanceCount);
+
+		renderStats.countStateChanges(2 + this->textures.size());
+		renderStats.countDraw(lod.indexCount / 3, instanceCount);
+
+		// leave the VAO as Draw() expects it
+		for (GLuint location = INSTANCE_MATRIX_LOCATION; location <= INSTANCE_TINT_LOCATION; location++) {
+
+			glDisableVertexAttribArray(location);
+		}
+		glBindVertexArray(0);
+
+		resetInstanceAttributes();
+
+		unbindTextures();
+	}
+
+	void Mesh::bindTextures(gps::Shader shader) {
+
 		//set textures
 		for (GLuint i = 0; i < textures.size(); i++) {
 
@@ -27,18 +294,16 @@ namespace gps {
 			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
 			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
+	}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+	void Mesh::unbindTextures() {
 
         for(GLuint i = 0; i < this->textures.size(); i++) {
 
             glActiveTexture(GL_TEXTURE0 + i);
             glBindTexture(GL_TEXTURE_2D, 0);
         }
-
-    }
+	}
 
 	// Initializes all the buffer objects/arrays
 	void Mesh::setupMesh() {
@@ -68,5 +333,7 @@ namespace gps {
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
 
 		glBindVertexArray(0);
+
+		resetInstanceAttributes();
 	}
 }
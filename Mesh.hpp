@@ -41,6 +41,28 @@ namespace gps {
         glm::vec3 specular;
     };
 
+    // One level of detail: a range of the index buffer, drawn over the vertices every level shares
+    struct MeshLod {
+
+        GLuint firstIndex;
+        GLuint indexCount;
+        // how far, in model units, the simplified surface may stray from the full mesh
+        float error;
+    };
+
+    // Cluster of neighbouring triangles of the full mesh, culled as a unit (see Meshlets.hpp)
+    struct Meshlet {
+
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLuint vertexCount;
+        glm::vec3 center;
+        float radius;
+        // the face normals all lie within the cone around coneAxis; coneCutoff is 1 when they spread too far
+        glm::vec3 coneAxis;
+        float coneCutoff;
+    };
+
     struct Buffers {
         GLuint VAO;
         GLuint VBO;
@@ -51,18 +73,91 @@ namespace gps {
 
     public:
         std::vector<Vertex> vertices;
+        // triangles of every LOD one after another; the full mesh is lods[0]
         std::vector<GLuint> indices;
         std::vector<Texture> textures;
-
-	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+        std::vector<MeshLod> lods;
+        // level Draw and DrawInstanced use, picked by Model3D::selectLods
+        int currentLod = 0;
+        // sphere around the vertices, in model space
+        glm::vec3 boundsCenter;
+        float boundsRadius;
+        // clusters of LOD 0, which is ordered so each is a contiguous range
+        std::vector<Meshlet> meshlets;
+        // where every vertex lies in the lightmap atlas (0 to 1), empty without a lightmap
+        std::vector<glm::vec2> lightmapCoords;
+
+	    // Without lods, indices is the full mesh and the only level
+	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+	        std::vector<MeshLod> lods = std::vector<MeshLod>());
+
+	    const MeshLod& getCurrentLod() const;
+
+	    // Restricts LOD 0 to the given index ranges (byte offsets) until the next call; Draw then submits
+	    // them with one glMultiDrawElements. culledTriangles is reported to the render stats per draw
+	    void setVisibleRanges(const std::vector<GLsizei>& counts, const std::vector<const GLvoid*>& offsets, size_t culledTriangles);
+
+	    // Draw LOD 0 whole again
+	    void clearVisibleRanges();
+
+	    // Whether Draw submits the ranges of setVisibleRanges instead of the whole current LOD
+	    bool hasVisibleRanges() const;
+
+	    // The ranges of setVisibleRanges, index counts and byte offsets, and the triangles they leave out
+	    const std::vector<GLsizei>& getVisibleCounts() const;
+	    const std::vector<const GLvoid*>& getVisibleOffsets() const;
+	    size_t getCulledTriangles() const;
 
 	    Buffers getBuffers();
 
+	    // Position-only geometry the shadow pass draws instead of the mesh, 12 bytes per vertex
+	    void setShadowProxy(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices);
+
+	    bool hasShadowProxy() const;
+
+	    // Baked ambient occlusion, one value per vertex, read by the shaders as attribute 8. Meshes
+	    // without it read 1, fully open
+	    void setOcclusion(const std::vector<float>& occlusion);
+
+	    // 0 when the mesh has no baked occlusion
+	    GLuint getOcclusionBuffer() const;
+
+	    // Lightmap atlas coordinates, one per vertex, read by the shaders as attribute 9
+	    void setLightmapCoords(const std::vector<glm::vec2>& coords);
+
+	    // 0 when the mesh has no lightmap coordinates
+	    GLuint getLightmapBuffer() const;
+
+	    // VAO 0 when the mesh has no proxy
+	    Buffers getShadowBuffers();
+
 	    void Draw(gps::Shader shader);
 
+	    // Depth-only draw for shadow casting: the proxy if there is one, else the current LOD without textures
+	    void DrawShadow(gps::Shader shader);
+
+	    // Draws instanceCount copies in one call, reading per-instance data from instanceBuffer:
+	    // a mat4 per instance at matrixOffset (attributes 3-6) and, if tintOffset >= 0, a vec4 tint (attribute 7).
+	    // Instance matrices are expected to hold rotation, translation and uniform scale only.
+	    void DrawInstanced(gps::Shader shader, GLuint instanceBuffer, GLintptr matrixOffset, GLintptr tintOffset, GLsizei instanceCount);
+
+	    // Binds the textures of the mesh to consecutive units, starting at 0
+	    void bindTextures(gps::Shader shader);
+
+	    void unbindTextures();
+
     private:
         /*  Render data  */
         Buffers buffers;
+        Buffers shadowBuffers;
+        GLsizei shadowIndexCount;
+        GLuint occlusionBuffer;
+        GLuint lightmapBuffer;
+        // set by setVisibleRanges; only used while currentLod is 0
+        bool rangesCulled;
+        std::vector<GLsizei> visibleCounts;
+        std::vector<const GLvoid*> visibleOffsets;
+        size_t culledTriangles;
 
 	    // Initializes all the buffer objects/arrays
 	    void setupMesh();
@@ -0,0 +1,421 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+	// Border planes weigh more than surface planes, so the outline of open meshes holds its shape
+	static const double BORDER_WEIGHT = 10.0;
+	// Each LOD aims for this share of the triangles of the one before
+	static const float LOD_REDUCTION = 0.5f;
+	// A level that keeps more than this share of the previous one's triangles ends the chain
+	static const float MIN_LOD_REDUCTION = 0.8f;
+	static const size_t MAX_LODS = 6;
+	// Meshes (or levels) below this many triangles are not simplified further
+	static const size_t MIN_LOD_TRIANGLES = 64;
+
+	namespace {
+
+		// Symmetric 4x4 matrix summing the squared distance to a set of planes; upper triangle only
+		struct Quadric {
+
+			double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+		};
+
+		enum VERTEX_KIND {KIND_MANIFOLD, KIND_BORDER, KIND_LOCKED};
+
+		struct Collapse {
+
+			GLuint from;
+			GLuint to;
+			double cost;
+		};
+
+		// Exact bit patterns, so only truly coincident vertices are welded
+		struct PositionKey {
+
+			uint32_t x, y, z;
+
+			bool operator==(const PositionKey& other) const {
+				return x == other.x && y == other.y && z == other.z;
+			}
+		};
+
+		struct PositionKeyHash {
+
+			size_t operator()(const PositionKey& key) const {
+				return (size_t)(key.x * 73856093u ^ key.y * 19349663u ^ key.z * 83492791u);
+			}
+		};
+	}
+
+	static void addPlane(Quadric& q, const glm::dvec3& normal, double d, double weight) {
+
+		q.a00 += weight * normal.x * normal.x;
+		q.a01 += weight * normal.x * normal.y;
+		q.a02 += weight * normal.x * normal.z;
+		q.a03 += weight * normal.x * d;
+		q.a11 += weight * normal.y * normal.y;
+		q.a12 += weight * normal.y * normal.z;
+		q.a13 += weight * normal.y * d;
+		q.a22 += weight * normal.z * normal.z;
+		q.a23 += weight * normal.z * d;
+		q.a33 += weight * d * d;
+	}
+
+	static void addQuadric(Quadric& q, const Quadric& other) {
+
+		q.a00 += other.a00; q.a01 += other.a01; q.a02 += other.a02; q.a03 += other.a03;
+		q.a11 += other.a11; q.a12 += other.a12; q.a13 += other.a13;
+		q.a22 += other.a22; q.a23 += other.a23;
+		q.a33 += other.a33;
+	}
+
+	// Sum of the weighted squared distances from p to the planes of q
+	static double evaluate(const Quadric& q, const glm::vec3& p) {
+
+		double x = p.x, y = p.y, z = p.z;
+		double error = q.a00 * x * x + 2.0 * q.a01 * x * y + 2.0 * q.a02 * x * z + 2.0 * q.a03 * x
+			+ q.a11 * y * y + 2.0 * q.a12 * y * z + 2.0 * q.a13 * y
+			+ q.a22 * z * z + 2.0 * q.a23 * z
+			+ q.a33;
+
+		return std::max(error, 0.0);
+	}
+
+	static uint64_t edgeKey(GLuint a, GLuint b) {
+
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+
+	// Number of triangles on every edge, by welded vertex
+	static void countEdges(const std::vector<GLuint>& indices, const std::vector<GLuint>& welded,
+		std::unordered_map<uint64_t, int>& edges) {
+
+		edges.clear();
+		edges.reserve(indices.size());
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			for (int e = 0; e < 3; e++) {
+				edges[edgeKey(welded[indices[i + e]], welded[indices[i + (e + 1) % 3]])]++;
+			}
+		}
+	}
+
+	void weldPositions(const std::vector<glm::vec3>& positions, std::vector<GLuint>& welded) {
+
+		welded.resize(positions.size());
+		std::unordered_map<PositionKey, GLuint, PositionKeyHash> positionIds;
+		positionIds.reserve(positions.size());
+		for (GLuint v = 0; v < positions.size(); v++) {
+
+			PositionKey key;
+			memcpy(&key, &positions[v], sizeof(key));
+			welded[v] = positionIds.emplace(key, v).first->second;
+		}
+	}
+
+	float simplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices,
+		size_t targetIndexCount, std::vector<GLuint>& destination, float maxError) {
+
+		size_t vertexCount = positions.size();
+		double maxCost = maxError < FLT_MAX ? (double)maxError * maxError : DBL_MAX;
+
+		// the triangles work on welded vertices; a position the triangles reach through several vertices is a seam
+		std::vector<GLuint> welded;
+		weldPositions(positions, welded);
+
+		std::vector<unsigned char> referenced(vertexCount, 0);
+		for (size_t i = 0; i < indices.size(); i++) {
+			referenced[indices[i]] = 1;
+		}
+
+		std::vector<int> wedgeCount(vertexCount, 0);
+		for (GLuint v = 0; v < vertexCount; v++) {
+			if (referenced[v]) {
+				wedgeCount[welded[v]]++;
+			}
+		}
+
+		std::unordered_map<uint64_t, int> edges;
+		countEdges(indices, welded, edges);
+
+		// by welded vertex: seams and non-manifold edges are locked; open borders can only slide along themselves
+		std::vector<unsigned char> kind(vertexCount, KIND_MANIFOLD);
+		for (GLuint v = 0; v < vertexCount; v++) {
+			if (wedgeCount[v] > 1) {
+				kind[v] = KIND_LOCKED;
+			}
+		}
+
+		std::vector<Quadric> quadrics(vertexCount);
+		memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+
+		for (size_t i = 0; i < indices.size(); i += 3) {
+
+			GLuint corners[3] = { welded[indices[i]], welded[indices[i + 1]], welded[indices[i + 2]] };
+			glm::dvec3 p[3] = { glm::dvec3(positions[corners[0]]), glm::dvec3(positions[corners[1]]), glm::dvec3(positions[corners[2]]) };
+
+			glm::dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+			double length = glm::length(normal);
+			if (length == 0.0) {
+				continue;
+			}
+			normal /= length;
+
+			for (int c = 0; c < 3; c++) {
+				addPlane(quadrics[corners[c]], normal, -glm::dot(normal, p[0]), 1.0);
+			}
+
+			for (int e = 0; e < 3; e++) {
+
+				GLuint a = corners[e];
+				GLuint b = corners[(e + 1) % 3];
+				int triangles = edges[edgeKey(a, b)];
+				if (triangles > 2) {
+					kind[a] = kind[b] = KIND_LOCKED;
+				}
+				if (triangles != 1) {
+					continue;
+				}
+
+				// plane through the border edge, perpendicular to the triangle
+				glm::dvec3 edgeNormal = glm::cross(p[(e + 1) % 3] - p[e], normal);
+				double edgeLength = glm::length(edgeNormal);
+				if (edgeLength > 0.0) {
+					edgeNormal /= edgeLength;
+					addPlane(quadrics[a], edgeNormal, -glm::dot(edgeNormal, p[e]), BORDER_WEIGHT);
+					addPlane(quadrics[b], edgeNormal, -glm::dot(edgeNormal, p[e]), BORDER_WEIGHT);
+				}
+				for (GLuint corner : { a, b }) {
+					if (kind[corner] == KIND_MANIFOLD) {
+						kind[corner] = KIND_BORDER;
+					}
+				}
+			}
+		}
+
+		std::vector<GLuint> current = indices;
+		std::vector<GLuint> next;
+		std::vector<Collapse> collapses;
+		std::vector<GLuint> adjacencyOffsets(vertexCount + 1);
+		std::vector<GLuint> adjacency;
+		std::vector<GLuint> remap(vertexCount);
+		std::vector<unsigned char> touched(vertexCount);
+		double largestCost = 0.0;
+
+		while (current.size() > targetIndexCount) {
+
+			size_t triangleCount = current.size() / 3;
+			countEdges(current, welded, edges);
+
+			// triangles around every vertex, as offsets into one array
+			std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+			for (size_t i = 0; i < current.size(); i++) {
+				adjacencyOffsets[current[i] + 1]++;
+			}
+			for (size_t v = 0; v < vertexCount; v++) {
+				adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+			}
+			adjacency.resize(current.size());
+			std::vector<GLuint> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < current.size(); i++) {
+				adjacency[cursor[current[i]]++] = (GLuint)(i / 3);
+			}
+
+			collapses.clear();
+			for (size_t i = 0; i < current.size(); i++) {
+
+				GLuint a = current[i];
+				GLuint b = current[i - i % 3 + (i + 1) % 3];
+				GLuint pair[2][2] = { { a, b }, { b, a } };
+				for (int d = 0; d < 2; d++) {
+
+					GLuint from = pair[d][0];
+					GLuint to = pair[d][1];
+					unsigned char fromKind = kind[welded[from]];
+					if (fromKind == KIND_LOCKED) {
+						continue;
+					}
+					if (fromKind == KIND_BORDER && edges[edgeKey(welded[from], welded[to])] != 1) {
+						continue;
+					}
+
+					Quadric combined = quadrics[welded[from]];
+					addQuadric(combined, quadrics[welded[to]]);
+					collapses.push_back({ from, to, evaluate(combined, positions[to]) });
+				}
+			}
+
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+				return x.cost < y.cost;
+			});
+
+			for (GLuint v = 0; v < vertexCount; v++) {
+				remap[v] = v;
+			}
+			std::fill(touched.begin(), touched.end(), 0);
+
+			// every vertex a collapse affects is left alone for the rest of the pass, so the collapses of
+			// one pass are independent; only the cheaper half is tried, the rest waits for the next pass
+			size_t trianglesToRemove = triangleCount - targetIndexCount / 3;
+			size_t removed = 0;
+			size_t collapsed = 0;
+			size_t candidates = std::max<size_t>(1, collapses.size() / 2);
+			for (size_t c = 0; c < candidates && removed < trianglesToRemove; c++) {
+
+				const Collapse& collapse = collapses[c];
+				if (collapse.cost > maxCost) {
+					break;
+				}
+				GLuint from = collapse.from;
+				GLuint target = welded[collapse.to];
+				if (welded[from] == target || touched[welded[from]] || touched[target]) {
+					continue;
+				}
+
+				// the triangles that stay must not turn over
+				bool flips = false;
+				size_t disappearing = 0;
+				for (GLuint k = adjacencyOffsets[from]; k < adjacencyOffsets[from + 1] && !flips; k++) {
+
+					const GLuint* triangle = &current[adjacency[k] * 3];
+					glm::vec3 before[3];
+					glm::vec3 after[3];
+					bool degenerate = false;
+					for (int e = 0; e < 3; e++) {
+						before[e] = positions[triangle[e]];
+						after[e] = triangle[e] == from ? positions[collapse.to] : before[e];
+						degenerate = degenerate || welded[triangle[e]] == target;
+					}
+
+					if (degenerate) {
+						disappearing++;
+						continue;
+					}
+
+					glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+					glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+					flips = glm::dot(normalBefore, normalAfter) <= 0.0f;
+				}
+
+				if (flips) {
+					continue;
+				}
+
+				remap[from] = collapse.to;
+				addQuadric(quadrics[target], quadrics[welded[from]]);
+				largestCost = std::max(largestCost, collapse.cost);
+				removed += disappearing;
+				collapsed++;
+
+				for (GLuint k = adjacencyOffsets[from]; k < adjacencyOffsets[from + 1]; k++) {
+					for (int e = 0; e < 3; e++) {
+						touched[welded[current[adjacency[k] * 3 + e]]] = 1;
+					}
+				}
+			}
+
+			if (collapsed == 0) {
+				break;
+			}
+
+			next.clear();
+			for (size_t i = 0; i < current.size(); i += 3) {
+
+				GLuint a = remap[current[i]];
+				GLuint b = remap[current[i + 1]];
+				GLuint c = remap[current[i + 2]];
+				if (welded[a] == welded[b] || welded[b] == welded[c] || welded[c] == welded[a]) {
+					continue;
+				}
+				next.push_back(a);
+				next.push_back(b);
+				next.push_back(c);
+			}
+			current.swap(next);
+		}
+
+		destination.swap(current);
+		return (float)std::sqrt(largestCost);
+	}
+
+	void buildLodChain(const std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices, std::vector<gps::MeshLod>& lods) {
+
+		lods.clear();
+		lods.push_back({ 0, (GLuint)indices.size(), 0.0f });
+
+		std::vector<glm::vec3> positions(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++) {
+			positions[v] = vertices[v].Position;
+		}
+
+		std::vector<GLuint> previous = indices;
+		std::vector<GLuint> simplified;
+		float error = 0.0f;
+
+		while (lods.size() < MAX_LODS && previous.size() / 3 >= 2 * MIN_LOD_TRIANGLES) {
+
+			size_t target = (size_t)(previous.size() / 3 * LOD_REDUCTION) * 3;
+			float levelError = simplifyMesh(positions, previous, target, simplified);
+			if (simplified.size() > previous.size() * MIN_LOD_REDUCTION) {
+				break;
+			}
+
+			// each level is measured against the one before it, so the errors add up
+			error += levelError;
+			lods.push_back({ (GLuint)indices.size(), (GLuint)simplified.size(), error });
+			indices.insert(indices.end(), simplified.begin(), simplified.end());
+			previous.swap(simplified);
+		}
+	}
+
+	float buildShadowProxy(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, float maxError,
+		std::vector<glm::vec3>& proxyPositions, std::vector<GLuint>& proxyIndices) {
+
+		// one vertex per position, so normals and texture coordinates no longer split the surface
+		std::vector<glm::vec3> welded;
+		std::vector<GLuint> weldedIndices(indices.size());
+		std::unordered_map<PositionKey, GLuint, PositionKeyHash> positionIds;
+		positionIds.reserve(positions.size());
+		for (size_t i = 0; i < indices.size(); i++) {
+
+			PositionKey key;
+			memcpy(&key, &positions[indices[i]], sizeof(key));
+			std::pair<std::unordered_map<PositionKey, GLuint, PositionKeyHash>::iterator, bool> inserted =
+				positionIds.emplace(key, (GLuint)welded.size());
+			if (inserted.second) {
+				welded.push_back(positions[indices[i]]);
+			}
+			weldedIndices[i] = inserted.first->second;
+		}
+
+		std::vector<GLuint> simplified;
+		float error = 0.0f;
+		if (maxError > 0.0f) {
+			error = simplifyMesh(welded, weldedIndices, 0, simplified, maxError);
+		}
+		else {
+			simplified.swap(weldedIndices);
+		}
+
+		// keep only the vertices that are still referenced, in first-use order for the vertex cache
+		std::vector<GLuint> remap(welded.size(), UINT32_MAX);
+		proxyPositions.clear();
+		proxyIndices.resize(simplified.size());
+		for (size_t i = 0; i < simplified.size(); i++) {
+
+			GLuint& id = remap[simplified[i]];
+			if (id == UINT32_MAX) {
+				id = (GLuint)proxyPositions.size();
+				proxyPositions.push_back(welded[simplified[i]]);
+			}
+			proxyIndices[i] = id;
+		}
+
+		return error;
+	}
+}
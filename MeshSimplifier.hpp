@@ -0,0 +1,45 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cfloat>
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Quadric error metric simplification (Garland & Heckbert) by half-edge collapses: a vertex is only
+    // ever moved onto one of its neighbours, so every level indexes the same vertex buffer. Each vertex
+    // keeps the sum of the squared-distance quadrics of the planes around it; collapses are made
+    // cheapest first, in passes of independent collapses, until the triangle count is reached.
+    //
+    // Vertices that share a position with other vertices (seams between texture or normal wedges) stay
+    // in place so the seam can't tear; vertices on an open border only slide along it.
+
+    // welded[v] is the first vertex with exactly the position of v, which gives the connectivity of a mesh
+    // whose vertices are split along normal and texture seams
+    void weldPositions(const std::vector<glm::vec3>& positions, std::vector<GLuint>& welded);
+
+    // Fills destination with a simplified copy of the triangles in indices, aiming for targetIndexCount
+    // indices but stopping early rather than making a collapse that costs more than maxError. Returns the
+    // error introduced: about the largest distance, in model units, by which the simplified surface
+    // strays from the input
+    float simplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices,
+        size_t targetIndexCount, std::vector<GLuint>& destination, float maxError = FLT_MAX);
+
+    // Appends a chain of LODs to indices, which holds the full mesh on input, halving the triangles at
+    // every level; lods gets one range of indices per level, LOD 0 first. The chain stops early when a
+    // level can no longer be reduced much, or gets too small to be worth it
+    void buildLodChain(const std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices, std::vector<gps::MeshLod>& lods);
+
+    // Position-only copy of a mesh for depth-only passes: vertices are welded by position alone, which
+    // removes the seams the other levels must keep, then simplified as far as maxError allows (0 only
+    // welds). proxyPositions holds just the vertices proxyIndices uses. Returns the error introduced
+    float buildShadowProxy(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, float maxError,
+        std::vector<glm::vec3>& proxyPositions, std::vector<GLuint>& proxyIndices);
+}
+
+#endif /* MeshSimplifier_hpp */
@@ -0,0 +1,271 @@
+#include "Meshlets.hpp"
+
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace gps {
+
+	static const size_t MESHLET_MAX_VERTICES = 64;
+	static const size_t MESHLET_MAX_TRIANGLES = 124;
+	// Clusters whose normals spread further than this from their average (cosine) can't be cone culled
+	static const float CONE_MIN_SPREAD = 0.1f;
+
+	// Bounding sphere and normal cone of the triangles in [firstIndex, firstIndex + indexCount)
+	static Meshlet finishMeshlet(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices,
+		GLuint firstIndex, GLuint indexCount, GLuint vertexCount) {
+
+		Meshlet meshlet;
+		meshlet.firstIndex = firstIndex;
+		meshlet.indexCount = indexCount;
+		meshlet.vertexCount = vertexCount;
+
+		glm::vec3 minimum(FLT_MAX);
+		glm::vec3 maximum(-FLT_MAX);
+		glm::vec3 normalSum(0.0f);
+		for (GLuint i = firstIndex; i < firstIndex + indexCount; i += 3) {
+
+			glm::vec3 a = vertices[indices[i]].Position;
+			glm::vec3 b = vertices[indices[i + 1]].Position;
+			glm::vec3 c = vertices[indices[i + 2]].Position;
+			minimum = glm::min(minimum, glm::min(a, glm::min(b, c)));
+			maximum = glm::max(maximum, glm::max(a, glm::max(b, c)));
+
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float length = glm::length(normal);
+			if (length > 0.0f) {
+				normalSum += normal / length;
+			}
+		}
+
+		meshlet.center = (minimum + maximum) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (GLuint i = firstIndex; i < firstIndex + indexCount; i++) {
+			meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+		}
+
+		// the cone holds every face normal; a cutoff of 1 never culls
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 1.0f;
+		float sumLength = glm::length(normalSum);
+		if (sumLength == 0.0f) {
+			return meshlet;
+		}
+
+		glm::vec3 axis = normalSum / sumLength;
+		float minimumDot = 1.0f;
+		for (GLuint i = firstIndex; i < firstIndex + indexCount; i += 3) {
+
+			glm::vec3 a = vertices[indices[i]].Position;
+			glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+			float length = glm::length(normal);
+			if (length > 0.0f) {
+				minimumDot = std::min(minimumDot, glm::dot(axis, normal / length));
+			}
+		}
+
+		if (minimumDot > CONE_MIN_SPREAD) {
+			meshlet.coneAxis = axis;
+			// sine of the cone's half angle, measured from the plane perpendicular to the axis
+			meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+		}
+		return meshlet;
+	}
+
+	void buildMeshlets(const std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices, size_t triangleIndexCount,
+		std::vector<gps::Meshlet>& meshlets) {
+
+		meshlets.clear();
+		size_t triangleCount = triangleIndexCount / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// neighbours are found through positions, so seams don't split a cluster
+		std::vector<glm::vec3> positions(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++) {
+			positions[v] = vertices[v].Position;
+		}
+		std::vector<GLuint> welded;
+		weldPositions(positions, welded);
+
+		// triangles around every welded vertex, as offsets into one array
+		std::vector<GLuint> adjacencyOffsets(vertices.size() + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacencyOffsets[welded[indices[i]] + 1]++;
+		}
+		for (size_t v = 0; v < vertices.size(); v++) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		std::vector<GLuint> adjacency(triangleCount * 3);
+		std::vector<GLuint> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[cursor[welded[indices[i]]]++] = (GLuint)(i / 3);
+		}
+
+		std::vector<unsigned char> emitted(triangleCount, 0);
+		// meshlet a vertex, or a triangle in the frontier, was last added to; meshlet ids start at 1
+		std::vector<GLuint> vertexMeshlet(vertices.size(), 0);
+		std::vector<GLuint> frontierMeshlet(triangleCount, 0);
+		std::vector<GLuint> frontier;
+		std::vector<GLuint> reordered;
+		reordered.reserve(triangleCount * 3);
+
+		GLuint meshletId = 1;
+		GLuint meshletVertices = 0;
+		GLuint meshletStart = 0;
+		glm::vec3 positionSum(0.0f);
+		size_t nextSeed = 0;
+
+		while (reordered.size() < triangleCount * 3) {
+
+			// the frontier triangle that adds the fewest vertices, then the one nearest the cluster
+			size_t best = SIZE_MAX;
+			int bestNew = 4;
+			float bestDistance = FLT_MAX;
+			glm::vec3 center = meshletVertices > 0 ? positionSum / (float)meshletVertices : glm::vec3(0.0f);
+			for (size_t f = 0; f < frontier.size(); ) {
+
+				GLuint t = frontier[f];
+				if (emitted[t]) {
+					frontier[f] = frontier.back();
+					frontier.pop_back();
+					continue;
+				}
+
+				int added = 0;
+				for (int c = 0; c < 3; c++) {
+					added += vertexMeshlet[indices[t * 3 + c]] != meshletId;
+				}
+				if (meshletVertices + added <= MESHLET_MAX_VERTICES) {
+
+					glm::vec3 centroid = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) / 3.0f;
+					float distance = glm::length(centroid - center);
+					if (added < bestNew || (added == bestNew && distance < bestDistance)) {
+						best = f;
+						bestNew = added;
+						bestDistance = distance;
+					}
+				}
+				f++;
+			}
+
+			GLuint triangle;
+			if (best != SIZE_MAX) {
+				triangle = frontier[best];
+			}
+			else if (reordered.size() == meshletStart) {
+				// empty cluster: seed it with the next triangle in file order
+				while (emitted[nextSeed]) {
+					nextSeed++;
+				}
+				triangle = (GLuint)nextSeed;
+			}
+			else {
+				// nothing connected fits any more
+				meshlets.push_back(finishMeshlet(vertices, reordered, meshletStart, (GLuint)reordered.size() - meshletStart, meshletVertices));
+				meshletId++;
+				meshletVertices = 0;
+				meshletStart = (GLuint)reordered.size();
+				positionSum = glm::vec3(0.0f);
+				frontier.clear();
+				continue;
+			}
+
+			emitted[triangle] = 1;
+			for (int c = 0; c < 3; c++) {
+
+				GLuint vertex = indices[triangle * 3 + c];
+				reordered.push_back(vertex);
+				if (vertexMeshlet[vertex] != meshletId) {
+					vertexMeshlet[vertex] = meshletId;
+					meshletVertices++;
+					positionSum += positions[vertex];
+				}
+
+				GLuint w = welded[vertex];
+				for (GLuint k = adjacencyOffsets[w]; k < adjacencyOffsets[w + 1]; k++) {
+					GLuint neighbour = adjacency[k];
+					if (!emitted[neighbour] && frontierMeshlet[neighbour] != meshletId) {
+						frontierMeshlet[neighbour] = meshletId;
+						frontier.push_back(neighbour);
+					}
+				}
+			}
+
+			if ((reordered.size() - meshletStart) / 3 == MESHLET_MAX_TRIANGLES || reordered.size() == triangleCount * 3) {
+				meshlets.push_back(finishMeshlet(vertices, reordered, meshletStart, (GLuint)reordered.size() - meshletStart, meshletVertices));
+				meshletId++;
+				meshletVertices = 0;
+				meshletStart = (GLuint)reordered.size();
+				positionSum = glm::vec3(0.0f);
+				frontier.clear();
+			}
+		}
+
+		std::copy(reordered.begin(), reordered.end(), indices.begin());
+	}
+
+	void extractFrustumPlanes(const glm::mat4& clip, glm::vec4 planes[6]) {
+
+		// rows of the matrix; glm stores columns
+		glm::vec4 rows[4];
+		for (int r = 0; r < 4; r++) {
+			rows[r] = glm::vec4(clip[0][r], clip[1][r], clip[2][r], clip[3][r]);
+		}
+
+		// left, right, bottom, top, near, far
+		for (int axis = 0; axis < 3; axis++) {
+			planes[axis * 2] = rows[3] + rows[axis];
+			planes[axis * 2 + 1] = rows[3] - rows[axis];
+		}
+
+		for (int p = 0; p < 6; p++) {
+			planes[p] /= glm::length(glm::vec3(planes[p]));
+		}
+	}
+
+	size_t cullMeshlets(const std::vector<gps::Meshlet>& meshlets, const glm::vec4 planes[6], const glm::vec3& cameraPosition,
+		bool coneCulling, std::vector<GLsizei>& counts, std::vector<const GLvoid*>& offsets) {
+
+		counts.clear();
+		offsets.clear();
+		size_t culled = 0;
+		GLuint rangeEnd = 0;
+
+		for (size_t m = 0; m < meshlets.size(); m++) {
+
+			const Meshlet& meshlet = meshlets[m];
+
+			bool visible = true;
+			for (int p = 0; p < 6 && visible; p++) {
+				visible = glm::dot(glm::vec3(planes[p]), meshlet.center) + planes[p].w >= -meshlet.radius;
+			}
+
+			// every triangle faces away when the whole sphere lies inside the cone behind the cluster
+			if (visible && coneCulling) {
+				glm::vec3 toCenter = meshlet.center - cameraPosition;
+				visible = glm::dot(toCenter, meshlet.coneAxis) < meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+			}
+
+			if (!visible) {
+				culled += meshlet.indexCount / 3;
+				continue;
+			}
+
+			// clusters that are neighbours in the index buffer share a range
+			if (!counts.empty() && rangeEnd == meshlet.firstIndex) {
+				counts.back() += meshlet.indexCount;
+			}
+			else {
+				counts.push_back(meshlet.indexCount);
+				offsets.push_back((const GLvoid*)(meshlet.firstIndex * sizeof(GLuint)));
+			}
+			rangeEnd = meshlet.firstIndex + meshlet.indexCount;
+		}
+
+		return culled;
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef Meshlets_hpp
+#define Meshlets_hpp
+
+#include "Mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Meshlets split the full mesh into clusters of at most 64 vertices and 124 neighbouring triangles
+    // (the sizes mesh shading hardware favours), so the CPU can cull at a finer grain than whole meshes:
+    // a cluster outside the frustum, or whose triangles all face away from the camera, is left out of the
+    // draw. Each cluster is a contiguous range of the index buffer, and the ranges that survive are
+    // merged and drawn with one glMultiDrawElements.
+
+    // Groups the first triangleIndexCount indices (LOD 0) into meshlets of neighbouring triangles,
+    // reordering them in place so every meshlet is a contiguous range
+    void buildMeshlets(const std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices, size_t triangleIndexCount,
+        std::vector<gps::Meshlet>& meshlets);
+
+    // Normalized planes (xyz . p + w >= 0 inside) of the frustum of clip = projection * view * model, in
+    // the space the model's vertices are in
+    void extractFrustumPlanes(const glm::mat4& clip, glm::vec4 planes[6]);
+
+    // Fills counts and offsets with the index ranges of the meshlets that may be visible, joining
+    // neighbours into one range. cameraPosition is in model space; coneCulling also drops clusters
+    // facing away from it. Returns the number of triangles culled
+    size_t cullMeshlets(const std::vector<gps::Meshlet>& meshlets, const glm::vec4 planes[6], const glm::vec3& cameraPosition,
+        bool coneCulling, std::vector<GLsizei>& counts, std::vector<const GLvoid*>& offsets);
+}
+
+#endif /* Meshlets_hpp */
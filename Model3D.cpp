@@ -1,7 +1,34 @@
 #include "Model3D.hpp"
 
+#include "GpuMemory.hpp"
+#include "Lightmap.hpp"
+#include "MeshSimplifier.hpp"
+#include "Meshlets.hpp"
+#include "OcclusionCulling.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <utility>
+
 namespace gps {
 
+	// 4 MB holds the transforms and tints of roughly 50k instances before the ring wraps
+	static const GLsizeiptr INSTANCE_STREAM_CAPACITY = 4 * 1024 * 1024;
+
+	// Closer than this to a bounding sphere, the full mesh is always drawn
+	static const float LOD_NEAR_DISTANCE = 0.01f;
+	// An OBJ shape named <name>_shadow is the shadow proxy of the shape <name>
+	static const std::string SHADOW_PROXY_SUFFIX = "_shadow";
+	// Largest side of the lightmap atlas; denser requests are scaled down to fit
+	static const int MAX_LIGHTMAP_SIZE = 2048;
+
+	gps::StreamBuffer Model3D::instanceStream;
+
 	void Model3D::LoadModel(std::string fileName) {
 
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
@@ -13,17 +40,205 @@ namespace gps {
 		ReadOBJ(fileName, basePath);
 	}
 
-	// Draw each mesh from the model
+	// Draw each mesh from the model, except those the camera's PVS leaves out or found occluded
 	void Model3D::Draw(gps::Shader shaderProgram) {
 
+		for (int i = 0; i < meshes.size(); i++) {
+
+			if (!isMeshVisible(i)) {
+				renderStats.countCulled(meshes[i].getCurrentLod().indexCount / 3);
+				continue;
+			}
+			if (occlusionCulling == NULL) {
+				meshes[i].Draw(shaderProgram);
+				continue;
+			}
+			if (occlusionCulling->beginDraw(i, meshes[i].getCurrentLod().indexCount / 3)) {
+				meshes[i].Draw(shaderProgram);
+				occlusionCulling->endDraw();
+			}
+		}
+	}
+
+	// Upload the instance data once and draw every mesh of the model with it
+	void Model3D::DrawInstanced(gps::Shader shaderProgram, const glm::mat4* transforms, const glm::vec4* tints, GLsizei instanceCount) {
+
+		if (instanceCount <= 0) {
+			return;
+		}
+
+		if (instanceStream.getBuffer() == 0) {
+			instanceStream.init(GL_ARRAY_BUFFER, INSTANCE_STREAM_CAPACITY, "instances");
+		}
+
+		// matrices and tints share one reservation so a wrap cannot orphan one without the other
+		GLsizeiptr matrixBytes = instanceCount * sizeof(glm::mat4);
+		GLsizeiptr tintBytes = tints != NULL ? instanceCount * sizeof(glm::vec4) : 0;
+		GLintptr matrixOffset = 0;
+		char* destination = (char*)instanceStream.map(matrixBytes + tintBytes, &matrixOffset);
+
+		memcpy(destination, transforms, matrixBytes);
+		GLintptr tintOffset = -1;
+		if (tints != NULL) {
+			memcpy(destination + matrixBytes, tints, tintBytes);
+			tintOffset = matrixOffset + matrixBytes;
+		}
+		instanceStream.unmap();
+
 		for (int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shaderProgram);
+			meshes[i].DrawInstanced(shaderProgram, instanceStream.getBuffer(), matrixOffset, tintOffset, instanceCount);
+	}
+
+	// Draw the shadow casters: each mesh's proxy where it has one. The PVS is the camera's, so meshes
+	// outside it still cast their shadows into view
+	void Model3D::DrawShadow(gps::Shader shaderProgram) {
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].DrawShadow(shaderProgram);
+	}
+
+	std::vector<gps::Mesh>& Model3D::getMeshes() {
+		return meshes;
+	}
+
+	void Model3D::setShadowProxyError(float maxError) {
+		this->shadowProxyError = maxError;
+	}
+
+	void Model3D::setLightmapDensity(float texelsPerUnit) {
+		this->lightmapDensity = texelsPerUnit;
+	}
+
+	int Model3D::getLightmapWidth() const {
+		return this->lightmapWidth;
+	}
+
+	int Model3D::getLightmapHeight() const {
+		return this->lightmapHeight;
+	}
+
+	void Model3D::setVertexOcclusion(const std::vector<std::vector<float> >& occlusion) {
+
+		for (size_t i = 0; i < meshes.size() && i < occlusion.size(); i++) {
+
+			bool tracked = meshes[i].getOcclusionBuffer() != 0;
+			meshes[i].setOcclusion(occlusion[i]);
+			if (!tracked && meshes[i].getOcclusionBuffer() != 0) {
+				trackGpuBuffer(meshes[i].getOcclusionBuffer(), occlusion[i].size() * sizeof(float), this->name,
+					"mesh " + std::to_string(i) + " ambient occlusion");
+			}
+		}
+	}
+
+	// Pick the coarsest LOD of each mesh whose error stays under maxPixelError pixels on screen
+	void Model3D::selectLods(const glm::mat4& model, const glm::vec3& cameraPosition, float pixelsPerUnit, float maxPixelError, float hysteresis) {
+
+		// the largest axis scale bounds how much the model matrix stretches an error
+		float worldScale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			gps::Mesh& mesh = meshes[i];
+			if (maxPixelError <= 0.0f || mesh.lods.size() < 2) {
+				mesh.currentLod = 0;
+				continue;
+			}
+
+			// distance to the nearest point of the bounding sphere; from inside it the full mesh is drawn
+			glm::vec3 center = glm::vec3(model * glm::vec4(mesh.boundsCenter, 1.0f));
+			float distance = glm::length(center - cameraPosition) - mesh.boundsRadius * worldScale;
+			if (distance <= LOD_NEAR_DISTANCE) {
+				mesh.currentLod = 0;
+				continue;
+			}
+			float pixelsPerModelUnit = worldScale * pixelsPerUnit / distance;
+
+			// a level is only left once it is clearly past the threshold, so a camera resting near
+			// a switching distance doesn't flicker between two levels
+			int current = std::min(mesh.currentLod, (int)mesh.lods.size() - 1);
+			while (current > 0 && mesh.lods[current].error * pixelsPerModelUnit > maxPixelError * (1.0f + hysteresis)) {
+				current--;
+			}
+			while (current + 1 < (int)mesh.lods.size() && mesh.lods[current + 1].error * pixelsPerModelUnit <= maxPixelError / (1.0f + hysteresis)) {
+				current++;
+			}
+			mesh.currentLod = current;
+		}
+	}
+
+	// Leave out of LOD 0 the meshlets the camera can't see
+	void Model3D::cullMeshlets(const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, bool coneCulling) {
+
+		PROFILE_FUNCTION();
+
+		// the tests run in model space, so the meshlet bounds are used as stored
+		glm::vec4 planes[6];
+		extractFrustumPlanes(viewProjection * model, planes);
+		glm::vec3 modelCamera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+
+		std::vector<GLsizei> counts;
+		std::vector<const GLvoid*> offsets;
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			if (!isMeshVisible(i)) {
+				continue;
+			}
+			if (meshes[i].meshlets.empty()) {
+				meshes[i].clearVisibleRanges();
+				continue;
+			}
+			size_t culled = gps::cullMeshlets(meshes[i].meshlets, planes, modelCamera, coneCulling, counts, offsets);
+			meshes[i].setVisibleRanges(counts, offsets, culled);
+		}
+	}
+
+	void Model3D::clearMeshletCulling() {
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].clearVisibleRanges();
+	}
+
+	// Hide the meshes the camera's cell can't see
+	int Model3D::cullPvs(const gps::Pvs& pvs, const glm::mat4& model, const glm::vec3& cameraPosition) {
+
+		glm::vec3 modelCamera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+		int cell = pvs.findCell(modelCamera);
+		if (cell < 0 || pvs.getMeshCount() != meshes.size()) {
+			meshVisible.clear();
+			return -1;
+		}
+
+		const uint8_t* set = pvs.getVisibleSet(cell);
+		meshVisible.resize(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			meshVisible[i] = (set[i / 8] >> (i % 8)) & 1;
+		}
+		return cell;
+	}
+
+	bool Model3D::isMeshVisible(size_t mesh) const {
+		return meshVisible.empty() || meshVisible[mesh] != 0;
+	}
+
+	size_t Model3D::getVisibleMeshCount() const {
+		return meshVisible.empty() ? meshes.size() : (size_t)std::count(meshVisible.begin(), meshVisible.end(), 1);
+	}
+
+	void Model3D::setOcclusionCulling(gps::OcclusionCulling* occlusionCulling) {
+		this->occlusionCulling = occlusionCulling;
+	}
+
+	gps::OcclusionCulling* Model3D::getOcclusionCulling() const {
+		return occlusionCulling;
 	}
 
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
 
+		PROFILE_FUNCTION();
+
         std::cout << "Loading : " << fileName << std::endl;
+		this->name = fileName;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
@@ -46,12 +261,17 @@ namespace gps {
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		std::vector<std::vector<gps::Vertex> > shapeVertices(shapes.size());
+		std::vector<std::vector<GLuint> > shapeIndices(shapes.size());
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
 
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			std::vector<gps::Vertex>& vertices = shapeVertices[s];
+			std::vector<GLuint>& indices = shapeIndices[s];
+			// corners that reference the same position, normal and texture coordinates share a vertex,
+			// which both shrinks the buffer and lets the simplifier see which triangles are connected
+			std::map<std::tuple<int, int, int>, GLuint> vertexIds;
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -68,6 +288,14 @@ namespace gps {
 					// access to vertex
 					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 
+					std::tuple<int, int, int> key(idx.vertex_index, idx.normal_index, idx.texcoord_index);
+					std::map<std::tuple<int, int, int>, GLuint>::iterator found = vertexIds.find(key);
+					if (found != vertexIds.end()) {
+
+						indices.push_back(found->second);
+						continue;
+					}
+
 					float vx = attrib.vertices[3 * idx.vertex_index + 0];
 					float vy = attrib.vertices[3 * idx.vertex_index + 1];
 					float vz = attrib.vertices[3 * idx.vertex_index + 2];
@@ -92,13 +320,118 @@ namespace gps {
 					currentVertex.Normal = vertexNormal;
 					currentVertex.TexCoords = vertexTexCoords;
 
+					vertexIds[key] = (GLuint)vertices.size();
+					indices.push_back((GLuint)vertices.size());
 					vertices.push_back(currentVertex);
-
-					indices.push_back((GLuint)(index_offset + v));
 				}
 
 				index_offset += fv;
 			}
+		}
+
+		// pair the shadow proxies supplied in the file with the shapes they stand in for
+		std::vector<int> suppliedProxy(shapes.size(), -1);
+		std::vector<bool> isProxy(shapes.size(), false);
+		for (size_t s = 0; s < shapes.size(); s++) {
+
+			const std::string& shapeName = shapes[s].name;
+			if (shapeName.size() <= SHADOW_PROXY_SUFFIX.size() ||
+				shapeName.compare(shapeName.size() - SHADOW_PROXY_SUFFIX.size(), std::string::npos, SHADOW_PROXY_SUFFIX) != 0) {
+				continue;
+			}
+
+			// never drawn in the colour passes, even when proxies are off
+			isProxy[s] = true;
+			std::string owner = shapeName.substr(0, shapeName.size() - SHADOW_PROXY_SUFFIX.size());
+			size_t o = 0;
+			while (o < shapes.size() && shapes[o].name != owner) {
+				o++;
+			}
+			if (o < shapes.size()) {
+				suppliedProxy[o] = (int)s;
+			}
+			else {
+				std::cerr << "No shape " << owner << " for the shadow proxy " << shapeName << std::endl;
+			}
+		}
+
+		// the simplification is the slow part of loading, and each shape is independent
+		std::vector<std::vector<gps::MeshLod> > shapeLods(shapes.size());
+		std::vector<std::vector<gps::Meshlet> > shapeMeshlets(shapes.size());
+		std::vector<std::vector<glm::vec3> > proxyPositions(shapes.size());
+		std::vector<std::vector<GLuint> > proxyIndices(shapes.size());
+		std::vector<gps::LightmapCharts> shapeCharts(shapes.size());
+		{
+			PROFILE_ZONE("buildLodChains");
+			float proxyError = this->shadowProxyError;
+			bool lightmapCharts = this->lightmapDensity > 0.0f;
+			parallelFor(shapes.size(), 1, [&](size_t begin, size_t end) {
+				for (size_t s = begin; s < end; s++) {
+
+					if (isProxy[s]) {
+						continue;
+					}
+
+					// before the LODs are appended, while the indices are still just the full mesh
+					if (proxyError >= 0.0f) {
+						size_t source = suppliedProxy[s] >= 0 ? (size_t)suppliedProxy[s] : s;
+						std::vector<glm::vec3> positions(shapeVertices[source].size());
+						for (size_t v = 0; v < positions.size(); v++) {
+							positions[v] = shapeVertices[source][v].Position;
+						}
+						buildShadowProxy(positions, shapeIndices[source], suppliedProxy[s] >= 0 ? 0.0f : proxyError,
+							proxyPositions[s], proxyIndices[s]);
+					}
+
+					// the chart borders split vertices, which the meshlets and every LOD then keep
+					if (lightmapCharts) {
+						buildLightmapCharts(shapeVertices[s], shapeIndices[s], shapeCharts[s]);
+					}
+
+					// the clusters reorder the full mesh, which the LOD chain then starts from
+					buildMeshlets(shapeVertices[s], shapeIndices[s], shapeIndices[s].size(), shapeMeshlets[s]);
+					buildLodChain(shapeVertices[s], shapeIndices[s], shapeLods[s]);
+				}
+			});
+		}
+
+		// one atlas for the whole model, in the order the meshes are created
+		std::vector<std::vector<glm::vec2> > lightmapCoords;
+		this->lightmapWidth = 0;
+		this->lightmapHeight = 0;
+		if (this->lightmapDensity > 0.0f) {
+
+			PROFILE_ZONE("packLightmapAtlas");
+			std::vector<gps::LightmapCharts> meshCharts;
+			for (size_t s = 0; s < shapes.size(); s++) {
+				if (!isProxy[s]) {
+					meshCharts.push_back(std::move(shapeCharts[s]));
+				}
+			}
+			float density = packLightmapAtlas(meshCharts, this->lightmapDensity, MAX_LIGHTMAP_SIZE, lightmapCoords,
+				this->lightmapWidth, this->lightmapHeight);
+			if (density > 0.0f) {
+				std::cout << "# lightmap : " << this->lightmapWidth << "x" << this->lightmapHeight << " texels, "
+					<< density << " per unit" << std::endl;
+			}
+			else {
+				std::cerr << "Could not pack the lightmap charts of " << fileName << std::endl;
+				lightmapCoords.clear();
+			}
+		}
+
+		size_t fullTriangles = 0;
+		size_t proxyTriangles = 0;
+
+		for (size_t s = 0; s < shapes.size(); s++) {
+
+			if (isProxy[s]) {
+				continue;
+			}
+
+			std::vector<gps::Vertex>& vertices = shapeVertices[s];
+			std::vector<GLuint>& indices = shapeIndices[s];
+			std::vector<gps::Texture> textures;
 
 			// get material id
 			// Only try to read materials if the .mtl file is present
@@ -146,13 +479,45 @@ namespace gps {
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			meshes.push_back(gps::Mesh(vertices, indices, textures, shapeLods[s]));
+			meshes.back().meshlets.swap(shapeMeshlets[s]);
+
+			gps::Buffers buffers = meshes.back().getBuffers();
+			trackGpuBuffer(buffers.VBO, vertices.size() * sizeof(gps::Vertex), this->name, shapes[s].name + " vertices");
+			trackGpuBuffer(buffers.EBO, indices.size() * sizeof(GLuint), this->name,
+				shapes[s].name + " indices (" + std::to_string(shapeLods[s].size()) + " LODs)");
+
+			size_t meshIndex = meshes.size() - 1;
+			if (meshIndex < lightmapCoords.size()) {
+				meshes.back().setLightmapCoords(lightmapCoords[meshIndex]);
+				trackGpuBuffer(meshes.back().getLightmapBuffer(), lightmapCoords[meshIndex].size() * sizeof(glm::vec2), this->name,
+					shapes[s].name + " lightmap coordinates");
+			}
+
+			fullTriangles += shapeLods[s][0].indexCount / 3;
+			if (!proxyIndices[s].empty()) {
+
+				meshes.back().setShadowProxy(proxyPositions[s], proxyIndices[s]);
+				gps::Buffers shadowBuffers = meshes.back().getShadowBuffers();
+				trackGpuBuffer(shadowBuffers.VBO, proxyPositions[s].size() * sizeof(glm::vec3), this->name, shapes[s].name + " shadow proxy positions");
+				trackGpuBuffer(shadowBuffers.EBO, proxyIndices[s].size() * sizeof(GLuint), this->name, shapes[s].name + " shadow proxy indices");
+				proxyTriangles += proxyIndices[s].size() / 3;
+			}
+			else {
+				proxyTriangles += shapeLods[s][0].indexCount / 3;
+			}
+		}
+
+		if (this->shadowProxyError >= 0.0f) {
+			std::cout << "# shadow proxy : " << proxyTriangles << " of " << fullTriangles << " triangles" << std::endl;
 		}
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
 	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
 
+			PROFILE_FUNCTION();
+
 			for (int i = 0; i < loadedTextures.size(); i++) {
 
 				if (loadedTextures[i].path == path)	{
@@ -164,6 +529,9 @@ namespace gps {
 
 			gps::Texture currentTexture;
 			currentTexture.id = ReadTextureFromFile(path.c_str());
+			if (currentTexture.id != 0) {
+				trackGpuTexture(GL_TEXTURE_2D, currentTexture.id, this->name, path);
+			}
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
 
@@ -236,11 +604,12 @@ namespace gps {
 		return textureID;
 	}
 
-	Model3D::~Model3D() {
+	void Model3D::Unload() {
 
         for (size_t i = 0; i < loadedTextures.size(); i++) {
 
             glDeleteTextures(1, &loadedTextures.at(i).id);
+            releaseGpuResource(GPU_TEXTURE, loadedTextures.at(i).id);
         }
 
         for (size_t i = 0; i < meshes.size(); i++) {
@@ -251,6 +620,45 @@ namespace gps {
             glDeleteBuffers(1, &VBO);
             glDeleteBuffers(1, &EBO);
             glDeleteVertexArrays(1, &VAO);
+            releaseGpuResource(GPU_BUFFER, VBO);
+            releaseGpuResource(GPU_BUFFER, EBO);
+
+            GLuint occlusionBuffer = meshes.at(i).getOcclusionBuffer();
+            if (occlusionBuffer != 0) {
+
+                glDeleteBuffers(1, &occlusionBuffer);
+                releaseGpuResource(GPU_BUFFER, occlusionBuffer);
+            }
+
+            GLuint lightmapBuffer = meshes.at(i).getLightmapBuffer();
+            if (lightmapBuffer != 0) {
+
+                glDeleteBuffers(1, &lightmapBuffer);
+                releaseGpuResource(GPU_BUFFER, lightmapBuffer);
+            }
+
+            if (meshes.at(i).hasShadowProxy()) {
+
+                gps::Buffers shadowBuffers = meshes.at(i).getShadowBuffers();
+                glDeleteBuffers(1, &shadowBuffers.VBO);
+                glDeleteBuffers(1, &shadowBuffers.EBO);
+                glDeleteVertexArrays(1, &shadowBuffers.VAO);
+                releaseGpuResource(GPU_BUFFER, shadowBuffers.VBO);
+                releaseGpuResource(GPU_BUFFER, shadowBuffers.EBO);
+            }
         }
+
+        loadedTextures.clear();
+        meshes.clear();
+	}
+
+	void Model3D::UnloadInstanceStream() {
+
+		instanceStream.release();
+	}
+
+	Model3D::~Model3D() {
+
+		Unload();
 	}
 }
@@ -2,6 +2,8 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "Pvs.hpp"
+#include "StreamBuffer.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
@@ -12,6 +14,8 @@
 
 namespace gps {
 
+    class OcclusionCulling;
+
     class Model3D {
 
     public:
@@ -21,13 +25,91 @@ namespace gps {
 
 		void LoadModel(std::string fileName, std::string basePath);
 
+		// Frees the textures and mesh buffers; the destructor does it too, but only if a context is still current then
+		void Unload();
+
+		// Frees the instance stream all the models share - once none of them draws again
+		static void UnloadInstanceStream();
+
 		void Draw(gps::Shader shaderProgram);
 
+		// Depth-only draw of the model for the shadow pass, through the meshes' shadow proxies
+		void DrawShadow(gps::Shader shaderProgram);
+
+		// Draws instanceCount copies of the model with one draw call per mesh.
+		// transforms holds one model matrix per instance (combined with the "model" uniform);
+		// tints is optional and multiplies the diffuse color of each instance.
+		void DrawInstanced(gps::Shader shaderProgram, const glm::mat4* transforms, const glm::vec4* tints, GLsizei instanceCount);
+
+		// Component meshes, for passes that walk the geometry themselves
+		std::vector<gps::Mesh>& getMeshes();
+
+		// Before LoadModel: give every mesh a position-only shadow proxy, taken from a shape named
+		// <name>_shadow in the file when there is one, else generated by simplifying the mesh as long as
+		// it stays within maxError model units. Negative (the default) loads no proxies
+		void setShadowProxyError(float maxError);
+
+		// Before LoadModel: split every mesh into lightmap charts and pack them into one atlas at
+		// texelsPerUnit texels per model unit, lower if it would outgrow 2048 texels a side. Negative
+		// (the default) gives the meshes no lightmap coordinates
+		void setLightmapDensity(float texelsPerUnit);
+
+		// Size of the lightmap atlas in texels, 0 without one
+		int getLightmapWidth() const;
+		int getLightmapHeight() const;
+
+		// After LoadModel: per-vertex ambient occlusion for every mesh, as baked by bakeVertexOcclusion
+		void setVertexOcclusion(const std::vector<std::vector<float> >& occlusion);
+
+		// Sets the LOD every mesh draws with: the coarsest whose error, projected from the mesh's
+		// bounding sphere, stays within maxPixelError pixels. pixelsPerUnit is the size on screen of
+		// one unit at distance 1 (viewport height / (2 tan(fov / 2))). A level only changes once its
+		// error is a hysteresis fraction past the threshold; maxPixelError <= 0 draws the full meshes
+		void selectLods(const glm::mat4& model, const glm::vec3& cameraPosition, float pixelsPerUnit, float maxPixelError, float hysteresis);
+
+		// Culls the meshlets of the meshes drawn at LOD 0 against the frustum of viewProjection and, with
+		// coneCulling, against the direction they face from cameraPosition; the draws until the next call
+		// submit only the clusters left
+		void cullMeshlets(const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, bool coneCulling);
+
+		// Draw the meshes whole again
+		void clearMeshletCulling();
+
+		// Leaves out of Draw, until the next call, the meshes outside the potentially visible set of the
+		// cell holding cameraPosition (in world space); outside the grid every mesh is drawn. Run it before
+		// cullMeshlets, which then skips the hidden meshes. Returns the cell, -1 outside the grid
+		int cullPvs(const gps::Pvs& pvs, const glm::mat4& model, const glm::vec3& cameraPosition);
+
+		// Whether Draw draws the mesh, after cullPvs
+		bool isMeshVisible(size_t mesh) const;
+
+		// Meshes Draw draws, after cullPvs
+		size_t getVisibleMeshCount() const;
+
+		// Draw wraps every mesh in the occlusion test of occlusionCulling, which must have been set up for
+		// this model; NULL (the default) draws without one
+		void setOcclusionCulling(gps::OcclusionCulling* occlusionCulling);
+
+		gps::OcclusionCulling* getOcclusionCulling() const;
+
     private:
+		// The .obj file, owner of the GPU memory of the model
+		std::string name;
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		// -1: no shadow proxies
+		float shadowProxyError = -1.0f;
+		// -1: no lightmap charts
+		float lightmapDensity = -1.0f;
+		int lightmapWidth = 0;
+		int lightmapHeight = 0;
+		// per mesh, set by cullPvs: 1 drawn, 0 outside the camera's PVS; empty draws every mesh
+		std::vector<unsigned char> meshVisible;
+		gps::OcclusionCulling* occlusionCulling = NULL;
+		// Per-instance data shared by all instanced draws
+		static gps::StreamBuffer instanceStream;
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
@@ -0,0 +1,237 @@
+#include "OcclusionCulling.hpp"
+
+#include "Model3D.hpp"
+#include "RenderStats.hpp"
+
+#include "glm/gtc/type_ptr.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace gps {
+
+	// Readback mode tests the meshes it last saw every this many frames, staggered across the meshes
+	static const uint64_t VISIBLE_QUERY_INTERVAL = 4;
+	// The boxes grow by this share of their size on every side, plus BOX_PADDING model units
+	static const float BOX_MARGIN = 0.01f;
+	static const float BOX_PADDING = 0.01f;
+	// Closer than this to a box, the near plane could cut its front faces away and hide it
+	static const float CAMERA_MARGIN = 1.0f;
+	static const GLsizei BOX_VERTICES = 36;
+
+	void OcclusionCulling::init(OCCLUSION_CULLING mode, int minTriangles) {
+
+		this->mode = mode;
+		this->minTriangles = (uint64_t)std::max(minTriangles, 0);
+		if (mode == OCCLUSION_CULL_NONE) {
+			return;
+		}
+
+		this->shader.loadShader("shaders/occlusionBox.vert", "shaders/occlusionBox.frag");
+		glGenVertexArrays(1, &this->VAO);
+	}
+
+	void OcclusionCulling::beginFrame(gps::Model3D& model, const glm::mat4& modelMatrix, const glm::vec3& cameraPosition) {
+
+		if (this->mode == OCCLUSION_CULL_NONE) {
+			return;
+		}
+
+		std::vector<gps::Mesh>& meshes = model.getMeshes();
+		if (this->meshes.size() != meshes.size()) {
+
+			this->meshes.assign(meshes.size(), MeshState());
+			for (size_t i = 0; i < meshes.size(); i++) {
+
+				glm::vec3 minimum(FLT_MAX);
+				glm::vec3 maximum(-FLT_MAX);
+				for (size_t v = 0; v < meshes[i].vertices.size(); v++) {
+					minimum = glm::min(minimum, meshes[i].vertices[v].Position);
+					maximum = glm::max(maximum, meshes[i].vertices[v].Position);
+				}
+				glm::vec3 margin = (maximum - minimum) * BOX_MARGIN + glm::vec3(BOX_PADDING);
+				this->meshes[i].boxMin = minimum - margin;
+				this->meshes[i].boxMax = maximum + margin;
+			}
+
+			for (int f = 0; f < QUERY_FRAMES; f++) {
+				QueryFrame& queryFrame = this->queryFrames[f];
+				if (!queryFrame.queries.empty()) {
+					glDeleteQueries((GLsizei)queryFrame.queries.size(), queryFrame.queries.data());
+				}
+				queryFrame.queries.assign(meshes.size(), 0);
+				if (!meshes.empty()) {
+					glGenQueries((GLsizei)meshes.size(), queryFrame.queries.data());
+				}
+				queryFrame.pending.assign(meshes.size(), 0);
+				queryFrame.issued.assign(meshes.size(), 0);
+			}
+		}
+
+		this->frame++;
+		this->stats = OcclusionStats();
+
+		// oldest first, starting with the slot this frame takes over
+		for (int age = QUERY_FRAMES; age >= 1; age--) {
+			resolve(this->queryFrames[(this->frame + QUERY_FRAMES - age) % QUERY_FRAMES]);
+		}
+
+		QueryFrame& current = this->queryFrames[this->frame % QUERY_FRAMES];
+		current.frame = this->frame;
+		std::fill(current.issued.begin(), current.issued.end(), 0);
+
+		glm::vec3 modelCamera = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(cameraPosition, 1.0f));
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			MeshState& state = this->meshes[i];
+			glm::vec3 nearMin = state.boxMin - glm::vec3(CAMERA_MARGIN);
+			glm::vec3 nearMax = state.boxMax + glm::vec3(CAMERA_MARGIN);
+			bool cameraNear = glm::all(glm::greaterThanEqual(modelCamera, nearMin)) && glm::all(glm::lessThanEqual(modelCamera, nearMax));
+
+			// a query costs about as much as drawing a small mesh, and proves nothing from inside the box
+			state.candidate = model.isMeshVisible(i) && meshes[i].getCurrentLod().indexCount / 3 >= this->minTriangles && !cameraNear;
+			if (!state.candidate) {
+				// it starts over from visible when it is tested again
+				state.occluded = false;
+				continue;
+			}
+			this->stats.candidates++;
+		}
+	}
+
+	void OcclusionCulling::resolve(QueryFrame& queryFrame) {
+
+		for (size_t i = 0; i < queryFrame.pending.size(); i++) {
+
+			if (!queryFrame.pending[i]) {
+				continue;
+			}
+
+			GLuint available = 0;
+			glGetQueryObjectuiv(queryFrame.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				// the slot about to be reused gives up on it; the newer ones wait another frame
+				if (queryFrame.frame + QUERY_FRAMES <= this->frame) {
+					queryFrame.pending[i] = 0;
+				}
+				continue;
+			}
+
+			GLuint samples = 0;
+			glGetQueryObjectuiv(queryFrame.queries[i], GL_QUERY_RESULT, &samples);
+			queryFrame.pending[i] = 0;
+			this->meshes[i].occluded = samples == 0;
+
+			// the draw of the frame after the query was conditional on it
+			if (this->mode == OCCLUSION_CULL_CONDITIONAL && samples == 0) {
+				this->stats.skippedDraws++;
+			}
+		}
+	}
+
+	bool OcclusionCulling::beginDraw(size_t mesh, uint64_t triangles) {
+
+		if (this->mode == OCCLUSION_CULL_NONE || mesh >= this->meshes.size() || !this->meshes[mesh].candidate) {
+			return true;
+		}
+
+		if (this->mode == OCCLUSION_CULL_READBACK) {
+			if (this->meshes[mesh].occluded) {
+				this->stats.skippedDraws++;
+				this->stats.skippedTriangles += triangles;
+				renderStats.countCulled(triangles);
+				return false;
+			}
+			return true;
+		}
+
+		// the GPU skips the draw if last frame's box had no samples, and draws it if the answer isn't in yet
+		QueryFrame& previous = this->queryFrames[(this->frame + QUERY_FRAMES - 1) % QUERY_FRAMES];
+		if (previous.frame + 1 == this->frame && previous.issued[mesh]) {
+			glBeginConditionalRender(previous.queries[mesh], GL_QUERY_NO_WAIT);
+			this->conditionalOpen = true;
+		}
+		return true;
+	}
+
+	void OcclusionCulling::endDraw() {
+
+		if (this->conditionalOpen) {
+			glEndConditionalRender();
+			this->conditionalOpen = false;
+		}
+	}
+
+	void OcclusionCulling::issueQueries(const glm::mat4& viewProjection, const glm::mat4& modelMatrix) {
+
+		if (this->mode == OCCLUSION_CULL_NONE || this->stats.candidates == 0) {
+			return;
+		}
+
+		QueryFrame& current = this->queryFrames[this->frame % QUERY_FRAMES];
+
+		this->shader.useShaderProgram();
+		glm::mat4 clip = viewProjection * modelMatrix;
+		glUniformMatrix4fv(glGetUniformLocation(this->shader.shaderProgram, "clip"), 1, GL_FALSE, glm::value_ptr(clip));
+		GLint boxMinLocation = glGetUniformLocation(this->shader.shaderProgram, "boxMin");
+		GLint boxMaxLocation = glGetUniformLocation(this->shader.shaderProgram, "boxMax");
+
+		// tested against the depth, never written into it or the colour
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_FALSE);
+		glDepthFunc(GL_LEQUAL);
+		glBindVertexArray(this->VAO);
+
+		for (size_t i = 0; i < this->meshes.size(); i++) {
+
+			const MeshState& state = this->meshes[i];
+			if (!state.candidate) {
+				continue;
+			}
+			// conditional rendering needs last frame's query, so only readback mode can spread them out
+			if (this->mode == OCCLUSION_CULL_READBACK && !state.occluded && (this->frame + i) % VISIBLE_QUERY_INTERVAL != 0) {
+				continue;
+			}
+
+			glUniform3fv(boxMinLocation, 1, glm::value_ptr(state.boxMin));
+			glUniform3fv(boxMaxLocation, 1, glm::value_ptr(state.boxMax));
+			glBeginQuery(GL_ANY_SAMPLES_PASSED, current.queries[i]);
+			glDrawArrays(GL_TRIANGLES, 0, BOX_VERTICES);
+			glEndQuery(GL_ANY_SAMPLES_PASSED);
+			current.issued[i] = 1;
+			current.pending[i] = 1;
+			this->stats.queries++;
+			renderStats.countDraw(BOX_VERTICES / 3);
+		}
+
+		glBindVertexArray(0);
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		renderStats.countStateChanges(3);
+	}
+
+	const OcclusionStats& OcclusionCulling::getStats() const {
+		return this->stats;
+	}
+
+	OCCLUSION_CULLING OcclusionCulling::getMode() const {
+		return this->mode;
+	}
+
+	void OcclusionCulling::release() {
+
+		for (int f = 0; f < QUERY_FRAMES; f++) {
+			if (!this->queryFrames[f].queries.empty()) {
+				glDeleteQueries((GLsizei)this->queryFrames[f].queries.size(), this->queryFrames[f].queries.data());
+				this->queryFrames[f].queries.clear();
+			}
+		}
+		// beginFrame makes new queries for them
+		this->meshes.clear();
+		if (this->VAO != 0) {
+			glDeleteVertexArrays(1, &this->VAO);
+			this->VAO = 0;
+		}
+	}
+}
@@ -0,0 +1,108 @@
+#ifndef OcclusionCulling_hpp
+#define OcclusionCulling_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "glm/glm.hpp"
+
+#include "Options.hpp"
+#include "Shader.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    class Model3D;
+
+    // What the occlusion queries skipped. Conditional rendering happens on the GPU, so in that mode the
+    // skipped draws are the queries that came back hidden, counted when their results arrive
+    struct OcclusionStats {
+
+        uint32_t candidates = 0;
+        uint32_t queries = 0;
+        uint32_t skippedDraws = 0;
+        uint64_t skippedTriangles = 0;
+    };
+
+    // Hardware occlusion culling of a model's large meshes. Once the scene's geometry is in the depth
+    // buffer, the bounding box of every mesh worth testing is drawn without colour or depth writes inside
+    // a GL_ANY_SAMPLES_PASSED query. The next frame uses the answer without the CPU ever waiting:
+    // conditional mode wraps the mesh's draw in glBeginConditionalRender on the query (GL_QUERY_NO_WAIT,
+    // so it draws if the result isn't in yet), readback mode skips the draw on the CPU when a result read
+    // back from a ring of QUERY_FRAMES frames said the box was hidden. A query is worth it for meshes with
+    // at least minTriangles triangles at their current LOD, not left out by the PVS, and whose box is
+    // not around the camera. In readback mode, visible meshes are tested again every few frames only.
+    // A mesh that comes into view is drawn one frame late in conditional mode, and one to a few frames
+    // late in readback mode, depending on how soon the GPU answers.
+    class OcclusionCulling {
+
+    public:
+        static const int QUERY_FRAMES = 3;
+
+        // Loads shaders/occlusionBox.vert/.frag - needs a current context
+        void init(OCCLUSION_CULLING mode, int minTriangles);
+
+        // After the LODs and the PVS are chosen: reads the results that are in and picks the meshes to
+        // test this frame. cameraPosition is in world space
+        void beginFrame(gps::Model3D& model, const glm::mat4& modelMatrix, const glm::vec3& cameraPosition);
+
+        // Around the draw of every mesh of the model; beginDraw returns false when the draw is skipped
+        bool beginDraw(size_t mesh, uint64_t triangles);
+        void endDraw();
+
+        // With the depth of the frame's geometry bound: tests the boxes, for the next frames
+        void issueQueries(const glm::mat4& viewProjection, const glm::mat4& modelMatrix);
+
+        const OcclusionStats& getStats() const;
+
+        OCCLUSION_CULLING getMode() const;
+
+        // Deletes the queries and the VAO - before the context goes
+        void release();
+
+    private:
+        struct MeshState {
+
+            // model space, grown a little so the mesh's own surfaces don't hide its box
+            glm::vec3 boxMin;
+            glm::vec3 boxMax;
+            // the last result read back
+            bool occluded = false;
+            // tested this frame
+            bool candidate = false;
+        };
+
+        struct QueryFrame {
+
+            uint64_t frame = 0;
+            std::vector<GLuint> queries;
+            // per mesh: 1 while a query was issued and not read back
+            std::vector<unsigned char> pending;
+            // per mesh: a query was issued this frame
+            std::vector<unsigned char> issued;
+        };
+
+        OCCLUSION_CULLING mode = OCCLUSION_CULL_NONE;
+        uint64_t minTriangles = 0;
+        gps::Shader shader;
+        // the cube comes from gl_VertexID, so the VAO holds no buffers
+        GLuint VAO = 0;
+        uint64_t frame = 0;
+        bool conditionalOpen = false;
+
+        std::vector<MeshState> meshes;
+        QueryFrame queryFrames[QUERY_FRAMES];
+        OcclusionStats stats;
+
+        void resolve(QueryFrame& queryFrame);
+    };
+}
+
+#endif /* OcclusionCulling_hpp */
@@ -0,0 +1,376 @@
+#include "Options.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace gps {
+
+	static void printUsage(const char* program) {
+
+		fprintf(stderr,
+			"usage: %s [options]\n"
+			"  --renderer forward|deferred|visibility\n"
+			"                                shading path (default: forward)\n"
+			"  --aa none|fxaa|msaa2|msaa4|msaa8\n"
+			"                                anti-aliasing: none, the FXAA post pass or MSAA samples (default: msaa4)\n"
+			"  --night                       start in night mode\n"
+			"  --hud                         start with the performance overlay shown\n"
+			"  --gpu-budget <MB>             warn when the GPU memory in use grows past MB\n"
+			"  --gpu-memory-report <file>    write the GPU memory report to file at exit\n"
+			"  --benchmark <frames>          fly the camera path (or a built-in orbit) and report frame times as JSON\n"
+			"  --benchmark-output <file>     write the benchmark report to file instead of stdout\n"
+			"  --record <file>               R starts/stops recording the flight to file, for --camera-path\n"
+			"  --tick-rate <hz>              simulation ticks per second (default: 60)\n"
+			"  --sim-thread                  run the simulation on its own thread\n"
+			"  --no-vsync                    render uncapped instead of at the display refresh rate\n"
+			"  --on-demand                   only redraw when the view changes, sleep while idle\n"
+			"  --dynamic-resolution <ms>     scale the render resolution to hold the GPU frame time at ms\n"
+			"  --resolution-scale <min>-<max>\n"
+			"                                bounds of the dynamic resolution scale (default: 0.5-1)\n"
+			"  --sharpness <0-1>             sharpening of the upscaled image (default: 0.5)\n"
+			"  --lod-bias <factor>           scale the screen error allowed for mesh LODs; 0 disables them (default: 1)\n"
+			"  --lod-hysteresis <fraction>   margin around the LOD switching distances (default: 0.25)\n"
+			"  --no-shadow-proxies           cast shadows from the full meshes instead of simplified proxies\n"
+			"  --meshlet-culling none|frustum|cone\n"
+			"                                clusters culled on the CPU: off screen, or also facing away (default: frustum)\n"
+			"  --bvh-cache                   load the scene BVH from a file next to the .obj, writing it when stale\n"
+			"  --no-ambient-occlusion        shade without the baked per-vertex ambient occlusion\n"
+			"  --ao-samples <count>          hemisphere rays per vertex of the occlusion bake (default: 64)\n"
+			"  --ao-distance <units>         range of the occlusion rays (default: 2)\n"
+			"  --lightmap                    bake the sun light and shadows into a lightmap for the forward path\n"
+			"  --lightmap-density <texels>   lightmap texels per world unit (default: 4)\n"
+			"  --lightmap-passes <count>     progressive passes of the lightmap bake (default: 64)\n"
+			"  --pvs                         draw only the meshes visible from the camera's cell (baked once)\n"
+			"  --pvs-cell <units>            side of the PVS cells (default: 4)\n"
+			"  --pvs-rays <count>            rays cast from each PVS cell (default: 1024)\n"
+			"  --occlusion-culling none|conditional|readback\n"
+			"                                skip large meshes hidden last frame, on the GPU or the CPU (default: none)\n"
+			"  --occlusion-min-triangles <count>\n"
+			"                                smallest mesh given an occlusion query (default: 2048)\n"
+			"  --no-camera-collision         let the camera fly through the scene geometry\n"
+			"  --walk                        walk on the ground with gravity instead of flying\n"
+			"  --eye-height <units>          height of the camera above the ground when walking (default: 1.7)\n"
+			"  --headless                    render offscreen without a window or display\n"
+			"  --resolution <w>x<h>          window or offscreen framebuffer size (default: 1600x1200)\n"
+			"  --frames <count>              exit after this many frames\n"
+			"  --output <pattern>|-          write frames as PPM files (printf pattern, e.g. out/%%04d.ppm) or to stdout\n"
+			"  --camera-path <file>          fly the camera through the keyframes in file\n"
+			"  --trace <file>                record CPU profiling zones from launch and write them to file at exit\n",
+			program);
+	}
+
+	// Reads the integer after argv[i]; false if it is missing or not a positive number
+	static bool readCount(int argc, const char* argv[], int& i, int& value) {
+
+		if (i + 1 >= argc) {
+			return false;
+		}
+
+		char* end = NULL;
+		long parsed = strtol(argv[++i], &end, 10);
+		if (*end != '\0' || parsed <= 0) {
+			return false;
+		}
+
+		value = (int)parsed;
+		return true;
+	}
+
+	// Reads the number after argv[i]; false if it is missing or out of [minimum, maximum]
+	static bool readFloat(int argc, const char* argv[], int& i, float& value, float minimum, float maximum) {
+
+		if (i + 1 >= argc) {
+			return false;
+		}
+
+		char* end = NULL;
+		float parsed = strtof(argv[++i], &end);
+		if (end == argv[i] || *end != '\0' || !(parsed >= minimum && parsed <= maximum)) {
+			return false;
+		}
+
+		value = parsed;
+		return true;
+	}
+
+	// Reads a "<min>-<max>" scale range after argv[i]
+	static bool readScaleRange(int argc, const char* argv[], int& i, float& minimum, float& maximum) {
+
+		if (i + 1 >= argc) {
+			return false;
+		}
+
+		char trailing;
+		if (sscanf(argv[++i], "%f-%f%c", &minimum, &maximum, &trailing) != 2) {
+			return false;
+		}
+
+		return minimum >= 0.25f && minimum <= maximum && maximum <= 1.0f;
+	}
+
+	// Reads a "<width>x<height>" argument after argv[i]
+	static bool readResolution(int argc, const char* argv[], int& i, int& width, int& height) {
+
+		if (i + 1 >= argc) {
+			return false;
+		}
+
+		char trailing;
+		if (sscanf(argv[++i], "%dx%d%c", &width, &height, &trailing) != 2) {
+			return false;
+		}
+
+		return width > 0 && height > 0;
+	}
+
+	// Reads the string after argv[i]
+	static bool readString(int argc, const char* argv[], int& i, std::string& value) {
+
+		if (i + 1 >= argc) {
+			return false;
+		}
+
+		value = argv[++i];
+		return true;
+	}
+
+	bool parseOptions(int argc, const char* argv[], Options& options) {
+
+		for (int i = 1; i < argc; i++) {
+
+			bool valid = true;
+
+			if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc) {
+
+				const char* name = argv[++i];
+				if (strcmp(name, "forward") == 0) {
+					options.renderPath = RENDER_FORWARD;
+				}
+				else if (strcmp(name, "deferred") == 0) {
+					options.renderPath = RENDER_DEFERRED;
+				}
+				else if (strcmp(name, "visibility") == 0) {
+					options.renderPath = RENDER_VISIBILITY;
+				}
+				else {
+					valid = false;
+				}
+			}
+			else if (strcmp(argv[i], "--aa") == 0 && i + 1 < argc) {
+
+				const char* name = argv[++i];
+				int samples = 0;
+				char trailing;
+				if (strcmp(name, "none") == 0) {
+					options.antialiasing = AA_NONE;
+				}
+				else if (strcmp(name, "fxaa") == 0) {
+					options.antialiasing = AA_FXAA;
+				}
+				else if (sscanf(name, "msaa%d%c", &samples, &trailing) == 1 && (samples == 2 || samples == 4 || samples == 8)) {
+					options.antialiasing = AA_MSAA;
+					options.msaaSamples = samples;
+				}
+				else {
+					valid = false;
+				}
+			}
+			else if (strcmp(argv[i], "--night") == 0) {
+				options.nightMode = true;
+			}
+			else if (strcmp(argv[i], "--hud") == 0) {
+				options.hud = true;
+			}
+			else if (strcmp(argv[i], "--gpu-budget") == 0) {
+				valid = readCount(argc, argv, i, options.gpuMemoryBudget);
+			}
+			else if (strcmp(argv[i], "--gpu-memory-report") == 0) {
+				valid = readString(argc, argv, i, options.gpuMemoryReport);
+			}
+			else if (strcmp(argv[i], "--benchmark") == 0) {
+				valid = readCount(argc, argv, i, options.benchmarkFrames);
+			}
+			else if (strcmp(argv[i], "--benchmark-output") == 0) {
+				valid = readString(argc, argv, i, options.benchmarkOutput);
+			}
+			else if (strcmp(argv[i], "--record") == 0) {
+				valid = readString(argc, argv, i, options.recordPath);
+			}
+			else if (strcmp(argv[i], "--tick-rate") == 0) {
+				valid = readCount(argc, argv, i, options.tickRate);
+			}
+			else if (strcmp(argv[i], "--sim-thread") == 0) {
+				options.threadedSimulation = true;
+			}
+			else if (strcmp(argv[i], "--no-vsync") == 0) {
+				options.vsync = false;
+			}
+			else if (strcmp(argv[i], "--on-demand") == 0) {
+				options.onDemand = true;
+			}
+			else if (strcmp(argv[i], "--dynamic-resolution") == 0) {
+				valid = readFloat(argc, argv, i, options.dynamicResolution, 0.1f, 1000.0f);
+			}
+			else if (strcmp(argv[i], "--resolution-scale") == 0) {
+				valid = readScaleRange(argc, argv, i, options.minResolutionScale, options.maxResolutionScale);
+			}
+			else if (strcmp(argv[i], "--sharpness") == 0) {
+				valid = readFloat(argc, argv, i, options.sharpness, 0.0f, 1.0f);
+			}
+			else if (strcmp(argv[i], "--lod-bias") == 0) {
+				valid = readFloat(argc, argv, i, options.lodBias, 0.0f, 100.0f);
+			}
+			else if (strcmp(argv[i], "--lod-hysteresis") == 0) {
+				valid = readFloat(argc, argv, i, options.lodHysteresis, 0.0f, 1.0f);
+			}
+			else if (strcmp(argv[i], "--no-shadow-proxies") == 0) {
+				options.shadowProxies = false;
+			}
+			else if (strcmp(argv[i], "--bvh-cache") == 0) {
+				options.bvhCache = true;
+			}
+			else if (strcmp(argv[i], "--no-ambient-occlusion") == 0) {
+				options.ambientOcclusion = false;
+			}
+			else if (strcmp(argv[i], "--ao-samples") == 0) {
+				valid = readCount(argc, argv, i, options.aoSamples);
+			}
+			else if (strcmp(argv[i], "--ao-distance") == 0) {
+				valid = readFloat(argc, argv, i, options.aoDistance, 0.01f, 1000.0f);
+			}
+			else if (strcmp(argv[i], "--lightmap") == 0) {
+				options.lightmap = true;
+			}
+			else if (strcmp(argv[i], "--lightmap-density") == 0) {
+				valid = readFloat(argc, argv, i, options.lightmapDensity, 0.1f, 64.0f);
+			}
+			else if (strcmp(argv[i], "--lightmap-passes") == 0) {
+				valid = readCount(argc, argv, i, options.lightmapPasses);
+			}
+			else if (strcmp(argv[i], "--pvs") == 0) {
+				options.pvs = true;
+			}
+			else if (strcmp(argv[i], "--pvs-cell") == 0) {
+				valid = readFloat(argc, argv, i, options.pvsCellSize, 0.1f, 1000.0f);
+			}
+			else if (strcmp(argv[i], "--pvs-rays") == 0) {
+				valid = readCount(argc, argv, i, options.pvsRays);
+			}
+			else if (strcmp(argv[i], "--occlusion-culling") == 0 && i + 1 < argc) {
+
+				const char* name = argv[++i];
+				if (strcmp(name, "none") == 0) {
+					options.occlusionCulling = OCCLUSION_CULL_NONE;
+				}
+				else if (strcmp(name, "conditional") == 0) {
+					options.occlusionCulling = OCCLUSION_CULL_CONDITIONAL;
+				}
+				else if (strcmp(name, "readback") == 0) {
+					options.occlusionCulling = OCCLUSION_CULL_READBACK;
+				}
+				else {
+					valid = false;
+				}
+			}
+			else if (strcmp(argv[i], "--occlusion-min-triangles") == 0) {
+				valid = readCount(argc, argv, i, options.occlusionMinTriangles);
+			}
+			else if (strcmp(argv[i], "--no-camera-collision") == 0) {
+				options.cameraCollision = false;
+			}
+			else if (strcmp(argv[i], "--walk") == 0) {
+				options.walk = true;
+			}
+			else if (strcmp(argv[i], "--eye-height") == 0) {
+				valid = readFloat(argc, argv, i, options.eyeHeight, 0.1f, 100.0f);
+			}
+			else if (strcmp(argv[i], "--meshlet-culling") == 0 && i + 1 < argc) {
+
+				const char* name = argv[++i];
+				if (strcmp(name, "none") == 0) {
+					options.meshletCulling = MESHLET_CULL_NONE;
+				}
+				else if (strcmp(name, "frustum") == 0) {
+					options.meshletCulling = MESHLET_CULL_FRUSTUM;
+				}
+				else if (strcmp(name, "cone") == 0) {
+					options.meshletCulling = MESHLET_CULL_CONE;
+				}
+				else {
+					valid = false;
+				}
+			}
+			else if (strcmp(argv[i], "--headless") == 0) {
+				options.headless = true;
+			}
+			else if (strcmp(argv[i], "--resolution") == 0) {
+				valid = readResolution(argc, argv, i, options.width, options.height);
+			}
+			else if (strcmp(argv[i], "--frames") == 0) {
+				valid = readCount(argc, argv, i, options.frameCount);
+			}
+			else if (strcmp(argv[i], "--output") == 0) {
+				valid = readString(argc, argv, i, options.output);
+			}
+			else if (strcmp(argv[i], "--camera-path") == 0) {
+				valid = readString(argc, argv, i, options.cameraPath);
+			}
+			else if (strcmp(argv[i], "--trace") == 0) {
+				valid = readString(argc, argv, i, options.tracePath);
+			}
+			else {
+				valid = false;
+			}
+
+			if (!valid) {
+
+				fprintf(stderr, "ERROR: invalid argument %s\n", argv[i]);
+				printUsage(argv[0]);
+				return false;
+			}
+		}
+
+		if (options.headless && options.frameCount == 0 && options.benchmarkFrames == 0) {
+			options.frameCount = 1;
+		}
+
+		return true;
+	}
+
+	const char* renderPathName(RENDER_PATH renderPath) {
+
+		switch (renderPath) {
+		case RENDER_DEFERRED: return "deferred";
+		case RENDER_VISIBILITY: return "visibility";
+		default: return "forward";
+		}
+	}
+
+	const char* meshletCullingName(MESHLET_CULLING meshletCulling) {
+
+		switch (meshletCulling) {
+		case MESHLET_CULL_NONE: return "none";
+		case MESHLET_CULL_FRUSTUM: return "frustum";
+		default: return "cone";
+		}
+	}
+
+	const char* occlusionCullingName(OCCLUSION_CULLING occlusionCulling) {
+
+		switch (occlusionCulling) {
+		case OCCLUSION_CULL_CONDITIONAL: return "conditional";
+		case OCCLUSION_CULL_READBACK: return "readback";
+		default: return "none";
+		}
+	}
+
+	std::string antialiasingName(const Options& options) {
+
+		switch (options.antialiasing) {
+		case AA_NONE: return "none";
+		case AA_FXAA: return "fxaa";
+		default: return "msaa" + std::to_string(options.msaaSamples);
+		}
+	}
+}
@@ -0,0 +1,123 @@
+#ifndef Options_hpp
+#define Options_hpp
+
+#include <string>
+
+namespace gps {
+
+    enum RENDER_PATH {RENDER_FORWARD, RENDER_DEFERRED, RENDER_VISIBILITY};
+
+    enum ANTIALIASING {AA_NONE, AA_MSAA, AA_FXAA};
+
+    // What the CPU culls per meshlet before the draws: nothing, clusters outside the frustum, or also
+    // clusters facing away from the camera
+    enum MESHLET_CULLING {MESHLET_CULL_NONE, MESHLET_CULL_FRUSTUM, MESHLET_CULL_CONE};
+
+    // How the hardware occlusion queries of the large meshes are used: not at all, by the GPU through
+    // conditional rendering, or read back so the CPU skips the hidden draws (see OcclusionCulling.hpp)
+    enum OCCLUSION_CULLING {OCCLUSION_CULL_NONE, OCCLUSION_CULL_CONDITIONAL, OCCLUSION_CULL_READBACK};
+
+    // Settings chosen on the command line at startup
+    struct Options {
+
+        RENDER_PATH renderPath = RENDER_FORWARD;
+        // MSAA multisamples the framebuffer the scene is drawn into; FXAA draws it single-sampled
+        // and smooths the edges of the finished image in a post pass
+        ANTIALIASING antialiasing = AA_MSAA;
+        // samples per pixel with AA_MSAA: 2, 4 or 8
+        int msaaSamples = 4;
+        // start with night mode (and its street lamps) switched on
+        bool nightMode = false;
+        // start with the performance overlay shown (H toggles it)
+        bool hud = false;
+        // > 0: warn whenever the tracked GPU memory grows past this many MB
+        int gpuMemoryBudget = 0;
+        // file the GPU memory report is written to at exit; G prints it at any time
+        std::string gpuMemoryReport;
+        // > 0: fly the benchmark camera path for this many frames with vsync off, report the timings, then exit
+        int benchmarkFrames = 0;
+        // file the benchmark's JSON report goes to; empty prints it to stdout
+        std::string benchmarkOutput;
+        // file the flight recorded with the R key is saved to; empty disables recording
+        std::string recordPath;
+        // simulation ticks per second, independent of the frame rate
+        int tickRate = 60;
+        // run the simulation ticks on their own thread instead of between frames
+        bool threadedSimulation = false;
+        // > 0: render the scene at the resolution that holds the GPU frame time at this many ms, between
+        // minResolutionScale and maxResolutionScale of the window size per axis, then upscale it
+        float dynamicResolution = 0.0f;
+        float minResolutionScale = 0.5f;
+        float maxResolutionScale = 1.0f;
+        // strength of the sharpening of the upscale, 0 to 1
+        float sharpness = 0.5f;
+        // multiplies the screen error a mesh LOD may show, 1 pixel by default; 0 always draws the full meshes
+        float lodBias = 1.0f;
+        // share of the threshold an LOD's error must pass before the level changes, so it doesn't flicker
+        float lodHysteresis = 0.25f;
+        // false: the shadow pass draws the full meshes instead of their position-only proxies
+        bool shadowProxies = true;
+        // the scene is drawn two-sided, so only frustum culling is safe by default; cone culling also drops
+        // clusters facing away, which only suits closed meshes
+        MESHLET_CULLING meshletCulling = MESHLET_CULL_FRUSTUM;
+        // keep the scene BVH in a file next to the .obj and load it from there while the geometry is unchanged
+        bool bvhCache = false;
+        // bake ambient occlusion per vertex on the first run (cached next to the .obj) and shade with it
+        bool ambientOcclusion = true;
+        // hemisphere rays per vertex, and how far away geometry still occludes
+        int aoSamples = 64;
+        float aoDistance = 2.0f;
+        // bake the sun into a lightmap and light the forward path with it (see Lightmap.hpp)
+        bool lightmap = false;
+        // lightmap texels per world unit, lowered when the atlas would outgrow 2048x2048
+        float lightmapDensity = 4.0f;
+        int lightmapPasses = 64;
+        // draw only the meshes in the potentially visible set of the camera's cell (baked on the first run)
+        bool pvs = false;
+        // side of the PVS cells, in world units, and the rays cast from each cell
+        float pvsCellSize = 4.0f;
+        int pvsRays = 1024;
+        OCCLUSION_CULLING occlusionCulling = OCCLUSION_CULL_NONE;
+        // meshes with fewer triangles at their current LOD are drawn without an occlusion query
+        int occlusionMinTriangles = 2048;
+        // false: the camera flies through the scene geometry instead of sliding along it
+        bool cameraCollision = true;
+        // keep the camera on the ground at eyeHeight above it, pulled down by gravity
+        bool walk = false;
+        float eyeHeight = 1.7f;
+        // draw only when something on screen changes and sleep in between (ignored by benchmarks and headless runs)
+        bool onDemand = false;
+        // false: present frames uncapped instead of waiting for the display refresh
+        bool vsync = true;
+
+        // render without a window through an EGL/OSMesa context into an offscreen framebuffer
+        bool headless = false;
+        // window size, or the offscreen framebuffer size in headless mode
+        int width = 1600;
+        int height = 1200;
+        // > 0: exit after this many frames (headless runs default to 1)
+        int frameCount = 0;
+        // where rendered frames are written as PPM: a printf pattern for the frame number
+        // (e.g. frames/%04d.ppm) or "-" for stdout; empty writes nothing
+        std::string output;
+        // keyframe file the camera follows instead of the keyboard
+        std::string cameraPath;
+        // file the CPU profiling zones are written to as Chrome trace JSON; recording starts at launch
+        // and the trace is written at exit. T toggles recording either way.
+        std::string tracePath;
+    };
+
+    // Fills options from argv; prints the usage and returns false on unknown or malformed arguments
+    bool parseOptions(int argc, const char* argv[], Options& options);
+
+    const char* renderPathName(RENDER_PATH renderPath);
+
+    const char* meshletCullingName(MESHLET_CULLING meshletCulling);
+
+    const char* occlusionCullingName(OCCLUSION_CULLING occlusionCulling);
+
+    // "none", "fxaa" or "msaa" followed by the sample count, e.g. "msaa4"
+    std::string antialiasingName(const Options& options);
+}
+
+#endif /* Options_hpp */
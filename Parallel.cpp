@@ -0,0 +1,157 @@
+#include "Parallel.hpp"
+
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+	namespace {
+
+		// Set on pool workers and while a thread runs a job, so nested calls fall back to a plain loop
+		thread_local bool insideParallelFor = false;
+
+		class WorkerPool {
+
+		public:
+			WorkerPool() {
+
+				unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+				for (unsigned i = 1; i < hardwareThreads; i++) {
+					workers.emplace_back(&WorkerPool::workerLoop, this);
+				}
+			}
+
+			~WorkerPool() {
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopping = true;
+				}
+				wake.notify_all();
+				for (size_t i = 0; i < workers.size(); i++) {
+					workers[i].join();
+				}
+			}
+
+			unsigned threadCount() const {
+				return (unsigned)workers.size() + 1;
+			}
+
+			// Only one job runs at a time; a second caller gets false and should run serially
+			bool tryRun(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& body) {
+
+				std::unique_lock<std::mutex> submitLock(submitMutex, std::try_to_lock);
+				if (!submitLock.owns_lock()) {
+					return false;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					job = &body;
+					jobCount = count;
+					jobGrain = grainSize;
+					nextItem.store(0);
+					busyWorkers = (unsigned)workers.size();
+					generation++;
+				}
+				wake.notify_all();
+
+				insideParallelFor = true;
+				runChunks();
+				insideParallelFor = false;
+
+				std::unique_lock<std::mutex> lock(mutex);
+				done.wait(lock, [this] { return busyWorkers == 0; });
+				job = nullptr;
+
+				return true;
+			}
+
+		private:
+			std::vector<std::thread> workers;
+			std::mutex submitMutex;
+			std::mutex mutex;
+			std::condition_variable wake;
+			std::condition_variable done;
+			bool stopping = false;
+			unsigned generation = 0;
+			unsigned busyWorkers = 0;
+
+			const std::function<void(size_t, size_t)>* job = nullptr;
+			size_t jobCount = 0;
+			size_t jobGrain = 1;
+			std::atomic<size_t> nextItem{ 0 };
+
+			void runChunks() {
+
+				PROFILE_ZONE("parallelFor");
+
+				for (;;) {
+
+					size_t begin = nextItem.fetch_add(jobGrain);
+					if (begin >= jobCount) {
+						return;
+					}
+					(*job)(begin, std::min(begin + jobGrain, jobCount));
+				}
+			}
+
+			void workerLoop() {
+
+				setProfilerThreadName("worker");
+				insideParallelFor = true;
+				unsigned seenGeneration = 0;
+
+				for (;;) {
+
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+						if (stopping) {
+							return;
+						}
+						seenGeneration = generation;
+					}
+
+					runChunks();
+
+					std::lock_guard<std::mutex> lock(mutex);
+					if (--busyWorkers == 0) {
+						done.notify_one();
+					}
+				}
+			}
+		};
+
+		WorkerPool& workerPool() {
+
+			static WorkerPool pool;
+			return pool;
+		}
+	}
+
+	unsigned parallelThreadCount() {
+		return workerPool().threadCount();
+	}
+
+	void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& body) {
+
+		if (count == 0) {
+			return;
+		}
+
+		grainSize = std::max<size_t>(grainSize, 1);
+
+		// small ranges and nested calls are cheaper on the current thread
+		if (count <= grainSize || insideParallelFor || !workerPool().tryRun(count, grainSize, body)) {
+
+			body(0, count);
+		}
+	}
+}
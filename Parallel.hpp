@@ -0,0 +1,18 @@
+#ifndef Parallel_hpp
+#define Parallel_hpp
+
+#include <cstddef>
+#include <functional>
+
+namespace gps {
+
+    // Number of threads that take part in parallelFor (workers plus the calling thread)
+    unsigned parallelThreadCount();
+
+    // Splits [0, count) into chunks of at least grainSize items and runs body(begin, end) on each,
+    // using a pool of worker threads that is started on first use. The calling thread helps and
+    // returns when every chunk is done. Calls made from inside a body run serially.
+    void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& body);
+}
+
+#endif /* Parallel_hpp */
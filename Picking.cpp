@@ -0,0 +1,52 @@
+#include "Picking.hpp"
+
+namespace gps {
+
+	BvhRay screenRay(const glm::vec2& ndc, const glm::mat4& view, const glm::mat4& projection) {
+
+		glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+		glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+		glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+
+		BvhRay ray;
+		ray.origin = glm::vec3(nearPoint) / nearPoint.w;
+		glm::vec3 toFar = glm::vec3(farPoint) / farPoint.w - ray.origin;
+		ray.tMax = glm::length(toFar);
+		ray.direction = toFar / ray.tMax;
+		return ray;
+	}
+
+	PickResult pick(const gps::Bvh& bvh, const glm::vec2& ndc, const glm::mat4& model, const glm::mat4& view,
+		const glm::mat4& projection) {
+
+		PickResult result;
+		result.hit = false;
+		result.mesh = 0;
+		result.triangle = 0;
+		result.position = glm::vec3(0.0f);
+		result.distance = 0.0f;
+
+		BvhRay worldRay = screenRay(ndc, view, projection);
+
+		// the direction is left unnormalized in model space, so t means the same distance in both spaces
+		// even if the model is scaled
+		glm::mat4 inverseModel = glm::inverse(model);
+		BvhRay modelRay;
+		modelRay.origin = glm::vec3(inverseModel * glm::vec4(worldRay.origin, 1.0f));
+		modelRay.direction = glm::vec3(inverseModel * glm::vec4(worldRay.direction, 0.0f));
+		modelRay.tMax = worldRay.tMax;
+
+		BvhHit hit;
+		if (!bvh.intersect(modelRay, hit)) {
+			return result;
+		}
+
+		result.hit = true;
+		result.mesh = hit.mesh;
+		result.triangle = hit.triangle;
+		result.position = worldRay.origin + worldRay.direction * hit.t;
+		// measured from the camera rather than the near plane
+		result.distance = glm::length(result.position - glm::vec3(glm::inverse(view)[3]));
+		return result;
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef Picking_hpp
+#define Picking_hpp
+
+#include "Bvh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+
+namespace gps {
+
+    struct PickResult {
+
+        bool hit;
+        // index of the mesh in the model, and of the triangle in that mesh's index buffer (LOD 0)
+        uint32_t mesh;
+        uint32_t triangle;
+        // world space point under the cursor, and its distance from the camera
+        glm::vec3 position;
+        float distance;
+    };
+
+    // World space ray through a point of the window, given in normalized device coordinates
+    // (-1..1, y up), from the near plane towards the far plane
+    BvhRay screenRay(const glm::vec2& ndc, const glm::mat4& view, const glm::mat4& projection);
+
+    // What the cursor is over, found by casting the ray through it against the scene's BVH on the CPU,
+    // so nothing is read back from the GPU. bvh holds the model's triangles in model space
+    PickResult pick(const gps::Bvh& bvh, const glm::vec2& ndc, const glm::mat4& model, const glm::mat4& view,
+        const glm::mat4& projection);
+}
+
+#endif /* Picking_hpp */
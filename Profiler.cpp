@@ -0,0 +1,224 @@
+#include "Profiler.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace gps {
+
+	namespace {
+
+		// Each thread appends to its own buffer of fixed-size chunks, so recording a zone never locks
+		// and never moves events a concurrent writeProfilerTrace may be reading
+		const size_t CHUNK_EVENTS = 4096;
+		const size_t MAX_CHUNKS = 1024;
+
+		struct ZoneEvent {
+
+			const char* name;
+			int64_t start;
+			int64_t duration;
+		};
+
+		struct ThreadBuffer {
+
+			std::atomic<ZoneEvent*> chunks[MAX_CHUNKS];
+			// events [0, count) are complete and belong to the given recording session; written by the
+			// owning thread only, which starts over at its first zone of a new session
+			std::atomic<size_t> count{ 0 };
+			std::atomic<unsigned> session{ 0 };
+			// zones of the session that didn't fit
+			std::atomic<size_t> dropped{ 0 };
+			unsigned threadIndex = 0;
+			// guarded by registryMutex
+			std::string name;
+
+			ThreadBuffer() {
+
+				for (size_t i = 0; i < MAX_CHUNKS; i++) {
+					chunks[i].store(nullptr, std::memory_order_relaxed);
+				}
+			}
+		};
+
+		std::atomic<bool> recording{ false };
+		// bumped by every startProfiling, so each trace only holds its own session
+		std::atomic<unsigned> currentSession{ 0 };
+
+		// Buffers are never freed, so threads that have exited still show up in the trace
+		std::mutex registryMutex;
+		std::vector<ThreadBuffer*> registry;
+
+		thread_local ThreadBuffer* threadBuffer = nullptr;
+
+		const std::chrono::steady_clock::time_point traceOrigin = std::chrono::steady_clock::now();
+
+		int64_t nanosecondsSinceOrigin() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceOrigin).count();
+		}
+
+		ThreadBuffer* currentThreadBuffer() {
+
+			if (threadBuffer == nullptr) {
+
+				threadBuffer = new ThreadBuffer();
+
+				std::lock_guard<std::mutex> lock(registryMutex);
+				threadBuffer->threadIndex = (unsigned)registry.size();
+				registry.push_back(threadBuffer);
+			}
+
+			return threadBuffer;
+		}
+
+		void recordZone(const char* name, int64_t start, int64_t end, unsigned session) {
+
+			if (session != currentSession.load(std::memory_order_relaxed)) {
+				// opened during an earlier session
+				return;
+			}
+
+			ThreadBuffer* buffer = currentThreadBuffer();
+
+			// the chunks are kept and overwritten; the count goes back first, so a reader that sees the
+			// new session never sees the old events
+			if (buffer->session.load(std::memory_order_relaxed) != session) {
+				buffer->count.store(0, std::memory_order_relaxed);
+				buffer->dropped.store(0, std::memory_order_relaxed);
+				buffer->session.store(session, std::memory_order_release);
+			}
+
+			size_t index = buffer->count.load(std::memory_order_relaxed);
+			size_t chunkIndex = index / CHUNK_EVENTS;
+			if (chunkIndex >= MAX_CHUNKS) {
+				// full - the rest of the session is counted, not stored, rather than growing without bound
+				buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			ZoneEvent* chunk = buffer->chunks[chunkIndex].load(std::memory_order_relaxed);
+			if (chunk == nullptr) {
+				chunk = new ZoneEvent[CHUNK_EVENTS];
+				buffer->chunks[chunkIndex].store(chunk, std::memory_order_release);
+			}
+
+			ZoneEvent& event = chunk[index % CHUNK_EVENTS];
+			event.name = name;
+			event.start = start;
+			event.duration = end - start;
+
+			buffer->count.store(index + 1, std::memory_order_release);
+		}
+
+		void writeJsonString(FILE* file, const char* text) {
+
+			fputc('"', file);
+			for (const char* c = text; *c != '\0'; c++) {
+				if (*c == '"' || *c == '\\') {
+					fputc('\\', file);
+				}
+				if ((unsigned char)*c >= 0x20) {
+					fputc(*c, file);
+				}
+			}
+			fputc('"', file);
+		}
+	}
+
+	void startProfiling() {
+		currentSession.fetch_add(1, std::memory_order_relaxed);
+		recording.store(true, std::memory_order_relaxed);
+	}
+
+	void stopProfiling() {
+		recording.store(false, std::memory_order_relaxed);
+	}
+
+	bool isProfiling() {
+		return recording.load(std::memory_order_relaxed);
+	}
+
+	void setProfilerThreadName(const char* name) {
+
+		ThreadBuffer* buffer = currentThreadBuffer();
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		buffer->name = name;
+	}
+
+	bool writeProfilerTrace(const std::string& fileName) {
+
+		FILE* file = fopen(fileName.c_str(), "w");
+		if (file == NULL) {
+			fprintf(stderr, "ERROR: could not open %s for writing\n", fileName.c_str());
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		bool first = true;
+		unsigned session = currentSession.load(std::memory_order_relaxed);
+		size_t dropped = 0;
+
+		for (size_t i = 0; i < registry.size(); i++) {
+
+			ThreadBuffer* buffer = registry[i];
+
+			if (!buffer->name.empty()) {
+				fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ",
+					first ? "" : ",\n", buffer->threadIndex);
+				writeJsonString(file, buffer->name.c_str());
+				fprintf(file, "}}");
+				first = false;
+			}
+
+			// a thread that recorded nothing this session still holds an earlier one
+			if (buffer->session.load(std::memory_order_acquire) != session) {
+				continue;
+			}
+			dropped += buffer->dropped.load(std::memory_order_relaxed);
+
+			// only what was complete when we looked; the owning thread may keep appending meanwhile
+			size_t count = buffer->count.load(std::memory_order_acquire);
+			for (size_t j = 0; j < count; j++) {
+
+				const ZoneEvent& event = buffer->chunks[j / CHUNK_EVENTS].load(std::memory_order_acquire)[j % CHUNK_EVENTS];
+
+				fprintf(file, "%s{\"name\": ", first ? "" : ",\n");
+				writeJsonString(file, event.name);
+				// trace_event times are in microseconds
+				fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+					buffer->threadIndex, event.start * 1e-3, event.duration * 1e-3);
+				first = false;
+			}
+		}
+
+		fprintf(file, "\n]}\n");
+
+		bool written = !ferror(file);
+		fclose(file);
+
+		if (dropped > 0) {
+			fprintf(stderr, "WARNING: %zu profiling zones didn't fit in the buffers and are missing from %s\n",
+				dropped, fileName.c_str());
+		}
+
+		return written;
+	}
+
+	ProfileZone::ProfileZone(const char* name) {
+
+		this->name = name;
+		this->session = currentSession.load(std::memory_order_relaxed);
+		this->start = recording.load(std::memory_order_relaxed) ? nanosecondsSinceOrigin() : -1;
+	}
+
+	ProfileZone::~ProfileZone() {
+
+		if (this->start >= 0) {
+			recordZone(this->name, this->start, nanosecondsSinceOrigin(), this->session);
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef Profiler_hpp
+#define Profiler_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// CPU profiling zones. PROFILE_ZONE("name") times the rest of the enclosing scope, PROFILE_FUNCTION()
+// does the same under the function's name. Zones are only stored while recording is on (startProfiling);
+// otherwise a zone costs one relaxed atomic load. Building with GPS_NO_PROFILING compiles them out.
+#if defined (GPS_NO_PROFILING)
+    #define PROFILE_ZONE(name)
+    #define PROFILE_FUNCTION()
+#else
+    #define PROFILE_CONCAT_(a, b) a##b
+    #define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+    #define PROFILE_ZONE(name) gps::ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+    #define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#endif
+
+namespace gps {
+
+    // Starts storing zones, in a new session that replaces what earlier ones recorded; zones that were
+    // already open when recording starts are skipped
+    void startProfiling();
+
+    void stopProfiling();
+
+    bool isProfiling();
+
+    // Names the calling thread in the trace; threads that never call it show up by number
+    void setProfilerThreadName(const char* name);
+
+    // Writes every zone the session has recorded so far, on every thread, as Chrome trace_event JSON
+    // (chrome://tracing, ui.perfetto.dev); false if the file can't be written. Warns about zones that
+    // didn't fit in the buffers
+    bool writeProfilerTrace(const std::string& fileName);
+
+    // Scoped timer behind PROFILE_ZONE; name must outlive the trace (a string literal)
+    class ProfileZone {
+
+    public:
+        explicit ProfileZone(const char* name);
+        ~ProfileZone();
+
+    private:
+        const char* name;
+        unsigned session;
+        int64_t start;
+    };
+}
+
+#endif /* Profiler_hpp */
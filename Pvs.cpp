@@ -0,0 +1,297 @@
+#include "Pvs.hpp"
+
+#include "Bake.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+	static const char CACHE_MAGIC[8] = { 'G', 'P', 'S', 'P', 'V', 'S', '0', '2' };
+	// Beyond this many cells, they are made larger instead
+	static const size_t MAX_CELLS = 65536;
+	static const size_t BAKE_GRAIN_CELLS = 4;
+	// Rays every mesh not yet in a cell's set gets aimed at it, however many meshes share the budget
+	static const int MIN_AIMED_RAYS = 8;
+
+	void Pvs::build(const gps::Bvh& bvh, const std::vector<gps::Mesh>& meshes, float cellSize, int raysPerCell) {
+
+		PROFILE_FUNCTION();
+
+		this->meshCount = meshes.size();
+		this->setBytes = (meshes.size() + 7) / 8;
+		this->cellSets.clear();
+		this->sets.clear();
+
+		glm::vec3 minimum(FLT_MAX);
+		glm::vec3 maximum(-FLT_MAX);
+		for (size_t m = 0; m < meshes.size(); m++) {
+			for (size_t v = 0; v < meshes[m].vertices.size(); v++) {
+				minimum = glm::min(minimum, meshes[m].vertices[v].Position);
+				maximum = glm::max(maximum, meshes[m].vertices[v].Position);
+			}
+		}
+		if (meshes.empty() || minimum.x > maximum.x || bvh.empty()) {
+			this->dimensions = glm::ivec3(0);
+			return;
+		}
+
+		// whole cells over the scene, larger ones when there would be too many
+		glm::vec3 extent = glm::max(maximum - minimum, glm::vec3(1e-3f));
+		this->cellSize = cellSize;
+		glm::ivec3 dimensions = glm::max(glm::ivec3(glm::ceil(extent / this->cellSize)), glm::ivec3(1));
+		while ((size_t)dimensions.x * dimensions.y * dimensions.z > MAX_CELLS) {
+			this->cellSize *= 1.25f;
+			dimensions = glm::max(glm::ivec3(glm::ceil(extent / this->cellSize)), glm::ivec3(1));
+		}
+		this->dimensions = dimensions;
+		this->origin = (minimum + maximum) * 0.5f - glm::vec3(dimensions) * (this->cellSize * 0.5f);
+
+		// triangles of every mesh, for the rays aimed at it
+		std::vector<size_t> triangleCounts(meshes.size());
+		for (size_t m = 0; m < meshes.size(); m++) {
+			triangleCounts[m] = meshes[m].lods[0].indexCount / 3;
+		}
+
+		int aimedRaysPerMesh = std::max(MIN_AIMED_RAYS, (int)((raysPerCell / 2 + meshes.size() - 1) / meshes.size()));
+
+		size_t cellCount = (size_t)dimensions.x * dimensions.y * dimensions.z;
+		std::vector<uint8_t> cellBits(cellCount * this->setBytes, 0);
+		float size = this->cellSize;
+		glm::vec3 gridOrigin = this->origin;
+
+		parallelFor(cellCount, BAKE_GRAIN_CELLS, [&](size_t begin, size_t end) {
+			for (size_t cell = begin; cell < end; cell++) {
+
+				uint8_t* bits = &cellBits[cell * this->setBytes];
+				glm::ivec3 coords((int)(cell % dimensions.x), (int)(cell / dimensions.x % dimensions.y), (int)(cell / ((size_t)dimensions.x * dimensions.y)));
+				glm::vec3 cellMin = gridOrigin + glm::vec3(coords) * size;
+				glm::vec3 cellMax = cellMin + glm::vec3(size);
+
+				// a mesh reaching into the cell can be right in front of the camera
+				for (size_t m = 0; m < meshes.size(); m++) {
+					glm::vec3 closest = glm::clamp(meshes[m].boundsCenter, cellMin, cellMax);
+					if (glm::length(closest - meshes[m].boundsCenter) <= meshes[m].boundsRadius) {
+						bits[m / 8] |= (uint8_t)(1 << (m % 8));
+					}
+				}
+
+				uint32_t random = hashInteger((uint32_t)cell); // the rays depend only on the cell, never on the threads
+				auto castRay = [&](BvhRay& ray) {
+					BvhHit hit;
+					if (bvh.intersect(ray, hit)) {
+						bits[hit.mesh / 8] |= (uint8_t)(1 << (hit.mesh % 8));
+					}
+				};
+
+				// half the budget uniform over the sphere
+				for (int r = 0; r < raysPerCell / 2; r++) {
+
+					BvhRay ray;
+					ray.origin = cellMin + glm::vec3(nextRandom(random), nextRandom(random), nextRandom(random)) * size;
+					ray.tMax = FLT_MAX;
+					float z = 1.0f - 2.0f * nextRandom(random);
+					float angle = 6.28318531f * nextRandom(random);
+					float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+					ray.direction = glm::vec3(radius * std::cos(angle), radius * std::sin(angle), z);
+					castRay(ray);
+				}
+
+				// the other half aimed at random points of every mesh's triangles, so small and distant meshes
+				// get rays too; each mesh at least MIN_AIMED_RAYS, unless one already found it
+				for (size_t m = 0; m < meshes.size(); m++) {
+
+					if (triangleCounts[m] == 0) {
+						continue;
+					}
+					const gps::Mesh& mesh = meshes[m];
+					for (int r = 0; r < aimedRaysPerMesh && !(bits[m / 8] & (1 << (m % 8))); r++) {
+
+						BvhRay ray;
+						ray.origin = cellMin + glm::vec3(nextRandom(random), nextRandom(random), nextRandom(random)) * size;
+						ray.tMax = FLT_MAX;
+
+						size_t triangle = std::min((size_t)(nextRandom(random) * triangleCounts[m]), triangleCounts[m] - 1);
+						const GLuint* corners = &mesh.indices[mesh.lods[0].firstIndex + triangle * 3];
+						float u = nextRandom(random);
+						float v = nextRandom(random);
+						if (u + v > 1.0f) {
+							u = 1.0f - u;
+							v = 1.0f - v;
+						}
+						glm::vec3 point = mesh.vertices[corners[0]].Position * (1.0f - u - v)
+							+ mesh.vertices[corners[1]].Position * u + mesh.vertices[corners[2]].Position * v;
+						ray.direction = point - ray.origin;
+						if (glm::length(ray.direction) == 0.0f) {
+							continue;
+						}
+						ray.direction = glm::normalize(ray.direction);
+						castRay(ray);
+					}
+				}
+			}
+		});
+
+		// the rays only sample the cell; a mesh seen by a neighbour is kept too, so one glimpsed through a
+		// narrow gap doesn't pop in and out as the camera crosses cells
+		std::vector<uint8_t> grownBits(cellBits.size(), 0);
+		parallelFor(cellCount, BAKE_GRAIN_CELLS * 64, [&](size_t begin, size_t end) {
+			for (size_t cell = begin; cell < end; cell++) {
+
+				glm::ivec3 coords((int)(cell % dimensions.x), (int)(cell / dimensions.x % dimensions.y), (int)(cell / ((size_t)dimensions.x * dimensions.y)));
+				glm::ivec3 low = glm::max(coords - glm::ivec3(1), glm::ivec3(0));
+				glm::ivec3 high = glm::min(coords + glm::ivec3(1), dimensions - glm::ivec3(1));
+				uint8_t* bits = &grownBits[cell * this->setBytes];
+				for (int z = low.z; z <= high.z; z++) {
+					for (int y = low.y; y <= high.y; y++) {
+						for (int x = low.x; x <= high.x; x++) {
+							const uint8_t* neighbour = &cellBits[(((size_t)z * dimensions.y + y) * dimensions.x + x) * this->setBytes];
+							for (size_t b = 0; b < this->setBytes; b++) {
+								bits[b] |= neighbour[b];
+							}
+						}
+					}
+				}
+			}
+		});
+		cellBits.swap(grownBits);
+
+		// keep one copy of every distinct set
+		std::unordered_map<uint64_t, std::vector<uint32_t> > setsByHash;
+		this->cellSets.resize(cellCount);
+		for (size_t cell = 0; cell < cellCount; cell++) {
+
+			const uint8_t* bits = &cellBits[cell * this->setBytes];
+			uint64_t hash = hashBytes(HASH_SEED, bits, this->setBytes);
+			std::vector<uint32_t>& candidates = setsByHash[hash];
+			uint32_t found = UINT32_MAX;
+			for (size_t c = 0; c < candidates.size() && found == UINT32_MAX; c++) {
+				if (memcmp(&this->sets[candidates[c] * this->setBytes], bits, this->setBytes) == 0) {
+					found = candidates[c];
+				}
+			}
+			if (found == UINT32_MAX) {
+				found = (uint32_t)(this->sets.size() / std::max<size_t>(this->setBytes, 1));
+				this->sets.insert(this->sets.end(), bits, bits + this->setBytes);
+				candidates.push_back(found);
+			}
+			this->cellSets[cell] = found;
+		}
+	}
+
+	bool Pvs::buildCached(const gps::Bvh& bvh, const std::vector<gps::Mesh>& meshes, float cellSize, int raysPerCell,
+		const std::string& cachePath) {
+
+		uint64_t sourceHash = hashBytes(HASH_SEED, &cellSize, sizeof(cellSize));
+		sourceHash = hashBytes(sourceHash, &raysPerCell, sizeof(raysPerCell));
+		sourceHash = hashMeshGeometry(sourceHash, meshes, false);
+		if (load(cachePath, sourceHash) && this->meshCount == meshes.size()) {
+			return true;
+		}
+
+		build(bvh, meshes, cellSize, raysPerCell);
+		if (!save(cachePath, sourceHash)) {
+			fprintf(stderr, "WARNING: could not write the PVS cache %s\n", cachePath.c_str());
+		}
+		return false;
+	}
+
+	int Pvs::findCell(const glm::vec3& position) const {
+
+		if (this->cellSets.empty()) {
+			return -1;
+		}
+
+		glm::ivec3 coords = glm::ivec3(glm::floor((position - this->origin) / this->cellSize));
+		if (coords.x < 0 || coords.y < 0 || coords.z < 0
+			|| coords.x >= this->dimensions.x || coords.y >= this->dimensions.y || coords.z >= this->dimensions.z) {
+			return -1;
+		}
+		return (coords.z * this->dimensions.y + coords.y) * this->dimensions.x + coords.x;
+	}
+
+	const uint8_t* Pvs::getVisibleSet(int cell) const {
+		return &this->sets[this->cellSets[cell] * this->setBytes];
+	}
+
+	size_t Pvs::getCellCount() const {
+		return this->cellSets.size();
+	}
+
+	size_t Pvs::getSetCount() const {
+		return this->setBytes > 0 ? this->sets.size() / this->setBytes : 0;
+	}
+
+	size_t Pvs::getMeshCount() const {
+		return this->meshCount;
+	}
+
+	float Pvs::getCellSize() const {
+		return this->cellSize;
+	}
+
+	bool Pvs::empty() const {
+		return this->cellSets.empty();
+	}
+
+	bool Pvs::load(const std::string& fileName, uint64_t sourceHash) {
+
+		FILE* file = openBakeCache(fileName, CACHE_MAGIC, sourceHash);
+		if (file == NULL) {
+			return false;
+		}
+
+		uint64_t meshCount = 0;
+		uint64_t setCount = 0;
+		bool valid = fread(&this->origin, sizeof(this->origin), 1, file) == 1
+			&& fread(&this->cellSize, sizeof(this->cellSize), 1, file) == 1
+			&& fread(&this->dimensions, sizeof(this->dimensions), 1, file) == 1
+			&& fread(&meshCount, sizeof(meshCount), 1, file) == 1
+			&& fread(&setCount, sizeof(setCount), 1, file) == 1;
+
+		if (valid) {
+			this->meshCount = (size_t)meshCount;
+			this->setBytes = (this->meshCount + 7) / 8;
+			this->cellSets.resize((size_t)this->dimensions.x * this->dimensions.y * this->dimensions.z);
+			this->sets.resize((size_t)setCount * this->setBytes);
+			valid = fread(this->cellSets.data(), sizeof(uint32_t), this->cellSets.size(), file) == this->cellSets.size()
+				&& fread(this->sets.data(), 1, this->sets.size(), file) == this->sets.size();
+		}
+		for (size_t cell = 0; cell < this->cellSets.size() && valid; cell++) {
+			valid = this->cellSets[cell] < setCount;
+		}
+		fclose(file);
+
+		if (!valid) {
+			this->cellSets.clear();
+			this->sets.clear();
+		}
+		return valid;
+	}
+
+	bool Pvs::save(const std::string& fileName, uint64_t sourceHash) const {
+
+		FILE* file = createBakeCache(fileName, CACHE_MAGIC, sourceHash);
+		if (file == NULL) {
+			return false;
+		}
+
+		uint64_t meshCount = this->meshCount;
+		uint64_t setCount = getSetCount();
+		bool written = fwrite(&this->origin, sizeof(this->origin), 1, file) == 1
+			&& fwrite(&this->cellSize, sizeof(this->cellSize), 1, file) == 1
+			&& fwrite(&this->dimensions, sizeof(this->dimensions), 1, file) == 1
+			&& fwrite(&meshCount, sizeof(meshCount), 1, file) == 1
+			&& fwrite(&setCount, sizeof(setCount), 1, file) == 1
+			&& fwrite(this->cellSets.data(), sizeof(uint32_t), this->cellSets.size(), file) == this->cellSets.size()
+			&& fwrite(this->sets.data(), 1, this->sets.size(), file) == this->sets.size();
+
+		return fclose(file) == 0 && written;
+	}
+}
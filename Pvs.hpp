@@ -0,0 +1,70 @@
+#ifndef Pvs_hpp
+#define Pvs_hpp
+
+#include "Bvh.hpp"
+#include "Mesh.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Potentially visible sets: the space around the scene is cut into a grid of cubic cells, and every
+    // cell stores which meshes can be seen from anywhere inside it. The sets are baked offline by casting
+    // rays from random points of each cell against the scene BVH, half in random directions and half
+    // aimed at the triangles of every mesh not found yet (a few per mesh at least), with the cells spread
+    // over the worker pool; each mesh a ray hits first is visible. Meshes whose bounds reach into a cell
+    // are always in its set, and every set is grown by those of the 26 cells around it, so a mesh the
+    // rays barely catch stays visible across cell borders. Neighbouring cells mostly see the same meshes,
+    // so only the distinct bitsets are stored, and each cell keeps an index into them. Finding the set of the camera is a lookup, whatever the size of the scene.
+    class Pvs {
+
+    public:
+        // Bakes the sets over LOD 0 of meshes, which bvh holds in the same space. The cells grow past
+        // cellSize when the grid would have too many of them
+        void build(const gps::Bvh& bvh, const std::vector<gps::Mesh>& meshes, float cellSize, int raysPerCell);
+
+        // Reads the sets from cachePath if they were baked from the same geometry and settings, else
+        // bakes them and writes them there. Returns true when the cache was used
+        bool buildCached(const gps::Bvh& bvh, const std::vector<gps::Mesh>& meshes, float cellSize, int raysPerCell,
+            const std::string& cachePath);
+
+        // Cell holding the position, in the space of the meshes; -1 outside the grid
+        int findCell(const glm::vec3& position) const;
+
+        // Meshes visible from the cell, one bit each: mesh m is bit m % 8 of byte m / 8
+        const uint8_t* getVisibleSet(int cell) const;
+
+        size_t getCellCount() const;
+
+        // distinct sets among the cells
+        size_t getSetCount() const;
+
+        size_t getMeshCount() const;
+
+        float getCellSize() const;
+
+        bool empty() const;
+
+    private:
+        // corner of cell 0 and the number of cells along each axis
+        glm::vec3 origin;
+        float cellSize = 0.0f;
+        glm::ivec3 dimensions;
+        size_t meshCount = 0;
+        size_t setBytes = 0;
+        // per cell, x fastest: index of its set
+        std::vector<uint32_t> cellSets;
+        // the distinct sets, setBytes each
+        std::vector<uint8_t> sets;
+
+        bool load(const std::string& fileName, uint64_t sourceHash);
+
+        bool save(const std::string& fileName, uint64_t sourceHash) const;
+    };
+}
+
+#endif /* Pvs_hpp */
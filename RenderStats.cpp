@@ -0,0 +1,30 @@
+#include "RenderStats.hpp"
+
+namespace gps {
+
+	RenderStats renderStats;
+
+	void RenderStats::countDraw(uint64_t triangles, uint64_t instances) {
+
+		this->drawCalls++;
+		this->trianglesSubmitted += triangles * instances;
+	}
+
+	void RenderStats::countCulled(uint64_t triangles) {
+
+		this->trianglesCulled += triangles;
+	}
+
+	void RenderStats::countStateChanges(uint64_t changes) {
+
+		this->stateChanges += changes;
+	}
+
+	void RenderStats::resetFrame() {
+
+		this->drawCalls = 0;
+		this->trianglesSubmitted = 0;
+		this->trianglesCulled = 0;
+		this->stateChanges = 0;
+	}
+}
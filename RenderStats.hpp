@@ -0,0 +1,29 @@
+#ifndef RenderStats_hpp
+#define RenderStats_hpp
+
+#include <cstdint>
+
+namespace gps {
+
+    // What the renderer submitted in one frame, counted where the draws are issued
+    struct RenderStats {
+
+        uint64_t drawCalls = 0;
+        uint64_t trianglesSubmitted = 0;
+        // triangles of draws that were skipped because they could not be seen
+        uint64_t trianglesCulled = 0;
+        // program, vertex array and texture binds
+        uint64_t stateChanges = 0;
+
+        void countDraw(uint64_t triangles, uint64_t instances = 1);
+        void countCulled(uint64_t triangles);
+        void countStateChanges(uint64_t changes);
+
+        void resetFrame();
+    };
+
+    // Counters of the frame being drawn
+    extern RenderStats renderStats;
+}
+
+#endif /* RenderStats_hpp */
@@ -0,0 +1,40 @@
+#include "RenderVersion.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+	void RenderVersion::invalidate() {
+
+		this->version++;
+	}
+
+	void RenderVersion::observe(const void* inputs, size_t size) {
+
+		if (this->lastInputs.size() == size && memcmp(this->lastInputs.data(), inputs, size) == 0) {
+			return;
+		}
+
+		const unsigned char* bytes = (const unsigned char*)inputs;
+		this->lastInputs.assign(bytes, bytes + size);
+		this->version++;
+		this->moved = true;
+	}
+
+	void RenderVersion::frameDrawn() {
+
+		this->lastFrameMoved = this->moved;
+		this->moved = false;
+		this->drawnVersion = this->version;
+	}
+
+	bool RenderVersion::needsFrame() const {
+
+		return this->version != this->drawnVersion || this->lastFrameMoved;
+	}
+
+	uint64_t RenderVersion::getVersion() const {
+
+		return this->version;
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef RenderVersion_hpp
+#define RenderVersion_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Version of everything the image is drawn from, for rendering on demand. The version moves when
+    // the inputs a frame observes differ from the previous frame's, or when something they don't
+    // capture (a window event, a key) invalidates it. A frame is only needed while the version is
+    // ahead of the last drawn one, or while the last drawn frame still moved - animations end with
+    // one frame identical to the one before, and then drawing stops.
+    class RenderVersion {
+
+    public:
+        void invalidate();
+
+        // Snapshot of the inputs of the frame being drawn, compared byte for byte, so it should hold no padding
+        void observe(const void* inputs, size_t size);
+
+        // Call once the frame is drawn
+        void frameDrawn();
+
+        bool needsFrame() const;
+
+        uint64_t getVersion() const;
+
+    private:
+        uint64_t version = 1;
+        uint64_t drawnVersion = 0;
+        bool moved = false;
+        bool lastFrameMoved = false;
+        std::vector<unsigned char> lastInputs;
+    };
+}
+
+#endif /* RenderVersion_hpp */
@@ -0,0 +1,237 @@
+#include "SceneGraph.hpp"
+
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+
+#include "glm/gtc/matrix_inverse.hpp"
+
+namespace gps {
+
+	// Levels with fewer dirty nodes than this are cheaper to update on the calling thread
+	static const size_t PARALLEL_UPDATE_THRESHOLD = 2048;
+
+	static const uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+	SceneNode SceneGraph::createNode(SceneNode parent, const glm::mat4& localTransform) {
+
+		SceneNode node = (SceneNode)this->nodeSlots.size();
+		uint32_t slot = (uint32_t)this->slotNodes.size();
+
+		// appended for now; rebuildOrder() moves it to its breadth-first position
+		this->nodeSlots.push_back(slot);
+		this->slotNodes.push_back(node);
+		this->parentSlots.push_back(parent == NO_PARENT ? NO_SLOT : this->nodeSlots[parent]);
+		this->depths.push_back(parent == NO_PARENT ? 0 : this->depths[this->nodeSlots[parent]] + 1);
+		this->firstChildSlots.push_back(0);
+		this->childCounts.push_back(0);
+		this->localTransforms.push_back(localTransform);
+		this->worldTransforms.push_back(glm::mat4(1.0f));
+		this->normalMatrices.push_back(glm::mat3(1.0f));
+		this->queued.push_back(0);
+
+		this->orderDirty = true;
+		queue(slot);
+
+		return node;
+	}
+
+	void SceneGraph::setLocalTransform(SceneNode node, const glm::mat4& localTransform) {
+
+		uint32_t slot = this->nodeSlots[node];
+		if (this->localTransforms[slot] == localTransform) {
+			return;
+		}
+
+		this->localTransforms[slot] = localTransform;
+		queue(slot);
+	}
+
+	const glm::mat4& SceneGraph::getLocalTransform(SceneNode node) const {
+		return this->localTransforms[this->nodeSlots[node]];
+	}
+
+	const glm::mat4& SceneGraph::getWorldTransform(SceneNode node) const {
+		return this->worldTransforms[this->nodeSlots[node]];
+	}
+
+	const glm::mat3& SceneGraph::getNormalMatrix(SceneNode node) const {
+		return this->normalMatrices[this->nodeSlots[node]];
+	}
+
+	size_t SceneGraph::getNodeCount() const {
+		return this->slotNodes.size();
+	}
+
+	size_t SceneGraph::update() {
+
+		PROFILE_FUNCTION();
+
+		if (this->orderDirty) {
+			rebuildOrder();
+		}
+
+		if (this->dirtySlots.empty()) {
+			return 0;
+		}
+
+		// bucket the dirty nodes by depth; their descendants are added level by level below. The slots are
+		// in breadth-first order, so the last one is the deepest, and levels never grows (and moves) while
+		// a level is being walked
+		this->levels.resize(this->depths.back() + 1);
+		for (size_t i = 0; i < this->levels.size(); i++) {
+			this->levels[i].clear();
+		}
+		for (size_t i = 0; i < this->dirtySlots.size(); i++) {
+
+			uint32_t slot = this->dirtySlots[i];
+			this->levels[this->depths[slot]].push_back(slot);
+		}
+		this->dirtySlots.clear();
+
+		size_t updatedCount = 0;
+
+		for (size_t depth = 0; depth < this->levels.size(); depth++) {
+
+			std::vector<uint32_t>& level = this->levels[depth];
+			if (level.empty()) {
+				continue;
+			}
+
+			// every node of a level only reads its parent, which belongs to a finished level
+			if (level.size() >= PARALLEL_UPDATE_THRESHOLD) {
+
+				parallelFor(level.size(), 256, [this, &level](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++) {
+						updateSlot(level[i]);
+					}
+				});
+			}
+			else {
+
+				for (size_t i = 0; i < level.size(); i++) {
+					updateSlot(level[i]);
+				}
+			}
+			updatedCount += level.size();
+
+			// the children of each updated node are one contiguous range of the next level
+			for (size_t i = 0; i < level.size(); i++) {
+
+				uint32_t slot = level[i];
+				this->queued[slot] = 0;
+
+				uint32_t firstChild = this->firstChildSlots[slot];
+				for (uint32_t child = firstChild; child < firstChild + this->childCounts[slot]; child++) {
+
+					if (!this->queued[child]) {
+						this->queued[child] = 1;
+						this->levels[depth + 1].push_back(child);
+					}
+				}
+			}
+		}
+
+		return updatedCount;
+	}
+
+	void SceneGraph::queue(uint32_t slot) {
+
+		if (!this->queued[slot]) {
+			this->queued[slot] = 1;
+			this->dirtySlots.push_back(slot);
+		}
+	}
+
+	void SceneGraph::updateSlot(uint32_t slot) {
+
+		uint32_t parent = this->parentSlots[slot];
+		if (parent == NO_SLOT) {
+			this->worldTransforms[slot] = this->localTransforms[slot];
+		}
+		else {
+			this->worldTransforms[slot] = this->worldTransforms[parent] * this->localTransforms[slot];
+		}
+		this->normalMatrices[slot] = glm::inverseTranspose(glm::mat3(this->worldTransforms[slot]));
+	}
+
+	void SceneGraph::rebuildOrder() {
+
+		size_t count = this->slotNodes.size();
+
+		// children of every old slot, in creation order
+		std::vector<uint32_t> childStart(count + 1, 0);
+		for (size_t slot = 0; slot < count; slot++) {
+			if (this->parentSlots[slot] != NO_SLOT) {
+				childStart[this->parentSlots[slot] + 1]++;
+			}
+		}
+		for (size_t slot = 0; slot < count; slot++) {
+			childStart[slot + 1] += childStart[slot];
+		}
+		std::vector<uint32_t> children(childStart[count]);
+		std::vector<uint32_t> fill(childStart.begin(), childStart.end() - 1);
+		for (size_t slot = 0; slot < count; slot++) {
+			if (this->parentSlots[slot] != NO_SLOT) {
+				children[fill[this->parentSlots[slot]]++] = (uint32_t)slot;
+			}
+		}
+
+		// breadth-first walk from the roots gives the new order
+		std::vector<uint32_t> order;
+		order.reserve(count);
+		for (size_t slot = 0; slot < count; slot++) {
+			if (this->parentSlots[slot] == NO_SLOT) {
+				order.push_back((uint32_t)slot);
+			}
+		}
+		for (size_t i = 0; i < order.size(); i++) {
+			uint32_t oldSlot = order[i];
+			order.insert(order.end(), children.begin() + childStart[oldSlot], children.begin() + childStart[oldSlot + 1]);
+		}
+
+		std::vector<uint32_t> newSlots(count);
+		for (size_t i = 0; i < count; i++) {
+			newSlots[order[i]] = (uint32_t)i;
+		}
+
+		std::vector<SceneNode> slotNodes(count);
+		std::vector<uint32_t> parentSlots(count), depths(count), firstChildSlots(count), childCounts(count);
+		std::vector<glm::mat4> localTransforms(count), worldTransforms(count);
+		std::vector<glm::mat3> normalMatrices(count);
+		std::vector<uint8_t> queued(count);
+
+		for (size_t i = 0; i < count; i++) {
+
+			uint32_t oldSlot = order[i];
+			uint32_t oldParent = this->parentSlots[oldSlot];
+
+			slotNodes[i] = this->slotNodes[oldSlot];
+			parentSlots[i] = oldParent == NO_SLOT ? NO_SLOT : newSlots[oldParent];
+			depths[i] = this->depths[oldSlot];
+			childCounts[i] = childStart[oldSlot + 1] - childStart[oldSlot];
+			firstChildSlots[i] = childCounts[i] > 0 ? newSlots[children[childStart[oldSlot]]] : 0;
+			localTransforms[i] = this->localTransforms[oldSlot];
+			worldTransforms[i] = this->worldTransforms[oldSlot];
+			normalMatrices[i] = this->normalMatrices[oldSlot];
+			queued[i] = this->queued[oldSlot];
+
+			this->nodeSlots[slotNodes[i]] = (uint32_t)i;
+		}
+
+		this->slotNodes.swap(slotNodes);
+		this->parentSlots.swap(parentSlots);
+		this->depths.swap(depths);
+		this->firstChildSlots.swap(firstChildSlots);
+		this->childCounts.swap(childCounts);
+		this->localTransforms.swap(localTransforms);
+		this->worldTransforms.swap(worldTransforms);
+		this->normalMatrices.swap(normalMatrices);
+		this->queued.swap(queued);
+
+		for (size_t i = 0; i < this->dirtySlots.size(); i++) {
+			this->dirtySlots[i] = newSlots[this->dirtySlots[i]];
+		}
+
+		this->orderDirty = false;
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef SceneGraph_hpp
+#define SceneGraph_hpp
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    typedef unsigned int SceneNode;
+
+    // Transform hierarchy. Node data lives in parallel arrays (structure of arrays) in breadth-first
+    // order: sorted by depth, and within a depth by parent, so the children of a node are contiguous.
+    // Changing a local transform marks the node dirty; update() then recomputes the world and normal
+    // matrices of dirty nodes and their descendants only, one depth level at a time.
+    class SceneGraph {
+
+    public:
+        static const SceneNode NO_PARENT = 0xFFFFFFFFu;
+
+        // Adds a node below parent (or a new root); the handle stays valid when the arrays are re-sorted
+        SceneNode createNode(SceneNode parent = NO_PARENT, const glm::mat4& localTransform = glm::mat4(1.0f));
+
+        // Marks the node dirty unless the transform is unchanged
+        void setLocalTransform(SceneNode node, const glm::mat4& localTransform);
+
+        const glm::mat4& getLocalTransform(SceneNode node) const;
+
+        // Valid after update()
+        const glm::mat4& getWorldTransform(SceneNode node) const;
+
+        // Inverse transpose of the world transform's upper 3x3, valid after update()
+        const glm::mat3& getNormalMatrix(SceneNode node) const;
+
+        // Propagates pending changes; returns the number of nodes whose matrices were recomputed
+        size_t update();
+
+        size_t getNodeCount() const;
+
+    private:
+        // indexed by SceneNode
+        std::vector<uint32_t> nodeSlots;
+
+        // indexed by slot (breadth-first position)
+        std::vector<SceneNode> slotNodes;
+        std::vector<uint32_t> parentSlots;
+        std::vector<uint32_t> depths;
+        std::vector<uint32_t> firstChildSlots;
+        std::vector<uint32_t> childCounts;
+        std::vector<glm::mat4> localTransforms;
+        std::vector<glm::mat4> worldTransforms;
+        std::vector<glm::mat3> normalMatrices;
+        std::vector<uint8_t> queued;
+
+        // nodes whose local transform changed since the last update
+        std::vector<uint32_t> dirtySlots;
+        // per depth level: slots to recompute in the current update
+        std::vector<std::vector<uint32_t>> levels;
+
+        bool orderDirty = false;
+
+        void queue(uint32_t slot);
+
+        // Re-sorts the arrays breadth-first after nodes were added
+        void rebuildOrder();
+
+        void updateSlot(uint32_t slot);
+    };
+}
+
+#endif /* SceneGraph_hpp */
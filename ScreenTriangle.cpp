@@ -0,0 +1,35 @@
+#include "ScreenTriangle.hpp"
+
+#include "RenderStats.hpp"
+
+namespace gps {
+
+	void ScreenTriangle::init() {
+
+		// shared by several passes, any of which may set it up
+		if (this->VAO != 0) {
+			return;
+		}
+
+		// core profiles refuse draws without a VAO, even an empty one
+		glGenVertexArrays(1, &this->VAO);
+	}
+
+	void ScreenTriangle::Draw(gps::Shader shader) {
+
+		shader.useShaderProgram();
+
+		glBindVertexArray(this->VAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+
+		renderStats.countStateChanges(2);
+		renderStats.countDraw(1);
+	}
+
+	void ScreenTriangle::release() {
+
+		glDeleteVertexArrays(1, &this->VAO);
+		this->VAO = 0;
+	}
+}
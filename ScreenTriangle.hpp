@@ -0,0 +1,34 @@
+#ifndef ScreenTriangle_hpp
+#define ScreenTriangle_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Shader.hpp"
+
+namespace gps {
+
+    // A single triangle covering the viewport, for fullscreen passes.
+    // The vertices come from gl_VertexID (see shaders/fullscreen.vert), so the VAO holds no buffers.
+    class ScreenTriangle {
+
+    public:
+        // Calling it again once the VAO exists does nothing
+        void init();
+
+        void Draw(gps::Shader shader);
+
+        // Deletes the VAO - before the context goes; init() creates it again
+        void release();
+
+    private:
+        GLuint VAO = 0;
+    };
+}
+
+#endif /* ScreenTriangle_hpp */
@@ -0,0 +1,112 @@
+#include "ShaderLoader.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <set>
+
+namespace gps {
+
+	// Deeper than this, the includes are taken to loop
+	static const int MAX_INCLUDE_DEPTH = 8;
+	static const char INCLUDE_DIRECTIVE[] = "#include";
+
+	static bool expandIncludes(const std::string& fileName, std::set<std::string>& included, int depth, std::string& source) {
+
+		if (depth > MAX_INCLUDE_DEPTH) {
+			fprintf(stderr, "ERROR: shader includes nest too deep at %s\n", fileName.c_str());
+			return false;
+		}
+
+		std::ifstream file(fileName.c_str());
+		if (!file) {
+			fprintf(stderr, "ERROR: could not read shader %s\n", fileName.c_str());
+			return false;
+		}
+
+		std::string directory = fileName.substr(0, fileName.find_last_of('/') + 1);
+		std::string line;
+		while (std::getline(file, line)) {
+
+			size_t start = line.find_first_not_of(" \t");
+			if (start == std::string::npos || line.compare(start, sizeof(INCLUDE_DIRECTIVE) - 1, INCLUDE_DIRECTIVE) != 0) {
+				source += line;
+				source += '\n';
+				continue;
+			}
+
+			size_t open = line.find('"', start);
+			size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+			if (close == std::string::npos) {
+				fprintf(stderr, "ERROR: malformed include in %s: %s\n", fileName.c_str(), line.c_str());
+				return false;
+			}
+
+			std::string includeName = directory + line.substr(open + 1, close - open - 1);
+			if (!included.insert(includeName).second) {
+				continue;
+			}
+			if (!expandIncludes(includeName, included, depth + 1, source)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool readShaderSource(const std::string& fileName, std::string& source) {
+
+		std::set<std::string> included;
+		source.clear();
+		return expandIncludes(fileName, included, 0, source);
+	}
+
+	static GLuint compileStage(GLenum stage, const std::string& fileName) {
+
+		std::string source;
+		if (!readShaderSource(fileName, source)) {
+			return 0;
+		}
+
+		GLuint shaderId = glCreateShader(stage);
+		const GLchar* text = source.c_str();
+		glShaderSource(shaderId, 1, &text, NULL);
+		glCompileShader(shaderId);
+
+		GLint success;
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success) {
+			GLchar infoLog[512];
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			fprintf(stderr, "ERROR: shader %s failed to compile\n%s\n", fileName.c_str(), infoLog);
+		}
+		return shaderId;
+	}
+
+	void loadShaderWithIncludes(gps::Shader& shader, const std::string& vertexFileName, const std::string& fragmentFileName) {
+
+		GLuint vertexShader = compileStage(GL_VERTEX_SHADER, vertexFileName);
+		GLuint fragmentShader = compileStage(GL_FRAGMENT_SHADER, fragmentFileName);
+		if (vertexShader == 0 || fragmentShader == 0) {
+			glDeleteShader(vertexShader);
+			glDeleteShader(fragmentShader);
+			shader.shaderProgram = 0;
+			return;
+		}
+
+		shader.shaderProgram = glCreateProgram();
+		glAttachShader(shader.shaderProgram, vertexShader);
+		glAttachShader(shader.shaderProgram, fragmentShader);
+		glLinkProgram(shader.shaderProgram);
+
+		GLint success;
+		glGetProgramiv(shader.shaderProgram, GL_LINK_STATUS, &success);
+		if (!success) {
+			GLchar infoLog[512];
+			glGetProgramInfoLog(shader.shaderProgram, sizeof(infoLog), NULL, infoLog);
+			fprintf(stderr, "ERROR: shaders %s and %s failed to link\n%s\n", vertexFileName.c_str(), fragmentFileName.c_str(), infoLog);
+		}
+
+		// the program keeps them alive while they are attached
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+	}
+}
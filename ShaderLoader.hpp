@@ -0,0 +1,29 @@
+#ifndef ShaderLoader_hpp
+#define ShaderLoader_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Shader.hpp"
+
+#include <string>
+
+namespace gps {
+
+    // Reads a GLSL file, replacing every line
+    //     #include "name"
+    // with the file of that name next to it, recursively; each file is pulled in once. GLSL 4.1 has no
+    // includes of its own, and the shading paths share their lighting model through them
+    // (see shaders/lighting.glsl). Returns false, with an error printed, if a file can't be read
+    bool readShaderSource(const std::string& fileName, std::string& source);
+
+    // Shader::loadShader with the #include lines of both stages expanded first
+    void loadShaderWithIncludes(gps::Shader& shader, const std::string& vertexFileName, const std::string& fragmentFileName);
+}
+
+#endif /* ShaderLoader_hpp */
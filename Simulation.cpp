@@ -0,0 +1,134 @@
+#include "Simulation.hpp"
+
+#include "Profiler.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+	// Frame times above this are clamped, so a stall (window drag, breakpoint) doesn't trigger a burst of catch-up ticks
+	static const double MAX_FRAME_SECONDS = 0.25;
+	// The simulation thread gives up on catching up once it falls this many ticks behind
+	static const int MAX_LAG_TICKS = 8;
+
+	SimulationState interpolate(const SimulationState& from, const SimulationState& to, float alpha) {
+
+		SimulationState state;
+		state.cameraPosition = glm::mix(from.cameraPosition, to.cameraPosition, alpha);
+		state.cameraFront = glm::normalize(glm::mix(from.cameraFront, to.cameraFront, alpha));
+		state.cameraUp = glm::normalize(glm::mix(from.cameraUp, to.cameraUp, alpha));
+		state.lightAngle = glm::mix(from.lightAngle, to.lightAngle, alpha);
+		state.fog = glm::mix(from.fog, to.fog, alpha);
+
+		return state;
+	}
+
+	Simulation::~Simulation() {
+
+		stopThread();
+	}
+
+	void Simulation::init(int tickRate, const SimulationState& initialState, StepFunction step) {
+
+		this->step = step;
+		this->tickSeconds = 1.0 / tickRate;
+		this->accumulator = 0.0;
+		this->previousState = initialState;
+		this->currentState = initialState;
+		this->tickCount = 0;
+		this->currentTickTime = Clock::now();
+	}
+
+	void Simulation::advance(double frameSeconds) {
+
+		this->accumulator += std::min(frameSeconds, MAX_FRAME_SECONDS);
+
+		while (this->accumulator >= this->tickSeconds) {
+
+			tick();
+			this->accumulator -= this->tickSeconds;
+		}
+	}
+
+	void Simulation::startThread() {
+
+		if (this->running.exchange(true)) {
+			return;
+		}
+
+		this->thread = std::thread(&Simulation::threadLoop, this);
+	}
+
+	void Simulation::stopThread() {
+
+		if (!this->running.exchange(false)) {
+			return;
+		}
+
+		this->thread.join();
+	}
+
+	void Simulation::setInput(const SimulationInput& input) {
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->input = input;
+	}
+
+	SimulationState Simulation::getRenderState() {
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		// the blend trails the newest tick by up to one tick, which is what keeps it continuous
+		double alpha;
+		if (this->running) {
+			alpha = std::chrono::duration<double>(Clock::now() - this->currentTickTime).count() / this->tickSeconds;
+		}
+		else {
+			alpha = this->accumulator / this->tickSeconds;
+		}
+
+		return interpolate(this->previousState, this->currentState, (float)std::min(std::max(alpha, 0.0), 1.0));
+	}
+
+	double Simulation::getTickSeconds() const {
+		return this->tickSeconds;
+	}
+
+	uint64_t Simulation::getTickCount() {
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->tickCount;
+	}
+
+	void Simulation::tick() {
+
+		PROFILE_ZONE("simulationTick");
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		this->previousState = this->currentState;
+		this->step(this->currentState, this->input, this->tickSeconds);
+		this->currentTickTime = Clock::now();
+		this->tickCount++;
+	}
+
+	void Simulation::threadLoop() {
+
+		setProfilerThreadName("simulation");
+
+		Clock::duration tickDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(this->tickSeconds));
+		Clock::time_point nextTick = Clock::now() + tickDuration;
+
+		while (this->running) {
+
+			std::this_thread::sleep_until(nextTick);
+			tick();
+
+			// keep a steady cadence, but don't replay ticks lost to a long stall
+			nextTick += tickDuration;
+			if (Clock::now() - nextTick > tickDuration * MAX_LAG_TICKS) {
+				nextTick = Clock::now() + tickDuration;
+			}
+		}
+	}
+}
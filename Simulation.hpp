@@ -0,0 +1,86 @@
+#ifndef Simulation_hpp
+#define Simulation_hpp
+
+#include "glm/glm.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace gps {
+
+    // Everything a simulation tick advances and the renderer interpolates between ticks
+    struct SimulationState {
+
+        glm::vec3 cameraPosition;
+        glm::vec3 cameraFront;
+        glm::vec3 cameraUp;
+        float lightAngle;
+        float fog;
+    };
+
+    // Keyboard state sampled on the main thread; ticks only ever see a copy
+    struct SimulationInput {
+
+        static const int KEY_COUNT = 1024;
+        bool keys[KEY_COUNT] = {};
+    };
+
+    // Linear blend of two states, directions re-normalized
+    SimulationState interpolate(const SimulationState& from, const SimulationState& to, float alpha);
+
+    // Fixed-timestep simulation decoupled from the frame rate. Ticks always advance the state by the
+    // same dt, either from an accumulator fed with the frame time (advance) or in real time on a thread
+    // of their own (startThread). The renderer draws a blend of the last two ticks (getRenderState),
+    // so motion stays smooth at any frame rate and stays the same when the frame rate changes.
+    class Simulation {
+
+    public:
+        typedef std::function<void(SimulationState& state, const SimulationInput& input, double dt)> StepFunction;
+
+        ~Simulation();
+
+        void init(int tickRate, const SimulationState& initialState, StepFunction step);
+
+        // Single-threaded mode: runs the whole ticks that fit into the accumulated frame time
+        void advance(double frameSeconds);
+
+        // Threaded mode: ticks run on a worker thread until stopThread()
+        void startThread();
+        void stopThread();
+
+        void setInput(const SimulationInput& input);
+
+        // State between the last two ticks, at the point in time the renderer is at
+        SimulationState getRenderState();
+
+        double getTickSeconds() const;
+        uint64_t getTickCount();
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        StepFunction step;
+        double tickSeconds = 1.0 / 60.0;
+        double accumulator = 0.0;
+
+        // guards everything below in threaded mode
+        std::mutex mutex;
+        SimulationState previousState;
+        SimulationState currentState;
+        SimulationInput input;
+        uint64_t tickCount = 0;
+        Clock::time_point currentTickTime;
+
+        std::thread thread;
+        std::atomic<bool> running{false};
+
+        void tick();
+        void threadLoop();
+    };
+}
+
+#endif /* Simulation_hpp */
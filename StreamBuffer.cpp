@@ -0,0 +1,113 @@
+#include "StreamBuffer.hpp"
+
+#include "GpuMemory.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace gps {
+
+	void StreamBuffer::init(GLenum target, GLsizeiptr capacity, const std::string& label) {
+
+		this->target = target;
+		this->label = label;
+		glGenBuffers(1, &this->buffer);
+		orphan(capacity);
+	}
+
+	GLintptr StreamBuffer::upload(const void* data, GLsizeiptr size, GLsizeiptr alignment) {
+
+		GLintptr offset = 0;
+		void* destination = map(size, &offset, alignment);
+		memcpy(destination, data, size);
+		unmap();
+
+		return offset;
+	}
+
+	void* StreamBuffer::map(GLsizeiptr size, GLintptr* offset, GLsizeiptr alignment) {
+
+		GLsizeiptr start = (this->head + alignment - 1) / alignment * alignment;
+
+		if (size > this->capacity) {
+
+			// grow to the next power of two so repeated large uploads settle quickly
+			GLsizeiptr newCapacity = this->capacity > 0 ? this->capacity : 1;
+			while (newCapacity < size) {
+				newCapacity *= 2;
+			}
+			orphan(newCapacity);
+			start = 0;
+		}
+		else if (start + size > this->capacity) {
+
+			// wrapped around - orphan instead of waiting for the GPU to release the old range
+			orphan(this->capacity);
+			start = 0;
+		}
+
+		this->head = start + size;
+		*offset = start;
+
+		glBindBuffer(this->target, this->buffer);
+		void* destination = glMapBufferRange(this->target, start, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+		if (destination == NULL) {
+
+			// some drivers refuse unsynchronized maps - stage in client memory instead
+			this->fallback = malloc(size);
+			this->fallbackOffset = start;
+			this->fallbackSize = size;
+			destination = this->fallback;
+		}
+
+		return destination;
+	}
+
+	void StreamBuffer::unmap() {
+
+		glBindBuffer(this->target, this->buffer);
+
+		if (this->fallback != nullptr) {
+
+			glBufferSubData(this->target, this->fallbackOffset, this->fallbackSize, this->fallback);
+			free(this->fallback);
+			this->fallback = nullptr;
+		}
+		else {
+
+			glUnmapBuffer(this->target);
+		}
+	}
+
+	GLuint StreamBuffer::getBuffer() const {
+		return this->buffer;
+	}
+
+	GLsizeiptr StreamBuffer::getCapacity() const {
+		return this->capacity;
+	}
+
+	void StreamBuffer::orphan(GLsizeiptr newCapacity) {
+
+		this->capacity = newCapacity;
+		this->head = 0;
+
+		glBindBuffer(this->target, this->buffer);
+		glBufferData(this->target, this->capacity, NULL, GL_STREAM_DRAW);
+		trackGpuBuffer(this->buffer, this->capacity, "StreamBuffer", this->label);
+	}
+
+	void StreamBuffer::release() {
+
+		if (this->buffer != 0) {
+
+			glDeleteBuffers(1, &this->buffer);
+			releaseGpuResource(GPU_BUFFER, this->buffer);
+			this->buffer = 0;
+			this->capacity = 0;
+			this->head = 0;
+		}
+	}
+}
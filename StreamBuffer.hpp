@@ -0,0 +1,57 @@
+#ifndef StreamBuffer_hpp
+#define StreamBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <string>
+
+namespace gps {
+
+    // Ring buffer for per-frame data that is written once by the CPU and read once by the GPU.
+    // Writes go to unsynchronized mapped ranges; when the ring wraps the storage is orphaned,
+    // so the driver hands us fresh memory instead of waiting on draws that still use the old one.
+    class StreamBuffer {
+
+    public:
+        // Creates the buffer object - needs a current context; label names it in the GPU memory report
+        void init(GLenum target, GLsizeiptr capacity, const std::string& label);
+
+        // Copies size bytes into the ring and returns their offset inside getBuffer()
+        GLintptr upload(const void* data, GLsizeiptr size, GLsizeiptr alignment = 256);
+
+        // Reserves size bytes and maps them for writing; everything written before unmap()
+        // stays valid together, even if a later reservation wraps the ring
+        void* map(GLsizeiptr size, GLintptr* offset, GLsizeiptr alignment = 256);
+
+        void unmap();
+
+        GLuint getBuffer() const;
+
+        GLsizeiptr getCapacity() const;
+
+        // Deletes the buffer - before the context goes; init() creates it again
+        void release();
+
+    private:
+        GLenum target = GL_ARRAY_BUFFER;
+        GLuint buffer = 0;
+        GLsizeiptr capacity = 0;
+        GLsizeiptr head = 0;
+        std::string label;
+        // Range handed out by map(), written with glBufferSubData if mapping failed
+        void* fallback = nullptr;
+        GLintptr fallbackOffset = 0;
+        GLsizeiptr fallbackSize = 0;
+
+        // Replaces the storage with an unused block of (at least) newCapacity bytes
+        void orphan(GLsizeiptr newCapacity);
+    };
+}
+
+#endif /* StreamBuffer_hpp */
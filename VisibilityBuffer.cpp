@@ -0,0 +1,306 @@
+#include "VisibilityBuffer.hpp"
+
+#include "GpuMemory.hpp"
+#include "OcclusionCulling.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace gps {
+
+	// Texture units of the resolve pass; 0-2 are the mesh textures, 3-6 the shadow map and light clusters
+	static const GLuint VISIBILITY_UNIT = 7;
+	static const GLuint VERTEX_DATA_UNIT = 8;
+	static const GLuint INDEX_DATA_UNIT = 9;
+	static const GLuint OCCLUSION_DATA_UNIT = 10;
+
+	static GLuint createTarget(int width, int height, GLint internalFormat, GLenum format, GLenum type) {
+
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		return texture;
+	}
+
+	static void checkFramebuffer(const char* name) {
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "ERROR: %s framebuffer is incomplete\n", name);
+		}
+	}
+
+	bool VisibilityBuffer::supports(gps::Model3D& model) {
+
+		std::vector<gps::Mesh>& meshes = model.getMeshes();
+		bool fits = true;
+		if (meshes.size() > MAX_DRAWS) {
+			fprintf(stderr, "ERROR: visibility buffer ids cover %d meshes, the model has %zu\n", MAX_DRAWS, meshes.size());
+			fits = false;
+		}
+
+		// the ids count triangles from the start of the index buffer, which holds every LOD one after another
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			uint64_t triangles = 0;
+			for (size_t l = 0; l < meshes[i].lods.size(); l++) {
+				triangles = std::max(triangles, ((uint64_t)meshes[i].lods[l].firstIndex + meshes[i].lods[l].indexCount) / 3);
+			}
+			if (triangles > MAX_TRIANGLES) {
+				fprintf(stderr, "ERROR: visibility buffer ids cover %u triangles per mesh, mesh %zu has %llu with its LODs\n",
+					MAX_TRIANGLES, i, (unsigned long long)triangles);
+				fits = false;
+			}
+		}
+		return fits;
+	}
+
+	void VisibilityBuffer::init(int width, int height, gps::Model3D& model) {
+
+		release();
+
+		this->width = width;
+		this->height = height;
+
+		this->visibilityTexture = createTarget(width, height, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT);
+		this->depthTexture = createTarget(width, height, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT);
+		this->colorTexture = createTarget(width, height, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		trackGpuTexture(GL_TEXTURE_2D, this->visibilityTexture, "VisibilityBuffer", "visibility ids");
+		trackGpuTexture(GL_TEXTURE_2D, this->depthTexture, "VisibilityBuffer", "depth");
+		trackGpuTexture(GL_TEXTURE_2D, this->colorTexture, "VisibilityBuffer", "shaded color");
+
+		glGenFramebuffers(1, &this->geometryFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->geometryFramebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->visibilityTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depthTexture, 0);
+		checkFramebuffer("visibility");
+
+		glGenRenderbuffers(1, &this->materialDepthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->materialDepthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		trackGpuRenderbuffer(this->materialDepthBuffer, "VisibilityBuffer", "material depth");
+
+		glGenFramebuffers(1, &this->resolveFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->resolveFramebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->colorTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->materialDepthBuffer);
+		checkFramebuffer("visibility resolve");
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		std::vector<gps::Mesh>& meshes = model.getMeshes();
+
+		// the resolve pass reads the geometry straight from the buffers the meshes are drawn from
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			GLuint textures[2];
+			glGenTextures(2, textures);
+
+			glBindTexture(GL_TEXTURE_BUFFER, textures[0]);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, meshes[i].getBuffers().VBO);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[1]);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, meshes[i].getBuffers().EBO);
+
+			this->vertexTextures.push_back(textures[0]);
+			this->indexTextures.push_back(textures[1]);
+
+			// the baked ambient occlusion, one float per vertex; 0 for meshes without it
+			GLuint occlusionTexture = 0;
+			if (meshes[i].getOcclusionBuffer() != 0) {
+				glGenTextures(1, &occlusionTexture);
+				glBindTexture(GL_TEXTURE_BUFFER, occlusionTexture);
+				glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, meshes[i].getOcclusionBuffer());
+			}
+			this->occlusionTextures.push_back(occlusionTexture);
+		}
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void VisibilityBuffer::renderGeometry(gps::Model3D& model, gps::Shader shader) {
+
+		glBindFramebuffer(GL_FRAMEBUFFER, this->geometryFramebuffer);
+		glViewport(0, 0, this->width, this->height);
+
+		// id 0 marks pixels no triangle covers
+		GLuint clearId[4] = { 0, 0, 0, 0 };
+		glClearBufferuiv(GL_COLOR, 0, clearId);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		shader.useShaderProgram();
+		GLint drawIdLocation = glGetUniformLocation(shader.shaderProgram, "drawID");
+		GLint firstTriangleLocation = glGetUniformLocation(shader.shaderProgram, "firstTriangle");
+
+		std::vector<gps::Mesh>& meshes = model.getMeshes();
+		for (size_t i = 0; i < meshes.size() && i < MAX_DRAWS; i++) {
+
+			if (!model.isMeshVisible(i)) {
+				renderStats.countCulled(meshes[i].getCurrentLod().indexCount / 3);
+				continue;
+			}
+			gps::OcclusionCulling* occlusionCulling = model.getOcclusionCulling();
+			if (occlusionCulling != NULL && !occlusionCulling->beginDraw(i, meshes[i].getCurrentLod().indexCount / 3)) {
+				continue;
+			}
+			glUniform1ui(drawIdLocation, (GLuint)i);
+			glBindVertexArray(meshes[i].getBuffers().VAO);
+			renderStats.countStateChanges(1);
+
+			// the resolve pass fetches triangles from the whole index buffer, so ids count from its start;
+			// gl_PrimitiveID restarts with every range, which rules out one multi-draw per mesh
+			if (meshes[i].hasVisibleRanges()) {
+
+				const std::vector<GLsizei>& counts = meshes[i].getVisibleCounts();
+				const std::vector<const GLvoid*>& offsets = meshes[i].getVisibleOffsets();
+				for (size_t r = 0; r < counts.size(); r++) {
+
+					GLuint firstIndex = (GLuint)((size_t)offsets[r] / sizeof(GLuint));
+					glUniform1ui(firstTriangleLocation, firstIndex / 3);
+					glDrawElements(GL_TRIANGLES, counts[r], GL_UNSIGNED_INT, offsets[r]);
+					renderStats.countDraw(counts[r] / 3);
+				}
+				renderStats.countCulled(meshes[i].getCulledTriangles());
+			}
+			else {
+				const gps::MeshLod& lod = meshes[i].getCurrentLod();
+				glUniform1ui(firstTriangleLocation, lod.firstIndex / 3);
+				glDrawElements(GL_TRIANGLES, (GLsizei)lod.indexCount, GL_UNSIGNED_INT, (GLvoid*)(lod.firstIndex * sizeof(GLuint)));
+				renderStats.countDraw(lod.indexCount / 3);
+			}
+			if (occlusionCulling != NULL) {
+				occlusionCulling->endDraw();
+			}
+		}
+		glBindVertexArray(0);
+		renderStats.countStateChanges(1);
+	}
+
+	void VisibilityBuffer::classify(gps::Shader shader, gps::ScreenTriangle& screenTriangle) {
+
+		glBindFramebuffer(GL_FRAMEBUFFER, this->resolveFramebuffer);
+		glViewport(0, 0, this->width, this->height);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		shader.useShaderProgram();
+		glActiveTexture(GL_TEXTURE0 + VISIBILITY_UNIT);
+		glBindTexture(GL_TEXTURE_2D, this->visibilityTexture);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "visibility"), VISIBILITY_UNIT);
+		glActiveTexture(GL_TEXTURE0);
+
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthFunc(GL_ALWAYS);
+		screenTriangle.Draw(shader);
+		glDepthFunc(GL_LESS);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	}
+
+	void VisibilityBuffer::resolve(gps::Model3D& model, gps::Shader shader, gps::ScreenTriangle& screenTriangle) {
+
+		glBindFramebuffer(GL_FRAMEBUFFER, this->resolveFramebuffer);
+		glViewport(0, 0, this->width, this->height);
+
+		shader.useShaderProgram();
+		glUniform2f(glGetUniformLocation(shader.shaderProgram, "viewportSize"), (GLfloat)this->width, (GLfloat)this->height);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "visibility"), VISIBILITY_UNIT);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "vertexData"), VERTEX_DATA_UNIT);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "indexData"), INDEX_DATA_UNIT);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "occlusionData"), OCCLUSION_DATA_UNIT);
+		GLint hasOcclusionLocation = glGetUniformLocation(shader.shaderProgram, "hasOcclusion");
+
+		glActiveTexture(GL_TEXTURE0 + VISIBILITY_UNIT);
+		glBindTexture(GL_TEXTURE_2D, this->visibilityTexture);
+
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+
+		std::vector<gps::Mesh>& meshes = model.getMeshes();
+		for (size_t i = 0; i < meshes.size() && i < MAX_DRAWS; i++) {
+
+			// no pixel holds the id of a mesh outside the PVS (an occluded one just finds none of its pixels)
+			if (!model.isMeshVisible(i)) {
+				continue;
+			}
+
+			glActiveTexture(GL_TEXTURE0 + VERTEX_DATA_UNIT);
+			glBindTexture(GL_TEXTURE_BUFFER, this->vertexTextures[i]);
+			glActiveTexture(GL_TEXTURE0 + INDEX_DATA_UNIT);
+			glBindTexture(GL_TEXTURE_BUFFER, this->indexTextures[i]);
+			glActiveTexture(GL_TEXTURE0 + OCCLUSION_DATA_UNIT);
+			glBindTexture(GL_TEXTURE_BUFFER, this->occlusionTextures[i]);
+			glUniform1i(hasOcclusionLocation, this->occlusionTextures[i] != 0);
+
+			meshes[i].bindTextures(shader);
+
+			// a zero-width depth range puts the whole triangle exactly on this draw's material depth;
+			// (i + 1) / MATERIAL_DEPTH_STEPS is exact in float, so it matches what classify wrote
+			GLdouble materialDepth = (GLdouble)(i + 1) / MATERIAL_DEPTH_STEPS;
+			glDepthRange(materialDepth, materialDepth);
+			screenTriangle.Draw(shader);
+
+			meshes[i].unbindTextures();
+		}
+
+		glDepthRange(0.0, 1.0);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	void VisibilityBuffer::composite(gps::Shader shader, gps::ScreenTriangle& screenTriangle) {
+
+		shader.useShaderProgram();
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, this->colorTexture);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "shadedColor"), 0);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, this->depthTexture);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "sceneDepth"), 1);
+		glActiveTexture(GL_TEXTURE0);
+
+		glDepthFunc(GL_ALWAYS);
+		screenTriangle.Draw(shader);
+		glDepthFunc(GL_LESS);
+	}
+
+	int VisibilityBuffer::getWidth() const {
+		return this->width;
+	}
+
+	int VisibilityBuffer::getHeight() const {
+		return this->height;
+	}
+
+	void VisibilityBuffer::release() {
+
+		if (this->geometryFramebuffer == 0) {
+			return;
+		}
+
+		glDeleteFramebuffers(1, &this->geometryFramebuffer);
+		glDeleteFramebuffers(1, &this->resolveFramebuffer);
+		glDeleteTextures(1, &this->visibilityTexture);
+		glDeleteTextures(1, &this->depthTexture);
+		glDeleteTextures(1, &this->colorTexture);
+		glDeleteRenderbuffers(1, &this->materialDepthBuffer);
+		releaseGpuResource(GPU_TEXTURE, this->visibilityTexture);
+		releaseGpuResource(GPU_TEXTURE, this->depthTexture);
+		releaseGpuResource(GPU_TEXTURE, this->colorTexture);
+		releaseGpuResource(GPU_RENDERBUFFER, this->materialDepthBuffer);
+		glDeleteTextures((GLsizei)this->vertexTextures.size(), this->vertexTextures.data());
+		glDeleteTextures((GLsizei)this->indexTextures.size(), this->indexTextures.data());
+		glDeleteTextures((GLsizei)this->occlusionTextures.size(), this->occlusionTextures.data());
+		this->vertexTextures.clear();
+		this->indexTextures.clear();
+		this->occlusionTextures.clear();
+		this->geometryFramebuffer = 0;
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef VisibilityBuffer_hpp
+#define VisibilityBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Model3D.hpp"
+#include "ScreenTriangle.hpp"
+#include "Shader.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Experimental visibility-buffer renderer. The geometry pass stores only a 32 bit id per pixel,
+    // ((draw + 1) << TRIANGLE_ID_BITS) | triangle, plus depth. Shading then runs once per pixel:
+    //   classify  - writes each pixel's draw as a "material depth" (draw + 1) / MATERIAL_DEPTH_STEPS
+    //   resolve   - per draw, a fullscreen triangle at that depth with GL_EQUAL, so early depth testing
+    //               lets through exactly the pixels of the draw; the shader fetches the triangle from the
+    //               mesh buffers, rebuilds barycentrics and shades with the lighting model of
+    //               shaders/lighting.glsl, ambient occlusion included
+    //   composite - copies the shaded color and the scene depth to the bound framebuffer
+    class VisibilityBuffer {
+
+    public:
+        static const int TRIANGLE_ID_BITS = 22;
+        static const int MAX_DRAWS = (1 << (32 - TRIANGLE_ID_BITS)) - 1;
+        static const int MATERIAL_DEPTH_STEPS = 1 << (32 - TRIANGLE_ID_BITS);
+        // triangles a mesh may hold over all its LODs
+        static const uint32_t MAX_TRIANGLES = 1u << TRIANGLE_ID_BITS;
+
+        // Whether the ids address every mesh of the model and every triangle of their LODs; prints
+        // what doesn't fit otherwise, and the model has to be drawn by another path
+        static bool supports(gps::Model3D& model);
+
+        // Creates the targets and buffer texture views of the model's vertex/index buffers
+        void init(int width, int height, gps::Model3D& model);
+
+        // Pass 1: writes the visibility ids of the model; shader is visibility.vert/.frag
+        void renderGeometry(gps::Model3D& model, gps::Shader shader);
+
+        // Pass 2: material depth from the visibility ids
+        void classify(gps::Shader shader, gps::ScreenTriangle& screenTriangle);
+
+        // Pass 3: shades every covered pixel once; the lighting uniforms must already be set on shader
+        void resolve(gps::Model3D& model, gps::Shader shader, gps::ScreenTriangle& screenTriangle);
+
+        // Pass 4: writes the shaded image and the scene depth into the currently bound framebuffer
+        void composite(gps::Shader shader, gps::ScreenTriangle& screenTriangle);
+
+        int getWidth() const;
+
+        int getHeight() const;
+
+        // Deletes the targets and buffer textures - before the context goes; init() creates them again
+        void release();
+
+    private:
+        int width = 0;
+        int height = 0;
+
+        // geometry pass: visibility ids + scene depth
+        GLuint geometryFramebuffer = 0;
+        GLuint visibilityTexture = 0;
+        GLuint depthTexture = 0;
+
+        // resolve pass: shaded color + material depth
+        GLuint resolveFramebuffer = 0;
+        GLuint colorTexture = 0;
+        GLuint materialDepthBuffer = 0;
+
+        // per mesh: buffer textures over the mesh's own VBO (2 RGBA32F texels per vertex) and EBO
+        std::vector<GLuint> vertexTextures;
+        std::vector<GLuint> indexTextures;
+        // per mesh: buffer texture over its baked occlusion (one float per vertex), 0 without one
+        std::vector<GLuint> occlusionTextures;
+    };
+}
+
+#endif /* VisibilityBuffer_hpp */
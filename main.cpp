@@ -36,19 +36,101 @@
 #include "glm/gtc/type_ptr.hpp"
 
 #include "Shader.hpp"
+#include "ShaderLoader.hpp"
 #include "Model3D.hpp"
 #include "Camera.hpp"
 #include "SkyBox.hpp"
-
+#include "LightClusters.hpp"
+#include "GBuffer.hpp"
+#include "VisibilityBuffer.hpp"
+#include "ScreenTriangle.hpp"
+#include "Options.hpp"
+#include "SceneGraph.hpp"
+#include "Simulation.hpp"
+#include "Framebuffer.hpp"
+#include "HeadlessContext.hpp"
+#include "CameraPath.hpp"
+#include "Benchmark.hpp"
+#include "GpuProfiler.hpp"
+#include "Profiler.hpp"
+#include "Hud.hpp"
+#include "RenderStats.hpp"
+#include "GpuMemory.hpp"
+#include "DynamicResolution.hpp"
+#include "Fxaa.hpp"
+#include "RenderVersion.hpp"
+#include "Picking.hpp"
+#include "CameraCollider.hpp"
+#include "AmbientOcclusion.hpp"
+#include "Lightmap.hpp"
+#include "Pvs.hpp"
+#include "OcclusionCulling.hpp"
+#include "Parallel.hpp"
+#include "Bvh.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 
+#if defined (_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+gps::Options options;
+
 int glWindowWidth = 1600;
 int glWindowHeight = 1200;
 int retina_width, retina_height;
 GLFWwindow* glWindow = NULL;
 
+// Headless mode - no window; the scene is drawn into offscreenFramebuffer and written out as PPM frames
+gps::HeadlessContext headlessContext;
+gps::Framebuffer offscreenFramebuffer;
+FILE* frameStream = NULL;
+// where the final image goes: 0 for the window, the offscreen framebuffer in headless mode
+GLuint sceneFramebuffer = 0;
+
+// Where the full size image is assembled: sceneFramebuffer, or with --aa fxaa the FXAA input,
+// which the FXAA pass smooths into sceneFramebuffer
+gps::Fxaa fxaa;
+gps::Shader fxaaShader;
+GLuint outputFramebuffer = 0;
+
+// Where the scene passes draw, and at what size: outputFramebuffer at the full size, or with
+// --dynamic-resolution a smaller target that the upscale pass stretches over outputFramebuffer
+gps::DynamicResolution dynamicResolution;
+gps::Shader upscaleShader;
+GLuint renderFramebuffer = 0;
+int renderWidth, renderHeight;
+
+// Keyframed camera flight from --camera-path (or the built-in benchmark orbit), advanced by the simulation
+gps::CameraPath cameraPath;
+int cameraPathTick = 0;
+
+// Live recording to --record, toggled with R; owned by the simulation tick, the flag is read by the renderer too
+gps::CameraPath recordedPath;
+std::atomic<bool> recording{false};
+bool recordKeyDown = false;
+int recordTick = 0;
+const float RECORD_INTERVAL = 0.25f;
+
 const unsigned int SHADOW_WIDTH = 2048;
 const unsigned int SHADOW_HEIGHT = 2048;
+// half the width of the square the shadow map covers, in world units
+const float SHADOW_EXTENT = 35.0f;
+// error a generated shadow proxy may have, in shadow map texels - below that the depth map can't tell
+const float SHADOW_PROXY_TEXELS = 1.0f;
+
+const float CAMERA_NEAR = 0.1f;
+const float CAMERA_FAR = 1000.0f;
+const float CAMERA_FOV = 45.0f;
+// screen error, in pixels, a mesh LOD may show at --lod-bias 1
+const float LOD_PIXEL_ERROR = 1.0f;
 
 glm::mat4 model;
 GLuint modelLoc;
@@ -67,23 +149,68 @@ GLuint lightColorLoc;
 
 GLuint textureID;
 
-gps::Camera myCamera(
-	glm::vec3(0.0f, 5.0f, 10.0f), 
-	glm::vec3(0.0f, 5.0f, 0.0f), 
-	glm::vec3(0.0f, 1.0f, 0.0f)  
-);
-
-float cameraSpeed = 0.5f;
+// Where the camera starts; from then on it lives in the simulation state
+const glm::vec3 CAMERA_START_POSITION(0.0f, 5.0f, 10.0f);
+const glm::vec3 CAMERA_START_TARGET(0.0f, 5.0f, 0.0f);
+const glm::vec3 CAMERA_START_UP(0.0f, 1.0f, 0.0f);
+
+// Simulation rates per second of simulated time (the old per-frame steps at 60 Hz)
+float cameraSpeed = 30.0f;
+const float CAMERA_TURN_SPEED = 60.0f;
+const float LIGHT_TURN_SPEED = 60.0f;
+const float FOG_SPEED = 0.12f;
+
+// Camera collision - the camera's sphere stays clear of the near plane's corners
+const float CAMERA_RADIUS = 0.25f;
+const float GRAVITY = 9.81f;
+const float MAX_FALL_SPEED = 50.0f;
+// walking climbs ledges up to this high and keeps to ground that drops away by less
+const float WALK_STEP_HEIGHT = 0.5f;
+gps::CameraCollider cameraCollider;
+float fallSpeed = 0.0f;
+
+// Baked sun light (--lightmap); the forward path uses it while the sun stays at the angle it was baked for
+gps::Lightmap lightmap;
+GLfloat lightmapAngle;
+
+// Potentially visible sets of the scene (--pvs), and the camera's cell in the frame being drawn
+gps::Pvs scenePvs;
+int pvsCell = -1;
+
+// Occlusion queries of the large meshes (--occlusion-culling), and the frames still to draw once nothing
+// moves so the results of the last ones show up when rendering on demand
+gps::OcclusionCulling occlusionCulling;
+int occlusionFramesLeft = 0;
 
 bool pressedKeys[1024];
 float angleY = 0.0f;
 GLfloat lightAngle;
 
+// Fixed-timestep simulation - owns the camera while it runs; the renderer only sees interpolated states
+gps::Simulation simulation;
+
+// Scene graph - the global model matrix mirrors the world transform of finalSceneNode
+gps::SceneGraph sceneGraph;
+gps::SceneNode sceneRootNode;
+gps::SceneNode finalSceneNode;
+gps::SceneNode lightPivotNode;
+gps::SceneNode lightCubeNode;
+
 // Obiecte 3D
+const char* FINAL_SCENE_PATH = "objects/Obiecte deja pregatite/FinalScene/ZPoze/BlenderProject.obj";
 gps::Model3D finalScene;
 gps::Model3D lightCube;
 gps::Model3D screenQuad;
 
+// Triangles of finalScene in model space, for the CPU queries on the scene
+gps::Bvh sceneBvh;
+
+// Mouse picking - last cursor position in window coordinates, and what the last click hit
+double cursorX = 0.0;
+double cursorY = 0.0;
+gps::PickResult selection;
+double selectionMilliseconds = 0.0;
+
 // Shaders
 gps::Shader myCustomShader;
 gps::Shader lightShader;
@@ -110,7 +237,57 @@ bool nightMode = false;
 // Point Light
 bool point = false;
 glm::vec3 lightPointPosition;
-GLuint lightPointPositionLocation;
+
+// Clustered point lights - the O/P light plus the lamps lit in night mode
+gps::LightClusters lightClusters;
+std::vector<gps::PointLight> nightLamps;
+std::vector<gps::PointLight> activePointLights;
+
+// Deferred shading
+gps::GBuffer gBuffer;
+gps::ScreenTriangle screenTriangle;
+gps::Shader gBufferShader;
+gps::Shader deferredLightingShader;
+
+// Visibility buffer
+gps::VisibilityBuffer visibilityBuffer;
+gps::Shader visibilityShader;
+gps::Shader visibilityClassifyShader;
+gps::Shader visibilityResolveShader;
+gps::Shader visibilityCompositeShader;
+
+// Benchmark - per-pass timings of a scripted flight, reported as JSON
+gps::Benchmark benchmark;
+const int BENCHMARK_WARMUP_FRAMES = 30;
+
+// GPU time of every render pass, always on
+gps::GpuProfiler gpuProfiler;
+
+// Performance overlay - toggled with H
+gps::Hud hud;
+bool showHud = false;
+const float HUD_SCALE = 2.0f;
+const int HUD_GRAPH_FRAMES = 120;
+// rings of the last HUD_GRAPH_FRAMES frame times in ms; hudGraphNext is the oldest
+float cpuFrameHistory[HUD_GRAPH_FRAMES];
+float gpuFrameHistory[HUD_GRAPH_FRAMES];
+int hudGraphNext = 0;
+// smoothed, so the numbers can be read while they change
+double smoothedFrameSeconds = 0.0;
+
+// On-demand rendering (--on-demand) - frames are only drawn while renderVersion says the image changes
+gps::RenderVersion renderVersion;
+// idle waits still wake up now and then, so nothing that slipped past the events goes unnoticed for long
+const double ON_DEMAND_WAIT_SECONDS = 0.5;
+
+// What the image depends on besides the scene; all 4 byte fields, so there is no padding to compare
+struct FrameInputs {
+	gps::SimulationState state;
+	int nightMode;
+	int point;
+	int showDepthMap;
+	int showHud;
+};
 
 GLenum glCheckError_(const char *file, int line) {
 	GLenum errorCode;
@@ -133,9 +310,32 @@ GLenum glCheckError_(const char *file, int line) {
 
 void windowResizeCallback(GLFWwindow* window, int width, int height) {
 	fprintf(stdout, "window resized to width: %d , and height: %d\n", width, height);
+	renderVersion.invalidate();
+}
+
+// The window contents were damaged, e.g. uncovered; on-demand mode has to draw them again
+void windowRefreshCallback(GLFWwindow* window) {
+	renderVersion.invalidate();
+}
+
+// Starts recording profiling zones, or stops and writes everything recorded so far
+void toggleProfiling() {
+	if (!gps::isProfiling()) {
+		gps::startProfiling();
+		fprintf(stderr, "profiling started\n");
+		return;
+	}
+
+	gps::stopProfiling();
+	std::string tracePath = options.tracePath.empty() ? "trace.json" : options.tracePath;
+	if (gps::writeProfilerTrace(tracePath)) {
+		fprintf(stderr, "saved profiling trace to %s\n", tracePath.c_str());
+	}
 }
 
 void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
+	renderVersion.invalidate();
+
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
 
@@ -143,6 +343,18 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 	if (key == GLFW_KEY_B && action == GLFW_PRESS)
 		showDepthMap = !showDepthMap;
 
+	// Show the performance overlay
+	if (key == GLFW_KEY_H && action == GLFW_PRESS)
+		showHud = !showHud;
+
+	// Print where the GPU memory goes
+	if (key == GLFW_KEY_G && action == GLFW_PRESS)
+		gps::writeGpuMemoryReport(stdout);
+
+	// Start/stop recording profiling zones; stopping writes the trace
+	if (key == GLFW_KEY_T && action == GLFW_PRESS)
+		toggleProfiling();
+
 	if (key >= 0 && key < 1024)
 	{
 		if (action == GLFW_PRESS)
@@ -154,72 +366,215 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
+	cursorX = xpos;
+	cursorY = ypos;
 }
 
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+	if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) {
+		return;
+	}
 
-void processMovement()
-{
-	// Camera movement (forward/backward/left/right)
-	if (pressedKeys[GLFW_KEY_W]) {
-		myCamera.move(gps::MOVE_FORWARD, cameraSpeed);		
+	// the cursor is in window coordinates, which differ from the framebuffer's on high DPI screens
+	int windowWidth, windowHeight;
+	glfwGetWindowSize(window, &windowWidth, &windowHeight);
+	if (windowWidth <= 0 || windowHeight <= 0) {
+		return;
+	}
+	glm::vec2 ndc(2.0f * (float)cursorX / (float)windowWidth - 1.0f, 1.0f - 2.0f * (float)cursorY / (float)windowHeight);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	selection = gps::pick(sceneBvh, ndc, model, view, projection);
+	selectionMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// shown in the HUD; stdout stays free for headless frames and benchmark reports
+	renderVersion.invalidate();
+}
+
+
+// The camera a tick moved goes back into the state, which is all the renderer sees of it
+void storeCamera(gps::SimulationState& state, const gps::Camera& camera) {
+	state.cameraPosition = camera.cameraPosition;
+	state.cameraFront = camera.cameraFrontDirection;
+	state.cameraUp = camera.cameraUpDirection;
+}
+
+// The camera a tick moves, rebuilt from the state the last tick left
+gps::Camera loadCamera(const gps::SimulationState& state) {
+	return gps::Camera(state.cameraPosition, state.cameraPosition + state.cameraFront, state.cameraUp);
+}
+
+// The start of the run: tick 0 of a scripted camera, else the fixed start pose
+gps::SimulationState initialSimulationState() {
+	gps::SimulationState state;
+	gps::Camera camera(CAMERA_START_POSITION, CAMERA_START_TARGET, CAMERA_START_UP);
+	state.lightAngle = lightAngle;
+	if (!cameraPath.empty()) {
+		gps::CameraKeyframe keyframe = cameraPath.evaluate(0.0f);
+		camera.setView(keyframe.position, keyframe.target);
+		state.lightAngle = keyframe.lightAngle;
 	}
+	storeCamera(state, camera);
+	state.fog = fog;
+	return state;
+}
 
-	if (pressedKeys[GLFW_KEY_S]) {
-		myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);		
+// Saves the recording when it stops; runs on the simulation thread, or at exit once it has stopped
+void toggleRecording() {
+	if (options.recordPath.empty()) {
+		return;
 	}
 
-	if (pressedKeys[GLFW_KEY_A]) {
-		myCamera.move(gps::MOVE_LEFT, cameraSpeed);		
+	recording = !recording;
+	if (recording) {
+		recordedPath.clear();
+		recordTick = 0;
+		fprintf(stderr, "recording camera path to %s\n", options.recordPath.c_str());
+	}
+	else if (recordedPath.save(options.recordPath)) {
+		fprintf(stderr, "saved camera path to %s\n", options.recordPath.c_str());
 	}
+}
 
-	if (pressedKeys[GLFW_KEY_D]) {
-		myCamera.move(gps::MOVE_RIGHT, cameraSpeed);		
+// Samples the flight every RECORD_INTERVAL; the spline through the samples replays it smoothly
+void recordKeyframe(const gps::SimulationState& state, double dt) {
+	int ticksPerKeyframe = glm::max(1, (int)(RECORD_INTERVAL / dt + 0.5));
+	if (recordTick++ % ticksPerKeyframe != 0) {
+		return;
 	}
 
-	// Camera movement (up/down)
-	if (pressedKeys[GLFW_KEY_Z]) {
-		myCamera.move(gps::MOVE_UP, cameraSpeed);
+	gps::CameraKeyframe keyframe;
+	keyframe.time = (float)((recordTick - 1) * dt);
+	keyframe.position = state.cameraPosition;
+	keyframe.target = state.cameraPosition + state.cameraFront;
+	keyframe.lightAngle = state.lightAngle;
+	recordedPath.addKeyframe(keyframe);
+}
+
+// Keeps this tick's camera move from previousPosition out of the scene geometry; when walking, the
+// move stays horizontal and gravity and the ground under the camera set its height
+void collideCamera(gps::Camera& camera, const glm::vec3& previousPosition, float dt) {
+	glm::vec3 motion = camera.cameraPosition - previousPosition;
+	if (options.walk) {
+		fallSpeed = std::min(fallSpeed + GRAVITY * dt, MAX_FALL_SPEED);
+		motion.y = -fallSpeed * dt;
 	}
-	if (pressedKeys[GLFW_KEY_X]) {
-		myCamera.move(gps::MOVE_DOWN, cameraSpeed);
+	camera.cameraPosition = cameraCollider.move(previousPosition, motion);
+	if (!options.walk) {
+		return;
 	}
 
-	// Nanosuit movement
-	if (pressedKeys[GLFW_KEY_Q]) {
-		myCamera.rotate(0.0f, -1.0f);
+	float ground;
+	if (!cameraCollider.findGround(camera.cameraPosition, options.eyeHeight + WALK_STEP_HEIGHT, ground)) {
+		return;
 	}
-	if (pressedKeys[GLFW_KEY_E]) {
-		myCamera.rotate(0.0f, +1.0f);
+	float rise = options.eyeHeight - ground;
+	if (rise > WALK_STEP_HEIGHT) {
+		// too high to step onto: stay where the tick started, but keep falling
+		camera.cameraPosition = cameraCollider.move(previousPosition, glm::vec3(0.0f, motion.y, 0.0f));
+		return;
 	}
+	camera.cameraPosition = cameraCollider.move(camera.cameraPosition, glm::vec3(0.0f, rise, 0.0f));
+	fallSpeed = 0.0f;
+}
+
+// One simulation tick: everything that moves over time, scaled by the fixed dt
+void simulationStep(gps::SimulationState& state, const gps::SimulationInput& input, double dt)
+{
+	const bool* keys = input.keys;
+	float step = cameraSpeed * (float)dt;
+	float turn = CAMERA_TURN_SPEED * (float)dt;
+	gps::Camera camera = loadCamera(state);
+
+	// scripted cameras follow their path tick by tick, so every run renders the same frames
+	if (!cameraPath.empty()) {
+		gps::CameraKeyframe keyframe = cameraPath.evaluate((float)(++cameraPathTick * dt));
+		camera.setView(keyframe.position, keyframe.target);
+		state.lightAngle = keyframe.lightAngle;
+	}
+	else {
+		glm::vec3 previousPosition = camera.cameraPosition;
+
+		// Camera movement (forward/backward/left/right)
+		if (keys[GLFW_KEY_W]) {
+			camera.move(gps::MOVE_FORWARD, step);
+		}
+
+		if (keys[GLFW_KEY_S]) {
+			camera.move(gps::MOVE_BACKWARD, step);
+		}
+
+		if (keys[GLFW_KEY_A]) {
+			camera.move(gps::MOVE_LEFT, step);
+		}
+
+		if (keys[GLFW_KEY_D]) {
+			camera.move(gps::MOVE_RIGHT, step);
+		}
+
+		// Camera movement (up/down)
+		if (keys[GLFW_KEY_Z]) {
+			camera.move(gps::MOVE_UP, step);
+		}
+		if (keys[GLFW_KEY_X]) {
+			camera.move(gps::MOVE_DOWN, step);
+		}
+
+		// Nanosuit movement
+		if (keys[GLFW_KEY_Q]) {
+			camera.rotate(0.0f, -turn);
+		}
+		if (keys[GLFW_KEY_E]) {
+			camera.rotate(0.0f, +turn);
+		}
+
+		if (options.cameraCollision || options.walk) {
+			collideCamera(camera, previousPosition, (float)dt);
+		}
+	}
+
+	storeCamera(state, camera);
 
 	// Light cube movement
-	if (pressedKeys[GLFW_KEY_J]) {
-		lightAngle -= 1.0f;		
+	if (keys[GLFW_KEY_J] && cameraPath.empty()) {
+		state.lightAngle -= LIGHT_TURN_SPEED * (float)dt;
 	}
-	if (pressedKeys[GLFW_KEY_L]) {
-		lightAngle += 1.0f;
+	if (keys[GLFW_KEY_L] && cameraPath.empty()) {
+		state.lightAngle += LIGHT_TURN_SPEED * (float)dt;
 	}
 
 	// Increase fog
-	if (pressedKeys[GLFW_KEY_C]) { 
-		fog += 0.002f;
-		if (fog >= 0.35f) {
-			fog = 0.35f;
-		}
-		myCustomShader.useShaderProgram();
-		glUniform1fv(fogLocation, 1, &fog);
+	if (keys[GLFW_KEY_C]) {
+		state.fog = glm::min(state.fog + FOG_SPEED * (float)dt, 0.35f);
 	}
 
 	// Degrease fog
-	if (pressedKeys[GLFW_KEY_V]) { 
-		fog -= 0.002f;
-		if (fog <= 0.0f) {
-			fog = 0.0f;
-		}
-		myCustomShader.useShaderProgram();
-		glUniform1fv(fogLocation, 1, &fog);
+	if (keys[GLFW_KEY_V]) {
+		state.fog = glm::max(state.fog - FOG_SPEED * (float)dt, 0.0f);
 	}
 
+	// Record the flight
+	if (keys[GLFW_KEY_R] && !recordKeyDown) {
+		toggleRecording();
+	}
+	recordKeyDown = keys[GLFW_KEY_R];
+	if (recording) {
+		recordKeyframe(state, dt);
+	}
+}
+
+// Render state for this frame: the view and the animated values drawn from the simulation
+void applySimulationState(const gps::SimulationState& state) {
+	view = glm::lookAt(state.cameraPosition, state.cameraPosition + state.cameraFront, state.cameraUp);
+	lightAngle = state.lightAngle;
+	fog = state.fog;
+}
+
+// Toggles that only change how the frame is drawn; they stay on the main thread with the GL context
+void processMovement()
+{
+	PROFILE_FUNCTION();
+
 	// Flat shading View
 	if (pressedKeys[GLFW_KEY_1]) {
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -254,19 +609,23 @@ void processMovement()
 
 	// start pointlight
 	if (pressedKeys[GLFW_KEY_O]) {
-		myCustomShader.useShaderProgram();
 		point = true;
-		glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "point"), point);
 	}
 
 	// stop pointlight
 	if (pressedKeys[GLFW_KEY_P]) {
-		myCustomShader.useShaderProgram();
 		point = false;
-		glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "point"), point);
 	}
 }
 
+// Samples of the window or offscreen framebuffer the scene is drawn into; 0 unless MSAA is chosen
+int msaaSamples() {
+	if (options.antialiasing != gps::AA_MSAA) {
+		return 0;
+	}
+	return options.msaaSamples;
+}
+
 bool initOpenGLWindow()
 {
 	if (!glfwInit()) {
@@ -286,8 +645,8 @@ bool initOpenGLWindow()
     //for sRBG framebuffer
     glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 
-    //for antialising
-    glfwWindowHint(GLFW_SAMPLES, 4);
+    //for antialising - only when the scene is drawn straight into the window
+    glfwWindowHint(GLFW_SAMPLES, msaaSamples());
 
 	glWindow = glfwCreateWindow(glWindowWidth, glWindowHeight, "OpenGL Shader Example", NULL, NULL);
 	if (!glWindow) {
@@ -298,11 +657,15 @@ bool initOpenGLWindow()
 
 	glfwSetWindowSizeCallback(glWindow, windowResizeCallback);
 	glfwSetKeyCallback(glWindow, keyboardCallback);
+	glfwSetWindowRefreshCallback(glWindow, windowRefreshCallback);
 	glfwSetCursorPosCallback(glWindow, mouseCallback);
+	glfwSetMouseButtonCallback(glWindow, mouseButtonCallback);
 
 	glfwMakeContextCurrent(glWindow);
 
-	glfwSwapInterval(1);
+	// benchmark runs measure the renderer, not the display refresh rate; the
+	// fixed-timestep simulation keeps motion the same either way
+	glfwSwapInterval(options.benchmarkFrames > 0 || !options.vsync ? 0 : 1);
 
 #if not defined (__APPLE__)
     // start GLEW extension handler
@@ -322,6 +685,71 @@ bool initOpenGLWindow()
 	return true;
 }
 
+// Windowless alternative to initOpenGLWindow: the scene renders into an offscreen framebuffer of the requested size
+bool initHeadlessContext()
+{
+	if (!headlessContext.create()) {
+		return false;
+	}
+
+#if not defined (__APPLE__)
+	glewExperimental = GL_TRUE;
+	glewInit();
+#endif
+
+	fprintf(stderr, "Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+	fprintf(stderr, "OpenGL version supported %s\n", (const char*)glGetString(GL_VERSION));
+
+	retina_width = options.width;
+	retina_height = options.height;
+
+	offscreenFramebuffer.init(retina_width, retina_height, msaaSamples());
+	sceneFramebuffer = offscreenFramebuffer.getFramebuffer();
+
+	return true;
+}
+
+// With --output -, frames own stdout; anything else the app prints is sent to stderr instead
+void initFrameStream() {
+	fflush(stdout);
+
+#if defined (_WIN32)
+	_setmode(_fileno(stdout), _O_BINARY);
+	frameStream = stdout;
+#else
+	int frameFd = dup(fileno(stdout));
+	dup2(fileno(stderr), fileno(stdout));
+	frameStream = fdopen(frameFd, "wb");
+#endif
+}
+
+bool writeFrame(int frame) {
+	if (options.output.empty()) {
+		return true;
+	}
+
+	if (frameStream != NULL) {
+		return offscreenFramebuffer.writePPM(frameStream);
+	}
+
+	char fileName[1024];
+	snprintf(fileName, sizeof(fileName), options.output.c_str(), frame);
+
+	FILE* file = fopen(fileName, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "ERROR: could not open %s for writing\n", fileName);
+		return false;
+	}
+
+	bool written = offscreenFramebuffer.writePPM(file);
+	fclose(file);
+	if (!written) {
+		fprintf(stderr, "ERROR: could not write %s\n", fileName);
+	}
+
+	return written;
+}
+
 void initOpenGLState()
 {
 	glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
@@ -337,12 +765,83 @@ void initOpenGLState()
 }
 
 void initObjects() {
-	finalScene.LoadModel("objects/Obiecte deja pregatite/FinalScene/ZPoze/BlenderProject.obj");
+	PROFILE_FUNCTION();
+	// the scene is loaded at unit scale, so world units are model units
+	finalScene.setShadowProxyError(options.shadowProxies ? SHADOW_PROXY_TEXELS * 2.0f * SHADOW_EXTENT / SHADOW_WIDTH : -1.0f);
+	finalScene.setLightmapDensity(options.lightmap ? options.lightmapDensity : -1.0f);
+	finalScene.LoadModel(FINAL_SCENE_PATH);
 	lightCube.LoadModel("objects/cube/cube.obj");
+	// before the shaders are loaded, so they follow the path actually used
+	if (options.renderPath == gps::RENDER_VISIBILITY && !gps::VisibilityBuffer::supports(finalScene)) {
+		fprintf(stderr, "WARNING: the scene doesn't fit the visibility buffer ids, using the forward renderer\n");
+		options.renderPath = gps::RENDER_FORWARD;
+	}
+
+	auto bvhStart = std::chrono::steady_clock::now();
+	bool cached = false;
+	if (options.bvhCache) {
+		cached = sceneBvh.buildCached(finalScene.getMeshes(), std::string(FINAL_SCENE_PATH) + ".bvh");
+	}
+	else {
+		sceneBvh.build(finalScene.getMeshes());
+	}
+	double bvhMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bvhStart).count();
+	printf("Scene BVH: %zu triangles, %zu nodes, %s in %.1f ms\n", sceneBvh.getTriangleCount(), sceneBvh.getNodeCount(),
+		cached ? "loaded" : "built", bvhMilliseconds);
+
+
+	if (options.ambientOcclusion) {
+		auto aoStart = std::chrono::steady_clock::now();
+		std::vector<std::vector<float> > occlusion;
+		bool aoCached = gps::bakeVertexOcclusionCached(sceneBvh, finalScene.getMeshes(), options.aoSamples, options.aoDistance,
+			std::string(FINAL_SCENE_PATH) + ".ao", occlusion);
+		finalScene.setVertexOcclusion(occlusion);
+		double aoMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - aoStart).count();
+		printf("Ambient occlusion: %d rays per vertex over %u threads, %s in %.1f ms\n", options.aoSamples,
+			gps::parallelThreadCount(), aoCached ? "loaded" : "baked", aoMilliseconds);
+	}
+
+	if (options.pvs) {
+		auto pvsStart = std::chrono::steady_clock::now();
+		bool pvsCached = scenePvs.buildCached(sceneBvh, finalScene.getMeshes(), options.pvsCellSize, options.pvsRays,
+			std::string(FINAL_SCENE_PATH) + ".pvs");
+		double pvsMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pvsStart).count();
+		printf("PVS: %zu cells of %.2f units, %zu distinct sets of %zu meshes, %s in %.1f ms\n", scenePvs.getCellCount(),
+			scenePvs.getCellSize(), scenePvs.getSetCount(), scenePvs.getMeshCount(), pvsCached ? "loaded" : "baked", pvsMilliseconds);
+	}
+}
+
+// Starts baking the sun at the angle the scene starts with, or loads an earlier bake of it
+void initLightmap() {
+	if (!options.lightmap || finalScene.getLightmapWidth() == 0) {
+		return;
+	}
+
+	// lightDir points towards the sun before the rotation by lightAngle
+	lightmapAngle = lightAngle;
+	glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightmapAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::vec3 sunDirection = glm::normalize(glm::mat3(rotation) * lightDir);
+	lightmap.bake(sceneBvh, finalScene.getMeshes(), finalScene.getLightmapWidth(), finalScene.getLightmapHeight(),
+		sunDirection, options.lightmapPasses, std::string(FINAL_SCENE_PATH) + ".lightmap");
+
+	// benchmarks and headless runs must see the same image every time, not whichever pass is done
+	if (options.benchmarkFrames > 0 || options.headless) {
+		lightmap.finish();
+	}
+	lightmap.update();
+	printf("Lightmap: %dx%d texels, %d passes, %s\n", lightmap.getWidth(), lightmap.getHeight(), lightmap.getPassCount(),
+		lightmap.baking() ? "baking in the background" : "loaded");
+}
+
+// The forward pass lights the scene from the lightmap instead of the sun and its shadow map
+bool lightmapActive() {
+	return options.renderPath == gps::RENDER_FORWARD && lightmap.ready() && lightAngle == lightmapAngle && !showDepthMap;
 }
 
 void initShaders() {
-	myCustomShader.loadShader("shaders/shaderStart.vert", "shaders/shaderStart.frag");
+	PROFILE_FUNCTION();
+	// the three shading paths include shaders/lighting.glsl
+	gps::loadShaderWithIncludes(myCustomShader, "shaders/shaderStart.vert", "shaders/shaderStart.frag");
 	myCustomShader.useShaderProgram();
 	lightShader.loadShader("shaders/lightCube.vert", "shaders/lightCube.frag");
 	lightShader.useShaderProgram();
@@ -352,13 +851,45 @@ void initShaders() {
 	depthMapShader.useShaderProgram();
 	skyboxShader.loadShader("shaders/skyboxShader.vert", "shaders/skyboxShader.frag");
 	skyboxShader.useShaderProgram();
+	if (options.renderPath == gps::RENDER_DEFERRED) {
+		gBufferShader.loadShader("shaders/gBuffer.vert", "shaders/gBuffer.frag");
+		gBufferShader.useShaderProgram();
+		gps::loadShaderWithIncludes(deferredLightingShader, "shaders/fullscreen.vert", "shaders/deferredLighting.frag");
+		deferredLightingShader.useShaderProgram();
+	}
+	if (options.renderPath == gps::RENDER_VISIBILITY) {
+		visibilityShader.loadShader("shaders/visibility.vert", "shaders/visibility.frag");
+		visibilityShader.useShaderProgram();
+		visibilityClassifyShader.loadShader("shaders/fullscreen.vert", "shaders/visibilityClassify.frag");
+		visibilityClassifyShader.useShaderProgram();
+		gps::loadShaderWithIncludes(visibilityResolveShader, "shaders/fullscreen.vert", "shaders/visibilityResolve.frag");
+		visibilityResolveShader.useShaderProgram();
+		visibilityCompositeShader.loadShader("shaders/fullscreen.vert", "shaders/visibilityComposite.frag");
+		visibilityCompositeShader.useShaderProgram();
+	}
+	if (options.antialiasing == gps::AA_FXAA) {
+		fxaaShader.loadShader("shaders/fullscreen.vert", "shaders/fxaa.frag");
+		fxaaShader.useShaderProgram();
+	}
+	if (options.dynamicResolution > 0.0f) {
+		upscaleShader.loadShader("shaders/fullscreen.vert", "shaders/upscale.frag");
+		upscaleShader.useShaderProgram();
+	}
+}
+
+void initOcclusionCulling() {
+	if (options.occlusionCulling == gps::OCCLUSION_CULL_NONE) {
+		return;
+	}
+	occlusionCulling.init(options.occlusionCulling, options.occlusionMinTriangles);
+	finalScene.setOcclusionCulling(&occlusionCulling);
 }
 
 glm::mat4 computeLightSpaceTrMatrix() {
 	lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
 	glm::mat4 lightView = glm::lookAt(glm::vec3(lightRotation * glm::vec4(lightDir, 1.0f)), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 	const GLfloat near_plane = 0.1f, far_plane = 300.0f;
-	glm::mat4 lightProjection = glm::ortho(-35.0f, 35.0f, -35.0f, 35.0f, near_plane, far_plane);
+	glm::mat4 lightProjection = glm::ortho(-SHADOW_EXTENT, SHADOW_EXTENT, -SHADOW_EXTENT, SHADOW_EXTENT, near_plane, far_plane);
 	glm::mat4 lightSpaceTrMatrix = lightProjection * lightView;
 	return lightSpaceTrMatrix;
 }
@@ -370,7 +901,7 @@ void initUniforms() {
 	modelLoc = glGetUniformLocation(myCustomShader.shaderProgram, "model");
 	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-	view = myCamera.getViewMatrix();
+	view = glm::lookAt(CAMERA_START_POSITION, CAMERA_START_TARGET, CAMERA_START_UP);
 	viewLoc = glGetUniformLocation(myCustomShader.shaderProgram, "view");
 	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 	
@@ -378,7 +909,7 @@ void initUniforms() {
 	normalMatrixLoc = glGetUniformLocation(myCustomShader.shaderProgram, "normalMatrix");
 	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	
-	projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
+	projection = glm::perspective(glm::radians(CAMERA_FOV), (float)retina_width / (float)retina_height, CAMERA_NEAR, CAMERA_FAR);
 	projectionLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
 	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
@@ -395,8 +926,6 @@ void initUniforms() {
 
 	// LightPoint
 	lightPointPosition = glm::vec3(5.0f, 6.0f, 22.0f);
-	lightPointPositionLocation = glGetUniformLocation(myCustomShader.shaderProgram, "lightPointPosition");
-	glUniform3fv(lightPointPositionLocation, 1, glm::value_ptr(lightPointPosition));
 
 
 	lightShader.useShaderProgram();
@@ -420,7 +949,134 @@ void  initSkybox()
 	faces.push_back("skybox/back.tga");
 	faces.push_back("skybox/front.tga");
 	mySkyBox.Load(faces);
+	gps::trackGpuTexture(GL_TEXTURE_CUBE_MAP, mySkyBox.GetTextureId(), "SkyBox", "cubemap");
+}
+void initSceneGraph() {
+	sceneRootNode = sceneGraph.createNode();
+	finalSceneNode = sceneGraph.createNode(sceneRootNode);
+
+	// the light cube hangs off a pivot that the J/L keys rotate around the y axis
+	lightPivotNode = sceneGraph.createNode(sceneRootNode);
+	glm::mat4 lightCubeLocal = glm::translate(glm::mat4(1.0f), 1.0f * lightDir);
+	lightCubeLocal = glm::scale(lightCubeLocal, glm::vec3(0.05f, 0.05f, 0.05f));
+	lightCubeNode = sceneGraph.createNode(lightPivotNode, lightCubeLocal);
+
+	sceneGraph.update();
+}
+
+// Feeds this frame's animated transforms to the scene graph and refreshes the changed subtrees
+void updateSceneGraph() {
+	lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+	sceneGraph.setLocalTransform(lightPivotNode, lightRotation);
+
+	sceneGraph.update();
+
+	model = sceneGraph.getWorldTransform(finalSceneNode);
+}
+
+// Eye space normal matrix of a node; the view matrix is rigid, so its rotation commutes with the inverse transpose
+glm::mat3 computeNormalMatrix(gps::SceneNode node) {
+	return glm::mat3(view) * sceneGraph.getNormalMatrix(node);
+}
+
+void initPointLights() {
+	lightClusters.init();
+
+	// street lamps on a regular grid over the scene, lit only in night mode
+	const int lampsPerRow = 16;
+	const float lampSpacing = 4.5f;
+	for (int row = 0; row < lampsPerRow; row++) {
+		for (int column = 0; column < lampsPerRow; column++) {
+			gps::PointLight lamp;
+			lamp.position = glm::vec3((column - lampsPerRow / 2) * lampSpacing, 1.5f, (row - lampsPerRow / 2) * lampSpacing);
+			lamp.color = glm::vec3(1.0f, 0.75f, 0.45f);
+			lamp.radius = 6.0f;
+			nightLamps.push_back(lamp);
+		}
+	}
+}
+
+// Lights that can reach the current frame, in the order they are binned
+void updateActivePointLights() {
+	activePointLights.clear();
+
+	if (point) {
+		gps::PointLight pointLight;
+		pointLight.position = lightPointPosition;
+		pointLight.color = lightColor;
+		pointLight.radius = 15.0f;
+		activePointLights.push_back(pointLight);
+	}
+
+	if (nightMode) {
+		activePointLights.insert(activePointLights.end(), nightLamps.begin(), nightLamps.end());
+	}
+}
+
+// Render pass markers, shared by the GPU profiler (and its debug groups) and the benchmark
+void beginPass(const char* name) {
+	gpuProfiler.beginPass(name);
+	benchmark.beginPass(name);
+}
+
+void endPass() {
+	benchmark.endPass();
+	gpuProfiler.endPass();
+}
+
+// Points the scene passes at this frame's target; the G-buffer and visibility targets follow the render size
+void selectRenderTarget() {
+	if (options.dynamicResolution > 0.0f) {
+		renderFramebuffer = dynamicResolution.getFramebuffer();
+		renderWidth = dynamicResolution.getRenderWidth();
+		renderHeight = dynamicResolution.getRenderHeight();
+	}
+	else {
+		renderFramebuffer = outputFramebuffer;
+		renderWidth = retina_width;
+		renderHeight = retina_height;
+	}
+
+	// they are sampled over their whole extent, so they are recreated rather than drawn into in part;
+	// the hysteresis of dynamicResolution keeps that rare
+	if (options.renderPath == gps::RENDER_DEFERRED && (gBuffer.getWidth() != renderWidth || gBuffer.getHeight() != renderHeight)) {
+		gBuffer.init(renderWidth, renderHeight);
+	}
+	if (options.renderPath == gps::RENDER_VISIBILITY &&
+		(visibilityBuffer.getWidth() != renderWidth || visibilityBuffer.getHeight() != renderHeight)) {
+		visibilityBuffer.init(renderWidth, renderHeight, finalScene);
+	}
+}
+
+// Feeds the GPU frame times read back by this frame's beginFrame() to the resolution controller
+void updateDynamicResolution() {
+	bool resized = false;
+	const std::vector<gps::GpuPassTiming>& timings = gpuProfiler.getResolvedTimings();
+	for (size_t i = 0; i < timings.size(); i++) {
+		if (strcmp(timings[i].name, "frame") == 0) {
+			resized = dynamicResolution.update(timings[i].milliseconds) || resized;
+		}
+	}
+
+	if (resized) {
+		selectRenderTarget();
+	}
 }
+
+// Stretches the scene over the full size target, sharpened; the overlay is drawn over it at full size
+void upscaleScene() {
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+	glViewport(0, 0, retina_width, retina_height);
+	dynamicResolution.upscale(upscaleShader, screenTriangle, options.sharpness);
+}
+
+// Smooths the edges of the finished image into sceneFramebuffer, before the overlay is drawn
+void applyFxaa() {
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+	glViewport(0, 0, retina_width, retina_height);
+	fxaa.apply(fxaaShader, screenTriangle);
+}
+
 void initFBO() {
 	glGenFramebuffers(1, &shadowMapFBO);
 	glGenTextures(1, &depthMapTexture);
@@ -440,40 +1096,207 @@ void initFBO() {
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	gps::trackGpuTexture(GL_TEXTURE_2D, depthMapTexture, "shadow", "shadow map");
+
+	outputFramebuffer = sceneFramebuffer;
+	if (options.antialiasing == gps::AA_FXAA) {
+		fxaa.init(retina_width, retina_height);
+		screenTriangle.init();
+		outputFramebuffer = fxaa.getFramebuffer();
+	}
+	if (options.dynamicResolution > 0.0f) {
+		dynamicResolution.init(retina_width, retina_height, options.minResolutionScale, options.maxResolutionScale,
+			options.dynamicResolution);
+		screenTriangle.init();
+	}
+	if (options.renderPath == gps::RENDER_DEFERRED || options.renderPath == gps::RENDER_VISIBILITY) {
+		screenTriangle.init();
+	}
+	selectRenderTarget();
+}
+
+// SkyBox issues one draw of its 12 cube triangles, binding its program, VAO and cubemap
+void drawSkyBox() {
+	mySkyBox.Draw(skyboxShader, view, projection);
+	gps::renderStats.countStateChanges(3);
+	gps::renderStats.countDraw(12);
 }
 
 void drawObjects(gps::Shader shader, bool depthPass) {
-	
+	PROFILE_FUNCTION();
+
 	shader.useShaderProgram();
 
 	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
 	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+		normalMatrix = computeNormalMatrix(finalSceneNode);
 		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
 	if (!depthPass)
-		mySkyBox.Draw(skyboxShader, view, projection);
+		drawSkyBox();
 
 	finalScene.Draw(shader);
 }
 
-void renderScene() {
+// Depth-only draw of the shadow casters into the bound shadow map
+void drawShadowCasters() {
+	PROFILE_FUNCTION();
 
 	depthMapShader.useShaderProgram();
-	glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"),
+	glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+
+	finalScene.DrawShadow(depthMapShader);
+}
+
+// Uniforms of the lighting model shared by shaderStart.frag and deferredLighting.frag
+void setLightingUniforms(gps::Shader shader) {
+	shader.useShaderProgram();
+
+	glUniform1i(glGetUniformLocation(shader.shaderProgram, "nightMode"), nightMode);
+	glUniform1fv(glGetUniformLocation(shader.shaderProgram, "fog"), 1, &fog);
+	glUniform3fv(glGetUniformLocation(shader.shaderProgram, "lightColor"), 1, glm::value_ptr(lightColor));
+	glUniform3fv(glGetUniformLocation(shader.shaderProgram, "lightDir"), 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
+
+	//bind the shadow map
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
+	glUniform1i(glGetUniformLocation(shader.shaderProgram, "shadowMap"), 3);
+
+	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "lightSpaceTrMatrix"),
 		1,
 		GL_FALSE,
 		glm::value_ptr(computeLightSpaceTrMatrix()));
-	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glClear(GL_DEPTH_BUFFER_BIT);
-	drawObjects(depthMapShader,showDepthMap);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// cluster lists go after the shadow map
+	lightClusters.bind(shader, 4);
+}
+
+// Shades every fragment as it is rasterized
+void renderForwardPass() {
+	beginPass("forward");
+	setLightingUniforms(myCustomShader);
+
+	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+
+	bool baked = lightmapActive();
+	glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "useLightmap"), baked);
+	if (baked) {
+		// after the cluster lists, which take units 4 to 6
+		glActiveTexture(GL_TEXTURE7);
+		glBindTexture(GL_TEXTURE_2D, lightmap.getTexture());
+		glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "lightmap"), 7);
+	}
+
+	drawObjects(myCustomShader, false);
+	occlusionCulling.issueQueries(projection * view, model);
+	endPass();
+}
+
+// Rasterizes the surface attributes first, then shades each pixel once with a fullscreen pass
+void renderDeferredPass() {
+	beginPass("gBuffer");
+	gBuffer.bindForGeometry();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	gBufferShader.useShaderProgram();
+	glUniformMatrix4fv(glGetUniformLocation(gBufferShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix4fv(glGetUniformLocation(gBufferShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+	normalMatrix = computeNormalMatrix(finalSceneNode);
+	glUniformMatrix3fv(glGetUniformLocation(gBufferShader.shaderProgram, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+
+	// drawn as a depth pass so the skybox stays out of the G-buffer
+	drawObjects(gBufferShader, true);
+	occlusionCulling.issueQueries(projection * view, model);
+	endPass();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, renderFramebuffer);
+	glViewport(0, 0, renderWidth, renderHeight);
+
+	beginPass("deferredLighting");
+	setLightingUniforms(deferredLightingShader);
+	glUniformMatrix4fv(glGetUniformLocation(deferredLightingShader.shaderProgram, "inverseProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(projection)));
+	glUniformMatrix4fv(glGetUniformLocation(deferredLightingShader.shaderProgram, "inverseView"), 1, GL_FALSE, glm::value_ptr(glm::inverse(view)));
+	gBuffer.bindTextures(deferredLightingShader, 7);
+
+	// the lighting pass writes the G-buffer depth, so always let it through
+	glDepthFunc(GL_ALWAYS);
+	screenTriangle.Draw(deferredLightingShader);
+	glDepthFunc(GL_LESS);
+	endPass();
+}
+
+// Stores only a triangle id per pixel, then shades each covered pixel once from the mesh buffers
+void renderVisibilityPass() {
+	beginPass("visibility");
+	visibilityShader.useShaderProgram();
+	glUniformMatrix4fv(glGetUniformLocation(visibilityShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+	glUniformMatrix4fv(glGetUniformLocation(visibilityShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix4fv(glGetUniformLocation(visibilityShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+	visibilityBuffer.renderGeometry(finalScene, visibilityShader);
+	occlusionCulling.issueQueries(projection * view, model);
+	endPass();
+
+	beginPass("visibilityClassify");
+	visibilityBuffer.classify(visibilityClassifyShader, screenTriangle);
+	endPass();
+
+	beginPass("visibilityResolve");
+	setLightingUniforms(visibilityResolveShader);
+	normalMatrix = computeNormalMatrix(finalSceneNode);
+	glUniformMatrix4fv(glGetUniformLocation(visibilityResolveShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+	glUniformMatrix4fv(glGetUniformLocation(visibilityResolveShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix3fv(glGetUniformLocation(visibilityResolveShader.shaderProgram, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	glUniformMatrix4fv(glGetUniformLocation(visibilityResolveShader.shaderProgram, "inverseProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(projection)));
+	glUniformMatrix4fv(glGetUniformLocation(visibilityResolveShader.shaderProgram, "inverseView"), 1, GL_FALSE, glm::value_ptr(glm::inverse(view)));
+	visibilityBuffer.resolve(finalScene, visibilityResolveShader, screenTriangle);
+	endPass();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, renderFramebuffer);
+	glViewport(0, 0, renderWidth, renderHeight);
+	beginPass("visibilityComposite");
+	visibilityBuffer.composite(visibilityCompositeShader, screenTriangle);
+	endPass();
+}
+
+void renderScene() {
+	PROFILE_FUNCTION();
+
+	updateSceneGraph();
+
+	// levels follow the camera; the shadow pass reuses them, which keeps the shadows matching the meshes
+	glm::vec3 cameraPosition = glm::vec3(glm::inverse(view)[3]);
+	float pixelsPerUnit = renderHeight / (2.0f * tanf(glm::radians(CAMERA_FOV) / 2.0f));
+	finalScene.selectLods(model, cameraPosition, pixelsPerUnit, LOD_PIXEL_ERROR * options.lodBias, options.lodHysteresis);
+	// the PVS first: the meshlets of the meshes it hides are never tested
+	if (options.pvs) {
+		pvsCell = finalScene.cullPvs(scenePvs, model, cameraPosition);
+	}
+	if (options.meshletCulling != gps::MESHLET_CULL_NONE) {
+		finalScene.cullMeshlets(model, projection * view, cameraPosition, options.meshletCulling == gps::MESHLET_CULL_CONE);
+	}
+	// after the LODs and the PVS, which decide the meshes worth a query; the geometry passes issue them
+	occlusionCulling.beginFrame(finalScene, model, cameraPosition);
+
+	// the lightmap holds the sun's shadows already
+	if (!lightmapActive()) {
+		depthMapShader.useShaderProgram();
+		glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"),
+			1,
+			GL_FALSE,
+			glm::value_ptr(computeLightSpaceTrMatrix()));
+		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+		glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
+		beginPass("shadow");
+		glClear(GL_DEPTH_BUFFER_BIT);
+		drawShadowCasters();
+		endPass();
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, renderFramebuffer);
 
 	// render depth map on screen - toggled with the B key
 
 	if (showDepthMap) {
-		glViewport(0, 0, retina_width, retina_height);
+		glViewport(0, 0, renderWidth, renderHeight);
 
 		glClear(GL_COLOR_BUFFER_BIT);
 
@@ -492,35 +1315,31 @@ void renderScene() {
 
 		// final scene rendering pass (with shadows)
 
-		glViewport(0, 0, retina_width, retina_height);
+		glViewport(0, 0, renderWidth, renderHeight);
 
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		myCustomShader.useShaderProgram();
-
-		// Update the night mode uniform
-		GLint nightModeLocation = glGetUniformLocation(myCustomShader.shaderProgram, "nightMode");
-		glUniform1i(nightModeLocation, nightMode);
-		
-		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		
-
 		lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-		glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
 
-		//bind the shadow map
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-		glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "shadowMap"), 3);
+		// bin the point lights for this view
+		beginPass("lightClusters");
+		updateActivePointLights();
+		lightClusters.update(activePointLights, view, projection, CAMERA_NEAR, CAMERA_FAR, renderWidth, renderHeight);
+		endPass();
 
-		glUniformMatrix4fv(glGetUniformLocation(myCustomShader.shaderProgram, "lightSpaceTrMatrix"),
-			1,
-			GL_FALSE,
-			glm::value_ptr(computeLightSpaceTrMatrix()));
+		if (options.renderPath == gps::RENDER_DEFERRED) {
+			renderDeferredPass();
+		}
+		else if (options.renderPath == gps::RENDER_VISIBILITY) {
+			renderVisibilityPass();
+		}
+		else {
+			renderForwardPass();
+		}
 
-		drawObjects(myCustomShader, false);
-		mySkyBox.Draw(skyboxShader, view, projection);
+		beginPass("skybox");
+		drawSkyBox();
+		endPass();
 
 		//draw a white cube around the light
 
@@ -528,46 +1347,525 @@ void renderScene() {
 
 		glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
 
-		model = lightRotation;
-		model = glm::translate(model, 1.0f * lightDir);
-		model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-		glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+		// the cube transform travels as instance data, so the global model matrix stays untouched
+		glm::mat4 lightCubeModel = sceneGraph.getWorldTransform(lightCubeNode);
+		glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
+
+		beginPass("lightCube");
+		lightCube.DrawInstanced(lightShader, &lightCubeModel, NULL, 1);
+		endPass();
+	}
+}
+
+// Abbreviates large counts to fit the overlay, e.g. 1.25M
+std::string formatCount(uint64_t count) {
+	char text[32];
+	if (count >= 1000000) {
+		snprintf(text, sizeof(text), "%.2fM", count / 1e6);
+	}
+	else if (count >= 10000) {
+		snprintf(text, sizeof(text), "%.1fK", count / 1e3);
+	}
+	else {
+		snprintf(text, sizeof(text), "%llu", (unsigned long long)count);
+	}
+	return text;
+}
 
-		lightCube.Draw(lightShader);
+// Adds a frame to the overlay graphs; gpu frame times arrive a few frames late, so the newest known one is used
+void recordHudFrame(double frameSeconds, double cpuSeconds) {
+	smoothedFrameSeconds = smoothedFrameSeconds > 0.0 ? glm::mix(smoothedFrameSeconds, frameSeconds, 0.05) : frameSeconds;
+
+	// passes without samples yet are left out of the stats, so "frame" isn't always the first
+	std::vector<gps::GpuPassStats> stats = gpuProfiler.getStats();
+	float gpuMilliseconds = 0.0f;
+	for (size_t i = 0; i < stats.size(); i++) {
+		if (strcmp(stats[i].name, "frame") == 0) {
+			gpuMilliseconds = (float)stats[i].last;
+			break;
+		}
 	}
+	cpuFrameHistory[hudGraphNext] = (float)(cpuSeconds * 1000.0);
+	gpuFrameHistory[hudGraphNext] = gpuMilliseconds;
+	hudGraphNext = (hudGraphNext + 1) % HUD_GRAPH_FRAMES;
 }
+
+// Performance overlay over the finished frame - one batched draw, after the counters it shows are final
+void drawHud() {
+	const glm::vec4 textColor(1.0f, 1.0f, 1.0f, 1.0f);
+	const glm::vec4 dimColor(0.7f, 0.7f, 0.7f, 1.0f);
+	const glm::vec4 overColor(1.0f, 0.3f, 0.3f, 1.0f);
+	const glm::vec4 cpuColor(0.3f, 0.8f, 1.0f, 0.9f);
+	const glm::vec4 gpuColor(1.0f, 0.6f, 0.2f, 0.9f);
+	const float line = gps::Hud::LINE_ADVANCE * HUD_SCALE;
+	const float graphWidth = 2.0f * HUD_GRAPH_FRAMES;
+	const float graphHeight = 4.0f * line;
+	// graphs span 0 to 33 ms, with a mark at 16.7 ms (60 FPS)
+	const float graphMaxMs = 1000.0f / 30.0f;
+
+	std::vector<gps::GpuPassStats> gpuStats = gpuProfiler.getStats();
+	const gps::RenderStats& stats = gps::renderStats;
+	char text[256];
+
+	hud.begin(retina_width, retina_height);
+
+	float x = 10.0f * HUD_SCALE;
+	float y = 10.0f * HUD_SCALE;
+	float lineCount = 14.0f + (float)gpuStats.size();
+	hud.addRect(x - 6.0f, y - 6.0f, 2.0f * graphWidth + x + 12.0f, lineCount * line + graphHeight + 12.0f,
+		glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+	double fps = smoothedFrameSeconds > 0.0 ? 1.0 / smoothedFrameSeconds : 0.0;
+	snprintf(text, sizeof(text), "FPS %.1f  CPU %.2f MS  GPU %.2f MS", fps,
+		cpuFrameHistory[(hudGraphNext + HUD_GRAPH_FRAMES - 1) % HUD_GRAPH_FRAMES],
+		gpuFrameHistory[(hudGraphNext + HUD_GRAPH_FRAMES - 1) % HUD_GRAPH_FRAMES]);
+	hud.addText(x, y, text, textColor, HUD_SCALE);
+	y += 1.5f * line;
+
+	hud.addText(x, y, "CPU FRAME", cpuColor, HUD_SCALE);
+	hud.addText(x + graphWidth + x, y, "GPU FRAME", gpuColor, HUD_SCALE);
+	y += line;
+	const float graphs[2] = { x, x + graphWidth + x };
+	for (int i = 0; i < 2; i++) {
+		hud.addRect(graphs[i], y, graphWidth, graphHeight, glm::vec4(1.0f, 1.0f, 1.0f, 0.1f));
+		hud.addGraph(graphs[i], y, graphWidth, graphHeight, i == 0 ? cpuFrameHistory : gpuFrameHistory, HUD_GRAPH_FRAMES,
+			hudGraphNext, graphMaxMs, i == 0 ? cpuColor : gpuColor);
+		hud.addRect(graphs[i], y + graphHeight / 2.0f, graphWidth, 1.0f, dimColor);
+	}
+	y += graphHeight + line;
+
+	snprintf(text, sizeof(text), "DRAWS %llu  STATE CHANGES %llu",
+		(unsigned long long)stats.drawCalls, (unsigned long long)stats.stateChanges);
+	hud.addText(x, y, text, textColor, HUD_SCALE);
+	y += line;
+
+	snprintf(text, sizeof(text), "TRIANGLES %s SUBMITTED  %s CULLED",
+		formatCount(stats.trianglesSubmitted).c_str(), formatCount(stats.trianglesCulled).c_str());
+	hud.addText(x, y, text, textColor, HUD_SCALE);
+	y += line;
+
+	if (!options.pvs) {
+		snprintf(text, sizeof(text), "PVS OFF");
+	}
+	else if (pvsCell < 0) {
+		snprintf(text, sizeof(text), "PVS OUTSIDE THE GRID  ALL %zu MESHES", finalScene.getMeshes().size());
+	}
+	else {
+		snprintf(text, sizeof(text), "PVS CELL %d  %zu OF %zu MESHES", pvsCell, finalScene.getVisibleMeshCount(),
+			finalScene.getMeshes().size());
+	}
+	hud.addText(x, y, text, textColor, HUD_SCALE);
+	y += line;
+
+	const gps::OcclusionStats& occlusionStats = occlusionCulling.getStats();
+	if (options.occlusionCulling == gps::OCCLUSION_CULL_NONE) {
+		snprintf(text, sizeof(text), "OCCLUSION OFF");
+	}
+	else {
+		snprintf(text, sizeof(text), "OCCLUSION %s  %u QUERIES  %u HIDDEN", gps::occlusionCullingName(options.occlusionCulling),
+			occlusionStats.queries, occlusionStats.skippedDraws);
+	}
+	hud.addText(x, y, text, textColor, HUD_SCALE);
+	y += line;
+
+	const double megabyte = 1024.0 * 1024.0;
+	int64_t budget = gps::getGpuMemoryBudget();
+	if (budget > 0) {
+		snprintf(text, sizeof(text), "GPU MEMORY %.1f MB OF %.0f MB", gps::getGpuMemoryTotal() / megabyte, budget / megabyte);
+	}
+	else {
+		snprintf(text, sizeof(text), "GPU MEMORY %.1f MB", gps::getGpuMemoryTotal() / megabyte);
+	}
+	hud.addText(x, y, text, budget > 0 && gps::getGpuMemoryTotal() > budget ? overColor : textColor, HUD_SCALE);
+	y += line;
+
+	snprintf(text, sizeof(text), "  TEX %.1f MB  BUF %.1f MB  RB %.1f MB", gps::getGpuMemoryTotal(gps::GPU_TEXTURE) / megabyte,
+		gps::getGpuMemoryTotal(gps::GPU_BUFFER) / megabyte, gps::getGpuMemoryTotal(gps::GPU_RENDERBUFFER) / megabyte);
+	hud.addText(x, y, text, dimColor, HUD_SCALE);
+	y += line;
+
+	if (options.dynamicResolution > 0.0f) {
+		snprintf(text, sizeof(text), "RENDER %dx%d  %.0f%% OF %dx%d  TARGET %.1f MS  AA %s", renderWidth, renderHeight,
+			dynamicResolution.getScale() * 100.0f, retina_width, retina_height, dynamicResolution.getTargetMilliseconds(),
+			gps::antialiasingName(options).c_str());
+	}
+	else {
+		snprintf(text, sizeof(text), "RENDER %dx%d  AA %s", renderWidth, renderHeight, gps::antialiasingName(options).c_str());
+	}
+	hud.addText(x, y, text, textColor, HUD_SCALE);
+	y += line;
+
+	double shadowMs = 0.0;
+	for (size_t i = 0; i < gpuStats.size(); i++) {
+		if (strcmp(gpuStats[i].name, "shadow") == 0) {
+			shadowMs = gpuStats[i].average;
+		}
+	}
+	if (lightmapActive()) {
+		snprintf(text, sizeof(text), "SHADOW BAKED  LIGHTMAP %dx%d %d/%d PASSES", lightmap.getWidth(), lightmap.getHeight(),
+			lightmap.getPassesDone(), lightmap.getPassCount());
+	}
+	else {
+		snprintf(text, sizeof(text), "SHADOW %ux%u %.2f MS%s", SHADOW_WIDTH, SHADOW_HEIGHT, shadowMs,
+			showDepthMap ? "  DEPTH MAP VIEW" : "");
+	}
+	hud.addText(x, y, text, textColor, HUD_SCALE);
+	y += line;
+
+	if (selection.hit) {
+		snprintf(text, sizeof(text), "PICK MESH %u TRI %u  %.1f %.1f %.1f  %.3f MS", selection.mesh, selection.triangle,
+			selection.position.x, selection.position.y, selection.position.z, selectionMilliseconds);
+	}
+	else {
+		snprintf(text, sizeof(text), "PICK NONE  %.3f MS", selectionMilliseconds);
+	}
+	hud.addText(x, y, text, dimColor, HUD_SCALE);
+	y += 1.5f * line;
+
+	// average over the profiler's rolling window, per pass in the order they were first seen
+	hud.addText(x, y, "GPU PASS              AVG     MAX", dimColor, HUD_SCALE);
+	y += line;
+	for (size_t i = 0; i < gpuStats.size(); i++) {
+		snprintf(text, sizeof(text), "%-20s %5.2f  %5.2f", gpuStats[i].name, gpuStats[i].average, gpuStats[i].maximum);
+		hud.addText(x, y, text, textColor, HUD_SCALE);
+		y += line;
+	}
+
+	hud.draw();
+}
+
+// Benchmark flight when no --camera-path is given: one orbit around the scene, bobbing up and down
+void createBenchmarkOrbit(float duration) {
+	const int keyframeCount = 32;
+	for (int i = 0; i <= keyframeCount; i++) {
+		float angle = glm::radians(360.0f * i / keyframeCount);
+
+		gps::CameraKeyframe keyframe;
+		keyframe.time = duration * i / keyframeCount;
+		keyframe.position = glm::vec3(30.0f * cos(angle), 6.0f + 3.0f * sin(2.0f * angle), 30.0f * sin(angle));
+		keyframe.target = glm::vec3(0.0f, 2.0f, 0.0f);
+		keyframe.lightAngle = lightAngle;
+		cameraPath.addKeyframe(keyframe);
+	}
+}
+
+void initSimulation() {
+	// the BVH is in finalScene's space; the scene graph places it in the world
+	cameraCollider.init(&sceneBvh, CAMERA_RADIUS, sceneGraph.getWorldTransform(finalSceneNode));
+
+	if (options.benchmarkFrames > 0 && cameraPath.empty()) {
+		createBenchmarkOrbit((float)options.benchmarkFrames / options.tickRate);
+	}
+
+	// tick 0 of a scripted camera is the initial state, so the first frame already shows the path's start
+	gps::SimulationState initialState = initialSimulationState();
+	lightAngle = initialState.lightAngle;
+	simulation.init(options.tickRate, initialState, simulationStep);
+
+	// benchmarks and headless runs advance exactly one tick per frame on the main thread to stay deterministic
+	if (options.threadedSimulation && options.benchmarkFrames == 0 && !options.headless) {
+		simulation.startThread();
+	}
+}
+
+// Hands the latest input to the simulation and picks the state to draw this frame
+gps::SimulationState updateSimulation(double frameSeconds) {
+	gps::SimulationInput input;
+	memcpy(input.keys, pressedKeys, sizeof(input.keys));
+	simulation.setInput(input);
+
+	if (options.benchmarkFrames > 0 || options.headless) {
+		// warm-up frames hold the flight at its start
+		simulation.advance(benchmark.isWarmingUp() ? 0.0 : simulation.getTickSeconds());
+	}
+	else if (!options.threadedSimulation) {
+		simulation.advance(frameSeconds);
+	}
+
+	gps::SimulationState state = simulation.getRenderState();
+	applySimulationState(state);
+	return state;
+}
+
+void startBenchmark() {
+	benchmark.setInfo("renderer", gps::renderPathName(options.renderPath));
+	benchmark.setInfo("antialiasing", gps::antialiasingName(options));
+	benchmark.setInfo("gl_renderer", (const char*)glGetString(GL_RENDERER));
+	benchmark.setInfo("width", retina_width);
+	benchmark.setInfo("height", retina_height);
+	benchmark.setInfo("night_mode", nightMode ? 1.0 : 0.0);
+	benchmark.setInfo("camera_path", options.cameraPath.empty() ? "orbit" : options.cameraPath);
+	benchmark.setInfo("tick_rate", options.tickRate);
+	benchmark.setInfo("dynamic_resolution_ms", options.dynamicResolution);
+	benchmark.setInfo("lod_bias", options.lodBias);
+	benchmark.setInfo("shadow_proxies", options.shadowProxies ? 1.0 : 0.0);
+	benchmark.setInfo("meshlet_culling", gps::meshletCullingName(options.meshletCulling));
+	benchmark.setInfo("occlusion_culling", gps::occlusionCullingName(options.occlusionCulling));
+	if (options.dynamicResolution > 0.0f) {
+		benchmark.setInfo("min_resolution_scale", options.minResolutionScale);
+		benchmark.setInfo("max_resolution_scale", options.maxResolutionScale);
+		benchmark.setInfo("sharpness", options.sharpness);
+	}
+
+	benchmark.start(options.benchmarkFrames, BENCHMARK_WARMUP_FRAMES, gpuProfiler.getFrame());
+}
+
+// JSON report to --benchmark-output, or stdout
+bool reportBenchmark() {
+	benchmark.setInfo("point_lights", lightClusters.getLightCount());
+	if (options.dynamicResolution > 0.0f) {
+		benchmark.setInfo("final_resolution_scale", dynamicResolution.getScale());
+	}
+
+	// the last frames' GPU times are still in flight
+	gpuProfiler.flush();
+	benchmark.addGpuTimings(gpuProfiler.getResolvedTimings());
+
+	if (options.benchmarkOutput.empty()) {
+		return benchmark.writeReport(stdout);
+	}
+
+	FILE* file = fopen(options.benchmarkOutput.c_str(), "w");
+	if (file == NULL) {
+		fprintf(stderr, "ERROR: could not open %s for writing\n", options.benchmarkOutput.c_str());
+		return false;
+	}
+	bool written = benchmark.writeReport(file);
+	fclose(file);
+
+	return written;
+}
+
+// --gpu-memory-report, written at exit while everything is still allocated
+void reportGpuMemory() {
+	FILE* file = fopen(options.gpuMemoryReport.c_str(), "w");
+	if (file == NULL) {
+		fprintf(stderr, "ERROR: could not open %s for writing\n", options.gpuMemoryReport.c_str());
+		return;
+	}
+	gps::writeGpuMemoryReport(file);
+	fclose(file);
+}
+
 void cleanup() {
+	simulation.stopThread();
+	if (gps::isProfiling()) {
+		toggleProfiling();
+	}
+	if (recording) {
+		toggleRecording();
+	}
+	if (!options.gpuMemoryReport.empty()) {
+		reportGpuMemory();
+	}
 	glDeleteTextures(1,& depthMapTexture);
+	gps::releaseGpuResource(gps::GPU_TEXTURE, depthMapTexture);
+	// the bake reads the scene's meshes
+	lightmap.release();
+	// the models outlive the context otherwise; they are globals
+	finalScene.Unload();
+	lightCube.Unload();
+	screenQuad.Unload();
+	gps::Model3D::UnloadInstanceStream();
+	// the same for every other global holding GL objects
+	occlusionCulling.release();
+	visibilityBuffer.release();
+	gBuffer.release();
+	lightClusters.release();
+	screenTriangle.release();
+	fxaa.release();
+	dynamicResolution.release();
+	offscreenFramebuffer.release();
+	hud.release();
+	gpuProfiler.release();
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glDeleteFramebuffers(1, &shadowMapFBO);
+	if (frameStream != NULL) {
+		fclose(frameStream);
+	}
+	if (options.headless) {
+		headlessContext.destroy();
+		return;
+	}
 	glfwDestroyWindow(glWindow);
 	//close GL context and any other GLFW resources
 	glfwTerminate();
 }
 
+// Benchmarks and headless runs draw every frame they are asked for
+bool renderingOnDemand() {
+	return options.onDemand && !options.headless && options.benchmarkFrames == 0;
+}
+
+// Held keys move the camera, light or fog every tick; paths and recordings advance with time
+bool isAnimating() {
+	for (int i = 0; i < 1024; i++) {
+		if (pressedKeys[i]) {
+			return true;
+		}
+	}
+	return !cameraPath.empty() || recording;
+}
+
+// Reports the inputs of the frame about to be drawn to renderVersion
+void observeFrameInputs(const gps::SimulationState& state) {
+	FrameInputs inputs = {};
+	inputs.state = state;
+	inputs.nightMode = nightMode;
+	inputs.point = point;
+	inputs.showDepthMap = showDepthMap;
+	inputs.showHud = showHud;
+	renderVersion.observe(&inputs, sizeof(inputs));
+}
+
+// Wall clock in seconds; unlike glfwGetTime it doesn't need GLFW, which headless runs never start
+double currentTime() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Window closed, or the requested number of frames is done
+bool shouldStop(int frame) {
+	if (options.frameCount > 0 && frame >= options.frameCount) {
+		return true;
+	}
+	return !options.headless && glfwWindowShouldClose(glWindow);
+}
+
 
 int main(int argc, const char * argv[]) {
 
-	if (!initOpenGLWindow()) {
+	if (!gps::parseOptions(argc, argv, options)) {
+		return 1;
+	}
+	gps::setProfilerThreadName("main");
+	gps::setGpuMemoryBudget((int64_t)options.gpuMemoryBudget * 1024 * 1024);
+	if (!options.tracePath.empty()) {
+		gps::startProfiling();
+	}
+	if (options.antialiasing == gps::AA_MSAA && options.dynamicResolution > 0.0f) {
+		fprintf(stderr, "WARNING: MSAA does not apply with --dynamic-resolution; use --aa fxaa\n");
+		options.antialiasing = gps::AA_NONE;
+	}
+	nightMode = options.nightMode;
+	glWindowWidth = options.width;
+	glWindowHeight = options.height;
+
+	if (!options.cameraPath.empty() && !cameraPath.load(options.cameraPath)) {
+		return 1;
+	}
+	if (!options.output.empty() && !options.headless) {
+		fprintf(stderr, "WARNING: --output only applies to --headless runs\n");
+	}
+
+	if (options.headless ? !initHeadlessContext() : !initOpenGLWindow()) {
 		glfwTerminate();
 		return 1;
 	}
+	if (options.headless && options.output == "-") {
+		initFrameStream();
+	}
 
 	initOpenGLState();
 	initObjects();
 	initSkybox();
 	initShaders();
+	initOcclusionCulling();
 	initUniforms();
+	initSceneGraph();
+	initPointLights();
 	initFBO();
+	initSimulation();
+	initLightmap();
+	gpuProfiler.init();
+	hud.init();
+	showHud = options.hud;
+	if (options.benchmarkFrames > 0) {
+		startBenchmark();
+	}
 
 	glCheckError();
 
-	while (!glfwWindowShouldClose(glWindow)) {
-		processMovement();
-		renderScene();		
+	int frame = 0;
+	double lastFrameStart = currentTime();
+	while (!shouldStop(frame)) {
+		// a finished bake pass is a new image, even with nothing else changing
+		if (lightmap.update()) {
+			renderVersion.invalidate();
+		}
+
+		// nothing changed since the last frame: sleep until an event (or the timeout) instead of drawing it again
+		if (renderingOnDemand() && !renderVersion.needsFrame() && !isAnimating() && occlusionFramesLeft == 0) {
+			PROFILE_ZONE("idle");
+			glfwWaitEventsTimeout(ON_DEMAND_WAIT_SECONDS);
+			// the idle time is not simulated; a key pressed now starts from rest
+			lastFrameStart = currentTime();
+			continue;
+		}
+		// a mesh coming into view is drawn once the queries of the frames before have answered
+		if (options.occlusionCulling != gps::OCCLUSION_CULL_NONE) {
+			bool moving = renderVersion.needsFrame() || isAnimating();
+			occlusionFramesLeft = moving ? gps::OcclusionCulling::QUERY_FRAMES : (occlusionFramesLeft > 0 ? occlusionFramesLeft - 1 : 0);
+		}
+
+		PROFILE_ZONE("frame");
+		double frameStart = currentTime();
+
+		if (benchmark.isFinished()) {
+			reportBenchmark();
+			break;
+		}
+		gpuProfiler.beginFrame();
+		benchmark.addGpuTimings(gpuProfiler.getResolvedTimings());
+		benchmark.beginFrame();
+		gps::renderStats.resetFrame();
+		if (options.dynamicResolution > 0.0f) {
+			updateDynamicResolution();
+		}
+
+		if (options.benchmarkFrames == 0) {
+			processMovement();
+		}
+
+		double frameSeconds = frameStart - lastFrameStart;
+		gps::SimulationState state = updateSimulation(frameSeconds);
+		lastFrameStart = frameStart;
+		if (renderingOnDemand()) {
+			observeFrameInputs(state);
+		}
+
+		renderScene();
+		if (options.dynamicResolution > 0.0f) {
+			beginPass("upscale");
+			upscaleScene();
+			endPass();
+		}
+		if (options.antialiasing == gps::AA_FXAA) {
+			beginPass("fxaa");
+			applyFxaa();
+			endPass();
+		}
+		if (showHud) {
+			beginPass("hud");
+			drawHud();
+			endPass();
+		}
+		gpuProfiler.endFrame();
+		recordHudFrame(frameSeconds, currentTime() - frameStart);
+
+		if (options.headless) {
+			if (!writeFrame(frame)) {
+				break;
+			}
+		}
+		else {
+			glfwPollEvents();
+			PROFILE_ZONE("present");
+			glfwSwapBuffers(glWindow);
+		}
 
-		glfwPollEvents();
-		glfwSwapBuffers(glWindow);
+		benchmark.endFrame();
+		renderVersion.frameDrawn();
+		frame++;
 	}
 
 	cleanup();
@@ -0,0 +1,58 @@
+#version 410 core
+
+// Lighting pass of the deferred path: the lighting model of shaders/lighting.glsl, evaluated once per
+// pixel from the G-buffer.
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+// G-buffer
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gSpecular;
+uniform sampler2D gDepth;
+
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+uniform mat4 lightSpaceTrMatrix;
+
+#include "lighting.glsl"
+
+vec3 decodeNormal(vec2 encoded) {
+
+    vec3 n = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0f) {
+        n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return normalize(n);
+}
+
+void main() {
+
+    float depth = texture(gDepth, fTexCoords).r;
+
+    // nothing was drawn here - leave the pixel to the skybox
+    if (depth >= 1.0f) {
+        discard;
+    }
+
+    // Rebuild the eye space position from the depth buffer
+    vec4 positionEye = inverseProjection * vec4(vec3(fTexCoords, depth) * 2.0f - 1.0f, 1.0f);
+
+    Surface surface;
+    surface.positionEye = vec4(positionEye.xyz / positionEye.w, 1.0f);
+    surface.normalEye = decodeNormal(texture(gNormal, fTexCoords).rg);
+    surface.positionLightSpace = lightSpaceTrMatrix * inverseView * surface.positionEye;
+    vec4 albedo = texture(gAlbedo, fTexCoords);
+    surface.diffuseColor = albedo.rgb;
+    surface.specularColor = texture(gSpecular, fTexCoords).rgb;
+    // alpha is the baked ambient occlusion
+    surface.occlusion = albedo.a;
+    surface.bakedLight = vec4(0.0f);
+
+    fColor = shadeSurface(surface);
+
+    // keep the scene depth so the skybox and the light cube are occluded as in the forward path
+    gl_FragDepth = depth;
+}
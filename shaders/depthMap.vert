@@ -1,5 +1,6 @@
 #version 410 core
 layout(location=0) in vec3 vPosition;
+layout(location=3) in mat4 vInstanceModel;
 uniform mat4 lightSpaceTrMatrix;
 uniform mat4 model;
 out vec4 fragPosLightSpace;
@@ -8,6 +9,6 @@ out vec4 fragPosLightSpace;
 void main()
 {
 
-gl_Position = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+gl_Position = lightSpaceTrMatrix * model * vInstanceModel * vec4(vPosition, 1.0f);
 
-}
\ No newline at end of file
+}
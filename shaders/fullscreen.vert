@@ -0,0 +1,10 @@
+#version 410 core
+
+out vec2 fTexCoords;
+
+void main() 
+{
+	// (0,0), (2,0), (0,2) in texture space - one triangle that covers the whole viewport
+	fTexCoords = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(fTexCoords * 2.0f - 1.0f, 0.0f, 1.0f);
+}
@@ -0,0 +1,157 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+uniform sampler2D sceneColor;
+
+// contrast below max(EDGE_THRESHOLD_MIN, EDGE_THRESHOLD * brightest neighbour) is not an edge
+const float EDGE_THRESHOLD = 0.125f;
+const float EDGE_THRESHOLD_MIN = 0.0312f;
+// how much of the sub-pixel aliasing (single bright or dark pixels) gets blurred away
+const float SUBPIXEL_QUALITY = 0.75f;
+// steps of the search for both ends of an edge; later steps stride further
+const int SEARCH_STEPS = 10;
+
+// sceneColor holds linear values; the edges are found on perceptual brightness
+float luma(vec3 color)
+{
+    return sqrt(dot(color, vec3(0.299f, 0.587f, 0.114f)));
+}
+
+float lumaAt(vec2 uv)
+{
+    return luma(texture(sceneColor, uv).rgb);
+}
+
+// luma of the pixel offset by whole pixels from this one
+float lumaAt(vec2 texel, vec2 offset)
+{
+    return luma(texture(sceneColor, fTexCoords + offset * texel).rgb);
+}
+
+float searchStride(int step)
+{
+    return step < 4 ? 1.0f : (step < 7 ? 2.0f : 4.0f);
+}
+
+void main()
+{
+    vec2 texel = 1.0f / vec2(textureSize(sceneColor, 0));
+    vec3 colorCenter = texture(sceneColor, fTexCoords).rgb;
+
+    float lumaCenter = luma(colorCenter);
+    float lumaDown = lumaAt(texel, vec2(0.0f, -1.0f));
+    float lumaUp = lumaAt(texel, vec2(0.0f, 1.0f));
+    float lumaLeft = lumaAt(texel, vec2(-1.0f, 0.0f));
+    float lumaRight = lumaAt(texel, vec2(1.0f, 0.0f));
+
+    float lumaMin = min(lumaCenter, min(min(lumaDown, lumaUp), min(lumaLeft, lumaRight)));
+    float lumaMax = max(lumaCenter, max(max(lumaDown, lumaUp), max(lumaLeft, lumaRight)));
+    float lumaRange = lumaMax - lumaMin;
+
+    // flat areas - most of the screen - leave after five reads
+    if (lumaRange < max(EDGE_THRESHOLD_MIN, lumaMax * EDGE_THRESHOLD)) {
+        fColor = vec4(colorCenter, 1.0f);
+        return;
+    }
+
+    float lumaDownLeft = lumaAt(texel, vec2(-1.0f, -1.0f));
+    float lumaUpRight = lumaAt(texel, vec2(1.0f, 1.0f));
+    float lumaUpLeft = lumaAt(texel, vec2(-1.0f, 1.0f));
+    float lumaDownRight = lumaAt(texel, vec2(1.0f, -1.0f));
+
+    float lumaDownUp = lumaDown + lumaUp;
+    float lumaLeftRight = lumaLeft + lumaRight;
+    float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+    float lumaDownCorners = lumaDownLeft + lumaDownRight;
+    float lumaRightCorners = lumaDownRight + lumaUpRight;
+    float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+    // the edge runs along the direction with the stronger second derivative across it
+    float edgeHorizontal = abs(-2.0f * lumaLeft + lumaLeftCorners) + 2.0f * abs(-2.0f * lumaCenter + lumaDownUp)
+        + abs(-2.0f * lumaRight + lumaRightCorners);
+    float edgeVertical = abs(-2.0f * lumaUp + lumaUpCorners) + 2.0f * abs(-2.0f * lumaCenter + lumaLeftRight)
+        + abs(-2.0f * lumaDown + lumaDownCorners);
+    bool isHorizontal = edgeHorizontal >= edgeVertical;
+
+    // which side of the pixel the edge is on
+    float luma1 = isHorizontal ? lumaDown : lumaLeft;
+    float luma2 = isHorizontal ? lumaUp : lumaRight;
+    float gradient1 = luma1 - lumaCenter;
+    float gradient2 = luma2 - lumaCenter;
+    bool is1Steepest = abs(gradient1) >= abs(gradient2);
+    float gradientScaled = 0.25f * max(abs(gradient1), abs(gradient2));
+
+    float stepLength = isHorizontal ? texel.y : texel.x;
+    float lumaLocalAverage;
+    if (is1Steepest) {
+        stepLength = -stepLength;
+        lumaLocalAverage = 0.5f * (luma1 + lumaCenter);
+    }
+    else {
+        lumaLocalAverage = 0.5f * (luma2 + lumaCenter);
+    }
+
+    // walk along the edge, half a pixel towards it, until the contrast stops matching at both ends
+    vec2 edgeUv = fTexCoords;
+    if (isHorizontal) {
+        edgeUv.y += 0.5f * stepLength;
+    }
+    else {
+        edgeUv.x += 0.5f * stepLength;
+    }
+    vec2 offset = isHorizontal ? vec2(texel.x, 0.0f) : vec2(0.0f, texel.y);
+    vec2 uv1 = edgeUv - offset;
+    vec2 uv2 = edgeUv + offset;
+
+    float lumaEnd1 = 0.0f;
+    float lumaEnd2 = 0.0f;
+    bool reached1 = false;
+    bool reached2 = false;
+    for (int i = 0; i < SEARCH_STEPS && !(reached1 && reached2); i++) {
+        if (!reached1) {
+            lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+            reached1 = abs(lumaEnd1) >= gradientScaled;
+            if (!reached1) {
+                uv1 -= offset * searchStride(i);
+            }
+        }
+        if (!reached2) {
+            lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+            reached2 = abs(lumaEnd2) >= gradientScaled;
+            if (!reached2) {
+                uv2 += offset * searchStride(i);
+            }
+        }
+    }
+
+    float distance1 = isHorizontal ? fTexCoords.x - uv1.x : fTexCoords.y - uv1.y;
+    float distance2 = isHorizontal ? uv2.x - fTexCoords.x : uv2.y - fTexCoords.y;
+    bool isDirection1 = distance1 < distance2;
+    float distanceFinal = min(distance1, distance2);
+    float edgeLength = distance1 + distance2;
+
+    // pixels near the end of an edge move the most; only blend if the nearer end goes the same way
+    float pixelOffset = 0.5f - distanceFinal / edgeLength;
+    bool isLumaCenterSmaller = lumaCenter < lumaLocalAverage;
+    bool correctVariation = ((isDirection1 ? lumaEnd1 : lumaEnd2) < 0.0f) != isLumaCenterSmaller;
+    float finalOffset = correctVariation ? pixelOffset : 0.0f;
+
+    // a pixel unlike all of its neighbours is blended by its contrast to their average
+    float lumaAverage = (2.0f * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners) / 12.0f;
+    float subPixelOffset1 = clamp(abs(lumaAverage - lumaCenter) / lumaRange, 0.0f, 1.0f);
+    float subPixelOffset2 = (-2.0f * subPixelOffset1 + 3.0f) * subPixelOffset1 * subPixelOffset1;
+    finalOffset = max(finalOffset, subPixelOffset2 * subPixelOffset2 * SUBPIXEL_QUALITY);
+
+    vec2 finalUv = fTexCoords;
+    if (isHorizontal) {
+        finalUv.y += finalOffset * stepLength;
+    }
+    else {
+        finalUv.x += finalOffset * stepLength;
+    }
+
+    fColor = vec4(texture(sceneColor, finalUv).rgb, 1.0f);
+}
@@ -0,0 +1,29 @@
+#version 410 core
+
+in vec3 fNormal;
+in vec2 fTexCoords;
+in vec4 fTint;
+in float fOcclusion;
+
+// G-buffer targets (see GBuffer.hpp); the albedo's alpha holds the baked ambient occlusion
+layout(location=0) out vec4 gAlbedo;
+layout(location=1) out vec2 gNormal;
+layout(location=2) out vec4 gSpecular;
+
+uniform sampler2D diffuseTexture;
+uniform sampler2D specularTexture;
+
+// Octahedral encoding - a unit vector in two components with even precision over the sphere
+vec2 encodeNormal(vec3 n) {
+
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 encoded = n.z >= 0.0f ? n.xy : (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    return encoded;
+}
+
+void main() {
+
+    gAlbedo = vec4(texture(diffuseTexture, fTexCoords).rgb * fTint.rgb, fOcclusion);
+    gNormal = encodeNormal(normalize(fNormal));
+    gSpecular = vec4(texture(specularTexture, fTexCoords).rgb, 1.0f);
+}
@@ -0,0 +1,27 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+layout(location=3) in mat4 vInstanceModel;
+layout(location=7) in vec4 vInstanceTint;
+layout(location=8) in float vOcclusion;
+
+out vec3 fNormal;
+out vec2 fTexCoords;
+out vec4 fTint;
+out float fOcclusion;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform	mat3 normalMatrix;
+
+void main() 
+{
+	fNormal = normalize(normalMatrix * mat3(vInstanceModel) * vNormal);
+	fTexCoords = vTexCoords;
+	fTint = vInstanceTint;
+	fOcclusion = vOcclusion;
+	gl_Position = projection * view * model * vInstanceModel * vec4(vPosition, 1.0f);
+}
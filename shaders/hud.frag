@@ -0,0 +1,14 @@
+#version 410 core
+
+in vec2 fTexCoords;
+in vec4 fTint;
+
+out vec4 fColor;
+
+// glyph coverage in the red channel
+uniform sampler2D font;
+
+void main()
+{
+	fColor = vec4(fTint.rgb, fTint.a * texture(font, fTexCoords).r);
+}
@@ -0,0 +1,18 @@
+#version 410 core
+
+layout(location=0) in vec2 vPosition;
+layout(location=1) in vec2 vTexCoords;
+layout(location=2) in vec4 vColor;
+
+out vec2 fTexCoords;
+out vec4 fTint;
+
+// viewport size in pixels; positions are in pixels from the top left corner
+uniform vec2 screenSize;
+
+void main()
+{
+	fTexCoords = vTexCoords;
+	fTint = vColor;
+	gl_Position = vec4(vPosition.x / screenSize.x * 2.0f - 1.0f, 1.0f - vPosition.y / screenSize.y * 2.0f, 0.0f, 1.0f);
+}
@@ -3,6 +3,7 @@
 layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
+layout(location=3) in mat4 vInstanceModel;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -10,5 +11,5 @@ uniform mat4 projection;
 
 void main() 
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
+	gl_Position = projection * view * model * vInstanceModel * vec4(vPosition, 1.0f);
 }
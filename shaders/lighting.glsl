@@ -0,0 +1,206 @@
+// Lighting model shared by the forward (shaderStart.frag), deferred (deferredLighting.frag) and
+// visibility buffer (visibilityResolve.frag) paths, pulled in with #include (see ShaderLoader.hpp):
+// the sun with its shadow map or the baked lightmap, ambient light darkened by the baked occlusion,
+// the clustered point lights and the fog. Each path fills a Surface and calls shadeSurface.
+
+// Lighting
+uniform vec3 lightDir;
+uniform vec3 lightColor;
+uniform sampler2D shadowMap;
+
+// Baked sun light (see Lightmap.hpp), only set by the forward path: Surface.bakedLight replaces the
+// sun's diffuse term and the shadow map
+uniform bool useLightmap;
+
+// Light components
+vec3 ambient;
+float ambientStrength = 0.2f;
+vec3 diffuse;
+vec3 specular;
+float specularStrength = 0.5f;
+float shininess = 32.0f;
+
+// Light constants
+float constant = 1.0f;
+float linear = 0.09f;
+float quadratic = 0.1;
+
+// Night Mode
+uniform bool nightMode;
+
+// Fog
+uniform float fog;
+
+// Clustered point lights (see LightClusters.hpp)
+// clusterLights: 2 texels per light - eye space position and radius, color
+// clusterGrid: offset and count of each cluster's range in clusterIndices
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+uniform vec2 clusterScreenScale;
+uniform float clusterSliceNear;
+uniform float clusterSliceScale;
+const ivec3 clusterCount = ivec3(16, 9, 24);
+
+// Point Light constants
+float ambient_point = 0.5f;
+float specular_point = 0.5f;
+float shininess_point = 32.0f;
+
+// What a path knows of the surface at the fragment
+struct Surface {
+    // eye space; w = 1
+    vec4 positionEye;
+    // eye space, normalized
+    vec3 normalEye;
+    vec4 positionLightSpace;
+    vec3 diffuseColor;
+    vec3 specularColor;
+    // baked ambient occlusion, 1 fully open
+    float occlusion;
+    // the lightmap texel, read while useLightmap: rgb the diffuse light in units of lightColor, alpha
+    // the fraction of the texel the sun reaches
+    vec4 bakedLight;
+};
+
+vec3 computeLightComponents(Surface surface) {
+
+    vec3 cameraPosEye = vec3(0.0f);  // In eye coordinates, the viewer is situated at the origin
+
+    // Compute light direction
+    vec3 lightDirN = normalize(lightDir);
+
+    // Compute view direction
+    vec3 viewDirN = normalize(cameraPosEye - surface.positionEye.xyz);
+    vec3 halfVector = normalize(lightDirN + viewDirN);
+
+    // Compute ambient light
+    ambient = ambientStrength * lightColor;
+
+    // Compute diffuse light
+    diffuse = useLightmap ? surface.bakedLight.rgb * lightColor : max(dot(surface.normalEye, lightDirN), 0.0f) * lightColor;
+
+    // Compute specular light
+    float specCoeff = pow(max(dot(halfVector, surface.normalEye), 0.0f), shininess);
+    specular = specularStrength * specCoeff * lightColor;
+
+    // In case night mode is active
+    if (nightMode) {
+        ambient = ambient * 0.1;
+        diffuse = diffuse * 0.2;
+        specular = specular * 0.3;
+    }
+
+    return (ambient + diffuse + specular);
+}
+
+float computeFog(Surface surface) {
+
+    float fragmentDistance = length(surface.positionEye);
+    float fogFactor = exp(-pow(fragmentDistance * fog, 2));
+
+    return clamp(fogFactor, 0.0f, 1.0f);
+}
+
+float computeShadow(Surface surface) {
+
+    if (useLightmap) {
+        return 1.0f - surface.bakedLight.a;
+    }
+
+    // Perform perspective divide
+    vec3 normalizedCoords = surface.positionLightSpace.xyz / surface.positionLightSpace.w;
+
+    // Transform to [0,1] range
+    normalizedCoords = normalizedCoords * 0.5f + 0.5f;
+
+    // Get closest depth value from light's perspective
+    float closestDepth = texture(shadowMap, normalizedCoords.xy).r;
+
+    // Get depth of current fragment from light's perspective
+    float currentDepth = normalizedCoords.z;
+
+    // Check whether current frag pos is in shadow
+    float bias = 0.0005f;
+    float shadow = currentDepth - bias > closestDepth ? 1.0f : 0.0f;
+    if (normalizedCoords.z > 1.0f) return 0.0f;
+
+    return shadow;
+}
+
+vec3 pointLight(Surface surface, vec3 lightPosEye, vec3 pointColor, float radius) {
+
+    // Define camera position in eye space
+    vec3 eyeSpaceCameraPos = vec3(0.0f);
+
+    // Compute light direction and view direction
+    vec3 lightDirection = normalize(lightPosEye - surface.positionEye.xyz);
+    vec3 viewDirection = normalize(eyeSpaceCameraPos - surface.positionEye.xyz);
+
+    // Compute ambient component
+    vec3 ambientComponent = ambient_point * pointColor;
+
+    // Compute diffuse component
+    vec3 diffuseComponent = max(dot(surface.normalEye, lightDirection), 0.0f) * pointColor;
+
+    // Compute specular component
+    vec3 halfwayVector = normalize(lightDirection + viewDirection);
+    vec3 specularComponent = specular_point * pow(max(dot(surface.normalEye, halfwayVector), 0.0f), shininess_point) * pointColor;
+
+    // Calculate attenuation
+    float distanceToLight = length(lightPosEye - surface.positionEye.xyz);
+    float attenuation = 1.0f / (constant + linear * distanceToLight + quadratic * distanceToLight * distanceToLight);
+
+    // Fade out to exactly zero at the radius the light was binned with
+    float falloff = clamp(1.0f - pow(distanceToLight / radius, 4.0f), 0.0f, 1.0f);
+    attenuation *= falloff * falloff;
+
+    return (ambientComponent + diffuseComponent + specularComponent) * attenuation;
+}
+
+// Final color of the surface, fog included
+vec4 shadeSurface(Surface surface) {
+
+    // Compute lighting components
+    vec3 lightingComponents = computeLightComponents(surface);
+
+    // Modulate lighting components with textures
+    vec3 ambientLight = ambient * surface.diffuseColor * surface.occlusion;
+    vec3 diffuseLight = diffuse * surface.diffuseColor;
+    vec3 specularLight = specular * surface.specularColor;
+
+    // Calculate shadow factor
+    float shadowFactor = computeShadow(surface);
+
+    // Point light contribution - only the lights binned into this fragment's cluster
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * clusterScreenScale), int(log(-surface.positionEye.z / clusterSliceNear) * clusterSliceScale));
+    cluster = clamp(cluster, ivec3(0), clusterCount - 1);
+    int clusterIndex = (cluster.z * clusterCount.y + cluster.y) * clusterCount.x + cluster.x;
+    uvec2 lightRange = texelFetch(clusterGrid, clusterIndex).xy;
+
+    for (uint i = 0u; i < lightRange.y; i++) {
+        int lightIndex = int(texelFetch(clusterIndices, int(lightRange.x + i)).x);
+        vec4 positionRadius = texelFetch(clusterLights, 2 * lightIndex);
+        vec3 pointColor = texelFetch(clusterLights, 2 * lightIndex + 1).rgb;
+        lightingComponents += pointLight(surface, positionRadius.xyz, pointColor, positionRadius.w);
+    }
+
+    // Combine lighting components with shadow
+    // (the baked diffuse light is shadowed already, and lit by the bounces where the sun doesn't reach)
+    vec3 finalLighting = useLightmap ? ambientLight + diffuseLight + (1.0f - shadowFactor) * specularLight
+        : ambientLight + (1.0f - shadowFactor) * (diffuseLight + specularLight);
+    vec3 colorWithLighting = min(finalLighting, vec3(1.0f));
+
+    // Fog effect calculation
+    float fogIntensity = computeFog(surface);
+    vec4 fogColor = vec4(0.6, 0.6, 0.6, 1.0); // Default fog color for day
+
+    // Adjust fog color for night mode
+    if (nightMode) {
+        fogColor = vec4(0.05, 0.05, 0.1, 1.0); // Darker fog for night
+    }
+
+    // Blend final color with fog
+    vec4 litColor = vec4(colorWithLighting, 1.0f);
+    return mix(fogColor, min(litColor * vec4(lightingComponents, 1.0f), 1.0f), fogIntensity);
+}
@@ -0,0 +1,6 @@
+#version 410 core
+
+// Only the depth test counts: colour and depth writes are off while the boxes are drawn
+void main()
+{
+}
@@ -0,0 +1,22 @@
+#version 410 core
+
+// Bounding box of a mesh for an occlusion query (see OcclusionCulling.hpp), generated from gl_VertexID
+uniform mat4 clip;
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+// 12 triangles over the corners of the box; bits 0, 1 and 2 of a corner pick max x, y and z
+const int cubeCorners[36] = int[36](
+	0, 2, 6, 0, 6, 4,
+	1, 5, 7, 1, 7, 3,
+	0, 4, 5, 0, 5, 1,
+	2, 3, 7, 2, 7, 6,
+	0, 1, 3, 0, 3, 2,
+	4, 6, 7, 4, 7, 5);
+
+void main()
+{
+	int corner = cubeCorners[gl_VertexID];
+	vec3 weights = vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+	gl_Position = clip * vec4(mix(boxMin, boxMax, weights), 1.0f);
+}
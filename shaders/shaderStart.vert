@@ -3,11 +3,21 @@
 layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
+// Per-instance data - identity matrix and white tint for non-instanced draws
+layout(location=3) in mat4 vInstanceModel;
+layout(location=7) in vec4 vInstanceTint;
+// Baked ambient occlusion - 1 for meshes without it
+layout(location=8) in float vOcclusion;
+// Lightmap atlas coordinates - only read when the lightmap is used
+layout(location=9) in vec2 vLightmapCoords;
 
 out vec3 fNormal;
 out vec4 fPosEye;
 out vec2 fTexCoords;
 out vec4 fragPosLightSpace;
+out vec4 fTint;
+out float fOcclusion;
+out vec2 fLightmapCoords;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -17,10 +27,15 @@ uniform mat4 lightSpaceTrMatrix;
 
 void main() 
 {
-	fragPosLightSpace=lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+	vec4 worldPosition = model * vInstanceModel * vec4(vPosition, 1.0f);
+	fragPosLightSpace = lightSpaceTrMatrix * worldPosition;
 	//compute eye space coordinates
-	fPosEye = view * model * vec4(vPosition, 1.0f);
-	fNormal = normalize(normalMatrix * vNormal);
+	fPosEye = view * worldPosition;
+	// instance matrices carry no non-uniform scale, so their upper 3x3 is enough for normals
+	fNormal = normalize(normalMatrix * mat3(vInstanceModel) * vNormal);
 	fTexCoords = vTexCoords;
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
+	fTint = vInstanceTint;
+	fOcclusion = vOcclusion;
+	fLightmapCoords = vLightmapCoords;
+	gl_Position = projection * fPosEye;
 }
@@ -0,0 +1,41 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+uniform sampler2D sceneColor;
+// part of sceneColor the scene was rendered into
+uniform vec2 renderScale;
+// 0 - plain bilinear, 1 - strongest sharpening
+uniform float sharpness;
+
+// Bilinear fetch that never reads outside the rendered corner
+vec3 sampleScene(vec2 uv, vec2 texel)
+{
+    return texture(sceneColor, clamp(uv, 0.5f * texel, renderScale - 0.5f * texel)).rgb;
+}
+
+void main()
+{
+    vec2 texel = 1.0f / vec2(textureSize(sceneColor, 0));
+    vec2 uv = fTexCoords * renderScale;
+
+    vec3 center = sampleScene(uv, texel);
+    vec3 north = sampleScene(uv + vec2(0.0f, texel.y), texel);
+    vec3 south = sampleScene(uv - vec2(0.0f, texel.y), texel);
+    vec3 east = sampleScene(uv + vec2(texel.x, 0.0f), texel);
+    vec3 west = sampleScene(uv - vec2(texel.x, 0.0f), texel);
+
+    vec3 minColor = min(center, min(min(north, south), min(east, west)));
+    vec3 maxColor = max(center, max(max(north, south), max(east, west)));
+
+    // contrast adaptive: flat areas get the full amount, edges that already have contrast less,
+    // so the upscaled image regains detail without halos
+    vec3 headroom = min(minColor, 1.0f - maxColor) / max(maxColor, vec3(0.0001f));
+    vec3 amount = sqrt(clamp(headroom, 0.0f, 1.0f)) * sharpness;
+
+    vec3 sharpened = center + (4.0f * center - north - south - east - west) * amount * 0.25f;
+
+    fColor = vec4(clamp(sharpened, minColor, maxColor), 1.0f);
+}
@@ -0,0 +1,15 @@
+#version 410 core
+
+// Packed visibility id, see VisibilityBuffer.hpp
+layout(location=0) out uint fVisibility;
+
+uniform uint drawID;
+// index of the draw's first triangle in the mesh's index buffer (non-zero for coarser LODs)
+uniform uint firstTriangle;
+
+const uint triangleIdBits = 22u;
+
+void main() 
+{
+    fVisibility = ((drawID + 1u) << triangleIdBits) | (firstTriangle + uint(gl_PrimitiveID));
+}
@@ -0,0 +1,20 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+uniform usampler2D visibility;
+
+const uint triangleIdBits = 22u;
+const float materialDepthSteps = 1024.0f;
+
+void main() 
+{
+    uint id = texelFetch(visibility, ivec2(gl_FragCoord.xy), 0).r;
+
+    // uncovered pixels keep the cleared depth, which no draw's material depth equals
+    if (id == 0u) {
+        discard;
+    }
+
+    gl_FragDepth = float(id >> triangleIdBits) / materialDepthSteps;
+}
@@ -0,0 +1,21 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+uniform sampler2D shadedColor;
+uniform sampler2D sceneDepth;
+
+void main() 
+{
+    float depth = texture(sceneDepth, fTexCoords).r;
+
+    // nothing was drawn here - leave the pixel to the skybox
+    if (depth >= 1.0f) {
+        discard;
+    }
+
+    fColor = texture(shadedColor, fTexCoords);
+    gl_FragDepth = depth;
+}
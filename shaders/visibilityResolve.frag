@@ -0,0 +1,103 @@
+#version 410 core
+
+// Resolve pass of the visibility buffer (see VisibilityBuffer.hpp). Runs once per covered pixel of
+// the current draw: fetches the pixel's triangle from the mesh buffers, rebuilds the barycentrics by
+// intersecting the view ray with it and shades with the lighting model of shaders/lighting.glsl.
+
+out vec4 fColor;
+
+uniform usampler2D visibility;
+// 2 texels per vertex: (position.xyz, normal.x), (normal.yz, texCoords)
+uniform samplerBuffer vertexData;
+uniform usamplerBuffer indexData;
+uniform vec2 viewportSize;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+uniform mat3 normalMatrix;
+
+// Texture
+uniform sampler2D diffuseTexture;
+uniform sampler2D specularTexture;
+
+const uint triangleIdBits = 22u;
+
+uniform mat4 lightSpaceTrMatrix;
+
+// per-vertex baked ambient occlusion, one float each; meshes without it are fully open
+uniform samplerBuffer occlusionData;
+uniform bool hasOcclusion;
+
+#include "lighting.glsl"
+
+struct Corner {
+    vec3 positionEye;
+    vec3 normal;
+    vec2 texCoords;
+    float occlusion;
+};
+
+Corner fetchCorner(uint index) {
+
+    vec4 first = texelFetch(vertexData, int(2u * index));
+    vec4 second = texelFetch(vertexData, int(2u * index + 1u));
+
+    Corner corner;
+    corner.positionEye = (view * model * vec4(first.xyz, 1.0f)).xyz;
+    corner.normal = vec3(first.w, second.xy);
+    corner.texCoords = second.zw;
+    corner.occlusion = hasOcclusion ? texelFetch(occlusionData, int(index)).r : 1.0f;
+    return corner;
+}
+
+// View ray through a pixel position (in pixels); the eye is at the origin
+vec3 viewRay(vec2 pixel) {
+
+    vec4 farPoint = inverseProjection * vec4(pixel / viewportSize * 2.0f - 1.0f, 1.0f, 1.0f);
+    return farPoint.xyz / farPoint.w;
+}
+
+// Barycentrics (of corners 1 and 2) where the ray from the eye hits the triangle's plane
+vec2 intersectBarycentrics(vec3 ray, vec3 p0, vec3 p1, vec3 p2) {
+
+    vec3 edge1 = p1 - p0;
+    vec3 edge2 = p2 - p0;
+    vec3 p = cross(ray, edge2);
+    float inverseDeterminant = 1.0f / dot(edge1, p);
+    vec3 s = -p0;
+    vec3 q = cross(s, edge1);
+    return vec2(dot(s, p), dot(ray, q)) * inverseDeterminant;
+}
+
+void main() {
+
+    uint id = texelFetch(visibility, ivec2(gl_FragCoord.xy), 0).r;
+    uint triangle = id & ((1u << triangleIdBits) - 1u);
+
+    Corner c0 = fetchCorner(texelFetch(indexData, int(3u * triangle)).r);
+    Corner c1 = fetchCorner(texelFetch(indexData, int(3u * triangle + 1u)).r);
+    Corner c2 = fetchCorner(texelFetch(indexData, int(3u * triangle + 2u)).r);
+
+    // barycentrics at this pixel and its right/upper neighbours, for the texture gradients
+    vec2 b = intersectBarycentrics(viewRay(gl_FragCoord.xy), c0.positionEye, c1.positionEye, c2.positionEye);
+    vec2 bx = intersectBarycentrics(viewRay(gl_FragCoord.xy + vec2(1.0f, 0.0f)), c0.positionEye, c1.positionEye, c2.positionEye);
+    vec2 by = intersectBarycentrics(viewRay(gl_FragCoord.xy + vec2(0.0f, 1.0f)), c0.positionEye, c1.positionEye, c2.positionEye);
+    vec3 weights = vec3(1.0f - b.x - b.y, b);
+
+    vec2 texCoords = weights.x * c0.texCoords + weights.y * c1.texCoords + weights.z * c2.texCoords;
+    vec2 texCoordsDx = (bx.x - b.x) * (c1.texCoords - c0.texCoords) + (bx.y - b.y) * (c2.texCoords - c0.texCoords);
+    vec2 texCoordsDy = (by.x - b.x) * (c1.texCoords - c0.texCoords) + (by.y - b.y) * (c2.texCoords - c0.texCoords);
+
+    Surface surface;
+    surface.positionEye = vec4(weights.x * c0.positionEye + weights.y * c1.positionEye + weights.z * c2.positionEye, 1.0f);
+    surface.normalEye = normalize(normalMatrix * (weights.x * c0.normal + weights.y * c1.normal + weights.z * c2.normal));
+    surface.positionLightSpace = lightSpaceTrMatrix * inverseView * surface.positionEye;
+    surface.diffuseColor = textureGrad(diffuseTexture, texCoords, texCoordsDx, texCoordsDy).rgb;
+    surface.specularColor = textureGrad(specularTexture, texCoords, texCoordsDx, texCoordsDy).rgb;
+    surface.occlusion = weights.x * c0.occlusion + weights.y * c1.occlusion + weights.z * c2.occlusion;
+    surface.bakedLight = vec4(0.0f);
+
+    fColor = shadeSurface(surface);
+}